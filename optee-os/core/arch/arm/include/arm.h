@@ -122,6 +122,9 @@
 /* ARM Generic timer definitions */
 #define CNTKCTL_PL0PCTEN	BIT(0) /* physical counter el0 access enable */
 #define CNTKCTL_PL0VCTEN	BIT(1) /* virtual counter el0 access enable */
+#define CNTKCTL_EVNTEN		BIT(2) /* event stream enable */
+#define CNTKCTL_EVNTI_SHIFT	4      /* event every 2^(EVNTI + 1) ticks */
+#define CNTKCTL_EVNTI_MASK	GENMASK_32(7, 4)
 
 #ifdef ARM32
 #include <arm32.h>
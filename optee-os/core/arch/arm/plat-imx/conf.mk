@@ -456,6 +456,24 @@ endif
 ifneq (,$(filter $(PLATFORM_FLAVOR),mx93evk))
 CFG_DDR_SIZE ?= 0x80000000
 CFG_UART_BASE ?= UART1_BASE
+# Ethos-U replay: sleep on the NPU interrupt instead of polling STATUS.
+# The waiting thread is woken by an asynchronous notification, so this
+# needs CFG_CORE_ASYNC_NOTIF (and its GIC interrupt ID). Off by default:
+# notif_wait() has no timeout, so a hung NPU blocks the replay PTA, and
+# every later replay call, instead of failing with TEE_ERROR_TIMEOUT.
+CFG_REPLAY_NPU_IRQ ?= n
+# Ethos-U replay: models kept resident in OCRAM by the replay PTA
+CFG_REPLAY_CACHE_ENTRIES ?= 4
+# Ethos-U replay: keep the last N template register accesses in a ring and
+# print them after each replay, instead of logging inside the replay loop
+CFG_REPLAY_TRACE_ENTRIES ?= 0
+# M33 replayer completion doorbell: general purpose interrupt 0 of MU2,
+# A55 side (MUB, GIC SPI 24). Off by default: MU2 must not be claimed by
+# Linux (disable it in the device tree). Without it the completion ring
+# is polled; the wait also needs CFG_CORE_ASYNC_NOTIF to sleep.
+CFG_REPLAY_DONE_MU ?= n
+CFG_REPLAY_DONE_MU_BASE ?= 0x42440000
+CFG_REPLAY_DONE_MU_IT ?= 56
 endif
 
 # i.MX6 Solo/SL/SoloX/DualLite/Dual/Quad specific config
@@ -104,6 +104,9 @@ register_ddr(CFG_NSEC_DDR_1_BASE, CFG_NSEC_DDR_1_SIZE);
 #endif
 register_phys_mem_pgdir(MEM_AREA_RAM_SEC, OCRAM_START, OCRAM_SIZE);
 register_phys_mem(MEM_AREA_IO_SEC, 0x4a900000, 0x1000 );
+#ifdef CFG_REPLAY_DONE_MU
+register_phys_mem(MEM_AREA_IO_SEC, CFG_REPLAY_DONE_MU_BASE, SMALL_PAGE_SIZE);
+#endif
 
 void console_init(void)
 {
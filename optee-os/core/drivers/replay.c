@@ -4,13 +4,22 @@
  * Driver init 阶段（每个核）做一次映射，后续统一使用 global_rd
  */
 
+ #include <arm.h>
+ #include <assert.h>
  #include <initcall.h>
+ #include <keep.h>
  #include <kernel/dt.h>
+ #include <kernel/interrupt.h>
+ #include <kernel/notif.h>
+ #include <kernel/spinlock.h>
+ #include <kernel/thread.h>
  #include <mm/core_memprot.h>
  #include <trace.h>
  #include <string.h>
  
  #include <drivers/replay.h>       /* struct replay_data, 函数声明 */
+ #include "replay_priv.h"          /* 驱动内部接口，含 replay_vm.h */
+ #include "replay_hist.h"          /* 各阶段耗时的直方图 */
  #include "replay_templates.h"     /* register_access_records, op_*_data 等 */
  
  #define REPLAY_NPU_REG_BASE   0x4A900000UL
@@ -21,115 +30,752 @@
  /* 全局保存 driver_init 阶段映射结果 */
  static struct replay_data global_rd;
  
+ /* NPU 寄存器物理地址对应的 VA；pa 不在 NPU 窗口里返回 NULL */
+ static inline volatile uint32_t *npu_reg_va(uintptr_t pa)
+ {
+     if (pa < REPLAY_NPU_REG_BASE || pa - REPLAY_NPU_REG_BASE >= REPLAY_NPU_REG_SIZE)
+         return NULL;
+     return (volatile uint32_t *)(global_rd.npu_regs.va +
+                                  (pa - REPLAY_NPU_REG_BASE));
+ }
+ 
+ /*
+  * 各阶段耗时的直方图，单位是通用定时器的 tick；多个会话、多个核都可能
+  * 在重放，用自旋锁保护。REPLAY_CMD_GET_STATS 读出
+  */
+ static replay_hist_t replay_phase_hist[REPLAY_PHASE_COUNT];
+ static unsigned int replay_phase_lock = SPINLOCK_UNLOCK;
+ 
+ static inline uint64_t replay_phase_begin(void)
+ {
+     return barrier_read_counter_timer();
+ }
+ 
+ static void replay_phase_end(enum replay_phase ph, uint64_t t0)
+ {
+     uint64_t ticks = barrier_read_counter_timer() - t0;
+     uint32_t exceptions = cpu_spin_lock_xsave(&replay_phase_lock);
+ 
+     replay_hist_add(&replay_phase_hist[ph], MIN(ticks, (uint64_t)UINT32_MAX));
+     cpu_spin_unlock_xrestore(&replay_phase_lock, exceptions);
+ }
+ 
+ void replay_get_phase_stats(struct replay_phase_stats st[REPLAY_PHASE_COUNT],
+                             bool reset)
+ {
+     uint32_t freq = read_cntfrq();
+     uint32_t exceptions = cpu_spin_lock_xsave(&replay_phase_lock);
+     replay_hist_summary_t s;
+ 
+     for (int i = 0; i < REPLAY_PHASE_COUNT; i++) {
+         replay_hist_summarize(&replay_phase_hist[i], freq, &s);
+         st[i].count = s.count;
+         st[i].min_ns = s.min_ns;
+         st[i].avg_ns = s.avg_ns;
+         st[i].max_ns = s.max_ns;
+         st[i].p99_ns = s.p99_ns;
+         if (reset)
+             replay_hist_reset(&replay_phase_hist[i]);
+     }
+     cpu_spin_unlock_xrestore(&replay_phase_lock, exceptions);
+ }
+ 
  /*
-  * 根据物理地址计算虚拟 MMIO 寄存器地址
+  * 模板的 OCRAM 预写数据：重放到 op_order 这条记录时拷到 pa
   */
- static inline volatile uint32_t *get_reg_va(uintptr_t pa)
+ struct replay_template_blob {
+     uint32_t op_order;
+     paddr_t pa;
+     const void *data;
+     size_t len;
+ };
+ 
+ static const struct replay_template_blob replay_template_blobs[] = {
+     { 24, 0x20480200, op_24_data, sizeof(op_24_data) },
+     { 28, 0x20480110, op_28_model_record_data,
+       sizeof(op_28_model_record_data) },
+     { 34, 0x20480000, op_34model_head_data, sizeof(op_34model_head_data) },
+     { 37, 0x20484050, op_37_input_record_data,
+       sizeof(op_37_input_record_data) },
+ };
+ 
+ /* 拷贝并 clean 到 PoC，NPU 才能看到 */
+ static void template_copy_blob(const struct replay_template_blob *b)
  {
-     size_t offset = pa - REPLAY_NPU_REG_BASE;
-     void *va = (void *)(global_rd.npu_regs.va + offset);
+     void *va = (void *)(global_rd.ocram.va + (b->pa - REPLAY_OCRAM_BASE));
+     uint64_t t0 = replay_phase_begin();
  
-     DMSG("replay: get_reg_va: PA=0x%08" PRIxPTR " -> VA=%p (off=0x%zx)\n",
-          pa, va, offset);
-     return (volatile uint32_t *)va;
+     memcpy(va, b->data, b->len);
+     cache_op_inner(DCACHE_AREA_CLEAN, va, b->len);
+     replay_phase_end(REPLAY_PHASE_COPY_IN, t0);
  }
  
  /*
-  * 单次寄存器读写（重放一条记录）
+  * 模板记录预先翻译成的访问表：driver_init 时把每条记录的物理地址换成 VA，
+  * 检查都落在 NPU 寄存器窗口里、4 字节对齐，OCRAM 预写数据也在这时对上，
+  * 重放时只剩 volatile 读写。录制下来的 OCRAM 读（驱动读模型、输入头）
+  * 不访问寄存器，只触发预写
   */
- static uint32_t do_register_access(reg_op_record_t *rec)
+ enum replay_acc_kind {
+     REPLAY_ACC_READ,
+     REPLAY_ACC_WRITE,
+     REPLAY_ACC_DATA,
+ };
+ 
+ #define REPLAY_NO_BLOB 0xff
+ 
+ struct replay_reg_op {
+     volatile uint32_t *va; /* REPLAY_ACC_DATA 时为 NULL */
+     uint32_t value;        /* 写入值，读时为录制到的值 */
+     uint8_t kind;          /* enum replay_acc_kind */
+     uint8_t blob;          /* replay_template_blobs 的下标 */
+ };
+ 
+ static_assert(ARRAY_SIZE(replay_template_blobs) < REPLAY_NO_BLOB);
+ 
+ static struct replay_reg_op replay_reg_ops[ARRAY_SIZE(register_access_records)];
+ static bool replay_reg_ops_ok;
+ 
+ static TEE_Result replay_build_ops(void)
  {
-     uintptr_t pa = (uintptr_t)rec->reg_address;
-     volatile uint32_t *addr;
-     uint32_t result = 0;
+     for (size_t i = 0; i < ARRAY_SIZE(register_access_records); i++) {
+         const reg_op_record_t *rec = &register_access_records[i];
+         uintptr_t pa = (uintptr_t)rec->reg_address;
+         struct replay_reg_op *op = &replay_reg_ops[i];
  
-     DMSG("replay: op_order=%u op_type=%u PA=0x%08" PRIxPTR "\n",
-          rec->op_order, rec->op_type, pa);
+         op->value = rec->reg_value;
+         op->blob = REPLAY_NO_BLOB;
+         for (size_t b = 0; b < ARRAY_SIZE(replay_template_blobs); b++) {
+             if (replay_template_blobs[b].op_order != rec->op_order)
+                 continue;
+             if (op->blob != REPLAY_NO_BLOB) {
+                 EMSG("replay: record %u has two OCRAM blobs",
+                      rec->op_order);
+                 return TEE_ERROR_BAD_FORMAT;
+             }
+             op->blob = b;
+         }
  
-     /* OCRAM 预写数据 */
-     switch (rec->op_order) {
-     case 24:
-         memcpy((void *)(global_rd.ocram.va + (0x20480200 - REPLAY_OCRAM_BASE)),
-                op_24_data, sizeof(op_24_data));
-         break;
-     case 28:
-         memcpy((void *)(global_rd.ocram.va + (0x20480110 - REPLAY_OCRAM_BASE)),
-                op_28_model_record_data, sizeof(op_28_model_record_data));
-         break;
-     case 34:
-         memcpy((void *)(global_rd.ocram.va + (0x20480000 - REPLAY_OCRAM_BASE)),
-                op_34model_head_data, sizeof(op_34model_head_data));
-         break;
-     case 37:
-         memcpy((void *)(global_rd.ocram.va + (0x20484050 - REPLAY_OCRAM_BASE)),
-                op_37_input_record_data, sizeof(op_37_input_record_data));
-         break;
-     default:
-         break;
+         if (pa >= REPLAY_OCRAM_BASE &&
+             pa - REPLAY_OCRAM_BASE < REPLAY_OCRAM_SIZE) {
+             op->kind = REPLAY_ACC_DATA;
+             op->va = NULL;
+             continue;
+         }
+         op->va = npu_reg_va(pa);
+         if (!op->va || !IS_ALIGNED(pa, sizeof(uint32_t))) {
+             EMSG("replay: record %u at 0x%08" PRIxPTR
+                  " is not an NPU register", rec->op_order, pa);
+             return TEE_ERROR_BAD_FORMAT;
+         }
+         op->kind = rec->op_type == REG_OP_WRITE ? REPLAY_ACC_WRITE :
+                                                   REPLAY_ACC_READ;
      }
+     /* 初始化阶段要轮询 WAIT 这条记录的寄存器 */
+     if (replay_reg_ops[WAIT].kind != REPLAY_ACC_READ)
+         return TEE_ERROR_BAD_FORMAT;
+     return TEE_SUCCESS;
+ }
+ 
+ #if defined(CFG_REPLAY_TRACE_ENTRIES) && CFG_REPLAY_TRACE_ENTRIES > 0
+ /*
+  * 访问轨迹：热路径只往环里记记录号和读写的值，一次重放结束后再打印，
+  * 不在重放期间打日志。只有最后 CFG_REPLAY_TRACE_ENTRIES 条
+  */
+ struct replay_trace_ent {
+     uint16_t rec;
+     uint16_t kind;
+     uint32_t value;
+ };
+ 
+ static_assert(ARRAY_SIZE(register_access_records) <= UINT16_MAX);
+ 
+ static struct replay_trace_ent replay_trace_ring[CFG_REPLAY_TRACE_ENTRIES];
+ static size_t replay_trace_count;
+ 
+ static inline void replay_trace(size_t rec, uint8_t kind, uint32_t value)
+ {
+     struct replay_trace_ent *e;
+ 
+     e = &replay_trace_ring[replay_trace_count++ % CFG_REPLAY_TRACE_ENTRIES];
+     e->rec = rec;
+     e->kind = kind;
+     e->value = value;
+ }
+ 
+ static void replay_trace_dump(void)
+ {
+     size_t n = MIN(replay_trace_count, (size_t)CFG_REPLAY_TRACE_ENTRIES);
+     size_t i = replay_trace_count - n;
+ 
+     for (; i < replay_trace_count; i++) {
+         const struct replay_trace_ent *e =
+             &replay_trace_ring[i % CFG_REPLAY_TRACE_ENTRIES];
+         const reg_op_record_t *rec = &register_access_records[e->rec];
  
-     if (rec->op_type == REG_OP_WRITE) {
-         addr = get_reg_va(pa);
-         *addr = rec->reg_value;
-         DMSG("replay: WRITE VA=%p = 0x%08x\n", addr, rec->reg_value);
-         result = rec->reg_value;
-     } else {
-         addr = get_reg_va(pa);
-         result = *addr;
-         DMSG("replay: READ  VA=%p -> 0x%08x (exp=0x%08x)\n",
-              addr, result, rec->reg_value);
+         IMSG("replay: op %u %s 0x%08" PRIxPTR " = 0x%08" PRIx32
+              " (recorded 0x%08" PRIx32 ")", rec->op_order,
+              e->kind == REPLAY_ACC_WRITE ? "W" : "R",
+              (uintptr_t)rec->reg_address, e->value, rec->reg_value);
      }
-     return result;
+     replay_trace_count = 0;
+ }
+ #else
+ static inline void replay_trace(size_t rec __unused, uint8_t kind __unused,
+                                 uint32_t value __unused)
+ {
  }
  
+ static inline void replay_trace_dump(void)
+ {
+ }
+ #endif
+ 
  /*
-  * 驱动接口：初始化 & 验证阶段
+  * 重放 [start, end] 的记录：先做 OCRAM 预写，再读写寄存器
   */
- void replay_initialization_verification(struct replay_data *rd __unused)
+ static void replay_run_ops(size_t start, size_t end)
  {
-     for (int i = INIT_VERIFICATION_START; i <= INIT_VERIFICATION_END; i++) {
-         if (i != WAIT) {
-             do_register_access(&register_access_records[i]);
-         } else {
-             int j = 0;
-             do {
-                 do_register_access(&register_access_records[i]);
-             } while (++j < 100000);
+     for (size_t i = start; i <= end; i++) {
+         const struct replay_reg_op *op = &replay_reg_ops[i];
+ 
+         if (op->blob != REPLAY_NO_BLOB)
+             template_copy_blob(&replay_template_blobs[op->blob]);
+         if (op->kind == REPLAY_ACC_WRITE) {
+             *op->va = op->value;
+             replay_trace(i, op->kind, op->value);
+         } else if (op->kind == REPLAY_ACC_READ) {
+             replay_trace(i, op->kind, *op->va);
          }
      }
  }
  
+ /*
+  * 等 NPU 完成的耗时统计，每次 PTA 调用打印一次，用来比较中断和轮询两种方式
+  */
+ struct replay_wait_stats {
+     unsigned int count;   /* 等待次数（推理数）                    */
+     uint64_t wait_ticks;  /* 开始等待到 STATUS.irq_raised 置位     */
+     uint64_t sleep_ticks; /* 其中线程睡眠、A55 交给 normal world 的时间 */
+     uint64_t wake_ticks;  /* NPU 中断到线程重新运行的延迟之和      */
+ };
+ 
+ /* 重放程序的 replay_vm::ctx */
+ struct replay_vm_ctx {
+     struct replay_wait_stats st;
+     uint32_t seg_base; /* COPY_BLOB 允许写的物理地址范围 */
+     uint32_t seg_size;
+ };
+ 
+ vaddr_t replay_ocram_va(paddr_t pa)
+ {
+     return global_rd.ocram.va + (pa - REPLAY_OCRAM_BASE);
+ }
+ 
+ /*
+  * 重放程序（rrtrace.py program 生成）：COPY_BLOB 只允许写 ctx 给的范围
+  * （默认整个 OCRAM 窗口，缓存的模型只能写自己的段），写完 clean 到 PoC，
+  * NPU 才能看到
+  */
+ static int replay_vm_copy(void *ctx, uint32_t pa, const void *src,
+                           uint32_t len)
+ {
+     struct replay_vm_ctx *c = ctx;
+     uint64_t t0 = replay_phase_begin();
+     TEE_Result res;
+     void *va;
+ 
+     if (pa < c->seg_base || len > c->seg_size ||
+         pa - c->seg_base > c->seg_size - len)
+         return -1;
+ 
+     va = (void *)replay_ocram_va(pa);
+     memcpy(va, src, len);
+     res = cache_op_inner(DCACHE_AREA_CLEAN, va, len);
+     replay_phase_end(REPLAY_PHASE_COPY_IN, t0);
+     return res == TEE_SUCCESS ? 0 : -1;
+ }
+ 
+ /* 启动 NPU 前，保证前面的拷贝和寄存器写都已完成 */
+ static void replay_vm_fence(void *ctx __unused)
+ {
+     dsb();
+ }
+ 
+ /* 轮询超时用通用定时器计时 */
+ static uint32_t replay_vm_now(void *ctx __unused)
+ {
+     return (uint32_t)barrier_read_counter_timer();
+ }
+ 
+ #ifdef ARM64
+ /*
+  * 轮询的第二级退避：WFE。期间打开通用定时器的事件流，NPU 挂死时 WFE
+  * 也会在几微秒内返回；屏蔽 foreign 中断，保证在同一个核上恢复 CNTKCTL
+  */
+ #define REPLAY_EVNTI 5 /* 每 2^6 个 tick 一次事件，24 MHz 下约 2.7 us */
+ 
+ static void replay_vm_wait_event(void *ctx __unused)
+ {
+     uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_FOREIGN_INTR);
+     uint32_t old = read_cntkctl();
+ 
+     write_cntkctl((old & ~CNTKCTL_EVNTI_MASK) | CNTKCTL_EVNTEN |
+                   SHIFT_U32(REPLAY_EVNTI, CNTKCTL_EVNTI_SHIFT));
+     isb();
+     wfe();
+     write_cntkctl(old);
+     isb();
+     thread_unmask_exceptions(exceptions);
+ }
+ #endif
+ 
+ static int replay_vm_wait_irq(void *ctx);
+ 
+ static const replay_vm_ops_t replay_vm_ops = {
+     .copy = replay_vm_copy,
+     .wait_irq = replay_vm_wait_irq,
+     .fence = replay_vm_fence,
+     .now = replay_vm_now,
+ #ifdef ARM64
+     .wait_event = replay_vm_wait_event,
+ #endif
+     /* .yield 为空：要让出 CPU 就用 NPU 中断睡眠，见 replay_wait_npu() */
+ };
+ 
+ static void replay_vm_setup(replay_vm_t *vm)
+ {
+     memset(vm, 0, sizeof(*vm));
+     vm->regs = (volatile uint32_t *)global_rd.npu_regs.va;
+     vm->reg_size = REPLAY_NPU_REG_SIZE;
+     vm->ticks_per_us = MAX(read_cntfrq() / 1000000U, 1U);
+     vm->ops = &replay_vm_ops;
+ }
+ 
+ /*
+  * 模板重放的轮询：等到 (*reg & mask) == expect，超时返回 TEE_ERROR_TIMEOUT
+  */
+ static TEE_Result replay_poll(volatile uint32_t *reg, uint32_t mask,
+                               uint32_t expect, uint32_t timeout_us)
+ {
+     replay_vm_t vm;
+ 
+     replay_vm_setup(&vm);
+     if (replay_vm_poll(&vm, reg, mask, expect, timeout_us,
+                        REPLAY_POLL_BACKOFF) != REPLAY_VM_OK)
+         return TEE_ERROR_TIMEOUT;
+     return TEE_SUCCESS;
+ }
+ 
+ #ifdef CFG_REPLAY_NPU_IRQ
+ /*
+  * NPU 中断（GIC SPI 178，与 M33 侧的 ETHOSU_IRQ 同号）。中断处理只屏蔽
+  * 中断并发异步通知；等待的线程通过 notif_wait() 在 normal world 睡眠，
+  * 和 wait_queue 睡眠用的是同一机制，只是唤醒可以来自中断上下文
+  */
+ #define REPLAY_NPU_IT (32 + 178)
+ 
+ static struct itr_handler *replay_itr;
+ static uint32_t replay_notif_value;
+ static uint64_t replay_irq_stamp; /* 中断到来时的计数器值 */
+ 
+ static enum itr_return replay_npu_it_handler(struct itr_handler *h)
+ {
+     /* 电平中断：CMD.clear_irq 由重放的 IRQ 阶段写，先屏蔽，睡眠前再打开 */
+     interrupt_mask(h->chip, h->it);
+     replay_irq_stamp = barrier_read_counter_timer();
+     notif_send_async(replay_notif_value);
+     return ITRR_HANDLED;
+ }
+ DECLARE_KEEP_PAGER(replay_npu_it_handler);
+ 
+ static TEE_Result replay_irq_init(void)
+ {
+     TEE_Result res;
+ 
+     res = notif_alloc_async_value(&replay_notif_value);
+     if (res)
+         return res;
+ 
+     res = interrupt_alloc_add_conf_handler(interrupt_get_main_chip(),
+                                            REPLAY_NPU_IT,
+                                            replay_npu_it_handler, 0, NULL,
+                                            IRQ_TYPE_LEVEL_HIGH, 0,
+                                            &replay_itr);
+     if (res) {
+         notif_free_async_value(replay_notif_value);
+         replay_itr = NULL;
+     }
+     return res;
+ }
+ 
+ /*
+  * 睡到 NPU 中断。normal world 还没启动异步通知时什么都不做，由调用方轮询。
+  * 通知在 notif_wait() 之前到达也不会丢：normal world 会记住它
+  */
+ static void replay_sleep_irq(struct replay_wait_stats *st)
+ {
+     uint64_t t0;
+     uint64_t t1;
+ 
+     if (!replay_itr || !notif_async_is_started())
+         return;
+ 
+     t0 = barrier_read_counter_timer();
+     interrupt_unmask(replay_itr->chip, replay_itr->it);
+     if (notif_wait(replay_notif_value)) {
+         interrupt_mask(replay_itr->chip, replay_itr->it);
+         return;
+     }
+     t1 = barrier_read_counter_timer();
+ 
+     st->sleep_ticks += t1 - t0;
+     st->wake_ticks += t1 - replay_irq_stamp;
+ }
+ #else
+ static TEE_Result replay_irq_init(void)
+ {
+     return TEE_SUCCESS;
+ }
+ 
+ static void replay_sleep_irq(struct replay_wait_stats *st __unused)
+ {
+ }
+ #endif
+ 
+ /*
+  * 等 NPU 完成：能用中断就先睡眠，最后都以 STATUS.irq_raised 的轮询确认。
+  * 这个版本的 notif_wait() 没有超时，只有轮询方式能在 NPU 挂死时
+  * REPLAY_IRQ_TIMEOUT_US 后返回
+  */
+ static TEE_Result replay_wait_npu(struct replay_wait_stats *st)
+ {
+     volatile uint32_t *status = npu_reg_va(REPLAY_NPU_REG_BASE +
+                                            REPLAY_NPU_STATUS);
+     uint64_t t0 = barrier_read_counter_timer();
+     TEE_Result res;
+ 
+     /* 只看 irq_raised，STATUS 其余位每次运行都可能不同 */
+     replay_sleep_irq(st);
+     res = replay_poll(status, REPLAY_STATUS_IRQ_RAISED,
+                       REPLAY_STATUS_IRQ_RAISED, REPLAY_IRQ_TIMEOUT_US);
+     st->wait_ticks += barrier_read_counter_timer() - t0;
+     st->count++;
+     if (!res)
+         replay_phase_end(REPLAY_PHASE_NPU, t0);
+ 
+     if (res)
+         EMSG("replay: NPU did not complete within %u us, STATUS=0x%08x",
+              REPLAY_IRQ_TIMEOUT_US, *status);
+     return res;
+ }
+ 
+ static void replay_report_wait(const struct replay_wait_stats *st)
+ {
+     uint64_t freq = MAX(read_cntfrq(), 1U);
+ 
+     if (!st->count)
+         return;
+ 
+     IMSG("replay: %u NPU waits (%s): %" PRIu64 " us, %" PRIu64
+          " us on CPU, wake latency %" PRIu64 " us avg", st->count,
+          st->sleep_ticks ? "irq" : "polling",
+          st->wait_ticks * 1000000 / freq,
+          (st->wait_ticks - st->sleep_ticks) * 1000000 / freq,
+          st->wake_ticks * 1000000 / freq / st->count);
+ }
+ 
+ /* WAIT_IRQ：ctx 是本次调用的 struct replay_vm_ctx */
+ static int replay_vm_wait_irq(void *ctx)
+ {
+     struct replay_vm_ctx *c = ctx;
+ 
+     return replay_wait_npu(&c->st) ? REPLAY_VM_ETIMEOUT : 0;
+ }
+ 
+ /*
+  * 驱动接口：初始化 & 验证阶段
+  */
+ TEE_Result replay_initialization_verification(struct replay_data *rd __unused)
+ {
+     uint64_t t0 = replay_phase_begin();
+ 
+     if (!replay_reg_ops_ok)
+         return TEE_ERROR_NOT_SUPPORTED;
+ 
+     replay_batch_invalidate();
+     replay_run_ops(INIT_VERIFICATION_START, (WAIT) - 1);
+     /* 等软复位完成：STATUS.reset_status 清零 */
+     if (replay_poll(replay_reg_ops[WAIT].va, REPLAY_STATUS_RESET, 0,
+                     REPLAY_RESET_TIMEOUT_US)) {
+         EMSG("replay: NPU reset did not complete");
+         replay_trace_dump();
+         return TEE_ERROR_TIMEOUT;
+     }
+     replay_run_ops((WAIT) + 1, INIT_VERIFICATION_END);
+     replay_phase_end(REPLAY_PHASE_INIT, t0);
+     return TEE_SUCCESS;
+ }
+ 
  /*
   * 驱动接口：推理（inference）阶段
   */
  void replay_inference(struct replay_data *rd __unused)
  {
-     for (int i = RUN_STREAM_COMMAND_START; i <= RUN_STREAM_COMMAND_END; i++)
-         do_register_access(&register_access_records[i]);
+     uint64_t t0 = replay_phase_begin();
+ 
+     replay_run_ops(RUN_STREAM_COMMAND_START, RUN_STREAM_COMMAND_END);
+     replay_phase_end(REPLAY_PHASE_KICK, t0);
  }
  
  /*
-  * 驱动接口：中断处理阶段
+  * 重放 IRQ 阶段的记录：写 CMD 清中断，检查 STATUS
   */
- void replay_handle_interrupt(struct replay_data *rd __unused)
+ static TEE_Result replay_irq_phase(void)
  {
+     volatile uint32_t *status = npu_reg_va(REPLAY_NPU_REG_BASE +
+                                            REPLAY_NPU_STATUS);
+     uint64_t t0 = replay_phase_begin();
+ 
      for (int i = INTERRUPT_HANDLING_START; i < INTERRUPT_HANDLING_END; i++) {
-         reg_op_record_t *rec = &register_access_records[i];
-         volatile uint32_t *addr = get_reg_va((uintptr_t)rec->reg_address);
-         uint32_t exp = (rec->op_order == INTERRUPT_HANDLING_START) ?
-                        1 : rec->reg_value;
-         if (rec->op_type == REG_OP_WRITE) {
-             *addr = rec->reg_value;
-             DMSG("replay: IRQ WRITE VA=%p = 0x%08x\n",
-                  addr, rec->reg_value);
-         } else {
-             uint32_t v;
-             do {
-                 v = *addr;
-             } while (v != exp);
-             DMSG("replay: IRQ READ OK VA=%p = 0x%08x\n", addr, v);
+         const struct replay_reg_op *op = &replay_reg_ops[i];
+         uint32_t v;
+ 
+         if (op->kind == REPLAY_ACC_WRITE) {
+             *op->va = op->value;
+             replay_trace(i, op->kind, op->value);
+             continue;
+         }
+         /* 只检查 STATUS 的错误位和 cmd_end_reached，CMD 等其他读直接跳过 */
+         if (op->kind != REPLAY_ACC_READ || op->va != status)
+             continue;
+         v = *op->va;
+         replay_trace(i, op->kind, v);
+         if ((v & REPLAY_STATUS_CHECK) != (op->value & REPLAY_STATUS_CHECK)) {
+             EMSG("replay: STATUS 0x%08x, expected 0x%08x", v, op->value);
+             return TEE_ERROR_BAD_STATE;
          }
      }
+     replay_phase_end(REPLAY_PHASE_IRQ_ACK, t0);
+     return TEE_SUCCESS;
+ }
+ 
+ /*
+  * 驱动接口：中断处理阶段
+  */
+ TEE_Result replay_handle_interrupt(struct replay_data *rd __unused)
+ {
+     struct replay_wait_stats st = { };
+     TEE_Result res;
+ 
+     res = replay_wait_npu(&st);
+     replay_report_wait(&st);
+     if (!res)
+         res = replay_irq_phase();
+     replay_trace_dump();
+     return res;
+ }
+ 
+ /*
+  * 批量推理：当前 NPU 和 OCRAM 里模型已经就绪的会话。别的重放会复位 NPU
+  * 或覆盖 OCRAM，都要调用 replay_batch_invalidate()，下一批再从头初始化
+  */
+ static void *replay_warm_owner;
+ 
+ void replay_batch_invalidate(void)
+ {
+     replay_warm_owner = NULL;
+ }
+ 
+ void replay_batch_release(void *owner)
+ {
+     if (replay_warm_owner == owner)
+         replay_warm_owner = NULL;
+ }
+ 
+ static bool ocram_range_ok(uint32_t pa, uint32_t len)
+ {
+     return pa >= REPLAY_OCRAM_BASE && len <= REPLAY_USABLE_SIZE &&
+            pa - REPLAY_OCRAM_BASE <= REPLAY_USABLE_SIZE - len;
+ }
+ 
+ /* 冷启动：复位并初始化 NPU，模型、命令流只拷一次 */
+ static TEE_Result replay_batch_setup(void)
+ {
+     TEE_Result res;
+ 
+     /* 模板按录制时的地址写 OCRAM，会覆盖缓存的模型 */
+     replay_cache_flush();
+     res = replay_initialization_verification(NULL);
+     if (res)
+         return res;
+     for (size_t i = 0; i < ARRAY_SIZE(replay_template_blobs); i++)
+         template_copy_blob(&replay_template_blobs[i]);
+     return TEE_SUCCESS;
+ }
+ 
+ /*
+  * 一次热推理：RUN 阶段只重放 NPU 寄存器写（QBASE、QSIZE、BASEP 和最后
+  * CMD 的启动），OCRAM 读和数据拷贝都跳过；然后等中断、重放 IRQ 阶段
+  */
+ static TEE_Result replay_batch_kick(struct replay_wait_stats *st)
+ {
+     uint64_t t0 = replay_phase_begin();
+     TEE_Result res;
+ 
+     for (int i = RUN_STREAM_COMMAND_START; i <= RUN_STREAM_COMMAND_END; i++) {
+         const struct replay_reg_op *op = &replay_reg_ops[i];
+ 
+         if (op->kind == REPLAY_ACC_WRITE) {
+             *op->va = op->value;
+             replay_trace(i, op->kind, op->value);
+         }
+     }
+     replay_phase_end(REPLAY_PHASE_KICK, t0);
+ 
+     res = replay_wait_npu(st);
+     if (res)
+         return res;
+     return replay_irq_phase();
+ }
+ 
+ /*
+  * 驱动接口：同一会话内的批量推理
+  */
+ TEE_Result replay_run_batch(struct replay_data *rd __unused, void *owner,
+                             const struct replay_batch *b)
+ {
+     struct replay_wait_stats st = { };
+     uint64_t t0 = barrier_read_counter_timer();
+     uint64_t freq = MAX(read_cntfrq(), 1U);
+     TEE_Result res = TEE_SUCCESS;
+     bool cold = replay_warm_owner != owner;
+     uint64_t tc;
+     uint32_t n = 0;
+     void *in_va;
+     void *out_va;
+ 
+     if (!b->count || !b->in_size || !ocram_range_ok(b->in_pa, b->in_size) ||
+         !ocram_range_ok(b->out_pa, b->out_size))
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     if (cold) {
+         res = replay_batch_setup();
+         if (res)
+             return res;
+         replay_warm_owner = owner;
+     }
+ 
+     in_va = (void *)replay_ocram_va(b->in_pa);
+     out_va = (void *)replay_ocram_va(b->out_pa);
+     for (n = 0; n < b->count; n++) {
+         tc = replay_phase_begin();
+         memcpy(in_va, b->in + (size_t)n * b->in_size, b->in_size);
+         cache_op_inner(DCACHE_AREA_CLEAN, in_va, b->in_size);
+         replay_phase_end(REPLAY_PHASE_COPY_IN, tc);
+ 
+         res = replay_batch_kick(&st);
+         if (res)
+             break;
+ 
+         /* NPU 运行期间可能有预取进来的旧行，完成后再 invalidate */
+         if (b->out_size) {
+             tc = replay_phase_begin();
+             cache_op_inner(DCACHE_AREA_INVALIDATE, out_va, b->out_size);
+             memcpy(b->out + (size_t)n * b->out_size, out_va, b->out_size);
+             replay_phase_end(REPLAY_PHASE_COPY_OUT, tc);
+         }
+     }
+     /* 出错后 NPU 状态未知，下一批从头初始化 */
+     if (res)
+         replay_warm_owner = NULL;
+ 
+     replay_report_wait(&st);
+     replay_trace_dump();
+     if (n)
+         IMSG("replay: batch of %" PRIu32 "%s, %" PRIu64 " us per inference",
+              n, cold ? " (cold)" : "",
+              (barrier_read_counter_timer() - t0) * 1000000 / freq / n);
+     return res;
+ }
+ 
+ /*
+  * 校验程序并挂到 vm 上；base 非零时把模型内存段搬到 base（原地改镜像）
+  */
+ TEE_Result replay_load_program(replay_vm_t *vm, void *image, size_t size,
+                                uint32_t base)
+ {
+     uint32_t mem_size;
+ 
+     replay_vm_setup(vm);
+     if (replay_vm_load(vm, image, size) != REPLAY_VM_OK) {
+         EMSG("replay: invalid program (%zu bytes)", size);
+         return TEE_ERROR_BAD_FORMAT;
+     }
+ 
+     /* 把模型的内存段搬到 base，整个段必须在完成环以下的 OCRAM 里 */
+     mem_size = vm->hdr->mem_size;
+     if (base) {
+         if (base < REPLAY_OCRAM_BASE || mem_size > REPLAY_USABLE_SIZE ||
+             base - REPLAY_OCRAM_BASE > REPLAY_USABLE_SIZE - mem_size ||
+             replay_vm_relocate(vm, image, base) != REPLAY_VM_OK) {
+             EMSG("replay: cannot place %" PRIu32 " bytes at 0x%08" PRIx32,
+                  mem_size, base);
+             return TEE_ERROR_BAD_PARAMETERS;
+         }
+         DMSG("replay: segment at 0x%08" PRIx32 ", %" PRIu32 " bytes",
+              base, mem_size);
+     }
+     return TEE_SUCCESS;
+ }
+ 
+ /*
+  * 执行已加载程序的全部推理，COPY_BLOB 限制在 [seg_base, seg_base + seg_size)
+  */
+ TEE_Result replay_exec_program(replay_vm_t *vm, uint32_t seg_base,
+                                uint32_t seg_size)
+ {
+     struct replay_vm_ctx ctx = {
+         .seg_base = seg_base,
+         .seg_size = seg_size,
+     };
+     int ret;
+ 
+     replay_batch_invalidate();
+     vm->ctx = &ctx;
+     ret = replay_vm_run(vm);
+     vm->ctx = NULL;
+     replay_report_wait(&ctx.st);
+     switch (ret) {
+     case REPLAY_VM_OK:
+         return TEE_SUCCESS;
+     case REPLAY_VM_ETIMEOUT:
+         EMSG("replay: poll timeout at pc %" PRIu32, vm->fault_pc);
+         return TEE_ERROR_TIMEOUT;
+     case REPLAY_VM_EVERIFY:
+         EMSG("replay: register check failed at pc %" PRIu32, vm->fault_pc);
+         return TEE_ERROR_NOT_SUPPORTED;
+     default:
+         EMSG("replay: program fault %d at pc %" PRIu32, ret, vm->fault_pc);
+         return TEE_ERROR_GENERIC;
+     }
+ }
+ 
+ /*
+  * 驱动接口：执行一个重放程序的全部推理。程序可以写完成环以下的整个
+  * OCRAM 窗口，所以先清空模型缓存
+  */
+ TEE_Result replay_run_program(struct replay_data *rd __unused,
+                               void *image, size_t size, uint32_t base)
+ {
+     replay_vm_t vm;
+     TEE_Result res;
+ 
+     replay_cache_flush();
+     res = replay_load_program(&vm, image, size, base);
+     if (res)
+         return res;
+     return replay_exec_program(&vm, REPLAY_OCRAM_BASE, REPLAY_USABLE_SIZE);
  }
  
  /*
@@ -170,7 +816,19 @@
   */
  static TEE_Result _replay_init_driver(void)
  {
-     return do_global_init() < 0 ? TEE_ERROR_GENERIC : TEE_SUCCESS;
+     if (do_global_init() < 0)
+         return TEE_ERROR_GENERIC;
+ 
+     /* 模板翻译失败只影响模板重放，重放程序照常可用 */
+     if (replay_build_ops())
+         EMSG("replay: built-in template disabled");
+     else
+         replay_reg_ops_ok = true;
+ 
+     /* 中断注册失败不影响重放，只是退回到轮询 */
+     if (replay_irq_init())
+         EMSG("replay: NPU interrupt unavailable, polling STATUS");
+     return TEE_SUCCESS;
  }
  driver_init(_replay_init_driver);
  
@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Ethos‑U replay 模型缓存：按 SHA-256 摘要索引、常驻 OCRAM 的重放程序
+ *
+ * OCRAM 窗口按槽分配，一个槽 = 模型内存段（重定位到槽首）+ 程序镜像。
+ * 镜像在槽里只做一次摘要校验和重定位，切换模型不需要重新拷贝镜像，
+ * 也不用重编 OP-TEE。OCRAM 在缓存外面也能被改写，所以每次运行前
+ * 再用 replay_vm_load() 检查一遍结构，越界的程序不会被执行
+ */
+
+#include <crypto/crypto.h>
+#include <kernel/mutex.h>
+#include <string.h>
+#include <trace.h>
+#include <util.h>
+
+#include "replay_priv.h"
+
+#ifndef CFG_REPLAY_CACHE_ENTRIES
+#define CFG_REPLAY_CACHE_ENTRIES 4
+#endif
+
+/* 槽的对齐：内存段重定位要求 16 字节对齐 */
+#define REPLAY_SLOT_ALIGN 16
+
+enum replay_slot_state {
+    REPLAY_SLOT_FREE,
+    REPLAY_SLOT_LOADING, /* 镜像还没写完或还没校验 */
+    REPLAY_SLOT_READY,
+};
+
+struct replay_cache_entry {
+    uint8_t digest[REPLAY_DIGEST_SIZE];
+    enum replay_slot_state state;
+    uint32_t base;      /* 槽的物理地址，也是内存段重定位后的地址 */
+    uint32_t seg_size;  /* 内存段占的字节数，镜像从 base + seg_size 开始 */
+    uint32_t slot_size; /* 整个槽的字节数 */
+    size_t image_size;
+    size_t loaded;      /* 已写入的镜像字节数 */
+    uint64_t last_use;  /* LRU 时间戳，replay_cache_clock 的值 */
+    replay_vm_t vm;     /* READY 时已加载、重定位 */
+};
+
+static struct replay_cache_entry replay_cache[CFG_REPLAY_CACHE_ENTRIES];
+static uint64_t replay_cache_clock;
+static struct mutex replay_cache_lock = MUTEX_INITIALIZER;
+
+static uint8_t *cache_image(const struct replay_cache_entry *e)
+{
+    return (uint8_t *)replay_ocram_va(e->base + e->seg_size);
+}
+
+static struct replay_cache_entry *cache_find(const uint8_t *digest)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(replay_cache); i++) {
+        struct replay_cache_entry *e = &replay_cache[i];
+
+        if (e->state != REPLAY_SLOT_FREE &&
+            !memcmp(e->digest, digest, REPLAY_DIGEST_SIZE))
+            return e;
+    }
+    return NULL;
+}
+
+static void cache_drop(struct replay_cache_entry *e)
+{
+    memset(e, 0, sizeof(*e));
+}
+
+/* 最久没用的槽（包括没写完的），缓存为空时返回 NULL */
+static struct replay_cache_entry *cache_lru(void)
+{
+    struct replay_cache_entry *lru = NULL;
+
+    for (size_t i = 0; i < ARRAY_SIZE(replay_cache); i++) {
+        struct replay_cache_entry *e = &replay_cache[i];
+
+        if (e->state != REPLAY_SLOT_FREE &&
+            (!lru || e->last_use < lru->last_use))
+            lru = e;
+    }
+    return lru;
+}
+
+static void cache_evict_lru(void)
+{
+    struct replay_cache_entry *e = cache_lru();
+
+    DMSG("replay: evict model at 0x%08" PRIx32 ", %" PRIu32 " bytes",
+         e->base, e->slot_size);
+    cache_drop(e);
+}
+
+/* OCRAM 里第一个放得下 size 字节的空隙，没有返回 0 */
+static uint32_t cache_find_gap(uint32_t size)
+{
+    uint32_t base = REPLAY_OCRAM_BASE;
+    bool moved = true;
+
+    while (moved) {
+        moved = false;
+        if (size > REPLAY_USABLE_SIZE ||
+            base - REPLAY_OCRAM_BASE > REPLAY_USABLE_SIZE - size)
+            return 0;
+        for (size_t i = 0; i < ARRAY_SIZE(replay_cache); i++) {
+            const struct replay_cache_entry *e = &replay_cache[i];
+
+            if (e->state != REPLAY_SLOT_FREE &&
+                base < e->base + e->slot_size && e->base < base + size) {
+                base = e->base + e->slot_size;
+                moved = true;
+            }
+        }
+    }
+    return base;
+}
+
+/*
+ * 第一块：从程序头算出槽的大小，按 LRU 腾出一个表项和一段 OCRAM。
+ * 这里读到的头只用来分配，提交时再以校验过的镜像为准
+ */
+static TEE_Result cache_alloc(const uint8_t *digest, size_t total,
+                              const void *chunk, size_t len,
+                              struct replay_cache_entry **out)
+{
+    struct replay_cache_entry *e = NULL;
+    replay_vm_header_t hdr;
+    uint32_t seg_size;
+    uint32_t slot_size;
+    uint32_t base;
+
+    if (len < sizeof(hdr))
+        return TEE_ERROR_BAD_PARAMETERS;
+    memcpy(&hdr, chunk, sizeof(hdr));
+    if (hdr.magic != REPLAY_VM_MAGIC || hdr.version != REPLAY_VM_VERSION)
+        return TEE_ERROR_BAD_FORMAT;
+    if (!hdr.mem_size)
+        return TEE_ERROR_NOT_SUPPORTED; /* 不可重定位，只能按录制地址跑 */
+    if (hdr.mem_size > REPLAY_USABLE_SIZE || total > REPLAY_USABLE_SIZE)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    seg_size = ROUNDUP(hdr.mem_size, REPLAY_SLOT_ALIGN);
+    slot_size = seg_size + ROUNDUP(total, REPLAY_SLOT_ALIGN);
+    if (slot_size > REPLAY_USABLE_SIZE)
+        return TEE_ERROR_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < ARRAY_SIZE(replay_cache) && !e; i++)
+        if (replay_cache[i].state == REPLAY_SLOT_FREE)
+            e = &replay_cache[i];
+    if (!e) {
+        e = cache_lru();
+        cache_evict_lru();
+    }
+    while (!(base = cache_find_gap(slot_size)))
+        cache_evict_lru();
+
+    /* 槽可能和模板的固定地址重叠 */
+    replay_batch_invalidate();
+
+    memcpy(e->digest, digest, REPLAY_DIGEST_SIZE);
+    e->state = REPLAY_SLOT_LOADING;
+    e->base = base;
+    e->seg_size = seg_size;
+    e->slot_size = slot_size;
+    e->image_size = total;
+    e->loaded = 0;
+    e->last_use = ++replay_cache_clock;
+    *out = e;
+    return TEE_SUCCESS;
+}
+
+/* 最后一块写完：校验摘要，再加载并把内存段重定位到槽首 */
+static TEE_Result cache_commit(struct replay_cache_entry *e)
+{
+    uint8_t *image = cache_image(e);
+    TEE_Result res;
+
+    res = hash_sha256_check(e->digest, image, e->image_size);
+    if (res) {
+        EMSG("replay: model image does not match its digest");
+        goto err;
+    }
+
+    res = replay_load_program(&e->vm, image, e->image_size, e->base);
+    if (res)
+        goto err;
+    /* 分配时的程序头来自调用方的内存，可能和校验过的不一样 */
+    if (e->vm.hdr->mem_size > e->seg_size) {
+        EMSG("replay: model segment does not fit its slot");
+        res = TEE_ERROR_BAD_FORMAT;
+        goto err;
+    }
+
+    e->state = REPLAY_SLOT_READY;
+    DMSG("replay: cached model at 0x%08" PRIx32 ", %" PRIu32 " bytes",
+         e->base, e->slot_size);
+    return TEE_SUCCESS;
+err:
+    cache_drop(e);
+    return res;
+}
+
+/*
+ * 运行前重新校验槽里的镜像：提交之后 OCRAM 可能被别的路径改写过，
+ * 寄存器偏移、COPY_BLOB 范围和重定位都要再检查，段也必须还在槽首
+ */
+static TEE_Result cache_recheck(struct replay_cache_entry *e)
+{
+    if (replay_vm_load(&e->vm, cache_image(e), e->image_size) != REPLAY_VM_OK ||
+        e->vm.hdr->mem_base != e->base || e->vm.hdr->mem_size > e->seg_size) {
+        EMSG("replay: cached model at 0x%08" PRIx32 " was overwritten",
+             e->base);
+        return TEE_ERROR_BAD_STATE;
+    }
+    return TEE_SUCCESS;
+}
+
+TEE_Result replay_cache_load(struct replay_data *rd __unused,
+                             const uint8_t digest[REPLAY_DIGEST_SIZE],
+                             size_t total, size_t offset,
+                             const void *chunk, size_t len)
+{
+    struct replay_cache_entry *e;
+    TEE_Result res = TEE_SUCCESS;
+
+    if (!len || offset > total || len > total - offset)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    mutex_lock(&replay_cache_lock);
+    e = cache_find(digest);
+    if (e && e->state == REPLAY_SLOT_READY) {
+        /* 别的会话已经加载完了 */
+        goto out;
+    }
+    if (!offset) {
+        /* 重新开始一次没写完的加载 */
+        if (e)
+            cache_drop(e);
+        res = cache_alloc(digest, total, chunk, len, &e);
+        if (res)
+            goto out;
+    } else if (!e || e->image_size != total || e->loaded != offset) {
+        res = TEE_ERROR_BAD_STATE;
+        goto out;
+    }
+
+    memcpy(cache_image(e) + offset, chunk, len);
+    e->loaded += len;
+    if (e->loaded == total)
+        res = cache_commit(e);
+out:
+    mutex_unlock(&replay_cache_lock);
+    return res;
+}
+
+TEE_Result replay_cache_run(struct replay_data *rd __unused,
+                            const uint8_t digest[REPLAY_DIGEST_SIZE])
+{
+    struct replay_cache_entry *e;
+    TEE_Result res;
+
+    mutex_lock(&replay_cache_lock);
+    e = cache_find(digest);
+    if (!e || e->state != REPLAY_SLOT_READY) {
+        res = TEE_ERROR_ITEM_NOT_FOUND;
+    } else {
+        e->last_use = ++replay_cache_clock;
+        res = cache_recheck(e);
+        if (res)
+            cache_drop(e);
+        else
+            res = replay_exec_program(&e->vm, e->base, e->seg_size);
+    }
+    mutex_unlock(&replay_cache_lock);
+    return res;
+}
+
+void replay_cache_flush(void)
+{
+    mutex_lock(&replay_cache_lock);
+    for (size_t i = 0; i < ARRAY_SIZE(replay_cache); i++)
+        cache_drop(&replay_cache[i]);
+    replay_batch_invalidate();
+    mutex_unlock(&replay_cache_lock);
+}
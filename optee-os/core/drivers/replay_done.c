@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * M33 重放完成通道的 A55 端：OCRAM 里的完成环（done_ring，与 M33 共用），
+ * 加一个可选的 MU 门铃。
+ *
+ * M33 每跑完一次推理往环里推一个槽（序号、状态、输出位置），再触发
+ * MU 的通用中断 0；这里的中断处理清掉 GIP0 并发异步通知，等待的线程
+ * 在 normal world 睡眠，不再占着一个核轮询标志字节。没有 MU 或异步
+ * 通知没启动，或者调用方给了超时，就退回到带延时的轮询
+ */
+
+#include <arm.h>
+#include <assert.h>
+#include <initcall.h>
+#include <io.h>
+#include <keep.h>
+#include <kernel/cache_helpers.h>
+#include <kernel/delay.h>
+#include <kernel/interrupt.h>
+#include <kernel/mutex.h>
+#include <kernel/notif.h>
+#include <mm/core_memprot.h>
+#include <trace.h>
+#include <util.h>
+
+#include <drivers/replay_done.h>
+
+#include "done_ring.h"
+
+static_assert(REPLAY_DONE_PA == DONE_RING_PA);
+static_assert(sizeof(done_ring_t) <= REPLAY_DONE_SIZE);
+
+/* 没有门铃时两次检查之间的延时 */
+#define REPLAY_DONE_POLL_US 100
+
+static done_ring_t *replay_done_ring;
+static struct mutex replay_done_lock = MUTEX_INITIALIZER;
+
+/* A55 的 D-Cache 和 M33 不一致：读之前作废，写之后清 */
+static void done_sync_in(void *ctx __unused, const volatile void *p,
+                         uint32_t len)
+{
+    dcache_inv_range((void *)(uintptr_t)p, len);
+}
+
+static void done_sync_out(void *ctx __unused, const volatile void *p,
+                          uint32_t len)
+{
+    dcache_clean_range((void *)(uintptr_t)p, len);
+}
+
+/* M33 不在 A55 的 inner shareable 域里，用全系统的屏障 */
+static void done_fence(void *ctx __unused)
+{
+    dsb();
+}
+
+static const done_ring_ops_t replay_done_ops = {
+    .sync_in = done_sync_in,
+    .sync_out = done_sync_out,
+    .fence = done_fence,
+};
+
+static done_ring_ep_t replay_done_ep(void)
+{
+    return (done_ring_ep_t){
+        .ring = replay_done_ring,
+        .ops = &replay_done_ops,
+    };
+}
+
+#ifdef CFG_REPLAY_DONE_MU
+/*
+ * MU 的 A55 侧（MUB）。通用中断 0 由 M33 写 MUA 的 GCR.GIR0 触发，
+ * 在这里置 GSR.GIP0，写 1 清除
+ */
+#define MU_GIER 0x110
+#define MU_GSR  0x118
+#define MU_GI0  BIT32(0)
+
+static vaddr_t replay_done_mu;
+static struct itr_handler *replay_done_itr;
+static uint32_t replay_done_notif_value;
+
+static enum itr_return replay_done_it_handler(struct itr_handler *h __unused)
+{
+    io_write32(replay_done_mu + MU_GSR, MU_GI0);
+    notif_send_async(replay_done_notif_value);
+    return ITRR_HANDLED;
+}
+DECLARE_KEEP_PAGER(replay_done_it_handler);
+
+static TEE_Result replay_done_mu_init(void)
+{
+    TEE_Result res;
+
+    replay_done_mu = core_mmu_get_va(CFG_REPLAY_DONE_MU_BASE,
+                                     MEM_AREA_IO_SEC, SMALL_PAGE_SIZE);
+    if (!replay_done_mu)
+        return TEE_ERROR_GENERIC;
+
+    res = notif_alloc_async_value(&replay_done_notif_value);
+    if (res)
+        return res;
+
+    res = interrupt_alloc_add_conf_handler(interrupt_get_main_chip(),
+                                           CFG_REPLAY_DONE_MU_IT,
+                                           replay_done_it_handler, 0, NULL,
+                                           IRQ_TYPE_LEVEL_HIGH, 0,
+                                           &replay_done_itr);
+    if (res) {
+        notif_free_async_value(replay_done_notif_value);
+        replay_done_itr = NULL;
+        return res;
+    }
+
+    io_write32(replay_done_mu + MU_GSR, MU_GI0);
+    io_setbits32(replay_done_mu + MU_GIER, MU_GI0);
+    interrupt_enable(replay_done_itr->chip, replay_done_itr->it);
+    return TEE_SUCCESS;
+}
+
+/*
+ * 睡到门铃响，返回 false 表示不能睡（没有中断或异步通知没启动）。
+ * 门铃在 notif_wait() 之前响也不会丢；多出来的通知只会让调用方多查一次环。
+ * 这个版本的 notif_wait() 没有超时，所以只在调用方不限时等待时才睡，
+ * 限时等待一律轮询
+ */
+static bool replay_done_sleep(void)
+{
+    if (!replay_done_itr || !notif_async_is_started())
+        return false;
+    return !notif_wait(replay_done_notif_value);
+}
+#else
+static TEE_Result replay_done_mu_init(void)
+{
+    return TEE_SUCCESS;
+}
+
+static bool replay_done_sleep(void)
+{
+    return false;
+}
+#endif
+
+TEE_Result replay_done_reset(void)
+{
+    done_ring_ep_t ep = replay_done_ep();
+
+    if (!ep.ring)
+        return TEE_ERROR_GENERIC;
+
+    mutex_lock(&replay_done_lock);
+    done_ring_reset(&ep);
+    mutex_unlock(&replay_done_lock);
+    return TEE_SUCCESS;
+}
+
+TEE_Result replay_done_wait(struct replay_done *done, uint32_t timeout_ms)
+{
+    done_ring_ep_t ep = replay_done_ep();
+    uint64_t start = barrier_read_counter_timer();
+    uint64_t limit = (uint64_t)read_cntfrq() * timeout_ms / 1000;
+    bool forever = timeout_ms == REPLAY_DONE_WAIT_FOREVER;
+    TEE_Result res = TEE_ERROR_TIMEOUT;
+    done_ring_slot_t slot;
+    int rc;
+
+    if (!ep.ring)
+        return TEE_ERROR_GENERIC;
+
+    mutex_lock(&replay_done_lock);
+    while (true) {
+        rc = done_ring_pop(&ep, &slot);
+        if (rc == DONE_RING_OK) {
+            done->seq = slot.seq;
+            done->status = slot.status;
+            done->out_pa = DONE_RING_OUT_BASE + slot.out_offset;
+            done->out_size = slot.out_size;
+            res = TEE_SUCCESS;
+            break;
+        }
+        if (rc != DONE_RING_EEMPTY || ep.ring->magic != DONE_RING_MAGIC) {
+            EMSG("replay: completion ring is not valid");
+            res = TEE_ERROR_BAD_STATE;
+            break;
+        }
+        if (!forever && barrier_read_counter_timer() - start > limit)
+            break;
+        /* notif_wait() 不会超时，有限等待只能轮询 */
+        if (!forever || !replay_done_sleep())
+            udelay(REPLAY_DONE_POLL_US);
+    }
+    mutex_unlock(&replay_done_lock);
+    return res;
+}
+
+static TEE_Result replay_done_init(void)
+{
+    replay_done_ring = (done_ring_t *)core_mmu_get_va(REPLAY_DONE_PA,
+                                                      MEM_AREA_RAM_SEC,
+                                                      REPLAY_DONE_SIZE);
+    if (!replay_done_ring) {
+        EMSG("replay: map completion ring failed");
+        return TEE_ERROR_GENERIC;
+    }
+
+    /* 门铃注册失败不影响完成通道，只是退回到轮询 */
+    if (replay_done_mu_init())
+        EMSG("replay: MU doorbell unavailable, polling completion ring");
+    return TEE_SUCCESS;
+}
+driver_init(replay_done_init);
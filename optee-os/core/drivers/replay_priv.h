@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Ethos‑U replay driver 内部接口：replay.c 和 replay_cache.c 共用，
+ * 依赖 replay_vm.h，所以不放到 core/include
+ */
+
+#ifndef REPLAY_PRIV_H
+#define REPLAY_PRIV_H
+
+#include <drivers/replay.h>
+#include <drivers/replay_done.h>
+#include <types_ext.h>
+#include <tee_api_types.h>
+
+#include "replay_vm.h"
+
+/*
+ * 重放程序和模型缓存能用的 OCRAM：从窗口开头到 M33 完成环为止。
+ * 完成环那一页在映射的窗口里，但不能被模型、输入输出或 COPY_BLOB 盖住
+ */
+#define REPLAY_USABLE_SIZE (REPLAY_DONE_PA - REPLAY_OCRAM_BASE)
+
+/* OCRAM 窗口内物理地址对应的安全虚拟地址，调用方保证 pa 在窗口内 */
+vaddr_t replay_ocram_va(paddr_t pa);
+
+/*
+ * 校验程序并挂到 vm 上；base 非零时把模型内存段搬到 base（原地改镜像）。
+ * 镜像要在安全内存里、4 字节对齐，执行期间不能移动
+ */
+TEE_Result replay_load_program(replay_vm_t *vm, void *image, size_t size,
+                               uint32_t base);
+
+/*
+ * 执行 replay_load_program() 加载的程序的全部推理，
+ * COPY_BLOB 只能写 [seg_base, seg_base + seg_size)
+ */
+TEE_Result replay_exec_program(replay_vm_t *vm, uint32_t seg_base,
+                               uint32_t seg_size);
+
+/*
+ * 复位 NPU 或改写 OCRAM 之前调用：批量推理的会话下一次要从头初始化
+ */
+void replay_batch_invalidate(void);
+
+#endif /* REPLAY_PRIV_H */
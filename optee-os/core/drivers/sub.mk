@@ -91,3 +91,14 @@ subdirs-y += pm
 subdirs-y += wdt
 subdirs-y += rtc
 srcs-y += replay.c
+srcs-y += replay_cache.c
+srcs-y += replay_done.c
+# Replay program interpreter, shared with the M33 replayer
+REPLAY_VM_DIR ?= $(abspath $(sub-dir)/../../../replayer/middleware/replay_vm)
+srcs-y += $(REPLAY_VM_DIR)/replay_vm.c
+srcs-y += $(REPLAY_VM_DIR)/replay_hist.c
+incdirs_ext-y += $(REPLAY_VM_DIR)
+# Completion ring written by the M33 replayer
+DONE_RING_DIR ?= $(abspath $(sub-dir)/../../../replayer/middleware/done_ring)
+srcs-y += $(DONE_RING_DIR)/done_ring.c
+incdirs_ext-y += $(DONE_RING_DIR)
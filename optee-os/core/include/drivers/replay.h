@@ -11,6 +11,7 @@
  #include <types_ext.h>
  #include <io.h>
  #include <mm/core_memprot.h>
+ #include <tee_api_types.h>
  
  /* Physical base addresses and sizes */
  #define REPLAY_NPU_REG_BASE   0x4A900000UL
@@ -38,9 +39,12 @@
  
  /*
   * Perform the "initialization & verification" phase
-  * of the Ethos‑U replay sequence.
+  * of the Ethos‑U replay sequence. Returns TEE_ERROR_TIMEOUT if the
+  * NPU soft reset does not complete, or TEE_ERROR_NOT_SUPPORTED if the
+  * built-in template was rejected at boot (a record outside the NPU
+  * register window).
   */
- void replay_initialization_verification(struct replay_data *rd);
+ TEE_Result replay_initialization_verification(struct replay_data *rd);
  
  /*
   * Perform the "inference" phase of the
@@ -49,10 +53,124 @@
  void replay_inference(struct replay_data *rd);
  
  /*
-  * Handle any pending Ethos‑U interrupts by
-  * replaying recorded IRQ operations.
+  * Wait (bounded) for the Ethos‑U interrupt and replay the
+  * recorded IRQ operations. With CFG_REPLAY_NPU_IRQ (off by default)
+  * the calling thread sleeps in normal world until the interrupt
+  * fires, without a timeout. Returns TEE_ERROR_TIMEOUT if a polled NPU hangs, or
+  * TEE_ERROR_BAD_STATE if STATUS reports a fault.
   */
- void replay_handle_interrupt(struct replay_data *rd);
+ TEE_Result replay_handle_interrupt(struct replay_data *rd);
+ 
+ /*
+  * Validate and run a replay program generated by "rrtrace.py program"
+  * (see replayer/middleware/replay_vm/replay_vm.h). The image must be in
+  * secure memory and 4-byte aligned. A non-zero base relocates the
+  * program's memory segment to that OCRAM address first, patching the
+  * image in place. Returns TEE_ERROR_BAD_FORMAT for a malformed program,
+  * TEE_ERROR_BAD_PARAMETERS if the segment does not fit at base,
+  * TEE_ERROR_TIMEOUT if the NPU did not respond, or
+  * TEE_ERROR_NOT_SUPPORTED if the NPU does not match the recorded one.
+  */
+ TEE_Result replay_run_program(struct replay_data *rd, void *image,
+                               size_t size, uint32_t base);
+ 
+ /*
+  * Batched inference on a warm NPU. The first batch of a session resets and
+  * initializes the NPU and copies the model once; every input then only
+  * costs the copy into the input slot, the QBASE/BASEP/CMD kick, the wait
+  * and the IRQ acknowledge. Inputs and outputs are packed back to back.
+  */
+ struct replay_batch {
+     uint32_t in_pa;       /* input slot in OCRAM                 */
+     uint32_t in_size;
+     uint32_t out_pa;      /* output tensor in OCRAM              */
+     uint32_t out_size;    /* 0: nothing to read back             */
+     const uint8_t *in;    /* count * in_size bytes               */
+     uint8_t *out;         /* count * out_size bytes              */
+     uint32_t count;
+ };
+ 
+ /*
+  * Run b->count inferences of the built-in template for owner, an opaque
+  * session handle. The NPU stays warm for owner until another replay
+  * touches the NPU or OCRAM, or replay_batch_release(owner). Returns
+  * TEE_ERROR_BAD_PARAMETERS if a slot is outside OCRAM, otherwise as
+  * replay_handle_interrupt(); after an error the next batch starts cold.
+  */
+ TEE_Result replay_run_batch(struct replay_data *rd, void *owner,
+                             const struct replay_batch *b);
+ 
+ /* Forget the warm state of owner, e.g. when its session closes */
+ void replay_batch_release(void *owner);
+ 
+ /*
+  * Model cache: replay programs keyed by their SHA-256 digest, up to
+  * CFG_REPLAY_CACHE_ENTRIES of them resident in OCRAM. Each model owns one
+  * slot holding its memory segment followed by the validated, relocated
+  * image, so running a resident model needs no copy and no validation.
+  * Slots are evicted least recently used first.
+  */
+ #define REPLAY_DIGEST_SIZE    32
+ 
+ /*
+  * Write bytes [offset, offset + len) of a total-byte image into the slot
+  * of digest. The chunk at offset 0 must hold the program header and
+  * allocates the slot, evicting as needed; later chunks must follow in
+  * order. After the last chunk the image is checked against digest, loaded
+  * and relocated into its slot. Returns TEE_ERROR_OUT_OF_MEMORY if the
+  * model does not fit in OCRAM, TEE_ERROR_NOT_SUPPORTED if the program is
+  * not relocatable, TEE_ERROR_SECURITY if the image does not match digest,
+  * or TEE_ERROR_BAD_FORMAT for a malformed program.
+  */
+ TEE_Result replay_cache_load(struct replay_data *rd,
+                              const uint8_t digest[REPLAY_DIGEST_SIZE],
+                              size_t total, size_t offset,
+                              const void *chunk, size_t len);
+ 
+ /*
+  * Run every inference of a resident model. Returns
+  * TEE_ERROR_ITEM_NOT_FOUND if it is not in the cache, otherwise as
+  * replay_run_program().
+  */
+ TEE_Result replay_cache_run(struct replay_data *rd,
+                             const uint8_t digest[REPLAY_DIGEST_SIZE]);
+ 
+ /*
+  * Drop every cached model. Replays that write OCRAM at fixed addresses
+  * call this first, since they overwrite the slots.
+  */
+ void replay_cache_flush(void);
+ 
+ /*
+  * Per-phase latency of every replay since boot or the last reset, measured
+  * with the generic timer. INIT is the NPU reset and verification, KICK the
+  * register writes that start a command stream (for template replays also
+  * the OCRAM writes recorded in that phase), NPU the wait for completion,
+  * IRQ_ACK the interrupt phase, COPY_IN the model and input copies into
+  * OCRAM and COPY_OUT the batch output copies out of it.
+  */
+ enum replay_phase {
+     REPLAY_PHASE_INIT,
+     REPLAY_PHASE_KICK,
+     REPLAY_PHASE_NPU,
+     REPLAY_PHASE_IRQ_ACK,
+     REPLAY_PHASE_COPY_IN,
+     REPLAY_PHASE_COPY_OUT,
+     REPLAY_PHASE_COUNT
+ };
+ 
+ /* Latencies in ns, saturated at UINT32_MAX; p99 is within 12.5% */
+ struct replay_phase_stats {
+     uint32_t count;
+     uint32_t min_ns;
+     uint32_t avg_ns;
+     uint32_t max_ns;
+     uint32_t p99_ns;
+ };
+ 
+ /* Summarize every phase into st, then clear the histograms if reset */
+ void replay_get_phase_stats(struct replay_phase_stats st[REPLAY_PHASE_COUNT],
+                             bool reset);
  
  #endif /* REPLAY_H */
  
\ No newline at end of file
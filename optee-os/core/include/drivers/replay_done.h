@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Completion channel from the M33 replayer: a ring of finished
+ * inferences in OCRAM (replayer/middleware/done_ring), optionally with a
+ * messaging unit doorbell (CFG_REPLAY_DONE_MU).
+ */
+
+#ifndef REPLAY_DONE_H
+#define REPLAY_DONE_H
+
+#include <tee_api_types.h>
+#include <types_ext.h>
+
+/* OCRAM page holding the ring, same as DONE_RING_PA on the M33 */
+#define REPLAY_DONE_PA      0x204DF000UL
+#define REPLAY_DONE_SIZE    0x1000UL
+
+/* One inference reported by the M33 */
+struct replay_done {
+    uint32_t seq;      /* counts from 0 after replay_done_reset() */
+    int32_t status;    /* 0 on success */
+    paddr_t out_pa;    /* output in OCRAM */
+    uint32_t out_size; /* 0 if the job has no output */
+};
+
+/*
+ * Empty the ring before (re)starting the M33. Completions not yet taken
+ * are dropped.
+ */
+TEE_Result replay_done_reset(void);
+
+/* timeout_ms for replay_done_wait(): no timeout */
+#define REPLAY_DONE_WAIT_FOREVER UINT32_MAX
+
+/*
+ * Take the oldest completion, waiting up to timeout_ms for one. A finite
+ * timeout polls the ring with a delay between checks. With
+ * REPLAY_DONE_WAIT_FOREVER, CFG_REPLAY_DONE_MU and asynchronous
+ * notifications started, the calling thread instead sleeps in normal
+ * world until the M33 rings the doorbell; that sleep cannot time out.
+ * Returns TEE_ERROR_TIMEOUT, or TEE_ERROR_BAD_STATE if the ring was never
+ * reset or has been overwritten.
+ */
+TEE_Result replay_done_wait(struct replay_done *done, uint32_t timeout_ms);
+
+#endif /* REPLAY_DONE_H */
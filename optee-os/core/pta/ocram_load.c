@@ -5,10 +5,20 @@
  *
  * This pseudo-TA loads data from a supplied buffer (previously read from
  * secure storage) into a fixed physical address in OCRAM (0x20484050),
- * but before that clears the byte at physical address 0x20490000.
+ * but before that empties the M33 completion ring (drivers/replay_done.h).
+ *
+ * OCRAM_LOAD_CMD_DECRYPT_INIT/UPDATE 按块解密，明文直接写到 OCRAM 目标地址，
+ * 不经过 TA 堆，模型大小只受 OCRAM 窗口限制。
+ * 认证加载在同一遍里对落进 OCRAM 的明文做 SHA-256，密文末尾的签名
+ * 解密后留在会话里，由 OCRAM_LOAD_CMD_DECRYPT_FINAL 连同摘要交给调用方验签。
+ * 认证加载在 DECRYPT_FINAL 之前出错、被新的 DECRYPT_INIT 顶掉或会话关闭时，
+ * 已写进 OCRAM 的明文当场清掉。
  */
 
  #include <compiler.h>
+ #include <crypto/crypto.h>
+ #include <drivers/replay.h>
+ #include <drivers/replay_done.h>
  #include <kernel/pseudo_ta.h>
  #include <malloc.h>
  #include <mm/tee_mm.h>
@@ -18,6 +28,7 @@
  #include <string.h>
  #include <string_ext.h>
  #include <trace.h>
+ #include <util.h>
  #include <tee_api_types.h>
  #include <kernel/cache_helpers.h>
  
@@ -29,18 +40,39 @@
        { 0xb7, 0xd1, 0x6b, 0x32, 0xde, 0xec, 0x18, 0x57 } }
  
  /* Command ID */
- #define OCRAM_LOAD_CMD  0
+ #define OCRAM_LOAD_CMD                0
+ #define OCRAM_LOAD_CMD_DECRYPT_INIT   1
+ #define OCRAM_LOAD_CMD_DECRYPT_UPDATE 2
+ #define OCRAM_LOAD_CMD_DECRYPT_FINAL  3
+ #define OCRAM_LOAD_CMD_WIPE           4
+ 
+ #define OCRAM_DEST_PA    0x20484050
+ /* 目标地址到 M33 完成环之间的字节数，模型不能盖住完成环 */
+ #define OCRAM_DEST_MAX   (REPLAY_DONE_PA - OCRAM_DEST_PA)
+ 
+ /* 认证加载密文末尾不落 OCRAM 的字节数上限，够放 RSA-4096 签名 */
+ #define OCRAM_TAIL_MAX   512
+ 
+ /* 每个会话一次进行中的解密加载 */
+ struct ocram_load_sess {
+     void *cipher;   /* crypto_cipher ctx，NULL 表示没有进行中的解密 */
+     uint32_t algo;
+     void *hash;     /* 认证加载的 SHA-256 ctx，普通加载为 NULL */
+     size_t total;   /* 落进 OCRAM 的明文字节数 */
+     size_t offset;  /* 已解密的字节数，包括尾部 */
+     size_t landed;  /* 最近一次加载已写进 OCRAM 的字节数，WIPE 用 */
+     size_t tail_size;
+     uint8_t tail[OCRAM_TAIL_MAX]; /* 尾部明文（签名） */
+ };
  
  /*
   * pta_load_to_ocram - Load data from input buffer into OCRAM and clean cache,
-  *                     but first clear one byte at physical 0x20490000.
+  *                     but first reset the M33 completion ring.
   */
  static TEE_Result pta_load_to_ocram(uint32_t ptypes,
                                      TEE_Param params[TEE_NUM_PARAMS])
  {
-     paddr_t flag_pa = 0x20490000;
-     paddr_t dest_pa = 0x20484050;
-     void *flag_va = NULL;
+     paddr_t dest_pa = OCRAM_DEST_PA;
      void *dest_va = NULL;
      uint32_t size = params[0].memref.size;
      uint32_t i;
@@ -59,24 +91,20 @@
      }
  
      /* 大小检查 */
-     if (size > 640 * 1024) {
+     if (size > OCRAM_DEST_MAX) {
          EMSG("Data size %u exceeds limit", size);
          return TEE_ERROR_BAD_PARAMETERS;
      }
  
-     /* 1) 先映射并清零 0x20490000 处的一个字节 */
-     flag_va = phys_to_virt(flag_pa, MEM_AREA_RAM_SEC, 1);
-     if (!flag_va) {
-         EMSG("Failed to map flag PA 0x%" PRIxPA, flag_pa);
+     /* 1) 先清空 M33 的完成环，之前的完成记录作废 */
+     if (replay_done_reset())
          return TEE_ERROR_GENERIC;
-     }
-     /* 写 0 并清 Cache */
-     *(uint8_t *)flag_va = 0;
-     dcache_clean_range(flag_va, 1);
-     DMSG("Cleared byte at PA 0x%" PRIxPA, flag_pa);
+ 
+     /* OCRAM 要被改写，replay 缓存里的程序作废 */
+     replay_cache_flush();
  
      /* 2) 再映射 OCRAM 目标区 */
-     dest_va = phys_to_virt(dest_pa, MEM_AREA_RAM_SEC, 640 * 1024);
+     dest_va = phys_to_virt(dest_pa, MEM_AREA_RAM_SEC, size);
      if (!dest_va) {
          EMSG("Failed to map OCRAM PA 0x%" PRIxPA, dest_pa);
          return TEE_ERROR_GENERIC;
@@ -105,17 +133,318 @@
      return TEE_SUCCESS;
  }
  
+ static void decrypt_abort(struct ocram_load_sess *sess)
+ {
+     if (sess->cipher) {
+         crypto_cipher_final(sess->cipher);
+         crypto_cipher_free_ctx(sess->cipher);
+     }
+     if (sess->hash)
+         crypto_hash_free_ctx(sess->hash);
+     sess->cipher = NULL;
+     sess->hash = NULL;
+     sess->total = 0;
+     sess->offset = 0;
+     sess->tail_size = 0;
+     memzero_explicit(sess->tail, sizeof(sess->tail));
+ }
+ 
+ /* 清掉最近一次加载写进 OCRAM 的明文 */
+ static TEE_Result wipe_landed(struct ocram_load_sess *sess)
+ {
+     void *dest_va = NULL;
+ 
+     if (!sess->landed)
+         return TEE_SUCCESS;
+ 
+     dest_va = phys_to_virt(OCRAM_DEST_PA, MEM_AREA_RAM_SEC, sess->landed);
+     if (!dest_va)
+         return TEE_ERROR_GENERIC;
+     memzero_explicit(dest_va, sess->landed);
+     dcache_clean_range(dest_va, sess->landed);
+     sess->landed = 0;
+     return TEE_SUCCESS;
+ }
+ 
+ /*
+  * 认证加载没走到 DECRYPT_FINAL 就被放弃（中途出错、关会话、被新的
+  * DECRYPT_INIT 顶掉）：OCRAM 里的明文没验过签，CTR 密文还能逐位篡改，
+  * 不能留给 M33
+  */
+ static void drop_unverified(struct ocram_load_sess *sess)
+ {
+     if (sess->hash && wipe_landed(sess))
+         EMSG("Failed to wipe unverified plaintext in OCRAM");
+ }
+ 
+ /*
+  * pta_decrypt_init - 开始一次解密加载
+  * [in] memref0 AES 密钥，memref1 IV（ECB 不用，可以为空）
+  * [in] value2  a = 落进 OCRAM 的明文字节数，
+  *              b = TEE_ALG_AES_CTR / TEE_ALG_AES_CBC_NOPAD /
+  *                  TEE_ALG_AES_ECB_NOPAD
+  * [in] value3  可选，a = 尾部字节数；给了就是认证加载
+  */
+ static TEE_Result pta_decrypt_init(struct ocram_load_sess *sess,
+                                    uint32_t ptypes,
+                                    TEE_Param params[TEE_NUM_PARAMS])
+ {
+     bool hashed = false;
+     size_t tail_size = 0;
+     TEE_Result res;
+ 
+     if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                         TEE_PARAM_TYPE_MEMREF_INPUT,
+                         TEE_PARAM_TYPE_VALUE_INPUT,
+                         TEE_PARAM_TYPE_VALUE_INPUT) == ptypes) {
+         hashed = true;
+         tail_size = params[3].value.a;
+     } else if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                TEE_PARAM_TYPE_MEMREF_INPUT,
+                                TEE_PARAM_TYPE_VALUE_INPUT,
+                                TEE_PARAM_TYPE_NONE) != ptypes) {
+         return TEE_ERROR_BAD_PARAMETERS;
+     }
+ 
+     if (!params[2].value.a || params[2].value.a > OCRAM_DEST_MAX) {
+         EMSG("Data size %" PRIu32 " exceeds limit", params[2].value.a);
+         return TEE_ERROR_BAD_PARAMETERS;
+     }
+     if (tail_size > OCRAM_TAIL_MAX)
+         return TEE_ERROR_BAD_PARAMETERS;
+     if (params[2].value.b != TEE_ALG_AES_CTR &&
+         params[2].value.b != TEE_ALG_AES_CBC_NOPAD &&
+         params[2].value.b != TEE_ALG_AES_ECB_NOPAD)
+         return TEE_ERROR_NOT_SUPPORTED;
+     /* CBC、ECB 在明文和尾部的分界处也要是整块 */
+     if (params[2].value.b != TEE_ALG_AES_CTR &&
+         ((params[2].value.a | tail_size) % TEE_AES_BLOCK_SIZE))
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     /* 上一次没写完的加载直接丢掉，没验签的明文先清掉 */
+     drop_unverified(sess);
+     decrypt_abort(sess);
+     sess->landed = 0;
+ 
+     if (hashed) {
+         res = crypto_hash_alloc_ctx(&sess->hash, TEE_ALG_SHA256);
+         if (!res)
+             res = crypto_hash_init(sess->hash);
+         if (res)
+             goto err;
+     }
+     res = crypto_cipher_alloc_ctx(&sess->cipher, params[2].value.b);
+     if (res) {
+         sess->cipher = NULL;
+         goto err;
+     }
+     res = crypto_cipher_init(sess->cipher, TEE_MODE_DECRYPT,
+                              params[0].memref.buffer, params[0].memref.size,
+                              NULL, 0,
+                              params[1].memref.buffer, params[1].memref.size);
+     if (res)
+         goto err;
+     sess->algo = params[2].value.b;
+     sess->total = params[2].value.a;
+     sess->tail_size = tail_size;
+     sess->offset = 0;
+ 
+     /* OCRAM 要被改写，replay 缓存里的程序作废 */
+     replay_cache_flush();
+ 
+     res = replay_done_reset();
+     if (res)
+         goto err;
+ 
+     return TEE_SUCCESS;
+ err:
+     decrypt_abort(sess);
+     return res;
+ }
+ 
+ /* 解密 len 字节到 OCRAM：认证加载顺带更新摘要，再清这段 D-Cache */
+ static TEE_Result decrypt_to_ocram(struct ocram_load_sess *sess,
+                                    const uint8_t *src, size_t len, bool last)
+ {
+     void *dest_va = NULL;
+     TEE_Result res;
+ 
+     dest_va = phys_to_virt(OCRAM_DEST_PA + sess->offset, MEM_AREA_RAM_SEC,
+                            len);
+     if (!dest_va)
+         return TEE_ERROR_GENERIC;
+ 
+     res = crypto_cipher_update(sess->cipher, TEE_MODE_DECRYPT, last,
+                                src, len, dest_va);
+     if (res)
+         return res;
+     sess->landed = sess->offset + len;
+     if (sess->hash) {
+         res = crypto_hash_update(sess->hash, dest_va, len);
+         if (res)
+             return res;
+     }
+     dcache_clean_range(dest_va, len);
+     return TEE_SUCCESS;
+ }
+ 
+ /*
+  * pta_decrypt_update - 解密一块密文，明文直接写到 OCRAM 并清这块的 D-Cache，
+  *                      落在尾部的部分留在会话里
+  * [in] memref0 密文块，value1 a = 这块在密文里的偏移（必须等于已解密的字节数）
+  */
+ static TEE_Result pta_decrypt_update(struct ocram_load_sess *sess,
+                                      uint32_t ptypes,
+                                      TEE_Param params[TEE_NUM_PARAMS])
+ {
+     const uint8_t *src = params[0].memref.buffer;
+     size_t len = params[0].memref.size;
+     size_t end = sess->total + sess->tail_size;
+     size_t n = 0;
+     bool last;
+     TEE_Result res = TEE_SUCCESS;
+ 
+     if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                         TEE_PARAM_TYPE_VALUE_INPUT,
+                         TEE_PARAM_TYPE_NONE,
+                         TEE_PARAM_TYPE_NONE) != ptypes)
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     if (!sess->cipher || params[1].value.a != sess->offset)
+         return TEE_ERROR_BAD_STATE;
+     if (!len || len > end - sess->offset)
+         return TEE_ERROR_BAD_PARAMETERS;
+     /* CBC、ECB 每块都要是整块，CTR 可以从任意字节续上 */
+     if (sess->algo != TEE_ALG_AES_CTR && (len % TEE_AES_BLOCK_SIZE))
+         return TEE_ERROR_BAD_PARAMETERS;
+     last = sess->offset + len == end;
+ 
+     if (sess->offset < sess->total) {
+         n = MIN(len, sess->total - sess->offset);
+         res = decrypt_to_ocram(sess, src, n, last && n == len);
+         if (res)
+             goto err;
+         sess->offset += n;
+     }
+     if (n < len) {
+         res = crypto_cipher_update(sess->cipher, TEE_MODE_DECRYPT, last,
+                                    src + n, len - n,
+                                    sess->tail + sess->offset - sess->total);
+         if (res)
+             goto err;
+         sess->offset += len - n;
+     }
+ 
+     if (last) {
+         DMSG("Decrypted %zu bytes into OCRAM PA 0x%x", sess->total,
+              OCRAM_DEST_PA);
+         crypto_cipher_final(sess->cipher);
+         crypto_cipher_free_ctx(sess->cipher);
+         sess->cipher = NULL;
+         /* 认证加载等 DECRYPT_FINAL 取摘要和尾部 */
+         if (!sess->hash)
+             decrypt_abort(sess);
+     }
+     return TEE_SUCCESS;
+ err:
+     drop_unverified(sess);
+     decrypt_abort(sess);
+     return res;
+ }
+ 
+ /*
+  * pta_decrypt_final - 结束认证加载
+  * [out] memref0 OCRAM 明文的 SHA-256，memref1 尾部明文
+  */
+ static TEE_Result pta_decrypt_final(struct ocram_load_sess *sess,
+                                     uint32_t ptypes,
+                                     TEE_Param params[TEE_NUM_PARAMS])
+ {
+     TEE_Result res;
+ 
+     if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                         TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                         TEE_PARAM_TYPE_NONE,
+                         TEE_PARAM_TYPE_NONE) != ptypes)
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     if (!sess->hash || sess->cipher ||
+         sess->offset != sess->total + sess->tail_size)
+         return TEE_ERROR_BAD_STATE;
+     if (params[0].memref.size < TEE_SHA256_HASH_SIZE ||
+         params[1].memref.size < sess->tail_size) {
+         params[0].memref.size = TEE_SHA256_HASH_SIZE;
+         params[1].memref.size = sess->tail_size;
+         return TEE_ERROR_SHORT_BUFFER;
+     }
+ 
+     res = crypto_hash_final(sess->hash, params[0].memref.buffer,
+                             TEE_SHA256_HASH_SIZE);
+     if (!res) {
+         memcpy(params[1].memref.buffer, sess->tail, sess->tail_size);
+         params[0].memref.size = TEE_SHA256_HASH_SIZE;
+         params[1].memref.size = sess->tail_size;
+     } else {
+         drop_unverified(sess);
+     }
+     decrypt_abort(sess);
+     return res;
+ }
+ 
+ /* pta_wipe - 验签失败时清掉本会话最近一次加载写进 OCRAM 的明文 */
+ static TEE_Result pta_wipe(struct ocram_load_sess *sess, uint32_t ptypes)
+ {
+     if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+                         TEE_PARAM_TYPE_NONE,
+                         TEE_PARAM_TYPE_NONE,
+                         TEE_PARAM_TYPE_NONE) != ptypes)
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     decrypt_abort(sess);
+     return wipe_landed(sess);
+ }
+ 
+ static TEE_Result open_session(uint32_t ptypes __unused,
+                                TEE_Param params[TEE_NUM_PARAMS] __unused,
+                                void **psess)
+ {
+     struct ocram_load_sess *sess = calloc(1, sizeof(*sess));
+ 
+     if (!sess)
+         return TEE_ERROR_OUT_OF_MEMORY;
+     *psess = sess;
+     return TEE_SUCCESS;
+ }
+ 
+ static void close_session(void *psess)
+ {
+     drop_unverified(psess);
+     decrypt_abort(psess);
+     free(psess);
+ }
+ 
  /*
   * invoke_command - PTA命令分发
   */
- static TEE_Result invoke_command(void *psess __unused,
+ static TEE_Result invoke_command(void *psess,
                                   uint32_t cmd,
                                   uint32_t ptypes,
                                   TEE_Param params[TEE_NUM_PARAMS])
  {
-     if (cmd == OCRAM_LOAD_CMD)
+     switch (cmd) {
+     case OCRAM_LOAD_CMD:
          return pta_load_to_ocram(ptypes, params);
-     return TEE_ERROR_BAD_PARAMETERS;
+     case OCRAM_LOAD_CMD_DECRYPT_INIT:
+         return pta_decrypt_init(psess, ptypes, params);
+     case OCRAM_LOAD_CMD_DECRYPT_UPDATE:
+         return pta_decrypt_update(psess, ptypes, params);
+     case OCRAM_LOAD_CMD_DECRYPT_FINAL:
+         return pta_decrypt_final(psess, ptypes, params);
+     case OCRAM_LOAD_CMD_WIPE:
+         return pta_wipe(psess, ptypes);
+     default:
+         return TEE_ERROR_BAD_PARAMETERS;
+     }
  }
  
  /* 注册 PTA */
@@ -123,6 +452,7 @@
      .uuid = OCRAM_LOAD_UUID,
      .name = TA_NAME,
      .flags = PTA_DEFAULT_FLAGS,
+     .open_session_entry_point = open_session,
+     .close_session_entry_point = close_session,
      .invoke_command_entry_point = invoke_command
  );
- 
\ No newline at end of file
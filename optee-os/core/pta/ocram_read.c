@@ -2,127 +2,216 @@
 /*
  * ocram_read.pta
  *
- * A pseudo-TA that waits until a flag at physical 0x20490000 becomes 1,
- * then reads up to 128 bytes from OCRAM physical address 0x20484000
- * and returns it to a calling TA via MEMREF_OUTPUT.
- * Performs cache maintenance to ensure data visibility on Cortex-M33.
+ * A pseudo-TA that copies inference outputs from OCRAM to a calling TA
+ * via MEMREF_OUTPUT, after the M33 reports completion on its completion
+ * ring (drivers/replay_done.h).
+ *
+ * OCRAM_READ_CMD 读一次推理的输出：M33 报告的输出区，没报告时从
+ * 0x20484000 读 memref 那么大。OCRAM_READ_CMD_READV 按调用方给的
+ * (offset, size) 列表读多段输出，依次紧挨着拷进输出 memref。
+ * 两个命令都只作废要读的区间，每段只拷一次，直接写进调用方的
+ * 共享内存，没有大小上限；只能读 M33 的 OCRAM（完成环以下）。
  */
 
  #include <compiler.h>
+ #include <drivers/replay.h>
+ #include <drivers/replay_done.h>
  #include <kernel/pseudo_ta.h>
  #include <mm/core_memprot.h>
  #include <trace.h>
  #include <tee_api_types.h>        /* TEE_Param, TEE_Result, etc. */
  #include <kernel/cache_helpers.h> /* dcache_* APIs */
  #include <string.h>               /* memcpy */
- 
+ #include <util.h>
+
  #define TA_NAME           "ocram_read.pta"
  #define OCRAM_READ_UUID   \
      { 0xfa152bfd, 0x7c9e, 0x4c33, \
        { 0xb8, 0xac, 0x7f, 0x5c, 0x2b, 0x64, 0x49, 0x92 } }
- 
- /* Command ID: read from OCRAM once flag is set */
- #define OCRAM_READ_CMD    0
- 
+
+ /* Command ID: read from OCRAM once the M33 reports completion */
+ #define OCRAM_READ_CMD        0
+ /* Command ID: read a list of OCRAM ranges */
+ #define OCRAM_READ_CMD_READV  1
+
+ /* OCRAM_READ_CMD_READV value2.a：先等下一条完成记录再读 */
+ #define OCRAM_READ_WAIT       BIT32(0)
+
+ /* 等 M33 完成的上限，包括 remoteproc 启动 M33 的时间 */
+ #define OCRAM_READ_TIMEOUT_MS 10000
+
+ /* 没有报告输出区时的默认输出地址 */
+ #define OCRAM_READ_DEFAULT_PA 0x20484000
+
+ /* 可读的窗口：M33 的 OCRAM，到完成环为止 */
+ #define OCRAM_READ_WIN_BASE   REPLAY_OCRAM_BASE
+ #define OCRAM_READ_WIN_SIZE   (REPLAY_DONE_PA - REPLAY_OCRAM_BASE)
+
+ /* READV 一次最多的区间数 */
+ #define OCRAM_READ_MAX_RANGES 64
+
+ /* READV 的区间，offset 相对 OCRAM 起始地址 0x20480000 */
+ struct ocram_read_range {
+     uint32_t offset;
+     uint32_t size;
+ };
+
+ /* 区间全部落在可读窗口里，返回总字节数，不合法返回 0 */
+ static size_t ranges_total(const struct ocram_read_range *r, size_t n)
+ {
+     size_t total = 0;
+
+     for (size_t i = 0; i < n; i++) {
+         if (!r[i].size || r[i].size > OCRAM_READ_WIN_SIZE ||
+             r[i].offset > OCRAM_READ_WIN_SIZE - r[i].size)
+             return 0;
+         if (ADD_OVERFLOW(total, r[i].size, &total))
+             return 0;
+     }
+     return total;
+ }
+
+ /* 作废每个区间的 D-Cache，再拷到 dst，dst 至少有 ranges_total() 字节 */
+ static TEE_Result copy_ranges(const struct ocram_read_range *r, size_t n,
+                               uint8_t *dst)
+ {
+     for (size_t i = 0; i < n; i++) {
+         void *va = phys_to_virt(OCRAM_READ_WIN_BASE + r[i].offset,
+                                 MEM_AREA_RAM_SEC, r[i].size);
+
+         if (!va)
+             return TEE_ERROR_GENERIC;
+         dcache_inv_range(va, r[i].size);
+         memcpy(dst, va, r[i].size);
+         dst += r[i].size;
+     }
+     return TEE_SUCCESS;
+ }
+
+ /* 等 M33 的下一条完成记录，推理失败也当错误返回 */
+ static TEE_Result wait_done(struct replay_done *done)
+ {
+     TEE_Result res;
+
+     res = replay_done_wait(done, OCRAM_READ_TIMEOUT_MS);
+     if (res) {
+         EMSG("No completion from the M33: 0x%" PRIx32, res);
+         return res;
+     }
+     if (done->status) {
+         EMSG("Inference %" PRIu32 " failed: %" PRId32, done->seq,
+              done->status);
+         return TEE_ERROR_GENERIC;
+     }
+     return TEE_SUCCESS;
+ }
+
+ /*
+  * 读一次推理的输出
+  * [out] memref0 输出；M33 报告了输出区时要放得下整个输出区
+  */
  static TEE_Result pta_read_from_ocram(uint32_t ptypes,
                                        TEE_Param params[TEE_NUM_PARAMS])
  {
-     const paddr_t flag_pa = 0x20490000; /* 循环等待的标志位 */
-     const paddr_t src_pa  = 0x20484000; /* OCRAM 数据起始地址 */
-     void *flag_va = NULL;
-     void *src_va  = NULL;
-     uint32_t req_size = params[0].memref.size;
-     const uint32_t MAX_READ = 1024;
- 
-     DMSG("pta_read_from_ocram called, ptypes=0x%" PRIx32, ptypes);
- 
-     /* 参数类型必须是单输出 MEMREF */
+     struct replay_done done = { };
+     struct ocram_read_range r = { };
+     TEE_Result res;
+
      if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_OUTPUT,
                          TEE_PARAM_TYPE_NONE,
                          TEE_PARAM_TYPE_NONE,
-                         TEE_PARAM_TYPE_NONE) != ptypes) {
-         EMSG("Invalid parameter types, expected MEMREF_OUTPUT");
+                         TEE_PARAM_TYPE_NONE) != ptypes)
          return TEE_ERROR_BAD_PARAMETERS;
+
+     res = wait_done(&done);
+     if (res)
+         return res;
+
+     if (done.out_size) {
+         r.offset = done.out_pa - OCRAM_READ_WIN_BASE;
+         r.size = done.out_size;
+     } else {
+         r.offset = OCRAM_READ_DEFAULT_PA - OCRAM_READ_WIN_BASE;
+         r.size = params[0].memref.size;
      }
- 
-     /* 大小检查 */
-     if (req_size == 0 || req_size > MAX_READ) {
-         EMSG("Requested read size %u invalid (max %u)", req_size, MAX_READ);
+     if (!ranges_total(&r, 1))
          return TEE_ERROR_BAD_PARAMETERS;
+     if (params[0].memref.size < r.size) {
+         params[0].memref.size = r.size;
+         return TEE_ERROR_SHORT_BUFFER;
      }
- 
-     /* 1) 映射并循环等待 flag 变为 1 */
-     flag_va = phys_to_virt(flag_pa, MEM_AREA_RAM_SEC, 1);
-     if (!flag_va) {
-         EMSG("Failed to map flag PA 0x%" PRIxPA, flag_pa);
-         return TEE_ERROR_GENERIC;
-     }
- 
-     DMSG("Waiting for flag at PA 0x%" PRIxPA, flag_pa);
-     while (true) {
-         dcache_inv_range(flag_va, 1);
-         if (*(volatile uint8_t *)flag_va == 1)
-             break;
+
+     res = copy_ranges(&r, 1, params[0].memref.buffer);
+     if (!res)
+         params[0].memref.size = r.size;
+     return res;
+ }
+
+ /*
+  * 按区间列表读 OCRAM
+  * [in]    memref0 struct ocram_read_range[]
+  * [out]   memref1 各区间依次紧挨着的数据
+  * [inout] value2  in: a = OCRAM_READ_WAIT 时先等下一条完成记录；
+  *                 out: a = 那条记录的序号
+  */
+ static TEE_Result pta_readv_from_ocram(uint32_t ptypes,
+                                        TEE_Param params[TEE_NUM_PARAMS])
+ {
+     struct ocram_read_range r[OCRAM_READ_MAX_RANGES];
+     struct replay_done done = { };
+     size_t n = params[0].memref.size / sizeof(r[0]);
+     size_t total;
+     TEE_Result res;
+
+     if (TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                         TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                         TEE_PARAM_TYPE_VALUE_INOUT,
+                         TEE_PARAM_TYPE_NONE) != ptypes)
+         return TEE_ERROR_BAD_PARAMETERS;
+     if (!n || n > ARRAY_SIZE(r) ||
+         params[0].memref.size % sizeof(r[0]))
+         return TEE_ERROR_BAD_PARAMETERS;
+
+     /* 区间先拷进来，校验之后调用方不能再改 */
+     memcpy(r, params[0].memref.buffer, n * sizeof(r[0]));
+     total = ranges_total(r, n);
+     if (!total)
+         return TEE_ERROR_BAD_PARAMETERS;
+     if (params[1].memref.size < total) {
+         params[1].memref.size = total;
+         return TEE_ERROR_SHORT_BUFFER;
      }
-     DMSG("Flag is set, proceed to read OCRAM");
- 
-     /* 2) 映射 OCRAM 数据区 */
-     src_va = phys_to_virt(src_pa, MEM_AREA_RAM_SEC, MAX_READ);
-     if (!src_va) {
-         EMSG("Failed to map OCRAM PA 0x%" PRIxPA, src_pa);
-         return TEE_ERROR_GENERIC;
+
+     if (params[2].value.a & OCRAM_READ_WAIT) {
+         res = wait_done(&done);
+         if (res)
+             return res;
      }
- 
-     /* 3) Invalidate D-Cache，保证写入的数据是最新的 */
-     dcache_inv_range(src_va, req_size);
-     DMSG("Invalidated D-Cache for OCRAM VA 0x%" PRIxVA " size %u",
-          (uintptr_t)src_va, req_size);
- 
-     /* 4) 拷贝数据到输出缓冲区 */
-  /*   memcpy(params[0].memref.buffer, src_va, req_size);
-     DMSG("Copied %u bytes from OCRAM PA 0x%" PRIxPA " to output buffer",
-          req_size, src_pa);
-          */
-
-    /* 4) 每 16 字节一行打印 */
-    uint32_t i, j;
-    char line[16 * 3 + 1];
-    int len;
-    const char hex[] = "0123456789abcdef";
-    for (i = 0; i < req_size; i += 16) {
-        len = 0;
-        /* 拼接本行最多 16 个字节的 hex */
-        for (j = 0; j < 16 && i + j < req_size; j++) {
-            uint8_t v = *(volatile uint8_t *)((uintptr_t)src_va + i + j);
-            /* 高 4 位 */
-            line[len++] = hex[v >> 4];
-            /* 低 4 位 */
-            line[len++] = hex[v & 0xF];
-            /* 空格分隔 */
-            line[len++] = ' ';
-        }
-        line[len] = '\0';
-        DMSG("OCRAM[PA 0x%" PRIxPA " + %03u..%03u]: %s",
-             src_pa, i, i + j - 1, line);
-    }
-
-
- 
+
+     res = copy_ranges(r, n, params[1].memref.buffer);
+     if (res)
+         return res;
+     params[1].memref.size = total;
+     params[2].value.a = done.seq;
      return TEE_SUCCESS;
  }
- 
+
  static TEE_Result invoke_command(void *psess __unused,
                                   uint32_t cmd,
                                   uint32_t ptypes,
                                   TEE_Param params[TEE_NUM_PARAMS])
  {
-     if (cmd == OCRAM_READ_CMD)
+     switch (cmd) {
+     case OCRAM_READ_CMD:
          return pta_read_from_ocram(ptypes, params);
-     return TEE_ERROR_BAD_PARAMETERS;
+     case OCRAM_READ_CMD_READV:
+         return pta_readv_from_ocram(ptypes, params);
+     default:
+         return TEE_ERROR_BAD_PARAMETERS;
+     }
  }
- 
+
  pseudo_ta_register(.uuid = OCRAM_READ_UUID,
                     .name = TA_NAME,
                     .flags = PTA_DEFAULT_FLAGS,
                     .invoke_command_entry_point = invoke_command);
- 
\ No newline at end of file
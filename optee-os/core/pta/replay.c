@@ -4,7 +4,10 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 #include <kernel/pseudo_ta.h>
+#include <malloc.h>
+#include <string.h>
 #include <trace.h>
+#include <util.h>
 #include <tee_api_types.h>
 #include <drivers/replay.h>  /* replay_driver_init + replay_* 三大接口 */
 
@@ -12,10 +15,51 @@
     { 0xbdf42668, 0x3cf8, 0x45a3, \
       { 0x81, 0x6e, 0x76, 0x86, 0x1c, 0xb0, 0x27, 0x47 } }
 #define REPLAY_CMD_RUN 0
+/*
+ * 执行 rrtrace.py program 生成的重放程序
+ * [in] memref[0]: 程序镜像
+ * [in] value[1].a: 可选，模型内存段在 OCRAM 中的物理地址，0 表示按录制时的地址
+ */
+#define REPLAY_CMD_RUN_PROGRAM 1
+/*
+ * 把重放程序的一块写进模型缓存，见 replay_cache_load()
+ * [in] memref[0]: 模型摘要，镜像的 SHA-256
+ * [in] value[1].a: 镜像总字节数
+ * [in] value[1].b: 这一块在镜像中的偏移
+ * [in] memref[2]: 这一块数据
+ */
+#define REPLAY_CMD_CACHE_LOAD 2
+/*
+ * 执行缓存里的模型，不在缓存里返回 TEE_ERROR_ITEM_NOT_FOUND
+ * [in] memref[0]: 模型摘要
+ */
+#define REPLAY_CMD_CACHE_RUN 3
+/*
+ * 同一会话内的批量推理：第一批复位、初始化 NPU，之后每个输入只重放启动和
+ * 中断应答，见 replay_run_batch()
+ * [in]  value[0].a: 输入槽的物理地址，value[0].b: 每个输入的字节数
+ * [in]  value[1].a: 输出的物理地址，value[1].b: 每个输出的字节数
+ * [in]  memref[2]: N 个输入，首尾相接
+ * [out] memref[3]: N 个输出，首尾相接
+ */
+#define REPLAY_CMD_RUN_BATCH 4
+/*
+ * 读各阶段的耗时统计（次数、最小、平均、最大、p99，单位 ns），
+ * 见 replay_get_phase_stats()
+ * [in]  value[0].a: 非零时读完清零
+ * [out] memref[1]: struct replay_phase_stats[REPLAY_PHASE_COUNT]
+ */
+#define REPLAY_CMD_GET_STATS 5
+
+/* 会话上下文：它的地址就是驱动里批量推理的 owner */
+struct replay_session {
+    unsigned int batches;
+};
 
 static TEE_Result run_replay(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
 {
     struct replay_data rd;
+    TEE_Result res;
 
     if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
                                   TEE_PARAM_TYPE_NONE,
@@ -29,27 +73,234 @@ static TEE_Result run_replay(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
         return TEE_ERROR_GENERIC;
     }
 
-    /* 2) 三大阶段依次执行 */
-    replay_initialization_verification(&rd);
+    /* 2) 模板按录制时的地址写 OCRAM，会覆盖缓存的模型 */
+    replay_cache_flush();
+
+    /* 3) 三大阶段依次执行，NPU 复位或推理超时直接返回错误 */
+    res = replay_initialization_verification(&rd);
+    if (res)
+        return res;
     replay_inference(&rd);
-    replay_handle_interrupt(&rd);
+    return replay_handle_interrupt(&rd);
+}
+
+static TEE_Result run_program(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
+{
+    struct replay_data rd;
+    TEE_Result res;
+    uint32_t base = 0;
+    void *image;
+    size_t size;
+
+    if (ptypes == TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_VALUE_INPUT,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE))
+        base = params[1].value.a;
+    else if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                       TEE_PARAM_TYPE_NONE,
+                                       TEE_PARAM_TYPE_NONE,
+                                       TEE_PARAM_TYPE_NONE))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    size = params[0].memref.size;
+    if (!params[0].memref.buffer || !size)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    /* 先拷到安全内存：校验之后调用方不能再改程序，重定位也在这份拷贝上做 */
+    image = malloc(size);
+    if (!image)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    memcpy(image, params[0].memref.buffer, size);
+
+    if (replay_driver_init(&rd) < 0) {
+        EMSG("replay: replay_driver_init() failed");
+        res = TEE_ERROR_GENERIC;
+    } else {
+        res = replay_run_program(&rd, image, size, base);
+    }
+
+    free(image);
+    return res;
+}
+
+/* 摘要拷到本地，调用方改不了正在比较的值 */
+static TEE_Result get_digest(const TEE_Param *p,
+                             uint8_t digest[REPLAY_DIGEST_SIZE])
+{
+    if (!p->memref.buffer || p->memref.size != REPLAY_DIGEST_SIZE)
+        return TEE_ERROR_BAD_PARAMETERS;
+    memcpy(digest, p->memref.buffer, REPLAY_DIGEST_SIZE);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result cache_load(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
+{
+    uint8_t digest[REPLAY_DIGEST_SIZE];
+    struct replay_data rd;
+    TEE_Result res;
+
+    if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_VALUE_INPUT,
+                                  TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_NONE))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = get_digest(&params[0], digest);
+    if (res)
+        return res;
+    if (!params[2].memref.buffer)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (replay_driver_init(&rd) < 0) {
+        EMSG("replay: replay_driver_init() failed");
+        return TEE_ERROR_GENERIC;
+    }
+    return replay_cache_load(&rd, digest, params[1].value.a,
+                             params[1].value.b, params[2].memref.buffer,
+                             params[2].memref.size);
+}
+
+static TEE_Result cache_run(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
+{
+    uint8_t digest[REPLAY_DIGEST_SIZE];
+    struct replay_data rd;
+    TEE_Result res;
+
+    if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    res = get_digest(&params[0], digest);
+    if (res)
+        return res;
+
+    if (replay_driver_init(&rd) < 0) {
+        EMSG("replay: replay_driver_init() failed");
+        return TEE_ERROR_GENERIC;
+    }
+    return replay_cache_run(&rd, digest);
+}
+
+static TEE_Result run_batch(struct replay_session *sess, uint32_t ptypes,
+                            TEE_Param params[TEE_NUM_PARAMS])
+{
+    struct replay_batch b = { };
+    struct replay_data rd;
+    size_t out_size;
+    TEE_Result res;
+
+    if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+                                  TEE_PARAM_TYPE_VALUE_INPUT,
+                                  TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_MEMREF_OUTPUT))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    b.in_pa = params[0].value.a;
+    b.in_size = params[0].value.b;
+    b.out_pa = params[1].value.a;
+    b.out_size = params[1].value.b;
+    if (!b.in_size || !params[2].memref.buffer ||
+        params[2].memref.size % b.in_size ||
+        params[2].memref.size / b.in_size > UINT32_MAX)
+        return TEE_ERROR_BAD_PARAMETERS;
+    b.count = params[2].memref.size / b.in_size;
+
+    if (MUL_OVERFLOW((size_t)b.count, (size_t)b.out_size, &out_size))
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[3].memref.size < out_size) {
+        params[3].memref.size = out_size;
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    b.in = params[2].memref.buffer;
+    b.out = params[3].memref.buffer;
+
+    if (replay_driver_init(&rd) < 0) {
+        EMSG("replay: replay_driver_init() failed");
+        return TEE_ERROR_GENERIC;
+    }
+    res = replay_run_batch(&rd, sess, &b);
+    if (!res) {
+        params[3].memref.size = out_size;
+        sess->batches++;
+    }
+    return res;
+}
+
+static TEE_Result get_stats(uint32_t ptypes, TEE_Param params[TEE_NUM_PARAMS])
+{
+    struct replay_phase_stats st[REPLAY_PHASE_COUNT];
 
+    if (ptypes != TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+                                  TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE))
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (params[1].memref.size < sizeof(st)) {
+        params[1].memref.size = sizeof(st);
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+    if (!params[1].memref.buffer)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    replay_get_phase_stats(st, params[0].value.a);
+    memcpy(params[1].memref.buffer, st, sizeof(st));
+    params[1].memref.size = sizeof(st);
+    return TEE_SUCCESS;
+}
+
+static TEE_Result open_session(uint32_t ptypes __unused,
+                               TEE_Param params[TEE_NUM_PARAMS] __unused,
+                               void **psess)
+{
+    struct replay_session *sess = calloc(1, sizeof(*sess));
+
+    if (!sess)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    *psess = sess;
     return TEE_SUCCESS;
 }
 
-static TEE_Result invoke_command(void *psess __unused,
+static void close_session(void *psess)
+{
+    struct replay_session *sess = psess;
+
+    DMSG("replay: session closed after %u batches", sess->batches);
+    replay_batch_release(sess);
+    free(sess);
+}
+
+static TEE_Result invoke_command(void *psess,
                                  uint32_t cmd,
                                  uint32_t ptypes,
                                  TEE_Param params[TEE_NUM_PARAMS])
 {
-    if (cmd == REPLAY_CMD_RUN)
+    switch (cmd) {
+    case REPLAY_CMD_RUN:
         return run_replay(ptypes, params);
-    return TEE_ERROR_BAD_PARAMETERS;
+    case REPLAY_CMD_RUN_PROGRAM:
+        return run_program(ptypes, params);
+    case REPLAY_CMD_CACHE_LOAD:
+        return cache_load(ptypes, params);
+    case REPLAY_CMD_CACHE_RUN:
+        return cache_run(ptypes, params);
+    case REPLAY_CMD_RUN_BATCH:
+        return run_batch(psess, ptypes, params);
+    case REPLAY_CMD_GET_STATS:
+        return get_stats(ptypes, params);
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
 }
 
 pseudo_ta_register(
     .uuid = REPLAY_UUID,
     .name = "replay.pta",
     .flags = PTA_DEFAULT_FLAGS,
+    .open_session_entry_point = open_session,
+    .close_session_entry_point = close_session,
     .invoke_command_entry_point = invoke_command
 );
@@ -17,36 +17,89 @@
  #include <inttypes.h>
  #include <tee_client_api.h>
  #include "ocram_load_ta.h"
- 
+
 
 #define FILENAME                   "model_data.bin"
 #define INPUT_FILE                 "input_data.bin"
 #define SIGNATURE_FILE             "signature.bin"
 #define OUTPUT_MAKE_FILE           "input_data_signed_encrypted.bin"
 #define ENCRYPTED_INPUT_FILE       "input_data_signed_encrypted.bin"
+#define OUTPUT_FILE                "output_data.bin"
  #define READ_SIZE                  1024
- #define AES_TEST_BUFFER_SIZE       4096
  #define AES_TEST_KEY_SIZE          16
  #define AES_BLOCK_SIZE             16
  #define DECODE                     0
  #define ENCODE                     1
  #define DIGEST_SIZE                32
- 
- /* Utility to read entire file into buffer */
- static void *read_file(const char *fname, size_t *sz_out) {
+ #define SIG_MAX_SIZE               512
+ #define READV_MAX_RANGES           64
+ /* 每次调用传的字节数，AES 块的整数倍；OCRAM 640K 三块就够 */
+ #define SHM_CHUNK_SIZE             (256 * 1024)
+
+ /*
+  * 共享内存池：启动时 TEEC_AllocateSharedMemory 一次，之后每次调用
+  * 都用 MEMREF_PARTIAL 引用，不再为每次 invoke 分配、拷贝临时缓冲。
+  * IN/OUT 放大块数据，AUX 放密钥、IV、摘要和签名
+  */
+ enum { SHM_IN, SHM_OUT, SHM_AUX, SHM_POOL_NUM };
+ #define AUX_KEY_OFF                0
+ #define AUX_IV_OFF                 32
+ #define AUX_DIGEST_OFF             64
+ #define AUX_SIG_OFF                128
+ #define AUX_SIZE                   (AUX_SIG_OFF + SIG_MAX_SIZE)
+
+ static TEEC_Context *shm_ctx;
+ static TEEC_SharedMemory shm_pool[SHM_POOL_NUM];
+
+ /* 保证池里 idx 号缓冲至少 sz 字节，不够时换一块更大的 */
+ static uint8_t *shm_reserve(int idx, size_t sz) {
+     TEEC_SharedMemory *shm = &shm_pool[idx];
+     if (shm->buffer && shm->size >= sz)
+         return shm->buffer;
+     if (shm->buffer)
+         TEEC_ReleaseSharedMemory(shm);
+     memset(shm, 0, sizeof(*shm));
+     shm->size  = sz;
+     shm->flags = TEEC_MEM_INPUT | TEEC_MEM_OUTPUT;
+     TEEC_Result res = TEEC_AllocateSharedMemory(shm_ctx, shm);
+     if (res != TEEC_SUCCESS)
+         errx(1, "TEEC_AllocateSharedMemory %zu failed: 0x%x", sz, res);
+     return shm->buffer;
+ }
+
+ static void shm_pool_init(TEEC_Context *ctx) {
+     shm_ctx = ctx;
+     shm_reserve(SHM_IN,  SHM_CHUNK_SIZE);
+     shm_reserve(SHM_OUT, SHM_CHUNK_SIZE);
+     shm_reserve(SHM_AUX, AUX_SIZE);
+ }
+
+ static void shm_pool_free(void) {
+     for (int i = 0; i < SHM_POOL_NUM; i++)
+         if (shm_pool[i].buffer)
+             TEEC_ReleaseSharedMemory(&shm_pool[i]);
+ }
+
+ /* op 的第 n 个参数引用池里 idx 号缓冲的 [off, off + sz) */
+ static void shm_ref(TEEC_Operation *op, int n, int idx, size_t off, size_t sz) {
+     op->params[n].memref.parent = &shm_pool[idx];
+     op->params[n].memref.offset = off;
+     op->params[n].memref.size   = sz;
+ }
+
+ /* 整个文件读进池里 idx 号缓冲，后面留 spare 字节 */
+ static size_t read_file_shm(const char *fname, int idx, size_t spare) {
      FILE *f = fopen(fname, "rb");
      if (!f) errx(1, "Failed to open %s", fname);
      fseek(f, 0, SEEK_END);
      size_t sz = ftell(f);
      rewind(f);
-     void *buf = malloc(sz);
-     if (!buf) errx(1, "malloc %zu failed", sz);
+     uint8_t *buf = shm_reserve(idx, sz + spare);
      if (fread(buf, 1, sz, f) != sz) errx(1, "fread %s failed", fname);
      fclose(f);
-     *sz_out = sz;
-     return buf;
+     return sz;
  }
- 
+
  /* Utility to write buffer to file */
  static void write_file(const char *fname, const void *buf, size_t sz) {
      FILE *f = fopen(fname, "wb");
@@ -54,7 +107,7 @@
      if (fwrite(buf, 1, sz, f) != sz) errx(1, "fwrite %s failed", fname);
      fclose(f);
  }
- 
+
  /* AES helpers */
  static void prepare_aes(TEEC_Session *sess, int encode) {
      TEEC_Operation op = {0}; uint32_t origin;
@@ -71,10 +124,10 @@
  static void set_key(TEEC_Session *sess, char *key, size_t key_sz) {
      TEEC_Operation op = {0}; uint32_t origin;
      op.paramTypes = TEEC_PARAM_TYPES(
-         TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+         TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE,
          TEEC_NONE, TEEC_NONE);
-     op.params[0].tmpref.buffer = key;
-     op.params[0].tmpref.size   = key_sz;
+     memcpy((uint8_t *)shm_pool[SHM_AUX].buffer + AUX_KEY_OFF, key, key_sz);
+     shm_ref(&op, 0, SHM_AUX, AUX_KEY_OFF, key_sz);
      TEEC_Result res = TEEC_InvokeCommand(sess, TA_AES_CMD_SET_KEY, &op, &origin);
      if (res != TEEC_SUCCESS)
          errx(1, "AES SET_KEY failed: 0x%x origin 0x%x", res, origin);
@@ -82,163 +135,252 @@
  static void set_iv(TEEC_Session *sess, char *iv, size_t iv_sz) {
      TEEC_Operation op = {0}; uint32_t origin;
      op.paramTypes = TEEC_PARAM_TYPES(
-         TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
+         TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE,
          TEEC_NONE, TEEC_NONE);
-     op.params[0].tmpref.buffer = iv;
-     op.params[0].tmpref.size   = iv_sz;
+     memcpy((uint8_t *)shm_pool[SHM_AUX].buffer + AUX_IV_OFF, iv, iv_sz);
+     shm_ref(&op, 0, SHM_AUX, AUX_IV_OFF, iv_sz);
      TEEC_Result res = TEEC_InvokeCommand(sess, TA_AES_CMD_SET_IV, &op, &origin);
      if (res != TEEC_SUCCESS)
          errx(1, "AES SET_IV failed: 0x%x origin 0x%x", res, origin);
  }
- static void cipher_buffer(TEEC_Session *sess, void *in, void *out, size_t sz) {
+ /* IN 缓冲 in_off 处 sz 字节加/解密到 OUT 缓冲开头，sz 不超过 SHM_CHUNK_SIZE */
+ static void cipher_chunk(TEEC_Session *sess, size_t in_off, size_t sz) {
      TEEC_Operation op = {0}; uint32_t origin;
      op.paramTypes = TEEC_PARAM_TYPES(
-         TEEC_MEMREF_TEMP_INPUT,
-         TEEC_MEMREF_TEMP_OUTPUT,
+         TEEC_MEMREF_PARTIAL_INPUT,
+         TEEC_MEMREF_PARTIAL_OUTPUT,
          TEEC_NONE, TEEC_NONE);
-     op.params[0].tmpref.buffer = in;
-     op.params[0].tmpref.size   = sz;
-     op.params[1].tmpref.buffer = out;
-     op.params[1].tmpref.size   = sz;
+     shm_ref(&op, 0, SHM_IN,  in_off, sz);
+     shm_ref(&op, 1, SHM_OUT, 0, sz);
      TEEC_Result res = TEEC_InvokeCommand(sess, TA_AES_CMD_CIPHER, &op, &origin);
      if (res != TEEC_SUCCESS)
          errx(1, "AES CIPHER failed: 0x%x origin 0x%x", res, origin);
  }
- 
+
+ /* IN 缓冲开头 sz 字节的 SHA-256 写到 AUX 的摘要位置 */
+ static void digest_in(TEEC_Session *sess, size_t sz) {
+     TEEC_Operation op = {0}; uint32_t origin;
+     op.paramTypes = TEEC_PARAM_TYPES(
+         TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+         TEEC_NONE, TEEC_NONE);
+     shm_ref(&op, 0, SHM_IN,  0, sz);
+     shm_ref(&op, 1, SHM_AUX, AUX_DIGEST_OFF, DIGEST_SIZE);
+     TEEC_Result res = TEEC_InvokeCommand(sess, TA_ACIPHER_CMD_DIGEST, &op, &origin);
+     if (res != TEEC_SUCCESS)
+         errx(1, "DIGEST failed: 0x%x origin 0x%x", res, origin);
+ }
+
+ /* 签 AUX 里的摘要，签名写到 idx 号缓冲 off 处，返回签名字节数 */
+ static size_t sign_digest(TEEC_Session *sess, int idx, size_t off) {
+     TEEC_Operation op = {0}; uint32_t origin;
+     op.paramTypes = TEEC_PARAM_TYPES(
+         TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+         TEEC_NONE, TEEC_NONE);
+     shm_ref(&op, 0, SHM_AUX, AUX_DIGEST_OFF, DIGEST_SIZE);
+     shm_ref(&op, 1, idx, off, SIG_MAX_SIZE);
+     TEEC_Result res = TEEC_InvokeCommand(sess, TA_ACIPHER_CMD_SIGN, &op, &origin);
+     if (res != TEEC_SUCCESS)
+         errx(1, "SIGN failed: 0x%x origin 0x%x", res, origin);
+     return op.params[1].memref.size;
+ }
+
+ /*
+  * 文件按 SHM_CHUNK_SIZE 读进 IN 缓冲，一块一块交给 TA 的 cmd（LOAD 或
+  * LOAD_VERIFIED）。调用前要设好密钥和 IV，返回密文总字节数
+  */
+ static size_t stream_load(TEEC_Session *sess, const char *fname, uint32_t cmd) {
+     FILE *f = fopen(fname, "rb");
+     if (!f) errx(1, "Failed to open %s", fname);
+     fseek(f, 0, SEEK_END);
+     size_t sz = ftell(f);
+     rewind(f);
+
+     for (size_t off = 0; off < sz; ) {
+         size_t len = fread(shm_pool[SHM_IN].buffer, 1, SHM_CHUNK_SIZE, f);
+         if (!len) errx(1, "fread %s failed", fname);
+         TEEC_Operation op = {0}; uint32_t origin;
+         op.paramTypes = TEEC_PARAM_TYPES(
+             TEEC_MEMREF_PARTIAL_INPUT, TEEC_VALUE_INPUT,
+             TEEC_NONE, TEEC_NONE);
+         shm_ref(&op, 0, SHM_IN, 0, len);
+         op.params[1].value.a = off;
+         op.params[1].value.b = sz;
+         TEEC_Result res = TEEC_InvokeCommand(sess, cmd, &op, &origin);
+         if (res == TEEC_ERROR_SIGNATURE_INVALID)
+             errx(1, "Invalid signature");
+         if (res != TEEC_SUCCESS)
+             errx(1, "OCRAM LOAD failed at %zu: 0x%x origin 0x%x", off, res, origin);
+         off += len;
+     }
+     fclose(f);
+     return sz;
+ }
+
  /* Simple AES file processor */
  static void process_aes_file(const char *infile,
                               const char *outfile,
                               int encode,
-                              TEEC_Context *ctx,
                               TEEC_Session *sess) {
      FILE *fin  = fopen(infile,  "rb");
      FILE *fout = fopen(outfile, "wb");
      if (!fin || !fout) errx(1, "Failed to open files");
- 
+
      char key[AES_TEST_KEY_SIZE];
      char iv[AES_BLOCK_SIZE];
-     char inbuf[AES_TEST_BUFFER_SIZE];
-     char outbuf[AES_TEST_BUFFER_SIZE];
      size_t r;
- 
+
      memset(key, 0xa5, sizeof(key));
      memset(iv,  0x00, sizeof(iv));
- 
+
      prepare_aes(sess, encode);
      set_key(sess, key, sizeof(key));
      set_iv(sess, iv, sizeof(iv));
- 
-     while ((r = fread(inbuf, 1, sizeof(inbuf), fin)) > 0) {
-         cipher_buffer(sess, inbuf, outbuf, r);
-         fwrite(outbuf, 1, r, fout);
+
+     while ((r = fread(shm_pool[SHM_IN].buffer, 1, SHM_CHUNK_SIZE, fin)) > 0) {
+         cipher_chunk(sess, 0, r);
+         fwrite(shm_pool[SHM_OUT].buffer, 1, r, fout);
      }
      fclose(fin);
      fclose(fout);
  }
- 
+
  /* Sign-then-encrypt for 'make' */
  static void make_signed_encrypted(const char *infile,
                                    const char *outfile,
                                    TEEC_Session *sess) {
-     size_t data_sz;
-     uint8_t *data = read_file(infile, &data_sz);
- 
+     /* 签名直接写在 IN 缓冲里数据的后面，拼起来就是要加密的明文 */
+     size_t data_sz = read_file_shm(infile, SHM_IN, SIG_MAX_SIZE);
+
      TEEC_Operation op = {0}; uint32_t eo;
      size_t key_size = 2048;
      op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
      op.params[0].value.a = (uint32_t)key_size;
      if (TEEC_InvokeCommand(sess, TA_ACIPHER_CMD_GEN_KEY, &op, &eo) != TEEC_SUCCESS)
          errx(1, "GEN_KEY failed");
- 
-     uint8_t digest[DIGEST_SIZE];
-     op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE);
-     op.params[0].tmpref.buffer = data;
-     op.params[0].tmpref.size   = data_sz;
-     op.params[1].tmpref.buffer = digest;
-     op.params[1].tmpref.size   = DIGEST_SIZE;
-     if (TEEC_InvokeCommand(sess, TA_ACIPHER_CMD_DIGEST, &op, &eo) != TEEC_SUCCESS)
-         errx(1, "DIGEST failed");
- 
-     size_t sig_sz = key_size/8;
-     uint8_t *sig = malloc(sig_sz);
-     op.params[0].tmpref.buffer = digest;
-     op.params[0].tmpref.size   = DIGEST_SIZE;
-     op.params[1].tmpref.buffer = sig;
-     op.params[1].tmpref.size   = sig_sz;
-     if (TEEC_InvokeCommand(sess, TA_ACIPHER_CMD_SIGN, &op, &eo) != TEEC_SUCCESS)
-         errx(1, "SIGN failed");
-     sig_sz = op.params[1].tmpref.size;
- 
+
+     digest_in(sess, data_sz);
+     size_t sig_sz = sign_digest(sess, SHM_IN, data_sz);
      size_t combined_sz = data_sz + sig_sz;
-     uint8_t *combined = malloc(combined_sz);
-     memcpy(combined, data, data_sz);
-     memcpy(combined + data_sz, sig, sig_sz);
-     free(data);
-     free(sig);
- 
+
      char key[AES_TEST_KEY_SIZE], iv[AES_BLOCK_SIZE];
      memset(key, 0xa5, sizeof(key));
      memset(iv,  0x00, sizeof(iv));
      prepare_aes(sess, ENCODE);
      set_key(sess, key, sizeof(key));
      set_iv(sess, iv, sizeof(iv));
- 
-     uint8_t *outbuf = malloc(combined_sz);
-     cipher_buffer(sess, combined, outbuf, combined_sz);
-     write_file(outfile, outbuf, combined_sz);
-     free(combined);
-     free(outbuf);
+
+     FILE *fout = fopen(outfile, "wb");
+     if (!fout) errx(1, "Failed to open %s for write", outfile);
+     for (size_t off = 0; off < combined_sz; off += SHM_CHUNK_SIZE) {
+         size_t len = combined_sz - off < SHM_CHUNK_SIZE ?
+                      combined_sz - off : SHM_CHUNK_SIZE;
+         cipher_chunk(sess, off, len);
+         if (fwrite(shm_pool[SHM_OUT].buffer, 1, len, fout) != len)
+             errx(1, "fwrite %s failed", outfile);
+     }
+     fclose(fout);
      printf("Generated '%s' (%zu bytes)\n", outfile, combined_sz);
  }
- 
+
+ /*
+  * readv：参数是 <offset>:<size>（相对 OCRAM 起始地址），区间表放在 IN，
+  * 各段输出紧挨着读进 OUT，再写到 OUTPUT_FILE。wait 非零时先等 M33
+  * 的下一条完成记录
+  */
+ static size_t readv_ocram(TEEC_Session *sess, char **spec, int n, int wait) {
+     struct ta_ocram_range *r;
+     TEEC_Operation op = {0};
+     uint32_t eo;
+     size_t total = 0;
+
+     if (n < 1 || n > READV_MAX_RANGES)
+         errx(1, "readv takes 1..%d ranges", READV_MAX_RANGES);
+     r = (struct ta_ocram_range *)shm_pool[SHM_IN].buffer;
+     for (int i = 0; i < n; i++) {
+         char *end;
+         r[i].offset = strtoul(spec[i], &end, 0);
+         if (*end != ':')
+             errx(1, "bad range '%s', expected <offset>:<size>", spec[i]);
+         r[i].size = strtoul(end + 1, &end, 0);
+         if (*end || !r[i].size)
+             errx(1, "bad range '%s', expected <offset>:<size>", spec[i]);
+         total += r[i].size;
+     }
+     shm_reserve(SHM_OUT, total);
+
+     op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_MEMREF_PARTIAL_OUTPUT,
+                                      TEEC_VALUE_INOUT, TEEC_NONE);
+     shm_ref(&op, 0, SHM_IN, 0, n * sizeof(*r));
+     shm_ref(&op, 1, SHM_OUT, 0, total);
+     op.params[2].value.a = wait ? TA_OCRAM_READ_WAIT : 0;
+     TEEC_Result res = TEEC_InvokeCommand(sess, TA_OCRAM_LOAD_CMD_READV, &op, &eo);
+     if (res != TEEC_SUCCESS)
+         errx(1, "READV failed: 0x%x", res);
+     write_file(OUTPUT_FILE, shm_pool[SHM_OUT].buffer, op.params[1].memref.size);
+     if (wait)
+         printf("Inference %u done\n", op.params[2].value.a);
+     return op.params[1].memref.size;
+ }
+
  int main(int argc, char *argv[]) {
      if (argc < 2) {
-         fprintf(stderr, "Usage: %s <store|load|read|encrypt|decrypt|sign|verify|make|inference> [args]\n", argv[0]);
+         fprintf(stderr, "Usage: %s <store|load|read|readv|encrypt|decrypt|sign|verify|make|inference> [args]\n", argv[0]);
          return 1;
      }
-     TEEC_Result res; uint32_t eo;
+     uint32_t eo;
      TEEC_Context ctx; TEEC_Session sess;
      const TEEC_UUID uuid = TA_OCRAM_LOAD_UUID;
- 
+
      if (TEEC_InitializeContext(NULL, &ctx) != TEEC_SUCCESS)
          errx(1, "TEEC_InitializeContext failed");
      if (TEEC_OpenSession(&ctx, &sess, &uuid, TEEC_LOGIN_PUBLIC, NULL, NULL, &eo) != TEEC_SUCCESS)
          errx(1, "TEEC_OpenSession failed");
- 
+     shm_pool_init(&ctx);
+
      if (strcmp(argv[1], "store") == 0) {
-         size_t sz; void *buf = read_file(FILENAME, &sz);
+         size_t sz = read_file_shm(FILENAME, SHM_IN, 0);
          TEEC_Operation op = {0};
-         op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-         op.params[0].tmpref.buffer = buf; op.params[0].tmpref.size = sz;
+         op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+         shm_ref(&op, 0, SHM_IN, 0, sz);
          if (TEEC_InvokeCommand(&sess, TA_OCRAM_LOAD_CMD_STORE, &op, &eo) != TEEC_SUCCESS)
              errx(1, "STORE failed");
          printf("Stored %zu bytes.\n", sz);
-         free(buf);
- 
+
      } else if (strcmp(argv[1], "load") == 0) {
-         TEEC_Operation op = {0};
-         op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-         if (TEEC_InvokeCommand(&sess, TA_OCRAM_LOAD_CMD_LOAD, &op, &eo) != TEEC_SUCCESS)
-             errx(1, "LOAD failed");
-         printf("Loaded into OCRAM.\n");
- 
+         if (argc != 3) errx(1, "Usage: %s load <encrypted file>", argv[0]);
+         char key[AES_TEST_KEY_SIZE], iv[AES_BLOCK_SIZE];
+         memset(key, 0xa5, sizeof(key));
+         memset(iv,  0x00, sizeof(iv));
+         prepare_aes(&sess, DECODE);
+         set_key(&sess, key, sizeof(key));
+         set_iv(&sess, iv, sizeof(iv));
+         size_t sz = stream_load(&sess, argv[2], TA_OCRAM_LOAD_CMD_LOAD);
+         printf("Loaded %zu bytes into OCRAM.\n", sz);
+
      } else if (strcmp(argv[1], "read") == 0) {
-         uint8_t buf[READ_SIZE];
+         uint8_t *buf = shm_pool[SHM_OUT].buffer;
          TEEC_Operation op = {0};
-         op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
-         op.params[0].tmpref.buffer = buf; op.params[0].tmpref.size = READ_SIZE;
+         op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE, TEEC_NONE, TEEC_NONE);
+         shm_ref(&op, 0, SHM_OUT, 0, READ_SIZE);
          if (TEEC_InvokeCommand(&sess, TA_OCRAM_LOAD_CMD_READ, &op, &eo) != TEEC_SUCCESS)
              errx(1, "READ failed");
-         for (uint32_t i=0; i<op.params[0].tmpref.size; i++) {
+         for (uint32_t i=0; i<op.params[0].memref.size; i++) {
              if (i%16==0) printf("\n%04x: ", i);
              printf("%02x ", buf[i]);
          }
          printf("\n");
- 
+
+     } else if (strcmp(argv[1], "readv") == 0) {
+         int wait = argc > 2 && strcmp(argv[2], "-w") == 0;
+         if (argc < 3 + wait)
+             errx(1, "Usage: %s readv [-w] <offset>:<size>...", argv[0]);
+         size_t sz = readv_ocram(&sess, argv + 2 + wait, argc - 2 - wait, wait);
+         printf("Read %zu bytes into %s\n", sz, OUTPUT_FILE);
+
      } else if (strcmp(argv[1], "encrypt")==0 || strcmp(argv[1], "decrypt")==0) {
          if (argc!=4) errx(1, "Usage: %s encrypt|decrypt <infile> <outfile>", argv[0]);
-         process_aes_file(argv[2], argv[3], strcmp(argv[1],"encrypt")==0, &ctx, &sess);
- 
+         process_aes_file(argv[2], argv[3], strcmp(argv[1],"encrypt")==0, &sess);
+
      } else if (strcmp(argv[1], "sign")==0 || strcmp(argv[1], "verify")==0) {
          size_t key_size=2048;
          TEEC_Operation op={0};
@@ -246,40 +388,31 @@
          op.params[0].value.a=(uint32_t)key_size;
          if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_GEN_KEY, &op, &eo)!=TEEC_SUCCESS)
              errx(1, "GEN_KEY failed");
-         size_t in_sz; void *inbuf=read_file(INPUT_FILE,&in_sz);
-         uint8_t digest[DIGEST_SIZE];
-         op.paramTypes=TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,TEEC_MEMREF_TEMP_OUTPUT,TEEC_NONE,TEEC_NONE);
-         op.params[0].tmpref.buffer=inbuf; op.params[0].tmpref.size=in_sz;
-         op.params[1].tmpref.buffer=digest; op.params[1].tmpref.size=DIGEST_SIZE;
-         if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_DIGEST, &op, &eo)!=TEEC_SUCCESS)
-             errx(1,"DIGEST failed");
+         size_t in_sz=read_file_shm(INPUT_FILE,SHM_IN,0);
+         digest_in(&sess,in_sz);
          if (strcmp(argv[1],"sign")==0) {
-             size_t sig_sz=key_size/8; void *sig=malloc(sig_sz);
-             op.params[0].tmpref.buffer=digest; op.params[0].tmpref.size=DIGEST_SIZE;
-             op.params[1].tmpref.buffer=sig; op.params[1].tmpref.size=sig_sz;
-             if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_SIGN, &op, &eo)!=TEEC_SUCCESS)
-                 errx(1,"SIGN failed");
-             write_file(SIGNATURE_FILE,sig,op.params[1].tmpref.size);
-             printf("Signature saved to %s (%u bytes)\n",SIGNATURE_FILE,(unsigned)op.params[1].tmpref.size);
-             free(sig);
+             size_t sig_sz=sign_digest(&sess,SHM_AUX,AUX_SIG_OFF);
+             write_file(SIGNATURE_FILE,(uint8_t *)shm_pool[SHM_AUX].buffer+AUX_SIG_OFF,sig_sz);
+             printf("Signature saved to %s (%u bytes)\n",SIGNATURE_FILE,(unsigned)sig_sz);
          } else {
-             size_t sig_sz; void *sig=read_file(SIGNATURE_FILE,&sig_sz);
-             op.paramTypes=TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,TEEC_MEMREF_TEMP_INPUT,TEEC_VALUE_OUTPUT,TEEC_NONE);
-             op.params[0].tmpref.buffer=digest; op.params[0].tmpref.size=DIGEST_SIZE;
-             op.params[1].tmpref.buffer=sig; op.params[1].tmpref.size=sig_sz;
+             size_t sig_sz=read_file_shm(SIGNATURE_FILE,SHM_OUT,0);
+             op.paramTypes=TEEC_PARAM_TYPES(TEEC_MEMREF_PARTIAL_INPUT,TEEC_MEMREF_PARTIAL_INPUT,TEEC_VALUE_OUTPUT,TEEC_NONE);
+             shm_ref(&op,0,SHM_AUX,AUX_DIGEST_OFF,DIGEST_SIZE);
+             shm_ref(&op,1,SHM_OUT,0,sig_sz);
              if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_VERIFY, &op, &eo)!=TEEC_SUCCESS)
                  errx(1,"VERIFY failed");
              printf("Signature is %s\n",op.params[2].value.a?"valid":"invalid");
-             free(sig);
          }
-         free(inbuf);
- 
+
      } else if (strcmp(argv[1], "make")==0) {
          make_signed_encrypted(INPUT_FILE, OUTPUT_MAKE_FILE, &sess);
- 
-     } else if (strcmp(argv[1], "inference")==0) 
+
+     } else if (strcmp(argv[1], "inference")==0)
      {
-        /* 1) AES 解密 + 拆分数据与签名 */
+        /*
+         * 1) 密文按块交给 TA：PTA 一遍完成解密、写 OCRAM 和 SHA-256，
+         *    最后一块在 TA 里验签，明文不回到普通世界
+         */
         prepare_aes(&sess, DECODE);
         char key[AES_TEST_KEY_SIZE];
         char iv [AES_BLOCK_SIZE];
@@ -288,61 +421,12 @@
         set_key(&sess, key, sizeof(key));
         set_iv(&sess, iv, sizeof(iv));
 
-        size_t enc_sz;
-        uint8_t *enc_buf = read_file(ENCRYPTED_INPUT_FILE, &enc_sz);
-        uint8_t *plain_buf = malloc(enc_sz);
-        if (!plain_buf) errx(1, "malloc failed");
-
-        cipher_buffer(&sess, enc_buf, plain_buf, enc_sz);
-        free(enc_buf);
-
-        size_t key_size = 2048;
-        size_t sig_sz   = key_size / 8;
-        if (enc_sz < sig_sz) errx(1, "File too small");
-
-        size_t data_sz = enc_sz - sig_sz;
-        uint8_t *sig   = plain_buf + data_sz;
-
-        /* 2) 摘要 + 验签 */
-        TEEC_Operation op = {0};
-        uint32_t eo;
-        uint8_t digest[DIGEST_SIZE];
-
-        op.paramTypes = TEEC_PARAM_TYPES(
-            TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_OUTPUT,
-            TEEC_NONE, TEEC_NONE);
-        op.params[0].tmpref.buffer = plain_buf;
-        op.params[0].tmpref.size   = data_sz;
-        op.params[1].tmpref.buffer = digest;
-        op.params[1].tmpref.size   = DIGEST_SIZE;
-        if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_DIGEST, &op, &eo) != TEEC_SUCCESS)
-            errx(1, "DIGEST failed");
-
-        op.paramTypes = TEEC_PARAM_TYPES(
-            TEEC_MEMREF_TEMP_INPUT, TEEC_MEMREF_TEMP_INPUT,
-            TEEC_VALUE_OUTPUT, TEEC_NONE);
-        op.params[0].tmpref.buffer = digest;
-        op.params[0].tmpref.size   = DIGEST_SIZE;
-        op.params[1].tmpref.buffer = sig;
-        op.params[1].tmpref.size   = sig_sz;
-        if (TEEC_InvokeCommand(&sess, TA_ACIPHER_CMD_VERIFY, &op, &eo) != TEEC_SUCCESS)
-            errx(1, "VERIFY failed");
-        if (!op.params[2].value.a)
-            errx(1, "Invalid signature");
-
-        /* 3) Load plaintext 到 OCRAM */
-        TEEC_Operation load_op = {0};
-        load_op.paramTypes = TEEC_PARAM_TYPES(
-            TEEC_MEMREF_TEMP_INPUT, TEEC_NONE,
-            TEEC_NONE, TEEC_NONE);
-        load_op.params[0].tmpref.buffer = plain_buf;
-        load_op.params[0].tmpref.size   = data_sz;
-        if (TEEC_InvokeCommand(&sess, TA_OCRAM_LOAD_CMD_LOAD, &load_op, &eo) != TEEC_SUCCESS)
-            errx(1, "OCRAM LOAD failed");
-
-        printf("Loaded %zu bytes of verified data into OCRAM\n", data_sz);
-
-        /* 4) 通知 remoteproc 启动 */
+        size_t enc_sz = stream_load(&sess, ENCRYPTED_INPUT_FILE,
+                                    TA_OCRAM_LOAD_CMD_LOAD_VERIFIED);
+        printf("Loaded %zu bytes of verified data into OCRAM\n",
+               enc_sz - 2048 / 8);
+
+        /* 2) 通知 remoteproc 启动 */
         {
             const char *rp_path = "/sys/class/remoteproc/remoteproc0/state";
             int fd = open(rp_path, O_WRONLY);
@@ -354,20 +438,19 @@
             printf("remoteproc0 state set to 'start'\n");
         }
 
-        /* 5) 通过 PTA 再次读回 OCRAM 内容并打印前 READ_SIZE 字节 */
+        /* 3) 通过 PTA 再次读回 OCRAM 内容并打印前 READ_SIZE 字节 */
         {
-            uint8_t buf[READ_SIZE] = {0};
             TEEC_Operation read_op = {0};
             read_op.paramTypes = TEEC_PARAM_TYPES(
-                TEEC_MEMREF_TEMP_OUTPUT, TEEC_NONE,
+                TEEC_MEMREF_PARTIAL_OUTPUT, TEEC_NONE,
                 TEEC_NONE, TEEC_NONE);
-            read_op.params[0].tmpref.buffer = buf;
-            read_op.params[0].tmpref.size   = READ_SIZE;
+            shm_ref(&read_op, 0, SHM_OUT, 0, READ_SIZE);
             if (TEEC_InvokeCommand(&sess, TA_OCRAM_LOAD_CMD_READ, &read_op, &eo) != TEEC_SUCCESS)
                 errx(1, "OCRAM READ failed");
 
            //printf("First %d bytes read from OCRAM:", READ_SIZE);
-    /*        for (uint32_t i = 0; i < read_op.params[0].tmpref.size; i++) {
+    /*        uint8_t *buf = shm_pool[SHM_OUT].buffer;
+            for (uint32_t i = 0; i < read_op.params[0].memref.size; i++) {
                 if ((i % 16) == 0) printf("\n%04x: ", i);
                 printf("%02x ", buf[i]);
             }
@@ -375,14 +458,12 @@
             */
         }
 
-        free(plain_buf);
-
     }
       else {
          errx(1,"Unknown command '%s'",argv[1]);
      }
+     shm_pool_free();
      TEEC_CloseSession(&sess);
      TEEC_FinalizeContext(&ctx);
      return 0;
  }
- 
\ No newline at end of file
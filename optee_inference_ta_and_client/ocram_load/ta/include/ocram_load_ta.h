@@ -28,6 +28,12 @@
  */
 #define TA_AES_CMD_PREPARE		0
 
+/*
+ * TA_OCRAM_LOAD_CMD_LOAD and _LOAD_VERIFIED decrypt in ocram_load.pta with the
+ * prepared key and IV. All three TA_AES_ALGO_xxx work there; with ECB and CBC
+ * every chunk must be a whole number of AES blocks, CTR takes any length.
+ */
+
 #define TA_AES_ALGO_ECB			0
 #define TA_AES_ALGO_CBC			1
 #define TA_AES_ALGO_CTR			2
@@ -70,4 +76,38 @@
 #define TA_ACIPHER_CMD_SIGN       11
 #define TA_ACIPHER_CMD_VERIFY     12
 #define TA_ACIPHER_CMD_DIGEST     13
+
+/*
+ * TA_OCRAM_LOAD_CMD_LOAD_VERIFIED - Streaming authenticated model load
+ * The input is AES ciphertext of (model || RSA signature), sent in order.
+ * Each chunk is decrypted straight into OCRAM and hashed in the same pass;
+ * the last chunk checks the signature and wipes OCRAM if it is invalid.
+ * Needs TA_AES_CMD_PREPARE/SET_KEY/SET_IV and the ACIPHER key first.
+ * param[0] (memref) ciphertext chunk
+ * param[1] (value) a: chunk offset, b: total ciphertext size
+ * param[2] unused
+ * param[3] unused
+ */
+#define TA_OCRAM_LOAD_CMD_LOAD_VERIFIED 14
+
+/*
+ * TA_OCRAM_LOAD_CMD_READV - Read inference outputs from OCRAM
+ * Each range is cache-invalidated and copied once, back to back, straight
+ * into param[1]. Offsets are from the start of OCRAM (0x20480000); ranges
+ * must lie below the M33 completion ring.
+ * param[0] (memref) struct ta_ocram_range[], at most 64 entries
+ * param[1] (memref) output, at least the sum of the range sizes;
+ *                   TEE_ERROR_SHORT_BUFFER returns the size needed
+ * param[2] (value) in a: TA_OCRAM_READ_WAIT to wait for the next
+ *                  completion from the M33 first; out a: its sequence number
+ * param[3] unused
+ */
+#define TA_OCRAM_LOAD_CMD_READV         15
+
+#define TA_OCRAM_READ_WAIT              1
+
+struct ta_ocram_range {
+    uint32_t offset;
+    uint32_t size;
+};
 #endif /*TA_OCRAM_LOAD_H*/
\ No newline at end of file
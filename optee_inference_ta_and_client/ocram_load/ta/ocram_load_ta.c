@@ -17,7 +17,12 @@
  /* Constants for OCRAM PTA commands and UUIDs */
  #define MODEL_DATA_OBJ_ID     "model_data.bin"
  #define OCRAM_LOAD_CMD        0
+ #define OCRAM_LOAD_CMD_DECRYPT_INIT   1
+ #define OCRAM_LOAD_CMD_DECRYPT_UPDATE 2
+ #define OCRAM_LOAD_CMD_DECRYPT_FINAL  3
+ #define OCRAM_LOAD_CMD_WIPE           4
  #define OCRAM_READ_CMD        0
+ #define OCRAM_READ_CMD_READV  1
  static const TEE_UUID pta_ocram_load_uuid = {
      0xd9e00de1, 0x950b, 0x4eb8,
      { 0xb7, 0xd1, 0x6b, 0x32, 0xde, 0xec, 0x18, 0x57 }
@@ -32,6 +37,10 @@
  #define AES128_KEY_BYTE_SIZE   (AES128_KEY_BIT_SIZE / 8)
  #define AES256_KEY_BIT_SIZE    256
  #define AES256_KEY_BYTE_SIZE   (AES256_KEY_BIT_SIZE / 8)
+ #define AES_BLOCK_BYTE_SIZE    16
+ #define SHA256_BYTE_SIZE       32
+ /* ocram_load.pta 认证加载尾部的上限 */
+ #define OCRAM_TAIL_MAX         512
  
  /* ACIPHER definitions */
  #define ACIPHER_KEY_ID         "acipher_key"
@@ -44,6 +53,11 @@
      uint32_t key_size;
      TEE_OperationHandle op_handle;
      TEE_ObjectHandle key_handle;
+     /* LOAD 在 PTA 里解密，要把密钥和 IV 再交给 ocram_load.pta */
+     uint8_t key[AES256_KEY_BYTE_SIZE];
+     uint8_t iv[AES_BLOCK_BYTE_SIZE];
+     uint32_t iv_size;
+     bool key_set;
  };
  
  /* ACIPHER context per session */
@@ -55,6 +69,10 @@
  struct ta_ctx {
      struct aes_cipher aes;
      struct acipher aci;
+     /* 进行中的 LOAD 用的 ocram_load.pta 会话，没有时为 TEE_HANDLE_NULL */
+     TEE_TASessionHandle load_sess;
+     /* ocram_read.pta 会话，第一次 READ 时打开，一直用到会话关闭 */
+     TEE_TASessionHandle read_sess;
  };
  
  /* Forward declarations for AES helpers */
@@ -221,6 +239,8 @@
      TEE_Result res = TEE_PopulateTransientObject(sess->key_handle, &attr, 1);
      if (res != TEE_SUCCESS)
          return res;
+     TEE_MemMove(sess->key, params[0].memref.buffer, key_sz);
+     sess->key_set = true;
  
      TEE_ResetOperation(sess->op_handle);
      return TEE_SetOperationKey(sess->op_handle, sess->key_handle);
@@ -237,7 +257,11 @@
          TEE_PARAM_TYPE_NONE);
      if (param_types != exp)
          return TEE_ERROR_BAD_PARAMETERS;
+     if (params[0].memref.size > sizeof(sess->iv))
+         return TEE_ERROR_BAD_PARAMETERS;
  
+     TEE_MemMove(sess->iv, params[0].memref.buffer, params[0].memref.size);
+     sess->iv_size = params[0].memref.size;
      TEE_CipherInit(sess->op_handle,
                     params[0].memref.buffer,
                     params[0].memref.size);
@@ -474,6 +498,250 @@ return load_persistent_key(state);
      return TEE_SUCCESS;
  }
  
+ /*----------------------------------------------------------
+  * OCRAM read helpers
+  *---------------------------------------------------------*/
+ /*
+  * 把读命令转给 ocram_read.pta。参数原样传过去：调用方的共享内存
+  * 直接给 PTA 写，输出只从 OCRAM 拷一次
+  */
+ static TEE_Result read_ocram(struct ta_ctx *ctx, uint32_t cmd,
+                              uint32_t param_types, TEE_Param params[4])
+ {
+     uint32_t err_orig = 0;
+     TEE_Result res;
+
+     if (ctx->read_sess == TEE_HANDLE_NULL) {
+         res = TEE_OpenTASession(
+             &pta_ocram_read_uuid, 0,
+             TEE_PARAM_TYPES(
+                 TEE_PARAM_TYPE_NONE,
+                 TEE_PARAM_TYPE_NONE,
+                 TEE_PARAM_TYPE_NONE,
+                 TEE_PARAM_TYPE_NONE),
+             NULL, &ctx->read_sess, &err_orig);
+         if (res != TEE_SUCCESS) {
+             ctx->read_sess = TEE_HANDLE_NULL;
+             return res;
+         }
+     }
+     return TEE_InvokeTACommand(ctx->read_sess, TEE_TIMEOUT_INFINITE,
+                                cmd, param_types, params, &err_orig);
+ }
+
+ /*----------------------------------------------------------
+  * OCRAM load helpers
+  *---------------------------------------------------------*/
+ /* 关掉 PTA 会话；没走完的认证加载，PTA 会清掉 OCRAM 里没验签的明文 */
+ static void close_load_session(struct ta_ctx *ctx)
+ {
+     if (ctx->load_sess != TEE_HANDLE_NULL)
+         TEE_CloseTASession(ctx->load_sess);
+     ctx->load_sess = TEE_HANDLE_NULL;
+ }
+ 
+ /*
+  * 打开 ocram_load.pta 并用当前 AES 密钥、IV 开始一次解密加载；
+  * tail 非零时是认证加载，最后 tail 字节（签名）不写 OCRAM
+  */
+ static TEE_Result start_load(struct ta_ctx *ctx, uint32_t total,
+                              uint32_t tail)
+ {
+     uint32_t err_orig = 0;
+     TEE_Param pt[4] = {0};
+     TEE_Result res;
+ 
+     if (!ctx->aes.key_set)
+         return TEE_ERROR_BAD_STATE;
+ 
+     close_load_session(ctx);
+     res = TEE_OpenTASession(
+         &pta_ocram_load_uuid, 0,
+         TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE),
+         NULL, &ctx->load_sess, &err_orig);
+     if (res != TEE_SUCCESS) {
+         ctx->load_sess = TEE_HANDLE_NULL;
+         return res;
+     }
+ 
+     pt[0].memref.buffer = ctx->aes.key;
+     pt[0].memref.size   = ctx->aes.key_size;
+     pt[1].memref.buffer = ctx->aes.iv;
+     pt[1].memref.size   = ctx->aes.iv_size;
+     pt[2].value.a = total;
+     pt[2].value.b = ctx->aes.algo;
+     pt[3].value.a = tail;
+     res = TEE_InvokeTACommand(
+         ctx->load_sess,
+         TEE_TIMEOUT_INFINITE,
+         OCRAM_LOAD_CMD_DECRYPT_INIT,
+         TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_VALUE_INPUT,
+             tail ? TEE_PARAM_TYPE_VALUE_INPUT : TEE_PARAM_TYPE_NONE),
+         pt, &err_orig);
+     if (res != TEE_SUCCESS)
+         close_load_session(ctx);
+     return res;
+ }
+ 
+ /* 一块密文交给 PTA 解密，offset 必须接着上一块 */
+ static TEE_Result update_load(struct ta_ctx *ctx, void *buf, uint32_t len,
+                               uint32_t offset)
+ {
+     uint32_t err_orig = 0;
+     TEE_Param pt[4] = {0};
+ 
+     if (ctx->load_sess == TEE_HANDLE_NULL)
+         return TEE_ERROR_BAD_STATE;
+ 
+     pt[0].memref.buffer = buf;
+     pt[0].memref.size   = len;
+     pt[1].value.a = offset;
+     return TEE_InvokeTACommand(
+         ctx->load_sess,
+         TEE_TIMEOUT_INFINITE,
+         OCRAM_LOAD_CMD_DECRYPT_UPDATE,
+         TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_VALUE_INPUT,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE),
+         pt, &err_orig);
+ }
+ 
+ /*
+  * 一块密文交给 PTA，解密后直接落到 OCRAM；TA 不再分配明文缓冲，
+  * 模型大小不受 TA_DATA_SIZE 限制。offset 为 0 时开始新的加载
+  */
+ static TEE_Result load_chunk(struct ta_ctx *ctx, void *buf, uint32_t len,
+                              uint32_t offset, uint32_t total)
+ {
+     TEE_Result res;
+ 
+     if (!offset) {
+         res = start_load(ctx, total, 0);
+         if (res != TEE_SUCCESS)
+             return res;
+     }
+     res = update_load(ctx, buf, len, offset);
+     if (res != TEE_SUCCESS || offset + len == total)
+         close_load_session(ctx);
+     return res;
+ }
+ 
+ /* 认证加载失败：让 PTA 清掉已经写进 OCRAM 的明文 */
+ static void wipe_load(struct ta_ctx *ctx)
+ {
+     uint32_t err_orig = 0;
+     TEE_Param pt[4] = {0};
+ 
+     TEE_InvokeTACommand(
+         ctx->load_sess,
+         TEE_TIMEOUT_INFINITE,
+         OCRAM_LOAD_CMD_WIPE,
+         TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE),
+         pt, &err_orig);
+ }
+ 
+ /*
+  * 验签，和 make 的签名方式一致：签的是 SHA-256(模型摘要)
+  */
+ static TEE_Result verify_load(struct ta_ctx *ctx, uint32_t sig_sz)
+ {
+     uint32_t err_orig = 0;
+     TEE_Param pt[4] = {0};
+     uint8_t digest[SHA256_BYTE_SIZE];
+     uint8_t hash[SHA256_BYTE_SIZE];
+     uint8_t sig[OCRAM_TAIL_MAX];
+     uint32_t hash_len = sizeof(hash);
+     TEE_ObjectInfo key_info;
+     TEE_OperationHandle op = TEE_HANDLE_NULL;
+     TEE_Result res;
+ 
+     pt[0].memref.buffer = digest;
+     pt[0].memref.size   = sizeof(digest);
+     pt[1].memref.buffer = sig;
+     pt[1].memref.size   = sig_sz;
+     res = TEE_InvokeTACommand(
+         ctx->load_sess,
+         TEE_TIMEOUT_INFINITE,
+         OCRAM_LOAD_CMD_DECRYPT_FINAL,
+         TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_OUTPUT,
+             TEE_PARAM_TYPE_MEMREF_OUTPUT,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE),
+         pt, &err_orig);
+     if (res != TEE_SUCCESS)
+         return res;
+ 
+     res = TEE_AllocateOperation(&op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+     if (res != TEE_SUCCESS)
+         return res;
+     res = TEE_DigestDoFinal(op, digest, sizeof(digest), hash, &hash_len);
+     TEE_FreeOperation(op);
+     if (res != TEE_SUCCESS)
+         return res;
+ 
+     TEE_GetObjectInfo1(ctx->aci.key, &key_info);
+     res = TEE_AllocateOperation(&op, TEE_ALG_RSASSA_PKCS1_V1_5_SHA256,
+                                 TEE_MODE_VERIFY, key_info.keySize);
+     if (res != TEE_SUCCESS)
+         return res;
+     res = TEE_SetOperationKey(op, ctx->aci.key);
+     if (res == TEE_SUCCESS)
+         res = TEE_AsymmetricVerifyDigest(op, NULL, 0, hash, hash_len,
+                                          sig, sig_sz);
+     TEE_FreeOperation(op);
+     if (res != TEE_SUCCESS)
+         EMSG("Model signature check failed: 0x%x", res);
+     return res;
+ }
+ 
+ /*
+  * 认证加载：密文 = AES(模型 || 签名)，一遍解密、写 OCRAM、算摘要，
+  * 明文不出 TEE。最后一块验签，验不过 OCRAM 被清掉
+  */
+ static TEE_Result load_verified_chunk(struct ta_ctx *ctx, void *buf,
+                                       uint32_t len, uint32_t offset,
+                                       uint32_t total)
+ {
+     TEE_ObjectInfo key_info;
+     uint32_t sig_sz;
+     TEE_Result res;
+ 
+     if (ctx->aci.key == TEE_HANDLE_NULL)
+         return TEE_ERROR_BAD_STATE;
+     TEE_GetObjectInfo1(ctx->aci.key, &key_info);
+     sig_sz = key_info.keySize / 8;
+     if (!sig_sz || sig_sz > OCRAM_TAIL_MAX || total <= sig_sz)
+         return TEE_ERROR_BAD_PARAMETERS;
+ 
+     if (!offset) {
+         res = start_load(ctx, total - sig_sz, sig_sz);
+         if (res != TEE_SUCCESS)
+             return res;
+     }
+     res = update_load(ctx, buf, len, offset);
+     if (res == TEE_SUCCESS && offset + len == total)
+         res = verify_load(ctx, sig_sz);
+     if (res != TEE_SUCCESS && ctx->load_sess != TEE_HANDLE_NULL)
+         wipe_load(ctx);
+     if (res != TEE_SUCCESS || offset + len == total)
+         close_load_session(ctx);
+     return res;
+ }
+ 
  /*----------------------------------------------------------
   * TA Entry Points
   *---------------------------------------------------------*/
@@ -498,6 +766,10 @@ return load_persistent_key(state);
      /* Initialize AES context */
      ctx->aes.op_handle = TEE_HANDLE_NULL;
      ctx->aes.key_handle = TEE_HANDLE_NULL;
+     ctx->aes.key_set = false;
+     ctx->aes.iv_size = 0;
+     ctx->load_sess = TEE_HANDLE_NULL;
+     ctx->read_sess = TEE_HANDLE_NULL;
  
      /* Initialize ACIPHER context */
      ctx->aci.key = TEE_HANDLE_NULL;
@@ -510,6 +782,9 @@ return load_persistent_key(state);
  void TA_CloseSessionEntryPoint(void *session)
  {
      struct ta_ctx *ctx = session;
+     close_load_session(ctx);
+     if (ctx->read_sess != TEE_HANDLE_NULL)
+         TEE_CloseTASession(ctx->read_sess);
      /* Free AES resources */
      if (ctx->aes.key_handle != TEE_HANDLE_NULL)
          TEE_FreeTransientObject(ctx->aes.key_handle);
@@ -518,6 +793,8 @@ return load_persistent_key(state);
      /* Free ACIPHER key */
      if (ctx->aci.key != TEE_HANDLE_NULL)
      TEE_CloseObject(ctx->aci.key);
+     /* 密钥副本不留在堆里 */
+     TEE_MemFill(ctx->aes.key, 0, sizeof(ctx->aes.key));
      TEE_Free(ctx);
  }
  
@@ -528,7 +805,6 @@ return load_persistent_key(state);
  {
      struct ta_ctx *ctx = session;
      TEE_Result res = TEE_ERROR_BAD_PARAMETERS;
-     uint32_t err_orig = 0;
  
      switch (command_id) {
      /* Store into Secure Storage */
@@ -561,59 +837,45 @@ return load_persistent_key(state);
          TEE_CloseObject(obj);
          break;
      }
-     /* Load (decrypt then PTA-load) */
+     /*
+      * Load：PTA 按块解密直接写 OCRAM。
+      * memref0 一块密文，value1 a = 偏移，b = 总字节数；
+      * 只给 memref0 时按整块加载处理
+      */
      case TA_OCRAM_LOAD_CMD_LOAD: {
-         const uint32_t exp = TEE_PARAM_TYPES(
+         const uint32_t exp_whole = TEE_PARAM_TYPES(
              TEE_PARAM_TYPE_MEMREF_INPUT,
              TEE_PARAM_TYPE_NONE,
              TEE_PARAM_TYPE_NONE,
              TEE_PARAM_TYPE_NONE);
+         const uint32_t exp_chunk = TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_VALUE_INPUT,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE);
+         if (param_types == exp_whole)
+             res = load_chunk(ctx, params[0].memref.buffer,
+                              params[0].memref.size,
+                              0, params[0].memref.size);
+         else if (param_types == exp_chunk)
+             res = load_chunk(ctx, params[0].memref.buffer,
+                              params[0].memref.size,
+                              params[1].value.a, params[1].value.b);
+         else
+             return TEE_ERROR_BAD_PARAMETERS;
+         break;
+     }
+     case TA_OCRAM_LOAD_CMD_LOAD_VERIFIED: {
+         const uint32_t exp = TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_VALUE_INPUT,
+             TEE_PARAM_TYPE_NONE,
+             TEE_PARAM_TYPE_NONE);
          if (param_types != exp)
              return TEE_ERROR_BAD_PARAMETERS;
-         /* Decrypt */
-         void *enc_buf   = params[0].memref.buffer;
-         uint32_t enc_sz = params[0].memref.size;
-         void *plain_buf = TEE_Malloc(enc_sz, 0);
-         if (!plain_buf)
-             return TEE_ERROR_OUT_OF_MEMORY;
-         uint32_t plain_sz = enc_sz;
-         res = TEE_CipherUpdate(
-             ctx->aes.op_handle,
-             enc_buf, enc_sz,
-             plain_buf, &plain_sz);
-         if (res != TEE_SUCCESS) {
-             TEE_Free(plain_buf);
-             return res;
-         }
-         /* PTA load to OCRAM */
-         TEE_TASessionHandle s1;
-         res = TEE_OpenTASession(
-             &pta_ocram_load_uuid, 0,
-             TEE_PARAM_TYPES(
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE),
-             NULL, &s1, &err_orig);
-         if (res != TEE_SUCCESS) {
-             TEE_Free(plain_buf);
-             return res;
-         }
-         TEE_Param pt[4] = {0};
-         pt[0].memref.buffer = plain_buf;
-         pt[0].memref.size   = plain_sz;
-         res = TEE_InvokeTACommand(
-             s1,
-             TEE_TIMEOUT_INFINITE,
-             OCRAM_LOAD_CMD,
-             TEE_PARAM_TYPES(
-                 TEE_PARAM_TYPE_MEMREF_INPUT,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE),
-             pt, &err_orig);
-         TEE_CloseTASession(s1);
-         TEE_Free(plain_buf);
+         res = load_verified_chunk(ctx, params[0].memref.buffer,
+                                   params[0].memref.size,
+                                   params[1].value.a, params[1].value.b);
          break;
      }
      /* Read back from OCRAM via PTA */
@@ -625,28 +887,18 @@ return load_persistent_key(state);
              TEE_PARAM_TYPE_NONE);
          if (param_types != exp)
              return TEE_ERROR_BAD_PARAMETERS;
-         TEE_TASessionHandle s2;
-         res = TEE_OpenTASession(
-             &pta_ocram_read_uuid, 0,
-             TEE_PARAM_TYPES(
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE,
-                 TEE_PARAM_TYPE_NONE),
-             NULL, &s2, &err_orig);
-         if (res != TEE_SUCCESS)
-             return res;
-         TEE_Param pt[4] = {0};
-         pt[0].memref.buffer = params[0].memref.buffer;
-         pt[0].memref.size   = params[0].memref.size;
-         res = TEE_InvokeTACommand(
-             s2,
-             TEE_TIMEOUT_INFINITE,
-             OCRAM_READ_CMD,
-             exp, pt, &err_orig);
-         if (res == TEE_SUCCESS)
-             params[0].memref.size = pt[0].memref.size;
-         TEE_CloseTASession(s2);
+         res = read_ocram(ctx, OCRAM_READ_CMD, param_types, params);
+         break;
+     }
+     case TA_OCRAM_LOAD_CMD_READV: {
+         const uint32_t exp = TEE_PARAM_TYPES(
+             TEE_PARAM_TYPE_MEMREF_INPUT,
+             TEE_PARAM_TYPE_MEMREF_OUTPUT,
+             TEE_PARAM_TYPE_VALUE_INOUT,
+             TEE_PARAM_TYPE_NONE);
+         if (param_types != exp)
+             return TEE_ERROR_BAD_PARAMETERS;
+         res = read_ocram(ctx, OCRAM_READ_CMD_READV, param_types, params);
          break;
      }
      /* AES commands */
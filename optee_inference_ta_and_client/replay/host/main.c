@@ -4,12 +4,30 @@
  * A simple C program that uses the OP‑TEE TEE Client API to
  * call the Replay TA (pseudo‑TA) and run the full Ethos‑U replay.
  *
+ *   replay                 run the replay built into OP‑TEE
+ *   replay program.rpvm    run a program from "rrtrace.py program"
+ *   replay program.rpvm base
+ *                          same, with the model's memory segment moved to
+ *                          OCRAM address base
+ *   replay store program.rpvm
+ *                          store a program in secure storage and print its
+ *                          SHA-256 digest, the model ID
+ *   replay model digest    run a stored model; it stays resident in OCRAM,
+ *                          so running it again does not reload it
+ *   replay batch in_pa in_size out_pa out_size inputs.bin outputs.bin
+ *                          run the built-in replay once per in_size bytes of
+ *                          inputs.bin on a warm NPU, copying each input to
+ *                          in_pa and out_size bytes from out_pa to outputs.bin
+ *   replay stats [reset]   print the latency of every replay phase since boot
+ *                          (or the last reset), then optionally clear it
+ *
  * SPDX-License-Identifier: BSD-2-Clause
  * Copyright (c) 2025 Rejoice
  */
 
  #include <err.h>
  #include <stdio.h>
+ #include <stdlib.h>
  #include <string.h>
  
  /* OP‑TEE TEE client API */
@@ -18,14 +36,98 @@
  /* Replay TA UUID and command IDs */
  #include "replay_ta.h"
  
- int main(void)
+ /* 读取重放程序文件内容，返回缓冲区和大小 */
+ static void *read_file(const char *filename, size_t *size_out)
+ {
+	 FILE *f;
+	 void *buffer;
+	 long size;
+ 
+	 f = fopen(filename, "rb");
+	 if (!f)
+		 errx(1, "Failed to open file: %s", filename);
+ 
+	 fseek(f, 0, SEEK_END);
+	 size = ftell(f);
+	 rewind(f);
+	 if (size <= 0)
+		 errx(1, "Empty program file: %s", filename);
+ 
+	 buffer = malloc(size);
+	 if (!buffer)
+		 errx(1, "Failed to allocate memory for file: %s", filename);
+ 
+	 if (fread(buffer, 1, size, f) != (size_t)size) {
+		 fclose(f);
+		 errx(1, "Failed to read file: %s", filename);
+	 }
+	 fclose(f);
+	 *size_out = size;
+	 return buffer;
+ }
+ 
+ static void write_file(const char *filename, const void *buf, size_t size)
+ {
+	 FILE *f = fopen(filename, "wb");
+ 
+	 if (!f)
+		 errx(1, "Failed to open file: %s", filename);
+	 if (fwrite(buf, 1, size, f) != size) {
+		 fclose(f);
+		 errx(1, "Failed to write file: %s", filename);
+	 }
+	 fclose(f);
+ }
+ 
+ /* 打印各阶段的耗时，单位 us */
+ static void print_stats(const struct ta_replay_phase_stats *st)
+ {
+	 static const char *const names[TA_REPLAY_PHASE_COUNT] = {
+		 [TA_REPLAY_PHASE_INIT] = "init",
+		 [TA_REPLAY_PHASE_KICK] = "kick",
+		 [TA_REPLAY_PHASE_NPU] = "npu",
+		 [TA_REPLAY_PHASE_IRQ_ACK] = "irq_ack",
+		 [TA_REPLAY_PHASE_COPY_IN] = "copy_in",
+		 [TA_REPLAY_PHASE_COPY_OUT] = "copy_out",
+	 };
+ 
+	 printf("%-9s %8s %10s %10s %10s %10s\n", "phase", "count",
+			"min_us", "avg_us", "max_us", "p99_us");
+	 for (int i = 0; i < TA_REPLAY_PHASE_COUNT; i++)
+		 printf("%-9s %8u %10.1f %10.1f %10.1f %10.1f\n", names[i],
+				st[i].count, st[i].min_ns / 1000.0, st[i].avg_ns / 1000.0,
+				st[i].max_ns / 1000.0, st[i].p99_ns / 1000.0);
+ }
+ 
+ /* 十六进制摘要 -> 32 字节 */
+ static void parse_digest(const char *hex, uint8_t digest[TA_REPLAY_DIGEST_SIZE])
+ {
+	 unsigned int byte;
+ 
+	 if (strlen(hex) != 2 * TA_REPLAY_DIGEST_SIZE)
+		 errx(1, "Model digest must be %d hex digits", 2 * TA_REPLAY_DIGEST_SIZE);
+	 for (int i = 0; i < TA_REPLAY_DIGEST_SIZE; i++) {
+		 if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+			 errx(1, "Bad model digest: %s", hex);
+		 digest[i] = byte;
+	 }
+ }
+ 
+ int main(int argc, char *argv[])
  {
 	 TEEC_Result    res;
 	 TEEC_Context   ctx;
 	 TEEC_Session   sess;
 	 TEEC_Operation op;
 	 uint32_t       err_origin;
+	 uint32_t       cmd = TA_REPLAY_CMD_RUN;
+	 void          *program = NULL;
+	 size_t         program_size = 0;
+	 uint8_t        digest[TA_REPLAY_DIGEST_SIZE];
+	 void          *outputs = NULL;
+	 size_t         outputs_size = 0;
 	 TEEC_UUID      uuid = TA_REPLAY_UUID;
+	 struct ta_replay_phase_stats stats[TA_REPLAY_PHASE_COUNT];
  
 	 /* 1. 创建 TEE Context */
 	 res = TEEC_InitializeContext(NULL, &ctx);
@@ -39,26 +141,111 @@
 		 errx(1, "TEEC_OpenSession failed: 0x%x, origin 0x%x",
 			  res, err_origin);
  
-	 /* 3. 调用 TA_REPLAY_CMD_RUN，无参数 */
+	 /* 3. 无参数调用 TA_REPLAY_CMD_RUN，或把程序传给 TA_REPLAY_CMD_RUN_PROGRAM */
 	 memset(&op, 0, sizeof(op));
 	 op.paramTypes = TEEC_PARAM_TYPES(TEEC_NONE,
 									  TEEC_NONE,
 									  TEEC_NONE,
 									  TEEC_NONE);
+	 if (argc > 2 && !strcmp(argv[1], "store")) {
+		 /* 存进安全存储，摘要写回 memref[1] */
+		 program = read_file(argv[2], &program_size);
+		 op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+										  TEEC_MEMREF_TEMP_OUTPUT,
+										  TEEC_NONE,
+										  TEEC_NONE);
+		 op.params[0].tmpref.buffer = program;
+		 op.params[0].tmpref.size = program_size;
+		 op.params[1].tmpref.buffer = digest;
+		 op.params[1].tmpref.size = sizeof(digest);
+		 cmd = TA_REPLAY_CMD_STORE_PROGRAM;
+	 } else if (argc > 2 && !strcmp(argv[1], "model")) {
+		 parse_digest(argv[2], digest);
+		 op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+										  TEEC_NONE,
+										  TEEC_NONE,
+										  TEEC_NONE);
+		 op.params[0].tmpref.buffer = digest;
+		 op.params[0].tmpref.size = sizeof(digest);
+		 cmd = TA_REPLAY_CMD_RUN_MODEL;
+	 } else if (argc > 7 && !strcmp(argv[1], "batch")) {
+		 uint32_t in_size = strtoul(argv[3], NULL, 0);
+		 uint32_t out_size = strtoul(argv[5], NULL, 0);
+ 
+		 program = read_file(argv[6], &program_size);
+		 if (!in_size || program_size % in_size)
+			 errx(1, "%s is not a whole number of %u-byte inputs",
+				  argv[6], in_size);
+		 outputs_size = program_size / in_size * out_size;
+		 outputs = malloc(outputs_size ? outputs_size : 1);
+		 if (!outputs)
+			 errx(1, "Failed to allocate %zu output bytes", outputs_size);
+		 op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+										  TEEC_VALUE_INPUT,
+										  TEEC_MEMREF_TEMP_INPUT,
+										  TEEC_MEMREF_TEMP_OUTPUT);
+		 op.params[0].value.a = strtoul(argv[2], NULL, 0);
+		 op.params[0].value.b = in_size;
+		 op.params[1].value.a = strtoul(argv[4], NULL, 0);
+		 op.params[1].value.b = out_size;
+		 op.params[2].tmpref.buffer = program;
+		 op.params[2].tmpref.size = program_size;
+		 op.params[3].tmpref.buffer = outputs;
+		 op.params[3].tmpref.size = outputs_size;
+		 cmd = TA_REPLAY_CMD_RUN_BATCH;
+	 } else if (argc > 1 && !strcmp(argv[1], "stats")) {
+		 op.paramTypes = TEEC_PARAM_TYPES(TEEC_VALUE_INPUT,
+										  TEEC_MEMREF_TEMP_OUTPUT,
+										  TEEC_NONE,
+										  TEEC_NONE);
+		 op.params[0].value.a = argc > 2 && !strcmp(argv[2], "reset");
+		 op.params[1].tmpref.buffer = stats;
+		 op.params[1].tmpref.size = sizeof(stats);
+		 cmd = TA_REPLAY_CMD_GET_STATS;
+	 } else if (argc > 1) {
+		 program = read_file(argv[1], &program_size);
+		 op.paramTypes = TEEC_PARAM_TYPES(TEEC_MEMREF_TEMP_INPUT,
+										  argc > 2 ? TEEC_VALUE_INPUT : TEEC_NONE,
+										  TEEC_NONE,
+										  TEEC_NONE);
+		 op.params[0].tmpref.buffer = program;
+		 op.params[0].tmpref.size = program_size;
+		 if (argc > 2)
+			 op.params[1].value.a = strtoul(argv[2], NULL, 0);
+		 cmd = TA_REPLAY_CMD_RUN_PROGRAM;
+	 }
  
-	 printf("Invoking Replay TA to run Ethos‑U replay...\n");
+	 if (cmd != TA_REPLAY_CMD_GET_STATS)
+		 printf("Invoking Replay TA to run Ethos‑U replay...\n");
 	 res = TEEC_InvokeCommand(&sess,
-							  TA_REPLAY_CMD_RUN,
+							  cmd,
 							  &op, &err_origin);
 	 if (res != TEEC_SUCCESS)
 		 errx(1, "TEEC_InvokeCommand failed: 0x%x, origin 0x%x",
 			  res, err_origin);
  
+	 if (cmd == TA_REPLAY_CMD_RUN_BATCH) {
+		 write_file(argv[7], outputs, outputs_size);
+		 printf("%zu inferences\n", program_size / op.params[0].value.b);
+	 }
+	 if (cmd == TA_REPLAY_CMD_GET_STATS) {
+		 print_stats(stats);
+		 TEEC_CloseSession(&sess);
+		 TEEC_FinalizeContext(&ctx);
+		 return 0;
+	 }
+	 if (cmd == TA_REPLAY_CMD_STORE_PROGRAM) {
+		 for (size_t i = 0; i < sizeof(digest); i++)
+			 printf("%02x", digest[i]);
+		 printf("\n");
+	 }
 	 printf("Replay TA completed successfully.\n");
  
 	 /* 4. 关闭会话并释放资源 */
 	 TEEC_CloseSession(&sess);
 	 TEEC_FinalizeContext(&ctx);
+	 free(program);
+	 free(outputs);
 	 return 0;
  }
  
\ No newline at end of file
@@ -13,5 +13,57 @@
 
 /* 伪TA里定义的命令号 */
 #define TA_REPLAY_CMD_RUN    0
+/* [in] memref[0]: rrtrace.py program 生成的重放程序 */
+#define TA_REPLAY_CMD_RUN_PROGRAM 1
+/*
+ * 把重放程序存进安全存储
+ * [in]  memref[0]: 重放程序
+ * [out] memref[1]: 32 字节 SHA-256 摘要，模型的 ID
+ */
+#define TA_REPLAY_CMD_STORE_PROGRAM 2
+/*
+ * 运行安全存储里的模型，常驻 OCRAM 时不用重新加载
+ * [in] memref[0]: TA_REPLAY_CMD_STORE_PROGRAM 返回的摘要
+ */
+#define TA_REPLAY_CMD_RUN_MODEL 3
+/*
+ * 批量推理：同一会话里只有第一批初始化 NPU
+ * [in]  value[0]: a = 输入槽物理地址，b = 每个输入的字节数
+ * [in]  value[1]: a = 输出物理地址，b = 每个输出的字节数
+ * [in]  memref[2]: N 个输入，首尾相接
+ * [out] memref[3]: N 个输出，首尾相接
+ */
+#define TA_REPLAY_CMD_RUN_BATCH 4
+
+/*
+ * 读重放各阶段的耗时统计
+ * [in]  value[0]: a 非零时读完清零
+ * [out] memref[1]: struct ta_replay_phase_stats[TA_REPLAY_PHASE_COUNT]
+ */
+#define TA_REPLAY_CMD_GET_STATS 5
+
+/* 模型摘要的字节数 */
+#define TA_REPLAY_DIGEST_SIZE 32
+
+/*
+ * 统计的阶段，顺序和 OP-TEE 的 enum replay_phase 一致：NPU 复位和验证、
+ * 启动命令流的寄存器写、等 NPU 完成、中断应答、拷进 OCRAM、拷出 OCRAM
+ */
+#define TA_REPLAY_PHASE_INIT     0
+#define TA_REPLAY_PHASE_KICK     1
+#define TA_REPLAY_PHASE_NPU      2
+#define TA_REPLAY_PHASE_IRQ_ACK  3
+#define TA_REPLAY_PHASE_COPY_IN  4
+#define TA_REPLAY_PHASE_COPY_OUT 5
+#define TA_REPLAY_PHASE_COUNT    6
+
+/* 一个阶段的耗时，单位 ns；p99 误差在 12.5% 以内 */
+struct ta_replay_phase_stats {
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t avg_ns;
+    uint32_t max_ns;
+    uint32_t p99_ns;
+};
 
 #endif /* REPLAY_TA_H */
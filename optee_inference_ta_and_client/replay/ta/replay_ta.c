@@ -10,6 +10,14 @@
 #include "replay_ta.h"
 
 #define REPLAY_CMD_RUN 0
+#define REPLAY_CMD_RUN_PROGRAM 1
+#define REPLAY_CMD_CACHE_LOAD 2
+#define REPLAY_CMD_CACHE_RUN 3
+#define REPLAY_CMD_RUN_BATCH 4
+#define REPLAY_CMD_GET_STATS 5
+
+/* 从安全存储读模型、交给 PTA 的块大小，受 TA 堆大小限制 */
+#define REPLAY_LOAD_CHUNK (16 * 1024)
 
 /* 把宏 TA_REPLAY_UUID 展开成变量，传给 TEE_OpenTASession */
 static const TEE_UUID replay_pta_uuid = {
@@ -17,6 +25,14 @@ static const TEE_UUID replay_pta_uuid = {
     { 0x81, 0x6e, 0x76, 0x86, 0x1c, 0xb0, 0x27, 0x47 }
 };
 
+/*
+ * 客户端会话：批量推理要在同一个 PTA 会话里才能保持 NPU 热，
+ * 所以第一次批量推理时打开，客户端关会话时才关
+ */
+struct replay_sess {
+    TEE_TASessionHandle pta_sess;
+};
+
 /* TA 创建时调用 */
 TEE_Result TA_CreateEntryPoint(void)
 {
@@ -39,8 +55,16 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
                                    TEE_PARAM_TYPE_NONE,
                                    TEE_PARAM_TYPE_NONE,
                                    TEE_PARAM_TYPE_NONE);
+    struct replay_sess *sess;
+
     if (param_types != exp)
         return TEE_ERROR_BAD_PARAMETERS;
+
+    sess = TEE_Malloc(sizeof(*sess), TEE_MALLOC_FILL_ZERO);
+    if (!sess)
+        return TEE_ERROR_OUT_OF_MEMORY;
+    sess->pta_sess = TEE_HANDLE_NULL;
+    *sess_ctx = sess;
     DMSG("Replay TA session opened");
     return TEE_SUCCESS;
 }
@@ -48,60 +72,326 @@ TEE_Result TA_OpenSessionEntryPoint(uint32_t param_types,
 /* 关闭会话时调用 */
 void TA_CloseSessionEntryPoint(void *sess_ctx)
 {
-    (void)sess_ctx;
+    struct replay_sess *sess = sess_ctx;
+
+    if (sess->pta_sess != TEE_HANDLE_NULL)
+        TEE_CloseTASession(sess->pta_sess);
+    TEE_Free(sess);
     DMSG("Replay TA session closed");
 }
 
-/* 真正执行 replay 的函数 */
-static TEE_Result run_replay(uint32_t param_types, TEE_Param params[4])
+/* 打开到 replay PTA 的会话 */
+static TEE_Result open_replay_pta(TEE_TASessionHandle *sess)
 {
     uint32_t origin = TEE_ORIGIN_API;
-    TEE_TASessionHandle pta_sess = TEE_HANDLE_NULL;
     TEE_Result res;
 
-    if (param_types != TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
-                                       TEE_PARAM_TYPE_NONE,
-                                       TEE_PARAM_TYPE_NONE,
-                                       TEE_PARAM_TYPE_NONE))
-        return TEE_ERROR_BAD_PARAMETERS;
-
-    /* 1) 打开到 replay PTA 的会话 */
     res = TEE_OpenTASession(&replay_pta_uuid,
                             TEE_LOGIN_PUBLIC,
                             TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
                                             TEE_PARAM_TYPE_NONE,
                                             TEE_PARAM_TYPE_NONE,
                                             TEE_PARAM_TYPE_NONE),
-                            NULL, &pta_sess, &origin);
-    if (res != TEE_SUCCESS) {
+                            NULL, sess, &origin);
+    if (res != TEE_SUCCESS)
         EMSG("TEE_OpenTASession failed: 0x%x origin %u", res, origin);
+    return res;
+}
+
+/*
+ * 真正执行 replay 的函数：pta_cmd 为 REPLAY_CMD_RUN（无参数）或
+ * REPLAY_CMD_RUN_PROGRAM（memref[0] 为重放程序，可选的 value[1].a 为模型内存段
+ * 地址，原样转给 PTA）
+ */
+static TEE_Result run_replay(uint32_t pta_cmd, uint32_t param_types,
+                             TEE_Param params[4])
+{
+    uint32_t origin = TEE_ORIGIN_API;
+    TEE_TASessionHandle pta_sess = TEE_HANDLE_NULL;
+    TEE_Result res;
+    uint32_t exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
+                                   TEE_PARAM_TYPE_NONE,
+                                   TEE_PARAM_TYPE_NONE,
+                                   TEE_PARAM_TYPE_NONE);
+
+    if (pta_cmd == REPLAY_CMD_RUN_PROGRAM)
+        exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                              TEE_PARAM_TYPE_NONE,
+                              TEE_PARAM_TYPE_NONE,
+                              TEE_PARAM_TYPE_NONE);
+    if (pta_cmd == REPLAY_CMD_RUN_PROGRAM &&
+        TEE_PARAM_GET_TYPE(param_types, 1) == TEE_PARAM_TYPE_VALUE_INPUT)
+        exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                              TEE_PARAM_TYPE_VALUE_INPUT,
+                              TEE_PARAM_TYPE_NONE,
+                              TEE_PARAM_TYPE_NONE);
+    if (param_types != exp)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    /* 1) 打开到 replay PTA 的会话 */
+    res = open_replay_pta(&pta_sess);
+    if (res != TEE_SUCCESS)
         return res;
-    }
 
-    /* 2) 发 “REPLAY_CMD_RUN” 命令给 PTA */
+    /* 2) 把命令发给 PTA */
     res = TEE_InvokeTACommand(pta_sess,
                               TEE_TIMEOUT_INFINITE,
-                              REPLAY_CMD_RUN,
-                              TEE_PARAM_TYPES(TEE_PARAM_TYPE_NONE,
-                                              TEE_PARAM_TYPE_NONE,
-                                              TEE_PARAM_TYPE_NONE,
-                                              TEE_PARAM_TYPE_NONE),
-                              NULL, &origin);
+                              pta_cmd,
+                              param_types,
+                              params, &origin);
     if (res != TEE_SUCCESS)
-        EMSG("TEE_InvokeTACommand(REPLAY_CMD_RUN) failed: 0x%x origin %u", res, origin);
+        EMSG("TEE_InvokeTACommand(%u) failed: 0x%x origin %u", pta_cmd, res, origin);
 
     /* 3) 关闭会话 */
     TEE_CloseTASession(pta_sess);
     return res;
 }
 
+/*
+ * 把重放程序存进安全存储，对象 ID 是镜像的 SHA-256
+ * [in]  memref[0]: 重放程序
+ * [out] memref[1]: 32 字节摘要，之后用它运行模型
+ */
+static TEE_Result store_program(uint32_t param_types, TEE_Param params[4])
+{
+    TEE_OperationHandle op = TEE_HANDLE_NULL;
+    TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+    uint8_t digest[TA_REPLAY_DIGEST_SIZE];
+    size_t digest_len = sizeof(digest);
+    TEE_Result res;
+    uint32_t exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                   TEE_PARAM_TYPE_NONE,
+                                   TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp || !params[0].memref.size)
+        return TEE_ERROR_BAD_PARAMETERS;
+    if (params[1].memref.size < sizeof(digest)) {
+        params[1].memref.size = sizeof(digest);
+        return TEE_ERROR_SHORT_BUFFER;
+    }
+
+    res = TEE_AllocateOperation(&op, TEE_ALG_SHA256, TEE_MODE_DIGEST, 0);
+    if (res != TEE_SUCCESS)
+        return res;
+    res = TEE_DigestDoFinal(op, params[0].memref.buffer,
+                            params[0].memref.size, digest, &digest_len);
+    TEE_FreeOperation(op);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    /*
+     * 镜像在共享内存里，写入的内容可能和算摘要时不同；PTA 加载时会按摘要
+     * 重新校验，所以这里不用先拷贝
+     */
+    res = TEE_CreatePersistentObject(TEE_STORAGE_PRIVATE,
+                                     digest, sizeof(digest),
+                                     TEE_DATA_FLAG_ACCESS_READ |
+                                     TEE_DATA_FLAG_ACCESS_WRITE_META |
+                                     TEE_DATA_FLAG_OVERWRITE,
+                                     TEE_HANDLE_NULL,
+                                     params[0].memref.buffer,
+                                     params[0].memref.size, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("TEE_CreatePersistentObject failed: 0x%x", res);
+        return res;
+    }
+    TEE_CloseObject(obj);
+
+    TEE_MemMove(params[1].memref.buffer, digest, sizeof(digest));
+    params[1].memref.size = sizeof(digest);
+    return TEE_SUCCESS;
+}
+
+/* 从安全存储按块读出模型，写进 PTA 的模型缓存 */
+static TEE_Result load_model(TEE_TASessionHandle pta_sess,
+                             uint8_t digest[TA_REPLAY_DIGEST_SIZE])
+{
+    TEE_ObjectHandle obj = TEE_HANDLE_NULL;
+    TEE_ObjectInfo info;
+    TEE_Param p[4] = { };
+    uint32_t origin;
+    uint32_t offset = 0;
+    size_t n;
+    void *chunk;
+    TEE_Result res;
+
+    res = TEE_OpenPersistentObject(TEE_STORAGE_PRIVATE,
+                                   digest, TA_REPLAY_DIGEST_SIZE,
+                                   TEE_DATA_FLAG_ACCESS_READ, &obj);
+    if (res != TEE_SUCCESS) {
+        EMSG("model not in secure storage: 0x%x", res);
+        return res;
+    }
+    res = TEE_GetObjectInfo1(obj, &info);
+    if (res != TEE_SUCCESS)
+        goto out;
+
+    chunk = TEE_Malloc(REPLAY_LOAD_CHUNK, TEE_MALLOC_FILL_ZERO);
+    if (!chunk) {
+        res = TEE_ERROR_OUT_OF_MEMORY;
+        goto out;
+    }
+
+    p[0].memref.buffer = digest;
+    p[0].memref.size = TA_REPLAY_DIGEST_SIZE;
+    p[1].value.a = info.dataSize;
+    p[2].memref.buffer = chunk;
+    while (offset < info.dataSize) {
+        res = TEE_ReadObjectData(obj, chunk, REPLAY_LOAD_CHUNK, &n);
+        if (res != TEE_SUCCESS || !n) {
+            res = res ? res : TEE_ERROR_CORRUPT_OBJECT;
+            break;
+        }
+        p[1].value.b = offset;
+        p[2].memref.size = n;
+        res = TEE_InvokeTACommand(pta_sess, TEE_TIMEOUT_INFINITE,
+                                  REPLAY_CMD_CACHE_LOAD,
+                                  TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                  TEE_PARAM_TYPE_VALUE_INPUT,
+                                                  TEE_PARAM_TYPE_MEMREF_INPUT,
+                                                  TEE_PARAM_TYPE_NONE),
+                                  p, &origin);
+        if (res != TEE_SUCCESS) {
+            EMSG("REPLAY_CMD_CACHE_LOAD failed: 0x%x origin %u", res, origin);
+            break;
+        }
+        offset += n;
+    }
+    TEE_Free(chunk);
+out:
+    TEE_CloseObject(obj);
+    return res;
+}
+
+/*
+ * 按摘要运行模型：先试 PTA 的模型缓存，不在缓存里就从安全存储加载
+ * [in] memref[0]: store_program() 返回的摘要
+ */
+static TEE_Result run_model(uint32_t param_types, TEE_Param params[4])
+{
+    TEE_TASessionHandle pta_sess = TEE_HANDLE_NULL;
+    uint8_t digest[TA_REPLAY_DIGEST_SIZE];
+    TEE_Param p[4] = { };
+    uint32_t origin;
+    TEE_Result res;
+    uint32_t pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE,
+                                  TEE_PARAM_TYPE_NONE);
+
+    if (param_types != pt || params[0].memref.size != sizeof(digest))
+        return TEE_ERROR_BAD_PARAMETERS;
+    TEE_MemMove(digest, params[0].memref.buffer, sizeof(digest));
+
+    res = open_replay_pta(&pta_sess);
+    if (res != TEE_SUCCESS)
+        return res;
+
+    p[0].memref.buffer = digest;
+    p[0].memref.size = sizeof(digest);
+    res = TEE_InvokeTACommand(pta_sess, TEE_TIMEOUT_INFINITE,
+                              REPLAY_CMD_CACHE_RUN, pt, p, &origin);
+    if (res == TEE_ERROR_ITEM_NOT_FOUND) {
+        DMSG("model not resident, loading it from secure storage");
+        res = load_model(pta_sess, digest);
+        if (res == TEE_SUCCESS)
+            res = TEE_InvokeTACommand(pta_sess, TEE_TIMEOUT_INFINITE,
+                                      REPLAY_CMD_CACHE_RUN, pt, p, &origin);
+    }
+    if (res != TEE_SUCCESS)
+        EMSG("running model failed: 0x%x", res);
+
+    TEE_CloseTASession(pta_sess);
+    return res;
+}
+
+/*
+ * 批量推理，参数原样转给 PTA 的 REPLAY_CMD_RUN_BATCH
+ * [in]  value[0]: 输入槽物理地址、每个输入的字节数
+ * [in]  value[1]: 输出物理地址、每个输出的字节数
+ * [in]  memref[2]: N 个输入
+ * [out] memref[3]: N 个输出
+ */
+static TEE_Result run_batch(struct replay_sess *sess, uint32_t param_types,
+                            TEE_Param params[4])
+{
+    uint32_t origin = TEE_ORIGIN_API;
+    TEE_Result res;
+    uint32_t exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+                                   TEE_PARAM_TYPE_VALUE_INPUT,
+                                   TEE_PARAM_TYPE_MEMREF_INPUT,
+                                   TEE_PARAM_TYPE_MEMREF_OUTPUT);
+
+    if (param_types != exp)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (sess->pta_sess == TEE_HANDLE_NULL) {
+        res = open_replay_pta(&sess->pta_sess);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    res = TEE_InvokeTACommand(sess->pta_sess, TEE_TIMEOUT_INFINITE,
+                              REPLAY_CMD_RUN_BATCH, param_types, params,
+                              &origin);
+    if (res != TEE_SUCCESS)
+        EMSG("REPLAY_CMD_RUN_BATCH failed: 0x%x origin %u", res, origin);
+    return res;
+}
+
+/*
+ * 读各阶段的耗时统计，参数原样转给 PTA 的 REPLAY_CMD_GET_STATS
+ * [in]  value[0]: a 非零时读完清零
+ * [out] memref[1]: struct ta_replay_phase_stats[TA_REPLAY_PHASE_COUNT]
+ */
+static TEE_Result get_stats(struct replay_sess *sess, uint32_t param_types,
+                            TEE_Param params[4])
+{
+    uint32_t origin = TEE_ORIGIN_API;
+    TEE_Result res;
+    uint32_t exp = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_INPUT,
+                                   TEE_PARAM_TYPE_MEMREF_OUTPUT,
+                                   TEE_PARAM_TYPE_NONE,
+                                   TEE_PARAM_TYPE_NONE);
+
+    if (param_types != exp)
+        return TEE_ERROR_BAD_PARAMETERS;
+
+    if (sess->pta_sess == TEE_HANDLE_NULL) {
+        res = open_replay_pta(&sess->pta_sess);
+        if (res != TEE_SUCCESS)
+            return res;
+    }
+
+    res = TEE_InvokeTACommand(sess->pta_sess, TEE_TIMEOUT_INFINITE,
+                              REPLAY_CMD_GET_STATS, param_types, params,
+                              &origin);
+    if (res != TEE_SUCCESS && res != TEE_ERROR_SHORT_BUFFER)
+        EMSG("REPLAY_CMD_GET_STATS failed: 0x%x origin %u", res, origin);
+    return res;
+}
+
 /* TA 收到客户端调用时的入口 */
-TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx __maybe_unused,
+TEE_Result TA_InvokeCommandEntryPoint(void *sess_ctx,
                                       uint32_t cmd_id,
                                       uint32_t param_types,
                                       TEE_Param params[4])
 {
-    if (cmd_id == TA_REPLAY_CMD_RUN)
-        return run_replay(param_types, params);
-    return TEE_ERROR_BAD_PARAMETERS;
+    switch (cmd_id) {
+    case TA_REPLAY_CMD_RUN:
+        return run_replay(REPLAY_CMD_RUN, param_types, params);
+    case TA_REPLAY_CMD_RUN_PROGRAM:
+        return run_replay(REPLAY_CMD_RUN_PROGRAM, param_types, params);
+    case TA_REPLAY_CMD_STORE_PROGRAM:
+        return store_program(param_types, params);
+    case TA_REPLAY_CMD_RUN_MODEL:
+        return run_model(param_types, params);
+    case TA_REPLAY_CMD_RUN_BATCH:
+        return run_batch(sess_ctx, param_types, params);
+    case TA_REPLAY_CMD_GET_STATS:
+        return get_stats(sess_ctx, param_types, params);
+    default:
+        return TEE_ERROR_BAD_PARAMETERS;
+    }
 }
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Build one release image per recording level (0 = off, 1 = values, 2 = full)
+# with the ethosu_invoke_regions latency benchmark enabled.
+mkdir -p bench
+for level in 0 1 2; do
+if [ -d "CMakeFiles" ];then rm -rf CMakeFiles; fi
+if [ -f "Makefile" ];then rm -f Makefile; fi
+if [ -f "cmake_install.cmake" ];then rm -f cmake_install.cmake; fi
+if [ -f "CMakeCache.txt" ];then rm -f CMakeCache.txt; fi
+cmake -DCMAKE_TOOLCHAIN_FILE="../../../../../tools/cmake_toolchain_files/armgcc.cmake" -G "Unix Makefiles" -DCMAKE_BUILD_TYPE=release -DETHOSU_RECORD_LEVEL=$level -DETHOSU_RECORD_BENCH=ON  .
+make -j5 | tee build_log.txt
+cp release/ethosu_apps.elf bench/ethosu_apps_record$level.elf
+cp release/ethosu_apps.bin bench/ethosu_apps_record$level.bin
+done
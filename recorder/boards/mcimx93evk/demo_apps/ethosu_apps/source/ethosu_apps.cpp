@@ -10,6 +10,7 @@
 #include "fsl_debug_console.h"
 
 #include "ethosu_driver.h"
+#include "ethosu_dlog.h"
 #include "ethosu_core_interface.h"
 #include "inference_process.hpp"
 // #include "add_model.hpp"
@@ -25,6 +26,9 @@
 //#include "softmax_model.hpp"
 #include "fsl_device_registers.h"
 #include "replay_templates_conv2d.h"
+#ifdef ETHOSU_RECORD_BENCH
+#include "record_bench.h"
+#endif
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -77,7 +81,7 @@ int main(void)
         return 1;
     }
 
-    NVIC_SetVector((IRQn_Type)ETHOSU_IRQ, (uint32_t)&ethosu_irq_handler);
+    NVIC_SetVector((IRQn_Type)ETHOSU_IRQ, (uint32_t)&ethosu_irq_dispatch);
     NVIC_EnableIRQ((IRQn_Type)ETHOSU_IRQ);
 
     // 复制模型数据到 OCRAM 的前 MODEL_REGION_SIZE 区域
@@ -124,7 +128,20 @@ int main(void)
         PRINTF("Inference status: failed\r\n");
     else
         PRINTF("Inference status: success\r\n");
+
+#ifdef ETHOSU_RECORD_BENCH
+    // 首次推理作为预热，之后统计 ethosu_invoke_regions 的耗时
+    record_bench_reset();
+    for (int i = 0; i < ETHOSU_RECORD_BENCH_RUNS; i++) {
+        if (inferenceprocess.runJob(job)) {
+            PRINTF("Benchmark run %d failed\r\n", i);
+            break;
+        }
+    }
+    record_bench_report();
+#endif
    
 dump_reg_op_records();
+ethosu_dlog_dump();
     return 0;
 }
\ No newline at end of file
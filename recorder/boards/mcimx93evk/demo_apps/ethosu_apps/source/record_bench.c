@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * ethosu_invoke_regions latency at the compiled-in ETHOSU_RECORD_LEVEL.
+ *
+ * Built only with -DETHOSU_RECORD_BENCH=ON, which links the image with
+ * -Wl,--wrap=ethosu_invoke_regions so every call from the TFLM Ethos-U kernel
+ * lands here first. Run build_bench.sh to get one image per level.
+ */
+
+#include "record_bench.h"
+
+#include "ethosu_driver.h"
+#include "ethosu_trace.h"
+#include "fsl_common.h"
+#include "fsl_debug_console.h"
+
+#include <stdint.h>
+
+int __real_ethosu_invoke_regions(struct ethosu_driver *drv,
+                                 const void *custom_data_ptr,
+                                 const int custom_data_size,
+                                 const uint64_t *base_addr,
+                                 const size_t *base_addr_size,
+                                 const uint8_t *base_addr_flags,
+                                 const int num_base_addr,
+                                 void *user_arg);
+
+static uint32_t bench_count;
+static uint32_t bench_min;
+static uint32_t bench_max;
+static uint64_t bench_total;
+
+void record_bench_reset(void)
+{
+    MSDK_EnableCpuCycleCounter();
+    bench_count = 0;
+    bench_min   = UINT32_MAX;
+    bench_max   = 0;
+    bench_total = 0;
+}
+
+int __wrap_ethosu_invoke_regions(struct ethosu_driver *drv,
+                                 const void *custom_data_ptr,
+                                 const int custom_data_size,
+                                 const uint64_t *base_addr,
+                                 const size_t *base_addr_size,
+                                 const uint8_t *base_addr_flags,
+                                 const int num_base_addr,
+                                 void *user_arg)
+{
+#if ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+    /* Every run records into an empty trace, otherwise later runs would hit
+     * the truncation early-out and look cheaper than they are */
+    ethosu_trace_reset(ethosu_trace_header()->reg_base);
+#endif
+
+    uint32_t start = MSDK_GetCpuCycleCount();
+    int ret = __real_ethosu_invoke_regions(drv, custom_data_ptr, custom_data_size, base_addr, base_addr_size,
+                                           base_addr_flags, num_base_addr, user_arg);
+    uint32_t cycles = MSDK_GetCpuCycleCount() - start;
+
+    bench_count++;
+    bench_total += cycles;
+    if (cycles < bench_min) {
+        bench_min = cycles;
+    }
+    if (cycles > bench_max) {
+        bench_max = cycles;
+    }
+
+    return ret;
+}
+
+void record_bench_report(void)
+{
+    if (bench_count == 0) {
+        PRINTF("BENCH level=%d: no ethosu_invoke_regions calls\r\n", ETHOSU_RECORD_LEVEL);
+        return;
+    }
+
+    uint32_t avg = (uint32_t)(bench_total / bench_count);
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    PRINTF("BENCH level=%d invokes=%u cycles min=%u avg=%u max=%u (avg %u us @ %u MHz)\r\n",
+           ETHOSU_RECORD_LEVEL,
+           bench_count,
+           bench_min,
+           avg,
+           bench_max,
+           mhz ? avg / mhz : 0,
+           mhz);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef RECORD_BENCH_H
+#define RECORD_BENCH_H
+
+#ifndef ETHOSU_RECORD_BENCH_RUNS
+#define ETHOSU_RECORD_BENCH_RUNS 100
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Clear the ethosu_invoke_v3 latency statistics and start the DWT counter */
+void record_bench_reset(void);
+
+/* Print min/avg/max ethosu_invoke_v3 cycles since the last reset */
+void record_bench_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECORD_BENCH_H
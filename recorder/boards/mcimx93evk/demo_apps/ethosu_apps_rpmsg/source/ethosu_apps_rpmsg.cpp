@@ -21,6 +21,7 @@
 #include "ethosu_core_interface.h"
 #include "inference_parser.hpp"
 #include "inference_process.hpp"
+#include "trace_stream.h"
 
 #include "rpmsg_lite.h"
 #include "rpmsg_queue.h"
@@ -60,6 +61,10 @@ using namespace EthosU;
 
 struct ethosu_driver ethosu_drv;
 
+// Kept across requests so a model that is submitted again reuses its
+// prepared interpreter; pointed at each request's tensor arena
+static InferenceProcess::InferenceProcess inferenceprocess(nullptr, 0);
+
 static TaskHandle_t app_task_handle = NULL;
 
 static int sendVersionRsp(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
@@ -174,44 +179,20 @@ static int sendCapabilitiesRsp(struct rpmsg_lite_instance *volatile ethosu_rpmsg
     return 0;
 }
 
-static int handleInferenceReq(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
-			      struct rpmsg_lite_endpoint *volatile ethosu_ept,
-			      volatile uint32_t remote_addr,
-			      ethosu_core_inference_req *req, uint32_t reqlen)
+static InferenceProcess::InferenceJob requestJob(ethosu_core_inference_req *req)
 {
-    struct ethosu_core_msg msg = {
-        .magic  = ETHOSU_CORE_MSG_MAGIC,
-	.type   = ETHOSU_CORE_MSG_INFERENCE_RSP,
-	.length = sizeof(ethosu_core_inference_rsp)
-    };
-    int32_t result;
-    ethosu_core_inference_rsp rsp;
-    void *tx_buf;
-    uint32_t size;
-
-    LOG_INFO("InferenceReq. network={0x%x, %u}, ifm={%u, 0x%x, %u}, ofm={%u, 0x%x, %u}, user_arg={0x%x}\r\n",
-	   req->network.buffer.ptr, req->network.buffer.size, req->ifm_count,
-	   req->ifm[0].ptr, req->ifm[0].size, req->ofm_count,
-	   req->ofm[0].ptr, req->ofm[0].size, req->user_arg);
+    // Linux may have rewritten the network buffer in place since the last
+    // request, weights included, which the interpreter cache does not check
+    ethosu_forget_const_regions();
 
     InferenceProcess::DataPtr networkModel(reinterpret_cast<void *>(req->network.buffer.ptr), req->network.buffer.size);
 
     bool isEthosuOp = (req->inference_type == ETHOSU_CORE_INFERENCE_OP);
-    uint8_t *tensorArena = NULL;
-    size_t tensorArenaSize = 0;
     std::vector<InferenceProcess::DataPtr> ifm;
-    if (isEthosuOp) {
-        for (uint32_t i = 0; i < req->ifm_count; ++i) {
-            ifm.push_back(InferenceProcess::DataPtr(reinterpret_cast<void *>(req->ifm[i].ptr), req->ifm[i].size));
-        }
-        // EthosuOp inference don't need tensor arena memory
-    } else {
-        // ifm[0] is used as tensor arena memory
-        tensorArena = reinterpret_cast<uint8_t *>(req->ifm[0].ptr);
-        tensorArenaSize = req->ifm[0].size;
-        for (uint32_t i = 1; i < req->ifm_count; ++i) {
-            ifm.push_back(InferenceProcess::DataPtr(reinterpret_cast<void *>(req->ifm[i].ptr), req->ifm[i].size));
-        }
+    // For a model, ifm[0] is used as tensor arena memory
+    // EthosuOp inference don't need tensor arena memory
+    for (uint32_t i = isEthosuOp ? 0 : 1; i < req->ifm_count; ++i) {
+        ifm.push_back(InferenceProcess::DataPtr(reinterpret_cast<void *>(req->ifm[i].ptr), req->ifm[i].size));
     }
 
     std::vector<InferenceProcess::DataPtr> ofm;
@@ -225,12 +206,26 @@ static int handleInferenceReq(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
         pmuEventConfig[i] = req->pmu_event_config[i];
     }
 
-    InferenceProcess::InferenceJob job("job", networkModel, ifm, ofm, expectedOutput, pmuEventConfig,
-                                       req->pmu_cycle_counter_enable, &ethosu_drv, 0, nullptr, isEthosuOp);
-    job.invalidate();
+    return InferenceProcess::InferenceJob("job", networkModel, ifm, ofm, expectedOutput, pmuEventConfig,
+                                          req->pmu_cycle_counter_enable, &ethosu_drv, 0, nullptr, isEthosuOp);
+}
+
+static int sendInferenceRsp(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
+			    struct rpmsg_lite_endpoint *volatile ethosu_ept,
+			    volatile uint32_t remote_addr,
+			    ethosu_core_inference_req *req,
+			    InferenceProcess::InferenceJob &job, bool failed)
+{
+    struct ethosu_core_msg msg = {
+        .magic  = ETHOSU_CORE_MSG_MAGIC,
+	.type   = ETHOSU_CORE_MSG_INFERENCE_RSP,
+	.length = sizeof(ethosu_core_inference_rsp)
+    };
+    int32_t result;
+    ethosu_core_inference_rsp rsp;
+    void *tx_buf;
+    uint32_t size;
 
-    InferenceProcess::InferenceProcess inferenceprocess(tensorArena, tensorArenaSize);
-    bool failed = inferenceprocess.runJob(job);
     for (size_t i = 0; i < job.ethosuMonitor.numEvents; i++) {
         rsp.pmu_event_config[i] = job.ethosuMonitor.ethosuEventIds[i];
     }
@@ -245,7 +240,7 @@ static int handleInferenceReq(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
     rsp.ofm_count = job.output.size();
     rsp.status = failed ? ETHOSU_CORE_STATUS_ERROR : ETHOSU_CORE_STATUS_OK;
 
-    for (size_t i = 0; i < ofm.size(); ++i) {
+    for (size_t i = 0; i < job.output.size(); ++i) {
         rsp.ofm_size[i] = job.output[i].size;
     }
 
@@ -263,6 +258,120 @@ static int handleInferenceReq(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
     return 0;
 }
 
+static int handleInferenceReq(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
+			      struct rpmsg_lite_endpoint *volatile ethosu_ept,
+			      volatile uint32_t remote_addr,
+			      ethosu_core_inference_req *req, uint32_t reqlen)
+{
+    LOG_INFO("InferenceReq. network={0x%x, %u}, ifm={%u, 0x%x, %u}, ofm={%u, 0x%x, %u}, user_arg={0x%x}\r\n",
+	   req->network.buffer.ptr, req->network.buffer.size, req->ifm_count,
+	   req->ifm[0].ptr, req->ifm[0].size, req->ofm_count,
+	   req->ofm[0].ptr, req->ofm[0].size, req->user_arg);
+
+    InferenceProcess::InferenceJob job = requestJob(req);
+    job.invalidate();
+
+    if (!job.isEthosuOp) {
+        inferenceprocess.setTensorArena(reinterpret_cast<uint8_t *>(req->ifm[0].ptr), req->ifm[0].size);
+    }
+    bool failed = inferenceprocess.runJob(job);
+#if ETHOSU_TRACE_STREAM
+    trace_stream_flush();
+#endif
+    return sendInferenceRsp(ethosu_rpmsg, ethosu_ept, remote_addr, req, job, failed);
+}
+
+static ethosu_core_inference_req *inferenceReq(void *rx_buf)
+{
+    if (((ethosu_core_msg *)rx_buf)->type != ETHOSU_CORE_MSG_INFERENCE_REQ)
+        return NULL;
+    return (ethosu_core_inference_req *)((char *)rx_buf + sizeof(ethosu_core_msg));
+}
+
+/*
+ * An OP request that can share the driver queue with others. One that samples
+ * QREAD (a single output) needs the NPU alone.
+ */
+static bool isQueueableOp(const ethosu_core_inference_req *req)
+{
+    return req != NULL && req->inference_type == ETHOSU_CORE_INFERENCE_OP &&
+           req->ifm_count >= 2 && req->ofm_count != 1;
+}
+
+/*
+ * The batch shares one PMU session, so a request joins only with the PMU setup
+ * of the first one, and only with an arena of its own.
+ */
+static bool canJoinBatch(const ethosu_core_inference_req *req, void *const *batch, size_t count)
+{
+    const ethosu_core_inference_req *first = inferenceReq(batch[0]);
+
+    if (!isQueueableOp(req) || req->pmu_cycle_counter_enable != first->pmu_cycle_counter_enable ||
+        memcmp(req->pmu_event_config, first->pmu_event_config, sizeof(req->pmu_event_config)) != 0)
+        return false;
+
+    for (size_t i = 0; i < count; i++) {
+        const ethosu_core_buffer *arena = &inferenceReq(batch[i])->ifm[0];
+
+        if (req->ifm[0].ptr < arena->ptr + arena->size && arena->ptr < req->ifm[0].ptr + req->ifm[0].size)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Run the OP request in rx_buf together with the ones already waiting behind
+ * it, so the driver prepares each command stream while the NPU runs the one
+ * before it. Answers and frees every request of the batch. The first message
+ * that cannot join is returned for the main loop, NULL if there is none.
+ */
+static void *handleInferenceBatch(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
+				  struct rpmsg_lite_endpoint *volatile ethosu_ept,
+				  rpmsg_queue_handle ethosu_queue,
+				  volatile uint32_t remote_addr, void *rx_buf,
+				  uint32_t *next_addr)
+{
+    void *batch[ETHOSU_JOB_QUEUE_DEPTH];
+    size_t count = 0;
+    void *next = NULL;
+
+    batch[count++] = rx_buf;
+    while (count < ETHOSU_JOB_QUEUE_DEPTH) {
+        uint32_t addr;
+        uint32_t len;
+        void *buf;
+
+        if (rpmsg_queue_recv_nocopy(ethosu_rpmsg, ethosu_queue, &addr, (char **)&buf, &len, RL_DONT_BLOCK) != 0)
+            break;
+        if (addr != remote_addr || !canJoinBatch(inferenceReq(buf), batch, count)) {
+            next = buf;
+            *next_addr = addr;
+            break;
+        }
+        batch[count++] = buf;
+    }
+
+    std::vector<InferenceProcess::InferenceJob> jobs;
+    std::vector<InferenceProcess::InferenceJob *> queued;
+    jobs.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        jobs.push_back(requestJob(inferenceReq(batch[i])));
+        jobs.back().invalidate();
+        queued.push_back(&jobs.back());
+    }
+
+    std::vector<bool> failed = inferenceprocess.runEthosuOps(queued);
+#if ETHOSU_TRACE_STREAM
+    trace_stream_flush();
+#endif
+    for (size_t i = 0; i < count; i++) {
+        sendInferenceRsp(ethosu_rpmsg, ethosu_ept, remote_addr, inferenceReq(batch[i]), jobs[i], failed[i]);
+        if (rpmsg_queue_nocopy_free(ethosu_rpmsg, batch[i]) != 0)
+            assert(false);
+    }
+    return next;
+}
+
 static int sendNetworkInfoRsp(struct rpmsg_lite_instance *volatile ethosu_rpmsg,
 			      struct rpmsg_lite_endpoint *volatile ethosu_ept,
 			      volatile uint32_t remote_addr,
@@ -390,6 +499,8 @@ static void app_task(void *param)
     struct ethosu_core_msg *msg;
     int32_t result;
     void *rx_buf;
+    void *next_buf = NULL;
+    uint32_t next_addr = 0;
     uint32_t len;
 
     /* Print the initial banner */
@@ -416,16 +527,26 @@ static void app_task(void *param)
     ethosu_queue = rpmsg_queue_create(ethosu_rpmsg);
     ethosu_ept   = rpmsg_lite_create_ept(ethosu_rpmsg, LOCAL_EPT_ADDR, rpmsg_queue_rx_cb, ethosu_queue);
     (void)rpmsg_ns_announce(ethosu_rpmsg, ethosu_ept, RPMSG_LITE_NS_ANNOUNCE_STRING, RL_NS_CREATE);
+#if ETHOSU_TRACE_STREAM
+    (void)trace_stream_init(ethosu_rpmsg);
+#endif
 
     PRINTF("Nameservice sent, ready for incoming messages...\r\n");
 
     for (;;)
     {
-        /* Get RPMsg rx buffer with message */
-        result =
-            rpmsg_queue_recv_nocopy(ethosu_rpmsg, ethosu_queue, (uint32_t *)&remote_addr, (char **)&rx_buf, &len, RL_BLOCK);
-        if (result != 0)
-            assert(false);
+        if (next_buf != NULL) {
+            /* A message a batch stopped at */
+            rx_buf = next_buf;
+            remote_addr = next_addr;
+            next_buf = NULL;
+        } else {
+            /* Get RPMsg rx buffer with message */
+            result =
+                rpmsg_queue_recv_nocopy(ethosu_rpmsg, ethosu_queue, (uint32_t *)&remote_addr, (char **)&rx_buf, &len, RL_BLOCK);
+            if (result != 0)
+                assert(false);
+        }
 
 	msg = (ethosu_core_msg *)rx_buf;
 
@@ -440,6 +561,12 @@ static void app_task(void *param)
 	    break;
 	case ETHOSU_CORE_MSG_INFERENCE_REQ:
 	    LOG_INFO("Receive Message Inference Request");
+	    if (isQueueableOp(inferenceReq(rx_buf))) {
+	        /* Frees rx_buf and the requests batched with it */
+	        next_buf = handleInferenceBatch(ethosu_rpmsg, ethosu_ept, ethosu_queue, remote_addr,
+	                                        rx_buf, &next_addr);
+	        continue;
+	    }
 	    handleInferenceReq(ethosu_rpmsg, ethosu_ept, remote_addr,
 			       (ethosu_core_inference_req *)((char *)rx_buf + sizeof(ethosu_core_msg)),
 			       sizeof(ethosu_core_inference_req));
@@ -491,7 +618,11 @@ int main(void)
 	return 1;
     }
 
-    NVIC_SetVector((IRQn_Type)ETHOSU_IRQ, (uint32_t)&ethosu_irq_handler);
+    NVIC_SetVector((IRQn_Type)ETHOSU_IRQ, (uint32_t)&ethosu_irq_dispatch);
+#if ETHOSU_TRACE_STREAM
+    /* The trace hands full chunks to its task from the NPU interrupt */
+    NVIC_SetPriority((IRQn_Type)ETHOSU_IRQ, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+#endif
     NVIC_EnableIRQ((IRQn_Type)ETHOSU_IRQ);
 
     if (xTaskCreate(app_task, "APP_TASK", APP_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &app_task_handle) != pdPASS)
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "trace_stream.h"
+
+#include "ethosu_log.h"
+#include "ethosu_trace.h"
+#include "rpmsg_lite.h"
+#include "rpmsg_ns.h"
+#include "rpmsg_queue.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if ETHOSU_TRACE_STREAM && ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+
+#define TRACE_EPT_ADDR           (31)
+#define TRACE_NS_ANNOUNCE_STRING "rpmsg-raw"
+#define TRACE_TASK_STACK_SIZE    (1024)
+
+#define TRACE_EVT_CHUNK (1u << 0)
+#define TRACE_EVT_FLUSH (1u << 1)
+
+static struct rpmsg_lite_instance *trace_rpmsg;
+static struct rpmsg_lite_endpoint *trace_ept;
+static rpmsg_queue_handle trace_queue;
+static TaskHandle_t trace_task_handle;
+static SemaphoreHandle_t trace_flush_done;
+static volatile uint32_t trace_remote_addr = RL_ADDR_ANY;
+static uint32_t trace_seq;
+static uint32_t trace_blob_sent; /* arena bytes the collector already has */
+
+static int trace_send(uint16_t type, uint32_t offset, const void *payload, uint16_t len)
+{
+    ethosu_trace_chunk_t chunk = {
+        .magic  = ETHOSU_TRACE_MAGIC,
+        .type   = type,
+        .length = len,
+        .seq    = trace_seq++,
+        .offset = offset,
+    };
+    void *tx_buf;
+    uint32_t size;
+
+    tx_buf = rpmsg_lite_alloc_tx_buffer(trace_rpmsg, &size, RL_BLOCK);
+    if (tx_buf == NULL || size < sizeof(chunk) + len) {
+        return -1;
+    }
+
+    memcpy(tx_buf, &chunk, sizeof(chunk));
+    memcpy((char *)tx_buf + sizeof(chunk), payload, len);
+
+    return rpmsg_lite_send_nocopy(trace_rpmsg, trace_ept, trace_remote_addr, tx_buf, sizeof(chunk) + len);
+}
+
+static void trace_drain_records(void)
+{
+    const uint8_t *chunk;
+    uint32_t len;
+    uint32_t offset;
+
+    while ((chunk = ethosu_trace_chunk_peek(&len, &offset)) != NULL) {
+        if (trace_send(ETHOSU_TRACE_CHUNK_RECORDS, offset, chunk, (uint16_t)len) != 0) {
+            LOG_ERR("Failed to send trace chunk at offset %u", offset);
+        }
+        ethosu_trace_chunk_release();
+    }
+}
+
+static void trace_finish(void)
+{
+    const ethosu_trace_header_t *hdr = ethosu_trace_header();
+    const uint8_t *blobs             = ethosu_trace_blobs();
+
+    /* Both chunks may be full, so drain before sealing the last one. The
+     * trace is not reset: the next inference keeps appending to it, and the
+     * collector always has every inference since ethosu_init. */
+    trace_drain_records();
+    (void)ethosu_trace_seal();
+    trace_drain_records();
+
+    /* The arena only grows, so only the part after trace_blob_sent is new */
+    while (blobs != NULL && trace_blob_sent < hdr->blob_bytes) {
+        uint32_t n = hdr->blob_bytes - trace_blob_sent;
+        if (n > ETHOSU_TRACE_CHUNK_BYTES) {
+            n = ETHOSU_TRACE_CHUNK_BYTES;
+        }
+        (void)trace_send(ETHOSU_TRACE_CHUNK_BLOBS, trace_blob_sent, blobs + trace_blob_sent, (uint16_t)n);
+        trace_blob_sent += n;
+    }
+
+    (void)trace_send(ETHOSU_TRACE_CHUNK_END, 0, hdr, sizeof(*hdr));
+    LOG_INFO("Trace sent: %u records, %u record bytes, %u blob bytes",
+             hdr->record_count, hdr->record_bytes, hdr->blob_bytes);
+}
+
+static void trace_task(void *param)
+{
+    uint32_t remote_addr;
+    uint32_t events;
+    char *rx_buf;
+    uint32_t len;
+
+    (void)param;
+
+    /* The collector opens the channel with a HELLO, which also tells us its address */
+    if (rpmsg_queue_recv_nocopy(trace_rpmsg, trace_queue, &remote_addr, &rx_buf, &len, RL_BLOCK) != 0) {
+        LOG_ERR("Trace channel receive failed");
+        vTaskDelete(NULL);
+    }
+    trace_remote_addr = remote_addr;
+    (void)rpmsg_queue_nocopy_free(trace_rpmsg, rx_buf);
+    LOG_INFO("Trace collector connected, addr=%u", remote_addr);
+
+    for (;;) {
+        (void)xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+
+        trace_drain_records();
+
+        if (events & TRACE_EVT_FLUSH) {
+            trace_finish();
+            (void)xSemaphoreGive(trace_flush_done);
+        }
+    }
+}
+
+void ethosu_trace_chunk_ready(void)
+{
+    if (trace_task_handle == NULL) {
+        return;
+    }
+
+    /* The last chunk of an inference usually fills up in the NPU interrupt */
+    if (xPortIsInsideInterrupt()) {
+        BaseType_t woken = pdFALSE;
+        (void)xTaskNotifyFromISR(trace_task_handle, TRACE_EVT_CHUNK, eSetBits, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        (void)xTaskNotify(trace_task_handle, TRACE_EVT_CHUNK, eSetBits);
+    }
+}
+
+int trace_stream_init(struct rpmsg_lite_instance *rpmsg)
+{
+    trace_rpmsg      = rpmsg;
+    trace_queue      = rpmsg_queue_create(rpmsg);
+    trace_ept        = rpmsg_lite_create_ept(rpmsg, TRACE_EPT_ADDR, rpmsg_queue_rx_cb, trace_queue);
+    trace_flush_done = xSemaphoreCreateBinary();
+    if (trace_queue == NULL || trace_ept == NULL || trace_flush_done == NULL) {
+        LOG_ERR("Failed to create trace endpoint");
+        return -1;
+    }
+
+    if (xTaskCreate(trace_task, "TRACE_TASK", TRACE_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 2,
+                    &trace_task_handle) != pdPASS) {
+        LOG_ERR("Failed to create trace task");
+        return -1;
+    }
+
+    (void)rpmsg_ns_announce(rpmsg, trace_ept, TRACE_NS_ANNOUNCE_STRING, RL_NS_CREATE);
+    return 0;
+}
+
+void trace_stream_flush(void)
+{
+    if (trace_remote_addr == RL_ADDR_ANY) {
+        LOG_WARN("No trace collector connected, keeping %u records", ethosu_trace_header()->record_count);
+        return;
+    }
+
+    (void)xTaskNotify(trace_task_handle, TRACE_EVT_FLUSH, eSetBits);
+    (void)xSemaphoreTake(trace_flush_done, portMAX_DELAY);
+}
+
+#else /* nothing to stream */
+
+int trace_stream_init(struct rpmsg_lite_instance *rpmsg)
+{
+    (void)rpmsg;
+    return 0;
+}
+
+void trace_stream_flush(void) {}
+
+#endif
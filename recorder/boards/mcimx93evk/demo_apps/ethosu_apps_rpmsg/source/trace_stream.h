@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef TRACE_STREAM_H
+#define TRACE_STREAM_H
+
+#include "ethosu_trace.h"
+#include "rpmsg_lite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stream the register trace to Linux on its own rpmsg endpoint.
+ *
+ * The endpoint is announced as "rpmsg-raw", which the Linux rpmsg_char
+ * driver exposes as /dev/rpmsgN. recorder/tools/trace/collector connects,
+ * sends a HELLO chunk and then receives record chunks while the inference
+ * runs, followed by the new snapshot bytes and an END chunk after every
+ * inference.
+ * Both calls are no-ops unless built with ETHOSU_TRACE_STREAM=1 and a
+ * recording level above ETHOSU_RECORD_OFF.
+ */
+int trace_stream_init(struct rpmsg_lite_instance *rpmsg);
+
+/*
+ * Mark the end of an inference: drain the remaining records, send the new
+ * part of the snapshot arena and an END chunk. Recording continues into the
+ * same trace. Blocks until everything has been sent; without a connected
+ * collector the records stay queued until the ring runs out.
+ */
+void trace_stream_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_STREAM_H */
@@ -18,6 +18,7 @@ limitations under the License.
 #include "flatbuffers/flexbuffers.h"
 #include "tensorflow/lite/c/common.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
 #include "tensorflow/lite/micro/micro_context.h"
 #include "tensorflow/lite/micro/micro_log.h"
 #include "fsl_debug_console.h"
@@ -27,10 +28,20 @@ namespace {
 
 constexpr uint8_t CO_TYPE_ETHOSU = 1;
 
+// CPU kernels share the arena with the NPU scratch, and a tensor they wrote
+// may have left dirty lines there, so the scratch regions are cleaned on
+// every invoke. Set to 0 only for models whose whole graph runs on the NPU:
+// then only the first invoke cleans them.
+#ifndef ETHOSU_CLEAN_SCRATCH
+#define ETHOSU_CLEAN_SCRATCH 1
+#endif
+
 struct OpData {
   int cms_data_size;
   int base_addr_idx;
   int base_addr_size_idx;
+  int base_addr_flags_idx;
+  bool regions_cleaned;  // first invoke done, the arena holds no dirty lines
 };
 
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
@@ -58,6 +69,9 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   //PRINTF("I Run Here in ethos2.7\r\n");
   TF_LITE_ENSURE_STATUS(context->RequestScratchBufferInArena(
       context, num_base_addr * sizeof(size_t), &data->base_addr_size_idx));
+  TF_LITE_ENSURE_STATUS(context->RequestScratchBufferInArena(
+      context, num_base_addr * sizeof(uint8_t), &data->base_addr_flags_idx));
+  data->regions_cleaned = false;
   //PRINTF("I Run Here in ethos2.8\r\n");
   // Get command stream data size.
   MicroContext* micro_context = GetMicroContext(context);
@@ -84,11 +98,27 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   void* cms_data;
   uint8_t co_type;
   int result;
-  const OpData* data = static_cast<const OpData*>(node->user_data);
+  OpData* data = static_cast<OpData*>(node->user_data);
   uint64_t* base_addrs = static_cast<uint64_t*>(
       context->GetScratchBuffer(context, data->base_addr_idx));
   size_t* base_addrs_size = static_cast<size_t*>(
       context->GetScratchBuffer(context, data->base_addr_size_idx));
+  uint8_t* base_addrs_flags = static_cast<uint8_t*>(
+      context->GetScratchBuffer(context, data->base_addr_flags_idx));
+
+  // The model never changes and is cleaned once by the driver. The first
+  // invoke cleans and invalidates everything else, as the application may
+  // have written the whole arena (e.g. zeroed it). After that only the
+  // scratch (see ETHOSU_CLEAN_SCRATCH) and the inputs the CPU wrote are
+  // cleaned and the outputs it reads invalidated, so the cache maintenance
+  // per invoke does not grow with the model size.
+  uint8_t scratch_flags = ETHOSU_CLEAN_SCRATCH ? ETHOSU_REGION_CPU_WRITE : 0;
+  uint8_t input_flags = ETHOSU_REGION_CPU_WRITE;
+  uint8_t output_flags = ETHOSU_REGION_CPU_READ;
+  if (!data->regions_cleaned) {
+    scratch_flags = input_flags = output_flags =
+        ETHOSU_REGION_CPU_WRITE | ETHOSU_REGION_CPU_READ;
+  }
 
   const uint8_t* custom_data =
       static_cast<uint8_t const*>(node->custom_initial_data);
@@ -108,11 +138,16 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
     tensor = context->GetEvalTensor(context, node->inputs->data[i]);
     base_addrs[num_tensors] =
         static_cast<uint64_t>(reinterpret_cast<uintptr_t>(tensor->data.uint8));
-    size_t byte_size = 1;
-    for (int k = 0; k < tensor->dims->size; k++) {
-      byte_size = byte_size * tensor->dims->data[k];
-    }
+    size_t byte_size = 0;
+    TF_LITE_ENSURE_STATUS(TfLiteEvalTensorByteLength(tensor, &byte_size));
     base_addrs_size[num_tensors] = byte_size;
+    if (i == 1) {
+      base_addrs_flags[num_tensors] = ETHOSU_REGION_CONST;
+    } else if (i <= 3) {
+      base_addrs_flags[num_tensors] = scratch_flags;
+    } else {
+      base_addrs_flags[num_tensors] = input_flags;
+    }
     num_tensors++;
   }
 
@@ -121,11 +156,10 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
     tensor = context->GetEvalTensor(context, node->outputs->data[i]);
     base_addrs[num_tensors] =
         static_cast<uint64_t>(reinterpret_cast<uintptr_t>(tensor->data.uint8));
-    size_t byte_size = 1;
-    for (int k = 0; k < tensor->dims->size; k++) {
-      byte_size = byte_size * tensor->dims->data[k];
-    }
+    size_t byte_size = 0;
+    TF_LITE_ENSURE_STATUS(TfLiteEvalTensorByteLength(tensor, &byte_size));
     base_addrs_size[num_tensors] = byte_size;
+    base_addrs_flags[num_tensors] = output_flags;
     num_tensors++;
   }
 
@@ -161,14 +195,16 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   num_tensors = std::min(num_tensors, 8);
 
   struct ethosu_driver* drv = ethosu_reserve_driver();
-  result = ethosu_invoke_v3(drv, cms_data, data->cms_data_size, base_addrs,
-                            base_addrs_size, num_tensors,
-                            GetMicroContext(context)->external_context());
+  result = ethosu_invoke_regions(drv, cms_data, data->cms_data_size,
+                                 base_addrs, base_addrs_size, base_addrs_flags,
+                                 num_tensors,
+                                 GetMicroContext(context)->external_context());
   ethosu_release_driver(drv);
 
   if (-1 == result) {
     return kTfLiteError;
   } else {
+    data->regions_cleaned = true;
     return kTfLiteOk;
   }
 }
@@ -33,9 +33,12 @@ namespace tflite {
 // Forward declarations
 class MicroInterpreter;
 class MicroResourceVariables;
+struct Model;
 } // namespace tflite
 
 namespace InferenceProcess {
+struct InterpreterCache;
+
 struct DataPtr {
     void *data;
     size_t size;
@@ -83,10 +86,27 @@ struct InferenceJob {
 class InferenceProcess {
 public:
     InferenceProcess(uint8_t *_tensorArena, size_t _tensorArenaSize);
+    ~InferenceProcess();
 
     bool runJob(InferenceJob &job);
 
+    // Run ETHOSU_CORE_INFERENCE_OP jobs back to back: up to
+    // ETHOSU_JOB_QUEUE_DEPTH are queued with the driver, so each command
+    // stream is prepared while the NPU runs the one before it. The jobs must
+    // not share arenas, and are counted with the PMU events of the first one.
+    // Jobs that sample QREAD (one output) need the NPU alone: use runJob().
+    // Returns a failure flag per job.
+    std::vector<bool> runEthosuOps(std::vector<InferenceJob *> &jobs);
+
+    // Use another tensor arena for the following jobs. The interpreters
+    // prepared in the old one are dropped.
+    void setTensorArena(uint8_t *_tensorArena, size_t _tensorArenaSize);
+
 private:
+    InferenceProcess(const InferenceProcess &)            = delete;
+    InferenceProcess &operator=(const InferenceProcess &) = delete;
+
+    tflite::MicroInterpreter *getInterpreter(InferenceJob &job, const tflite::Model *model);
     static bool copyIfm(InferenceJob &job, tflite::MicroInterpreter &interpreter);
     static bool copyOfm(InferenceJob &job, tflite::MicroInterpreter &interpreter);
     static bool compareOfm(InferenceJob &job, tflite::MicroInterpreter &interpreter);
@@ -97,6 +117,10 @@ private:
     bool runEthosuOp(InferenceJob &job);
 
     uint8_t *tensorArena;
-    const size_t tensorArenaSize;
+    size_t tensorArenaSize;
+
+    // Interpreters prepared by runModel(), reused while the job's model is
+    // unchanged
+    InterpreterCache *interpreterCache;
 };
 } // namespace InferenceProcess
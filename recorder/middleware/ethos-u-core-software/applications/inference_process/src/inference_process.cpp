@@ -37,7 +37,9 @@
 #include "cmsis_compiler.h"
 
 #include <inttypes.h>
+#include <algorithm>
 #include <cstdio>
+#include <new>
 
 #if ETHOSU_LOG_SEVERITY >= ETHOSU_LOG_DEBUG
 #include "tensorflow/lite/micro/micro_utils.h"
@@ -134,8 +136,222 @@ void InferenceJob::clean() {
     }
 }
 
+/****************************************************************************
+ * InterpreterCache
+ *
+ * runModel() keeps up to INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE prepared
+ * interpreters, each in its own equal slice of the tensor arena. A job whose
+ * model has the address, size and digest of a cached one skips the
+ * interpreter construction and AllocateTensors(), i.e. every kernel's
+ * Init/Prepare and the memory planner. A model that does not fit in a slice
+ * is prepared in the whole arena, which drops the other interpreters.
+ *
+ * The arena belongs to the cache between jobs: the application must not
+ * reuse it for anything else while it keeps submitting models.
+ *
+ * The digest does not cover the constant buffers, so a model whose weights
+ * were rewritten in place still hits the cache. The application must then
+ * call ethosu_forget_const_regions() itself, or the driver will not clean
+ * the new weights.
+ ****************************************************************************/
+
+#ifndef INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE
+#define INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE 2
+#endif
+
+// At most this many model bytes go into the digest, 0 for no limit. The
+// digest leaves the constant buffers (weights, command streams) out: a
+// prepared interpreter reads them in place, so only a change to the
+// flatbuffer tables that describe the graph needs a new one. Its cost then
+// follows the size of the graph, not of the weights.
+#ifndef INFERENCE_PROCESS_MODEL_DIGEST_BYTES
+#define INFERENCE_PROCESS_MODEL_DIGEST_BYTES 0
+#endif
+
+namespace {
+constexpr Crc modelCrc;
+
+uint32_t modelDigest(const tflite::Model *model, const DataPtr &data) {
+    const uint8_t *begin = reinterpret_cast<const uint8_t *>(data.begin());
+    vector<pair<size_t, size_t>> buffers; // [start, end) of every constant buffer
+
+    if (model->buffers() != nullptr) {
+        for (const auto *buffer : *model->buffers()) {
+            if (buffer == nullptr || buffer->data() == nullptr || buffer->data()->size() == 0) {
+                continue;
+            }
+            size_t start = buffer->data()->data() - begin;
+            if (start < data.size) {
+                buffers.emplace_back(start, std::min<size_t>(data.size, start + buffer->data()->size()));
+            }
+        }
+    }
+    std::sort(buffers.begin(), buffers.end());
+
+    size_t limit    = INFERENCE_PROCESS_MODEL_DIGEST_BYTES != 0 ? INFERENCE_PROCESS_MODEL_DIGEST_BYTES : data.size;
+    uint32_t digest = 0;
+    size_t pos      = 0;
+    for (size_t i = 0; i <= buffers.size() && limit > 0; i++) {
+        size_t end = i < buffers.size() ? buffers[i].first : data.size;
+        if (end > pos) {
+            size_t n = std::min(end - pos, limit);
+            digest   = modelCrc.crc32(begin + pos, n, digest);
+            limit -= n;
+        }
+        if (i < buffers.size()) {
+            pos = std::max(pos, buffers[i].second);
+        }
+    }
+    return digest;
+}
+} // namespace
+
+struct InterpreterCache {
+    struct Entry {
+        const void *model;
+        size_t modelSize;
+        uint32_t digest;
+        void *externalContext;
+        uint8_t *arena;
+        size_t arenaSize;
+        uint32_t lastUse;
+        tflite::MicroInterpreter *interpreter; // in storage, nullptr if the entry is free
+        alignas(tflite::MicroInterpreter) uint8_t storage[sizeof(tflite::MicroInterpreter)];
+    };
+
+    // Shared by the interpreters, which keep a reference to it
+    // Increased slot count from 3 to 4 to register Quantize
+    tflite::MicroMutableOpResolver<4> resolver;
+    Entry entries[INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE];
+    uint32_t useCount;
+
+    InterpreterCache() : entries(), useCount(0) {
+        resolver.AddEthosU();
+        resolver.AddDetectionPostprocess();
+        resolver.AddDequantize();
+        resolver.AddQuantize();
+    }
+
+    ~InterpreterCache() {
+        clear();
+    }
+
+    void drop(Entry &entry) {
+        if (entry.interpreter != nullptr) {
+            entry.interpreter->~MicroInterpreter();
+            entry.interpreter = nullptr;
+        }
+    }
+
+    void clear() {
+        for (auto &entry : entries) {
+            drop(entry);
+        }
+    }
+
+    // Drop the interpreters whose arena overlaps [arena, arena + size)
+    void dropOverlapping(const uint8_t *arena, size_t size) {
+        for (auto &entry : entries) {
+            if (entry.interpreter != nullptr && entry.arena < arena + size && arena < entry.arena + entry.arenaSize) {
+                drop(entry);
+            }
+        }
+    }
+};
+
 InferenceProcess::InferenceProcess(uint8_t *_tensorArena, size_t _tensorArenaSize) :
-    tensorArena(_tensorArena), tensorArenaSize(_tensorArenaSize) {}
+    tensorArena(_tensorArena), tensorArenaSize(_tensorArenaSize), interpreterCache(new InterpreterCache()) {}
+
+InferenceProcess::~InferenceProcess() {
+    delete interpreterCache;
+}
+
+void InferenceProcess::setTensorArena(uint8_t *_tensorArena, size_t _tensorArenaSize) {
+    if (_tensorArena != tensorArena || _tensorArenaSize != tensorArenaSize) {
+        interpreterCache->clear();
+        tensorArena     = _tensorArena;
+        tensorArenaSize = _tensorArenaSize;
+    }
+}
+
+tflite::MicroInterpreter *InferenceProcess::getInterpreter(InferenceJob &job, const tflite::Model *model) {
+    InterpreterCache &cache = *interpreterCache;
+    const uint32_t digest   = modelDigest(model, job.networkModel);
+    const uint32_t now    = ++cache.useCount;
+
+    for (auto &entry : cache.entries) {
+        if (entry.interpreter == nullptr || entry.model != job.networkModel.data ||
+            entry.modelSize != job.networkModel.size || entry.digest != digest ||
+            entry.externalContext != job.externalContext) {
+            continue;
+        }
+
+        // Back to the state right after AllocateTensors()
+        if (entry.interpreter->Reset() != kTfLiteOk) {
+            cache.drop(entry);
+            break;
+        }
+        entry.lastUse = now;
+        LOG_DEBUG("Reusing prepared interpreter: job=%s, arena=%p", job.name.c_str(), entry.arena);
+        return entry.interpreter;
+    }
+
+    // A new model: the driver cleans it again. A cache hit does not get here
+    ethosu_forget_const_regions();
+
+    // A free entry, else the least recently used one
+    size_t slot = 0;
+    for (size_t i = 0; i < INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE; i++) {
+        const auto &entry = cache.entries[i];
+        const auto &best  = cache.entries[slot];
+        if (best.interpreter != nullptr &&
+            (entry.interpreter == nullptr || entry.lastUse < best.lastUse)) {
+            slot = i;
+        }
+    }
+
+    const size_t sliceSize     = (tensorArenaSize / INFERENCE_PROCESS_INTERPRETER_CACHE_SIZE) & ~size_t(15);
+    uint8_t *arena             = tensorArena + slot * sliceSize;
+    size_t arenaSize           = sliceSize;
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        auto &entry = cache.entries[slot];
+
+        cache.dropOverlapping(arena, arenaSize);
+        entry.interpreter = new (entry.storage) tflite::MicroInterpreter(model, cache.resolver, arena, arenaSize);
+
+        // Set external context if provided
+        if (job.externalContext != nullptr) {
+            entry.interpreter->SetMicroExternalContext(job.externalContext);
+        }
+
+        // Allocate tensors
+        if (entry.interpreter->AllocateTensors() == kTfLiteOk) {
+            entry.model           = job.networkModel.data;
+            entry.modelSize       = job.networkModel.size;
+            entry.digest          = digest;
+            entry.externalContext = job.externalContext;
+            entry.arena           = arena;
+            entry.arenaSize       = arenaSize;
+            entry.lastUse         = now;
+            return entry.interpreter;
+        }
+        cache.drop(entry);
+
+        if (arenaSize == tensorArenaSize) {
+            break;
+        }
+        LOG_INFO("Model does not fit in %zu bytes of arena, using all %zu: job=%s",
+                 arenaSize,
+                 tensorArenaSize,
+                 job.name.c_str());
+        slot      = 0;
+        arena     = tensorArena;
+        arenaSize = tensorArenaSize;
+    }
+
+    return nullptr;
+}
 
 bool InferenceProcess::runJob(InferenceJob &job) {
     bool ret;
@@ -152,17 +368,23 @@ std::vector<ethosu_pmu_event_type> PMU_DEFAULT_CONFIG{ETHOSU_PMU_CYCLE,
                                                       ETHOSU_PMU_NPU_ACTIVE,
                                                       ETHOSU_PMU_MAC_ACTIVE};
 
-bool InferenceProcess::runEthosuOp(InferenceJob &job) {
-    LOG_INFO("Running inference job, name: %s, type: OP", job.name.c_str());
-
-#define BUFFER_ALIGNMENT 16
-#define ALIGN_SIZE(size) ((size + BUFFER_ALIGNMENT - 1) & (~(BUFFER_ALIGNMENT - 1)))
-    void *custom_data_ptr = job.networkModel.data;;
+namespace {
+// Driver arguments of an OP job. input[0] is the arena, input[1] the tensor
+// layout (input and output counts, then the region sizes and addresses) and
+// input[2], if present, the flash region.
+struct EthosuOp {
+    void *customData;
+    int customDataSize;
+    uint64_t *baseAddr;
+    size_t *baseAddrSize;
+    int numBaseAddr;
+};
+
+EthosuOp ethosuOp(InferenceJob &job) {
     void *arena_data_ptr = job.input[0].data;
     uint32_t *tensor_layout = reinterpret_cast<uint32_t*>(job.input[1].data);
     size_t *base_addr_size = reinterpret_cast<size_t*>(tensor_layout + 2);
 
-    int custom_data_size = job.networkModel.size;
     int num_base_addr = tensor_layout[0] + tensor_layout[1] + 3; //inputs + outputs + scatch + flash
     uint64_t *base_addr = reinterpret_cast<uint64_t*>(tensor_layout + 2 + num_base_addr);
     uint64_t flash_data_u64, arena_data_u64;
@@ -182,6 +404,21 @@ bool InferenceProcess::runEthosuOp(InferenceJob &job) {
     // the 8 first tensors
     num_base_addr = std::min(num_base_addr, 8);
 
+    return EthosuOp{job.networkModel.data, static_cast<int>(job.networkModel.size), base_addr, base_addr_size,
+                    num_base_addr};
+}
+} // namespace
+
+bool InferenceProcess::runEthosuOp(InferenceJob &job) {
+    LOG_INFO("Running inference job, name: %s, type: OP", job.name.c_str());
+
+    EthosuOp op = ethosuOp(job);
+    void *custom_data_ptr = op.customData;
+    int custom_data_size = op.customDataSize;
+    uint64_t *base_addr = op.baseAddr;
+    size_t *base_addr_size = op.baseAddrSize;
+    int num_base_addr = op.numBaseAddr;
+
     struct ethosu_driver* drv = ethosu_reserve_driver();
     if (drv == NULL) {
         return true;
@@ -198,14 +435,21 @@ bool InferenceProcess::runEthosuOp(InferenceJob &job) {
              return true;
         }
 
-        int qread_number = 0;
+        // Sample 0 is the state at the kick, every later one a change of QREAD
+        // or STATUS, and the last one the state at completion. tools/trace/npuprof.py
+        // charges the counts between two samples to the operation QREAD was at.
+        size_t qread_number = 0;
+        if (buffer_size > 0) {
+            job.ethosuMonitor.monitorSample(job.ethosuDriver, &qread_buffer[0]);
+            qread_number = 1;
+        }
         while (true) {
             ret = ethosu_wait(drv, false);
-            if (qread_number != buffer_size) {
-                auto pre = &(qread_buffer[qread_number]);
-                auto cur = &(qread_buffer[qread_number + 1]);
+            if (qread_number > 0 && qread_number < buffer_size) {
+                auto pre = &(qread_buffer[qread_number - 1]);
+                auto cur = &(qread_buffer[qread_number]);
                 job.ethosuMonitor.monitorSample(job.ethosuDriver, cur);
-                if (pre->qread != cur->qread || pre->status != cur->status)
+                if (pre->qread != cur->qread || pre->status != cur->status || ret == 0)
                     qread_number ++;
             }
             if (ret == 0) {
@@ -230,6 +474,69 @@ bool InferenceProcess::runEthosuOp(InferenceJob &job) {
     return false;
 }
 
+vector<bool> InferenceProcess::runEthosuOps(vector<InferenceJob *> &jobs) {
+    vector<bool> failed(jobs.size(), true);
+    queue<size_t> running;
+    size_t next = 0;
+
+    if (jobs.empty()) {
+        return failed;
+    }
+    LOG_INFO("Running %zu OP jobs back to back", jobs.size());
+
+    struct ethosu_driver *drv = ethosu_reserve_driver();
+    if (drv == NULL) {
+        return failed;
+    }
+
+    // One PMU session for the whole batch, with the events of the first job
+    InferenceJob &first = *jobs[0];
+    first.ethosuMonitor.configure(first.ethosuDriver, first.pmuEventConfig);
+    EthosUMonitor last = first.ethosuMonitor;
+    last.monitorSample(first.ethosuDriver);
+
+    while (next < jobs.size() || !running.empty()) {
+        // Keep the driver queue full: each payload is parsed and its regions
+        // cleaned while the NPU runs the job before it
+        while (next < jobs.size() && ethosu_job_count(drv) < ETHOSU_JOB_QUEUE_DEPTH) {
+            EthosuOp op = ethosuOp(*jobs[next]);
+            if (ethosu_invoke_async(drv, op.customData, op.customDataSize, op.baseAddr, op.baseAddrSize,
+                                    op.numBaseAddr, 0) == 0) {
+                running.push(next);
+            } else {
+                LOG_ERR("Failed to queue OP job %zu", next);
+            }
+            next++;
+        }
+        if (running.empty()) {
+            continue;
+        }
+
+        // A job's counts run from the completion of the one before it to its
+        // own, so they also take in the start of the job queued behind it
+        InferenceJob &job = *jobs[running.front()];
+        int ret           = ethosu_wait(drv, true);
+        job.ethosuMonitor = last;
+        job.ethosuMonitor.monitorSample(job.ethosuDriver);
+        EthosUMonitor now = job.ethosuMonitor;
+        for (size_t i = 0; i < job.ethosuMonitor.numEvents; i++) {
+            job.ethosuMonitor.eventCount[i] -= last.eventCount[i];
+        }
+        if (job.ethosuMonitor.pmuCycleCounterEnable != 0) {
+            job.ethosuMonitor.pmuCycleCounterCount -= last.pmuCycleCounterCount;
+        }
+        last = now;
+
+        failed[running.front()] = ret != 0;
+        running.pop();
+    }
+
+    ethosu_release_driver(drv);
+
+    LOG_INFO("Finished running %zu OP jobs", jobs.size());
+    return failed;
+}
+
 bool InferenceProcess::runModel(InferenceJob &job) {
     LOG_INFO("Running inference job, name: %s, type: Model", job.name.c_str());
 
@@ -242,28 +549,14 @@ bool InferenceProcess::runModel(InferenceJob &job) {
         return true;
     }
 
-    // Create the TFL micro interpreter
-    // Increased slot count from 3 to 4 to register Quantize
-    tflite::MicroMutableOpResolver<4> resolver;
-    resolver.AddEthosU();
-    resolver.AddDetectionPostprocess();
-    resolver.AddDequantize();
-    resolver.AddQuantize();
-
-    tflite::MicroInterpreter interpreter(
-        model, resolver, tensorArena, tensorArenaSize);
-
-    // Set external context if provided
-    if (job.externalContext != nullptr) {
-        interpreter.SetMicroExternalContext(job.externalContext);
-    }
-
-    // Allocate tensors
-    TfLiteStatus status = interpreter.AllocateTensors();
-    if (status != kTfLiteOk) {
+    // Get a prepared TFL micro interpreter for the model
+    tflite::MicroInterpreter *cached = getInterpreter(job, model);
+    if (cached == nullptr) {
         LOG_ERR("Failed to allocate tensors for inference: job=%s", job.name.c_str());
         return true;
     }
+    tflite::MicroInterpreter &interpreter = *cached;
+    TfLiteStatus status;
 
     job.ethosuMonitor.configure(job.ethosuDriver, job.pmuEventConfig);
 
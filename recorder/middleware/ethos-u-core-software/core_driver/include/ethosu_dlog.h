@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ETHOSU_DLOG_H
+#define ETHOSU_DLOG_H
+
+/*******************************************************************************
+ *  Deferred driver log
+ *  -------------------
+ *  With -DETHOSU_LOG_DEFERRED=1, LOG_WARN/LOG_INFO/LOG_DEBUG (ethosu_log.h) no
+ *  longer print: each call site stores its format string in the ethosu_dlog
+ *  section and appends the string's address plus the raw arguments to a word
+ *  ring. Nothing is formatted on the target. LOG_ERR and LOG stay synchronous.
+ *
+ *  Record layout (32-bit words, little endian)
+ *
+ *    word 0 : bits[7:0] record length in words, header included (>= 2)
+ *             bit 8     ETHOSU_DLOG_F_TRUNCATED, arguments were dropped
+ *    word 1 : address of the format string in the ethosu_dlog section
+ *    word 2+: one argument per conversion, in format order; an argument
+ *             takes as many words as its promoted C type (a long long or a
+ *             double takes two, a pointer takes sizeof(void *) / 4)
+ *
+ *  The ring is lock free: writers reserve space with a compare-and-swap, so
+ *  the NPU interrupt may log while a task is in the middle of a record. A full
+ *  ring drops the new record and counts it. ethosu_dlog_dump() prints the
+ *  records as "DLOG:<hex>" lines; recorder/tools/trace/dlog.py expands them
+ *  with the format strings and %s arguments read back from the firmware ELF.
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ETHOSU_LOG_DEFERRED
+#define ETHOSU_LOG_DEFERRED 0
+#endif
+
+/* Ring size in words, a power of two */
+#ifndef ETHOSU_DLOG_WORDS
+#define ETHOSU_DLOG_WORDS 2048
+#endif
+
+/* Argument words kept per record, the rest are dropped */
+#ifndef ETHOSU_DLOG_MAX_ARG_WORDS
+#define ETHOSU_DLOG_MAX_ARG_WORDS 12
+#endif
+
+#define ETHOSU_DLOG_F_TRUNCATED 0x100u
+
+/* Section holding the format strings, also read by dlog.py */
+#define ETHOSU_DLOG_SECTION __attribute__((section("ethosu_dlog"), used))
+
+#if ETHOSU_LOG_DEFERRED
+
+/**
+ * Append a record. fmt must point into the ethosu_dlog section; use
+ * ETHOSU_DLOG() rather than calling this directly. Safe from interrupts.
+ */
+void ethosu_dlog_write(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Move up to max_words words of complete records to dst and free them in the
+ * ring, e.g. for a transport that drains the log while inferences run.
+ * Returns the number of words copied.
+ */
+uint32_t ethosu_dlog_read(uint32_t *dst, uint32_t max_words);
+
+/**
+ * Records dropped because the ring was full, since boot.
+ */
+uint32_t ethosu_dlog_dropped(void);
+
+/**
+ * Print and free the buffered records as framed hex lines ("DLOG:<hex>")
+ * between "DLOG BEGIN" / "DLOG END" markers for dlog.py.
+ */
+void ethosu_dlog_dump(void);
+
+/* Store the literal format f in the ethosu_dlog section and log it */
+#define ETHOSU_DLOG(f, ...)                                        \
+    do {                                                           \
+        static const char ETHOSU_DLOG_SECTION ethosu_dlog_f[] = f; \
+        ethosu_dlog_write(ethosu_dlog_f, ##__VA_ARGS__);           \
+    } while (0)
+
+#else /* !ETHOSU_LOG_DEFERRED */
+
+static inline void ethosu_dlog_dump(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ETHOSU_DLOG_H */
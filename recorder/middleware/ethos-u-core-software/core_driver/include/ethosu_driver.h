@@ -41,6 +41,22 @@ extern "C" {
 #define ETHOSU_DRIVER_VERSION_MINOR 16 ///< Driver minor version
 #define ETHOSU_DRIVER_VERSION_PATCH 0  ///< Driver patch version
 
+/**
+ * Jobs a driver accepts before ethosu_wait() has to retire one. Override
+ * from the build; 1 gives the original one-job-at-a-time driver.
+ */
+#ifndef ETHOSU_JOB_QUEUE_DEPTH
+#define ETHOSU_JOB_QUEUE_DEPTH 4
+#endif
+
+/**
+ * Immutable regions (ETHOSU_REGION_CONST) the driver remembers as cleaned.
+ * Further ones are cleaned on every invoke.
+ */
+#ifndef ETHOSU_CONST_REGIONS
+#define ETHOSU_CONST_REGIONS 8
+#endif
+
 /******************************************************************************
  * Types
  ******************************************************************************/
@@ -52,7 +68,20 @@ enum ethosu_job_state
 {
     ETHOSU_JOB_IDLE = 0,
     ETHOSU_JOB_RUNNING,
-    ETHOSU_JOB_DONE
+    ETHOSU_JOB_DONE,
+    ETHOSU_JOB_PENDING ///< Prepared, waiting for the NPU to finish the jobs before it
+};
+
+/**
+ * How the CPU uses a base region, for ethosu_invoke_regions_async(). The
+ * driver cleans and invalidates only what these ask for; a region with no
+ * flag is left alone and must not hold dirty lines (NPU scratch).
+ */
+enum ethosu_region_flags
+{
+    ETHOSU_REGION_CONST     = 1 << 0, ///< Not written after its first invoke (model, weights): cleaned once
+    ETHOSU_REGION_CPU_WRITE = 1 << 1, ///< Written by the CPU before the invoke (IFM): cleaned
+    ETHOSU_REGION_CPU_READ  = 1 << 2, ///< Read by the CPU after the invoke (OFM): cleaned, then invalidated
 };
 
 struct ethosu_job
@@ -62,20 +91,27 @@ struct ethosu_job
     int custom_data_size;
     const uint64_t *base_addr;
     const size_t *base_addr_size;
+    const uint8_t *base_addr_flags; ///< enum ethosu_region_flags per region, NULL for all of them
     int num_base_addr;
     void *user_arg;
+    const uint8_t *cmd_stream; ///< Command stream found in the custom operator payload
+    uint32_t cms_bytes;
+    volatile bool status_error;
 };
 
 struct ethosu_driver
 {
     struct ethosu_device *dev;
     struct ethosu_driver *next;
-    struct ethosu_job job;
+    struct ethosu_job jobs[ETHOSU_JOB_QUEUE_DEPTH]; ///< Ring of submitted jobs, oldest at job_head
+    volatile uint8_t job_head;
+    volatile uint8_t job_count;
+    volatile bool npu_busy; ///< A job is running on the NPU
     void *semaphore;
     uint64_t fast_memory;
     size_t fast_memory_size;
     uint32_t power_request_counter;
-    bool status_error;
+    volatile bool status_error; ///< The NPU stopped on an error and has not been reset yet
     bool reserved;
 };
 
@@ -97,7 +133,8 @@ enum ethosu_request_clients
  ******************************************************************************/
 
 /**
- * Interrupt handler to be called on IRQ from Ethos-U
+ * Interrupt handler to be called on IRQ from Ethos-U. Completes the running
+ * job of drv and starts its next pending job, if any.
  */
 void ethosu_irq_handler(struct ethosu_driver *drv);
 
@@ -200,8 +237,19 @@ int ethosu_invoke_v3(struct ethosu_driver *drv,
 /**
  * Invoke Vela command stream using async interface.
  * Must be followed by call(s) to ethosu_wait() upon successful return.
+ *
+ * Up to ETHOSU_JOB_QUEUE_DEPTH jobs may be outstanding. The payload is parsed
+ * and the command stream and base regions are cleaned from the cache here,
+ * while the NPU may still be running an earlier job. Jobs in the queue must
+ * not share writable base regions (IFM/OFM/scratch).
+ *
+ * With ETHOSU_RECORD_LEVEL off, a queued job is started from the interrupt
+ * handler as soon as the NPU is free, so ethosu_inference_begin() must then
+ * be interrupt safe. While recording, the recorder hooks are not: the next
+ * job is started by ethosu_wait() in task context instead, and the NPU idles
+ * until the waiting task runs.
  * Returns
- *   -1 on error
+ *   -1 on error, or if the queue is full
  *    0 on success
  */
 int ethosu_invoke_async(struct ethosu_driver *drv,
@@ -212,10 +260,46 @@ int ethosu_invoke_async(struct ethosu_driver *drv,
                         const int num_base_addr,
                         void *user_arg);
 
+/**
+ * ethosu_invoke_async() with the cache maintenance limited by base_addr_flags
+ * (enum ethosu_region_flags, one per base address). The command stream is
+ * treated as ETHOSU_REGION_CONST. With base_addr_flags or base_addr_size
+ * NULL, every region is cleaned before and invalidated after the job.
+ */
+int ethosu_invoke_regions_async(struct ethosu_driver *drv,
+                                const void *custom_data_ptr,
+                                const int custom_data_size,
+                                const uint64_t *base_addr,
+                                const size_t *base_addr_size,
+                                const uint8_t *base_addr_flags,
+                                const int num_base_addr,
+                                void *user_arg);
+
+/**
+ * Blocking ethosu_invoke_regions_async()
+ */
+int ethosu_invoke_regions(struct ethosu_driver *drv,
+                          const void *custom_data_ptr,
+                          const int custom_data_size,
+                          const uint64_t *base_addr,
+                          const size_t *base_addr_size,
+                          const uint8_t *base_addr_flags,
+                          const int num_base_addr,
+                          void *user_arg);
+
+/**
+ * Forget the ETHOSU_REGION_CONST regions cleaned so far. Call after the CPU
+ * rewrites one of them, e.g. loads another model over the old one.
+ */
+void ethosu_forget_const_regions(void);
+
 /**
  * Wait for inference to complete (block=true)
  * Poll status or finish up if inference is complete (block=false)
  * (This function is only intended to be used in conjuction with ethosu_invoke_async)
+ * Jobs are finished in the order they were submitted; each call retires the
+ * oldest one and invalidates its base regions (the ETHOSU_REGION_CPU_READ
+ * ones with ethosu_invoke_regions_async()).
  * Returns
  *    1 on inference running (only for block=false)
  *    0 on inference success
@@ -224,6 +308,18 @@ int ethosu_invoke_async(struct ethosu_driver *drv,
  */
 int ethosu_wait(struct ethosu_driver *drv, bool block);
 
+/**
+ * Number of jobs submitted and not yet retired by ethosu_wait()
+ */
+int ethosu_job_count(struct ethosu_driver *drv);
+
+/**
+ * Vector-table entry for a single Ethos-U: calls ethosu_irq_handler() for
+ * the registered driver with a job on the NPU. With several NPUs, give each
+ * one its own vector that calls ethosu_irq_handler() with its driver.
+ */
+void ethosu_irq_dispatch(void);
+
 /**
  * Reserves a driver to execute inference with
  */
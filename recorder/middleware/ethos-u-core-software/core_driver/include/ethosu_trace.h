@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef ETHOSU_TRACE_H
+#define ETHOSU_TRACE_H
+
+/*******************************************************************************
+ *  Compact binary register trace
+ *  -----------------------------
+ *  The recorder used to keep one 40-byte record per register access and dump
+ *  every data snapshot as hex text over UART while the NPU was running.  The
+ *  trace is now packed into a byte stream plus an out-of-band blob section:
+ *
+ *    header : ethosu_trace_header_t (little endian)
+ *    records: tag byte + varint fields, see ETHOSU_TRACE_TAG_*
+ *    blobs  : snapshot arena, every distinct region content stored once
+ *
+ *  Record layout (op_order is implicit: 1 + index of the record)
+ *
+ *    READ / WRITE : tag, zigzag varint (word offset - previous word offset),
+ *                   varint value (omitted if ETHOSU_TRACE_F_ZERO is set)
+ *    SNAP         : tag, varint address, varint length, varint blob offset
+ *                   (identical snapshots share one blob, see ethosu_trace.c)
+ *    MARK         : tag, varint kind, varint argument
+ *
+ *  Register offsets are relative to hdr.reg_base.  The host decoder
+ *  recorder/tools/trace/rrtrace.py understands this layout and regenerates
+ *  replay_templates_*.h from it.
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Recording levels, select with -DETHOSU_RECORD_LEVEL=<n> */
+#define ETHOSU_RECORD_OFF    0 /* no recording, hooks compile away          */
+#define ETHOSU_RECORD_VALUES 1 /* register addresses and values only        */
+#define ETHOSU_RECORD_FULL   2 /* plus memory snapshots in the blob section */
+
+#ifndef ETHOSU_RECORD_LEVEL
+#define ETHOSU_RECORD_LEVEL ETHOSU_RECORD_FULL
+#endif
+
+#define ETHOSU_TRACE_MAGIC   0x52544e52u /* "RNTR" */
+#define ETHOSU_TRACE_VERSION 2
+
+/* Tag byte: bits[1:0] record kind, bits[7:2] flags */
+#define ETHOSU_TRACE_TAG_READ  0x0u
+#define ETHOSU_TRACE_TAG_WRITE 0x1u
+#define ETHOSU_TRACE_TAG_SNAP  0x2u
+#define ETHOSU_TRACE_TAG_MARK  0x3u
+#define ETHOSU_TRACE_TAG_MASK  0x3u
+
+#define ETHOSU_TRACE_F_ZERO 0x4u /* READ/WRITE value is zero, not encoded */
+
+/* MARK kinds */
+#define ETHOSU_TRACE_MARK_ORDER 0u /* argument: op_order of the next record */
+#define ETHOSU_TRACE_MARK_PHASE 1u /* argument: ETHOSU_TRACE_PHASE_*, the phase
+                                      starts with the next record          */
+
+/* Driver phases. A trace holds one INIT and then RUN, IRQ, IDLE for every
+ * inference; IDLE also covers the setup of the next job. */
+#define ETHOSU_TRACE_PHASE_INIT 0u /* ethosu_init: reset, config checks       */
+#define ETHOSU_TRACE_PHASE_RUN  1u /* handle_command_stream: QBASE/BASEP/kick */
+#define ETHOSU_TRACE_PHASE_IRQ  2u /* ethosu_irq_handler: status and IRQ ack  */
+#define ETHOSU_TRACE_PHASE_IDLE 3u /* after the IRQ, up to the next RUN       */
+
+/* Header flags */
+#define ETHOSU_TRACE_HDR_TRUNCATED 0x1u /* record or blob space ran out */
+
+/* Default capacities, override from the build if a model needs more */
+#ifndef ETHOSU_TRACE_RECORD_BYTES
+#define ETHOSU_TRACE_RECORD_BYTES (4 * 1024)
+#endif
+#ifndef ETHOSU_TRACE_BLOB_BYTES
+#define ETHOSU_TRACE_BLOB_BYTES (32 * 1024)
+#endif
+#ifndef ETHOSU_TRACE_BLOB_SLOTS
+#define ETHOSU_TRACE_BLOB_SLOTS 64 /* distinct snapshot contents */
+#endif
+
+/* Streaming: records go to a double-buffered chunk ring that the application
+ * drains (e.g. over rpmsg) instead of one fixed ETHOSU_TRACE_RECORD_BYTES
+ * buffer. A chunk plus ethosu_trace_chunk_t must fit one transport message. */
+#ifndef ETHOSU_TRACE_STREAM
+#define ETHOSU_TRACE_STREAM 0
+#endif
+#ifndef ETHOSU_TRACE_CHUNK_BYTES
+#define ETHOSU_TRACE_CHUNK_BYTES 480
+#endif
+
+/* Chunk types on the streaming wire */
+#define ETHOSU_TRACE_CHUNK_RECORDS 0 /* payload: record section bytes         */
+#define ETHOSU_TRACE_CHUNK_BLOBS   1 /* payload: snapshot arena bytes         */
+#define ETHOSU_TRACE_CHUNK_END     2 /* payload: ethosu_trace_header_t, the
+                                        trace so far is complete            */
+#define ETHOSU_TRACE_CHUNK_HELLO   3 /* collector -> target, no payload       */
+
+typedef struct {
+    uint32_t magic;  /* ETHOSU_TRACE_MAGIC                              */
+    uint16_t type;   /* ETHOSU_TRACE_CHUNK_*                            */
+    uint16_t length; /* payload bytes following this header             */
+    uint32_t seq;    /* running message number, exposes lost messages   */
+    uint32_t offset; /* payload position within its section             */
+} ethosu_trace_chunk_t;
+
+#if ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    uint32_t reg_base;     /* NPU register window the offsets refer to */
+    uint32_t record_count; /* number of READ/WRITE/SNAP records         */
+    uint32_t record_bytes; /* size of the record section                */
+    uint32_t blob_bytes;   /* size of the blob section                  */
+} ethosu_trace_header_t;
+
+/**
+ * Set the register window that READ/WRITE offsets are relative to and
+ * discard the records so far. The snapshot arena is kept, so content that
+ * was captured before is not stored again.
+ */
+void ethosu_trace_reset(uintptr_t reg_base);
+
+/**
+ * Append a register access. op_order is the value of the global operation
+ * counter; a MARK is emitted only when it is not the expected next value.
+ */
+void ethosu_trace_reg(uint32_t is_write, uintptr_t reg_addr, uint32_t value, uint32_t op_order);
+
+/**
+ * Append a MARK of the given kind. It takes no op_order and tags the
+ * records that follow, e.g. with a driver phase.
+ */
+void ethosu_trace_mark(uint32_t kind, uint32_t arg);
+
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+/**
+ * Append a memory snapshot. The bytes are copied into the snapshot arena
+ * unless a blob with the same content is already there.
+ */
+void ethosu_trace_snapshot(uintptr_t addr, const void *data, uint32_t size, uint32_t op_order);
+#endif
+
+/**
+ * Access the finished trace. Pointers stay valid until the next reset.
+ */
+const ethosu_trace_header_t *ethosu_trace_header(void);
+#if !ETHOSU_TRACE_STREAM
+const uint8_t *ethosu_trace_records(void);
+#endif
+const uint8_t *ethosu_trace_blobs(void);
+
+#if ETHOSU_TRACE_STREAM
+/**
+ * Called from the recording context - possibly the NPU interrupt - each time
+ * a chunk is full. Weak; the transport overrides it to wake its drain task.
+ */
+void ethosu_trace_chunk_ready(void);
+
+/**
+ * Oldest full chunk, or NULL if none is waiting. offset is the chunk's
+ * position in the record section.
+ */
+const uint8_t *ethosu_trace_chunk_peek(uint32_t *len, uint32_t *offset);
+
+/**
+ * Return the chunk from ethosu_trace_chunk_peek() to the recorder.
+ */
+void ethosu_trace_chunk_release(void);
+
+/**
+ * Hand over the partly filled chunk, used at the end of a recording.
+ * Returns -1 if the previous chunk has not been drained yet.
+ */
+int ethosu_trace_seal(void);
+#endif
+
+/**
+ * Print the trace as framed hex lines ("TRACE:<hex>") between
+ * "TRACE BEGIN" / "TRACE END" markers for rrtrace.py to pick up from a
+ * UART log.
+ */
+void ethosu_trace_dump(void);
+
+#else /* ETHOSU_RECORD_LEVEL == ETHOSU_RECORD_OFF */
+
+static inline void ethosu_trace_reset(uintptr_t reg_base)
+{
+    (void)reg_base;
+}
+
+static inline void ethosu_trace_mark(uint32_t kind, uint32_t arg)
+{
+    (void)kind;
+    (void)arg;
+}
+
+static inline void ethosu_trace_dump(void) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ETHOSU_TRACE_H
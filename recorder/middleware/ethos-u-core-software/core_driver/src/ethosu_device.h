@@ -80,12 +80,15 @@ enum ethosu_error_codes ethosu_dev_axi_init(struct ethosu_device *dev);
  *                             - 1: scratch tensor
  *                             - All input tensors
  *                             - All output tensors
+ * \param[in] base_addr_size   Size of each base address region, may be NULL.
+ *                             Used to snapshot the regions into the trace.
  * \param[in] num_base_addr    Number of base addresses.
  */
 void ethosu_dev_run_command_stream(struct ethosu_device *dev,
                                    const uint8_t *cmd_stream_ptr,
                                    uint32_t cms_length,
                                    const uint64_t *base_addr,
+                                   const size_t *base_addr_size,
                                    int num_base_addr);
 
 /**
@@ -19,18 +19,21 @@
 /*******************************************************************************
  *  NOTE
  *  ----
- *  This version of the driver augments every register access record with the
- *  exact source-file and line‑number of the call‑site.  The change is fully
- *  backward‑compatible: **no existing call‑sites need to be modified.**
+ *  Every register access (and every memory region the NPU is pointed at) is
+ *  recorded into the compact binary trace implemented in ethosu_trace.c.
+ *  Call-sites are unchanged: they still go through `record_reg_op()`, which
+ *  now costs a tag byte and two varints instead of a 40-byte record plus a
+ *  heap-allocated hex dump on the UART.
  *
  *  How it works
  *  ------------
- *  1. `reg_op_record_t` gains two fields: `file_name` and `line_number`.
- *  2. The original `record_reg_op()` implementation is renamed to
- *     `record_reg_op_impl()` and given two extra parameters.
- *  3. A macro of the old name forwards to the new implementation while
- *     injecting `__FILE__` and `__LINE__` automatically.
- *  4. `dump_reg_op_records()` now prints the extra information.
+ *  1. READ/WRITE records store the register offset delta and the value.
+ *  2. Records that carry a data pointer become SNAP records; the bytes are
+ *     copied into the trace's out-of-band blob section.
+ *  3. `dump_reg_op_records()` prints the finished trace once, after the
+ *     inference, for recorder/tools/trace/rrtrace.py to decode.
+ *  4. The trace is reset and the phase marks (INIT/RUN/IRQ/IDLE) are emitted
+ *     by ethosu_driver.c, so one trace can hold several inferences.
  ******************************************************************************/
 
 
@@ -44,6 +47,7 @@
 #include "ethosu_interface.h"
 #include "ethosu_device.h"
 #include "ethosu_log.h"
+#include "ethosu_trace.h"
 
 #ifdef ETHOSU55
 #include "ethosu_config_u55.h"
@@ -60,11 +64,6 @@
 #include <stdint.h>
 #include <string.h>    /* for memcpy */
 
-/* -------------------------------------------------------------------------- */
-/* Global monotonic counter for register‑access ordering                       */
-/* -------------------------------------------------------------------------- */
-static uint32_t g_npu_op_counter = 0;
-
 #define ETHOSU_PRODUCT_U55 0
 #define ETHOSU_PRODUCT_U65 1
 
@@ -80,7 +79,12 @@ static uint32_t g_npu_op_counter = 0;
 #define NPU_CMD_PWR_CLK_MASK (0xC)
 
 /* -------------------------------------------------------------------------- */
-/* Structures & bookkeeping for register‑operation recording                   */
+/* Register-operation recording                                               */
+/*                                                                            */
+/* ETHOSU_RECORD_LEVEL (see ethosu_trace.h) selects what is kept:             */
+/*   OFF    - record_reg_op() and the op counter compile to nothing           */
+/*   VALUES - register addresses and values, snapshots become plain READs     */
+/*   FULL   - as VALUES plus the memory snapshots in the blob section         */
 /* -------------------------------------------------------------------------- */
 
 typedef enum {
@@ -88,142 +92,58 @@ typedef enum {
     REG_OP_WRITE
 } reg_op_type_t;
 
-typedef struct {
-    uint32_t        op_order;       /* Sequential order of the operation        */
-    reg_op_type_t   op_type;        /* READ or WRITE                            */
-    volatile void  *reg_address;    /* Register address                         */
-    uint32_t        reg_value;      /* Value read/written                       */
-    void           *data_ptr;       /* Optional associated data pointer         */
-    uint32_t        data_size;      /* Size of data pointed to by data_ptr      */
-    uint8_t        *data_snapshot;  /* Heap copy of the data (may be NULL)      */
-    const char     *func_name;      /* Function in which the op occurred        */
-    const char     *file_name;      /*  source file                             */
-    uint32_t        line_number;    /*  source line                             */
-} reg_op_record_t;
-
-#define MAX_REG_OP_RECORDS 1024
-static reg_op_record_t reg_op_records[MAX_REG_OP_RECORDS];
-static uint32_t        reg_op_record_count = 0;
+#if ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+
+/* Global monotonic counter for register‑access ordering */
+static uint32_t g_npu_op_counter = 0;
+
+#define next_op_order() (++g_npu_op_counter)
 
 /* -------------------------------------------------------------------------- */
 /* Internal implementation — do not call directly, use the macro below        */
 /* -------------------------------------------------------------------------- */
-static void record_reg_op_impl(reg_op_type_t type,
+static inline void record_reg_op_impl(reg_op_type_t type,
     volatile void *reg_addr,
     uint32_t value,
     uint32_t op_order,
-    void *data_ptr,
-    uint32_t data_size,
-    const char *func_name,
-    const char *file_name,
-    uint32_t line_number)
+    const void *data_ptr,
+    uint32_t data_size)
 {
-// 替换原有实现，只保留一个定义
-if (reg_op_record_count >= MAX_REG_OP_RECORDS)
-return;
-
-reg_op_record_t *rec = &reg_op_records[reg_op_record_count++];
-
-rec->op_order    = op_order;
-rec->op_type     = type;
-rec->reg_address = reg_addr;
-rec->reg_value   = value;
-rec->data_ptr    = NULL;
-rec->data_size   = 0;
-rec->data_snapshot = NULL;
-rec->func_name   = func_name;
-rec->file_name   = file_name;
-rec->line_number = line_number;
-
-// 若需输出内存区域数据，通过 UART 一次性打印整行
-if (data_ptr != NULL && data_size > 0) {
-uint8_t *bytes = (uint8_t *)data_ptr;
-size_t buf_size = (size_t)data_size * 3 + 128;
-char *dump_buf = (char *)malloc(buf_size);
-if (dump_buf) {
-// 使用 %lu 并转换类型以匹配 uint32_t
-size_t idx = snprintf(dump_buf, buf_size,
-       "Record %lu: Data snapshot at %p : ",
-       (unsigned long)op_order,
-       data_ptr,
-       (unsigned long)data_size);
-for (uint32_t j = 0; j < data_size && idx < buf_size; ++j) {
-idx += snprintf(dump_buf + idx, buf_size - idx, "%02x ", bytes[j]);
-}
-LOG_INFO("%s", dump_buf);
-free(dump_buf);
-} else {
-// memory allocation failed
-LOG_INFO("Record %lu: Data snapshot at %p (size %lu bytes): <memory allocation failed>",
-(unsigned long)op_order,
-data_ptr,
-(unsigned long)data_size);
-}
-}
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+    if (data_ptr != NULL && data_size > 0) {
+        ethosu_trace_snapshot((uintptr_t)reg_addr, data_ptr, data_size, op_order);
+        return;
+    }
+#else
+    (void)data_ptr;
+    (void)data_size;
+#endif
+    ethosu_trace_reg(type == REG_OP_WRITE, (uintptr_t)reg_addr, value, op_order);
 }
 
 /* -------------------------------------------------------------------------- */
-/* Public macro — keeps the old signature intact while injecting file/line    */
+/* Public macro — keeps the old signature intact                              */
 /* -------------------------------------------------------------------------- */
 #define record_reg_op(type, addr, val, order, ptr, size, func) \
-    record_reg_op_impl((type), (addr), (val), (order), (ptr), (size), \
-                       (func), __FILE__, __LINE__)
-/* -------------------------------------------------------------------------- */
-/* Replay & dump utilities                                                     */
-/* -------------------------------------------------------------------------- */
-void replay_reg_operations(void)
-{
-    for (uint32_t i = 0; i < reg_op_record_count; i++) {
-        reg_op_record_t *rec = &reg_op_records[i];
-
-        /* Restore any recorded memory content first */
-        if (rec->data_snapshot != NULL && rec->data_size > 0) {
-            memcpy((void *)rec->reg_address, rec->data_snapshot, rec->data_size);
-        }
-
-        /* Only re‑issue write operations */
-        if (rec->op_type == REG_OP_WRITE) {
-            *((volatile uint32_t *)rec->reg_address) = rec->reg_value;
-        }
-    }
-}
+    record_reg_op_impl((type), (addr), (val), (order), (ptr), (size))
+
+/* One debug line per register access, only while recording */
+#define LOG_REG_OP(f, ...) LOG_DEBUG(f, ##__VA_ARGS__)
+
+#else /* ETHOSU_RECORD_LEVEL == ETHOSU_RECORD_OFF */
+
+#define next_op_order() (0u)
+#define record_reg_op(type, addr, val, order, ptr, size, func) ((void)(order), (void)(size))
+#define LOG_REG_OP(f, ...)
+
+#endif
+
 /**
- *  dump_reg_op_records – print all register‑operation records over UART
+ *  dump_reg_op_records – print the binary register trace over UART
  */
 void dump_reg_op_records(void)
 {
-    for (uint32_t i = 0; i < reg_op_record_count; i++) {
-        reg_op_record_t *rec = &reg_op_records[i];
-        const char *otype = (rec->op_type == REG_OP_READ) ? "READ" : "WRITE";
-
-        char buf[256];  
-        int len = snprintf(buf, sizeof(buf), "Record %u (%s:%u, %s): Type:%s, Address:%p, Value:0x%08x",
-                           rec->op_order, rec->file_name, rec->line_number,
-                           rec->func_name, otype, rec->reg_address, rec->reg_value);
-        if (len > 0) {
-            LOG_INFO("%s", buf);
-        }
-
-        if (rec->data_snapshot != NULL && rec->data_size > 0) {
-            size_t buf_size = rec->data_size * 3 + 1;
-            char *dump_buf = (char *)malloc(buf_size);
-            if (dump_buf != NULL) {
-                size_t idx = 0;
-                for (uint32_t j = 0; j < rec->data_size; j++) {
-                    idx += snprintf(dump_buf + idx, buf_size - idx, "%02x ", rec->data_snapshot[j]);
-                }
-                LOG_INFO("    Data (total %u bytes): %s", rec->data_size, dump_buf);
-                free(dump_buf);
-            } else {
-                LOG_INFO("    Data (total %u bytes): <memory allocation failed>", rec->data_size);
-            }
-        }
-
-        if (rec->data_snapshot != NULL) {
-            free(rec->data_snapshot);
-            rec->data_snapshot = NULL;
-        }
-    }
+    ethosu_trace_dump();
 }
 
 
@@ -252,14 +172,14 @@ dev->privileged = privilege_enable;
 /* ---------- 记录 CONFIG.word 的读取 ---------- */
 uint32_t cfg_word = dev->reg->CONFIG.word;
 {
-uint32_t order_val = ++g_npu_op_counter;
+uint32_t order_val = next_op_order();
 record_reg_op(REG_OP_READ,
 (volatile void *)&dev->reg->CONFIG.word,
 cfg_word,
 order_val,
 NULL, 0,
 "ethosu_dev_init");
-LOG_DEBUG("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
+LOG_REG_OP("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
 (void *)&dev->reg->CONFIG.word, cfg_word, order_val);
 }
 
@@ -310,8 +230,8 @@ return NULL;
      /* QCONFIG */
      dev->reg->QCONFIG.word = NPU_QCONFIG;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: QCONFIG.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: QCONFIG.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->QCONFIG.word, NPU_QCONFIG, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->QCONFIG.word,
                        NPU_QCONFIG, order_val, NULL, 0, "ethosu_dev_axi_init");
@@ -328,8 +248,8 @@ return NULL;
      rcfg.region7 = NPU_REGIONCFG_7;
      dev->reg->REGIONCFG.word = rcfg.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: REGIONCFG.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: REGIONCFG.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->REGIONCFG.word, rcfg.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->REGIONCFG.word,
                        rcfg.word, order_val, NULL, 0, "ethosu_dev_axi_init");
@@ -358,32 +278,32 @@ return NULL;
  
      dev->reg->AXI_LIMIT0.word = l0.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: AXI_LIMIT0.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: AXI_LIMIT0.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->AXI_LIMIT0.word, l0.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->AXI_LIMIT0.word,
                        l0.word, order_val, NULL, 0, "ethosu_dev_axi_init");
      }
      dev->reg->AXI_LIMIT1.word = l1.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: AXI_LIMIT1.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: AXI_LIMIT1.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->AXI_LIMIT1.word, l1.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->AXI_LIMIT1.word,
                        l1.word, order_val, NULL, 0, "ethosu_dev_axi_init");
      }
      dev->reg->AXI_LIMIT2.word = l2.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: AXI_LIMIT2.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: AXI_LIMIT2.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->AXI_LIMIT2.word, l2.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->AXI_LIMIT2.word,
                        l2.word, order_val, NULL, 0, "ethosu_dev_axi_init");
      }
      dev->reg->AXI_LIMIT3.word = l3.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: AXI_LIMIT3.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: AXI_LIMIT3.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->AXI_LIMIT3.word, l3.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->AXI_LIMIT3.word,
                        l3.word, order_val, NULL, 0, "ethosu_dev_axi_init");
@@ -400,6 +320,7 @@ return NULL;
                                     const uint8_t *cmd_stream_ptr,
                                     uint32_t cms_length,
                                     const uint64_t *base_addr,
+                                    const size_t *base_addr_size,
                                     int num_base_addr)
  {
      LOG_INFO("ethosu_dev_run_command_stream called.");
@@ -408,12 +329,12 @@ return NULL;
      struct cmd_r cmd;
      uint64_t qbase = (uintptr_t)cmd_stream_ptr + BASEP_OFFSET;
      assert(qbase <= ADDRESS_MASK);
-     LOG_DEBUG("QBASE=0x%016llx, QSIZE=%u, base_pointer_offset=0x%08x",
+     LOG_REG_OP("QBASE=0x%016llx, QSIZE=%u, base_pointer_offset=0x%08x",
                qbase, cms_length, BASEP_OFFSET);
  
-     // 记录 cmd_stream_ptr 指向内存的数据内容
+     // 记录 cmd_stream_ptr 指向内存的数据内容（快照按内容去重存放）
      {
-         uint32_t order_val = ++g_npu_op_counter;
+         uint32_t order_val = next_op_order();
          record_reg_op(REG_OP_READ, (volatile void *)cmd_stream_ptr,
                        0, order_val, (void *)cmd_stream_ptr, cms_length, "ethosu_dev_run_command_stream");
      }
@@ -421,8 +342,8 @@ return NULL;
      /* Write QBASE lower 32 bits */
      dev->reg->QBASE.word[0] = qbase & 0xffffffff;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: QBASE.word[0] addr=%p, value=0x%08llx, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: QBASE.word[0] addr=%p, value=0x%08llx, order=%u",
                    (void*)&dev->reg->QBASE.word[0],
                    (unsigned long long)(qbase & 0xffffffff),
                    order_val);
@@ -433,8 +354,8 @@ return NULL;
      /* Write QBASE higher 32 bits */
      dev->reg->QBASE.word[1] = qbase >> 32;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: QBASE.word[1] addr=%p, value=0x%08llx, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: QBASE.word[1] addr=%p, value=0x%08llx, order=%u",
                    (void*)&dev->reg->QBASE.word[1],
                    (unsigned long long)(qbase >> 32),
                    order_val);
@@ -446,8 +367,8 @@ return NULL;
      /* Write QSIZE */
      dev->reg->QSIZE.word = cms_length;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: QSIZE.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: QSIZE.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->QSIZE.word,
                    cms_length,
                    order_val);
@@ -460,13 +381,13 @@ return NULL;
      {
          uint64_t addr = base_addr[i] + BASEP_OFFSET;
          assert(addr <= ADDRESS_MASK);
-         LOG_DEBUG("BASEP%d=0x%016llx", i, addr);
+         LOG_REG_OP("BASEP%d=0x%016llx", i, addr);
  
-         // 根据已知信息，假定 base_addr[0] 指向模型数据，base_addr[1] 指向输入数据，
-         // 否则可以根据实际情况调整记录长度
-         uint32_t data_length = MODEL_LENGTH;
+         // 按驱动传入的区域大小对每个 BASEP 区域做快照；
+         // 调用方未提供大小时退回到 MODEL_LENGTH
+         uint32_t data_length = (base_addr_size != NULL) ? (uint32_t)base_addr_size[i] : MODEL_LENGTH;
          {
-             uint32_t order_val = ++g_npu_op_counter;
+             uint32_t order_val = next_op_order();
              record_reg_op(REG_OP_READ,
                            (volatile void *)(uintptr_t)base_addr[i],
                            0, order_val,
@@ -476,8 +397,8 @@ return NULL;
  
          dev->reg->BASEP[i].word[0] = addr & 0xffffffff;
          {
-             uint32_t order_val = ++g_npu_op_counter;
-             LOG_DEBUG("WR: BASEP[%d].word[0] addr=%p, value=0x%08llx, order=%u",
+             uint32_t order_val = next_op_order();
+             LOG_REG_OP("WR: BASEP[%d].word[0] addr=%p, value=0x%08llx, order=%u",
                        i,
                        (void*)&dev->reg->BASEP[i].word[0],
                        (unsigned long long)(addr & 0xffffffff),
@@ -488,8 +409,8 @@ return NULL;
  #ifdef ETHOSU65
          dev->reg->BASEP[i].word[1] = addr >> 32;
          {
-             uint32_t order_val = ++g_npu_op_counter;
-             LOG_DEBUG("WR: BASEP[%d].word[1] addr=%p, value=0x%08llx, order=%u",
+             uint32_t order_val = next_op_order();
+             LOG_REG_OP("WR: BASEP[%d].word[1] addr=%p, value=0x%08llx, order=%u",
                        i,
                        (void*)&dev->reg->BASEP[i].word[1],
                        (unsigned long long)(addr >> 32),
@@ -503,8 +424,8 @@ return NULL;
      /* Read and modify CMD register */
      cmd.word = dev->reg->CMD.word & NPU_CMD_PWR_CLK_MASK;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: CMD.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: CMD.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CMD.word,
                    cmd.word,
                    order_val);
@@ -514,8 +435,8 @@ return NULL;
      cmd.transition_to_running_state = 1;
      dev->reg->CMD.word = cmd.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: CMD.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: CMD.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CMD.word,
                    cmd.word,
                    order_val);
@@ -540,25 +461,25 @@ return NULL;
     uint32_t qread_word  = dev->reg->QREAD.word;
 
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       (volatile void *)&dev->reg->STATUS.word,
                       status_word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_print_err_status");
-        LOG_DEBUG("RD: STATUS.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("RD: STATUS.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->STATUS.word, status_word, order_val);
     }
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       (volatile void *)&dev->reg->QREAD.word,
                       qread_word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_print_err_status");
-        LOG_DEBUG("RD: QREAD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("RD: QREAD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->QREAD.word, qread_word, order_val);
     }
 
@@ -591,14 +512,14 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
     struct cmd_r cmd;
     cmd.word = dev->reg->CMD.word & NPU_CMD_PWR_CLK_MASK;
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       (volatile void *)&dev->reg->CMD.word,
                       cmd.word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_handle_interrupt");
-        LOG_DEBUG("RD: CMD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("RD: CMD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->CMD.word, cmd.word, order_val);
     }
 
@@ -606,14 +527,14 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
     cmd.clear_irq      = 1;
     dev->reg->CMD.word = cmd.word;
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_WRITE,
                       (volatile void *)&dev->reg->CMD.word,
                       cmd.word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_handle_interrupt");
-        LOG_DEBUG("WR: CMD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("WR: CMD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->CMD.word, cmd.word, order_val);
     }
 
@@ -622,25 +543,25 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
     uint32_t qread_word  = dev->reg->QREAD.word;
 
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       (volatile void *)&dev->reg->STATUS.word,
                       status_word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_handle_interrupt");
-        LOG_DEBUG("RD: STATUS.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("RD: STATUS.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->STATUS.word, status_word, order_val);
     }
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       (volatile void *)&dev->reg->QREAD.word,
                       qread_word,
                       order_val,
                       NULL, 0,
                       "ethosu_dev_handle_interrupt");
-        LOG_DEBUG("RD: QREAD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+        LOG_REG_OP("RD: QREAD.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                   (void *)&dev->reg->QREAD.word, qread_word, order_val);
     }
 
@@ -672,7 +593,7 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
     {
         #define RESULT_DATA_ADDR  ((volatile void *)0x20484000)
         #define RESULT_DATA_SIZE  MODEL_LENGTH
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         record_reg_op(REG_OP_READ,
                       RESULT_DATA_ADDR,        
                       0,                      
@@ -680,7 +601,7 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
                       (void *)RESULT_DATA_ADDR,
                       RESULT_DATA_SIZE,
                       "ethosu_dev_handle_interrupt");
-        LOG_DEBUG("Record inference result snapshot: addr=%p, size=%u, order=%u",
+        LOG_REG_OP("Record inference result snapshot: addr=%p, size=%u, order=%u",
                   RESULT_DATA_ADDR, RESULT_DATA_SIZE, order_val);
     }
     return true;        /* 推理完成且无错误 */
@@ -697,11 +618,11 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
     uint32_t prot_word = dev->reg->PROT.word;  // 假设 'word' 是 PROT 寄存器的 32 位值
 
     {
-        uint32_t order_val = ++g_npu_op_counter;
+        uint32_t order_val = next_op_order();
         // 记录整个 PROT 寄存器的值
         record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->PROT.word,
                       prot_word, order_val, NULL, 0, "ethosu_dev_verify_access_state");
-        LOG_DEBUG("RD: PROT.word value=0x%08x, order=%u", prot_word, order_val);
+        LOG_REG_OP("RD: PROT.word value=0x%08x, order=%u", prot_word, order_val);
     }
 
     // 获取 active_CSL 和 active_CPL 的值（通过位运算提取）
@@ -736,8 +657,8 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
      /* 写 RESET.word */
      dev->reg->RESET.word = reset.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: RESET.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: RESET.word addr=%p, value=0x%08" PRIx32 ", order=%" PRIu32,
                    (void*)&dev->reg->RESET.word, reset.word, order_val);
  
          record_reg_op(REG_OP_WRITE,
@@ -757,9 +678,9 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
      /* 读取整字 STATUS.word，再从中解出 reset_status */
      uint32_t sts_word = dev->reg->STATUS.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
+         uint32_t order_val = next_op_order();
          // 修改：这里对 STATUS.word 做 record
-         LOG_DEBUG("RD: STATUS.word addr=%p, full=0x%08" PRIx32 ", order=%" PRIu32,
+         LOG_REG_OP("RD: STATUS.word addr=%p, full=0x%08" PRIx32 ", order=%" PRIu32,
                    (void *)&dev->reg->STATUS.word, sts_word, order_val);
  
          record_reg_op(REG_OP_READ,
@@ -801,16 +722,16 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
  
      cfg.word = dev->reg->CONFIG.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CONFIG.word, cfg.word, order_val);
          record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->CONFIG.word,
                        cfg.word, order_val, NULL, 0, "ethosu_dev_get_hw_info");
      }
      id.word = dev->reg->ID.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: ID.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: ID.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->ID.word, id.word, order_val);
          record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->ID.word,
                        id.word, order_val, NULL, 0, "ethosu_dev_get_hw_info");
@@ -851,8 +772,8 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
      struct cmd_r cmd = {0};
      cmd.word = dev->reg->CMD.word & NPU_CMD_PWR_CLK_MASK;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: CMD.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: CMD.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CMD.word, cmd.word, order_val);
          record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->CMD.word,
                        cmd.word, order_val, NULL, 0, "ethosu_dev_set_clock_and_power");
@@ -869,8 +790,8 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
  
      dev->reg->CMD.word = cmd.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("WR: CMD.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("WR: CMD.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CMD.word, cmd.word, order_val);
          record_reg_op(REG_OP_WRITE, (volatile void *)&dev->reg->CMD.word,
                        cmd.word, order_val, NULL, 0, "ethosu_dev_set_clock_and_power");
@@ -896,16 +817,16 @@ bool ethosu_dev_handle_interrupt(struct ethosu_device *dev)
  
      hw_cfg.word = dev->reg->CONFIG.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: CONFIG.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->CONFIG.word, hw_cfg.word, order_val);
          record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->CONFIG.word,
                        hw_cfg.word, order_val, NULL, 0, "ethosu_dev_verify_optimizer_config");
      }
      hw_id.word = dev->reg->ID.word;
      {
-         uint32_t order_val = ++g_npu_op_counter;
-         LOG_DEBUG("RD: ID.word addr=%p, value=0x%08x, order=%u",
+         uint32_t order_val = next_op_order();
+         LOG_REG_OP("RD: ID.word addr=%p, value=0x%08x, order=%u",
                    (void*)&dev->reg->ID.word, hw_id.word, order_val);
          record_reg_op(REG_OP_READ, (volatile void *)&dev->reg->ID.word,
                        hw_id.word, order_val, NULL, 0, "ethosu_dev_verify_optimizer_config");
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ethosu_dlog.h"
+#include "ethosu_log.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if ETHOSU_LOG_DEFERRED
+
+#if (ETHOSU_DLOG_WORDS & (ETHOSU_DLOG_WORDS - 1)) != 0
+#error "ETHOSU_DLOG_WORDS must be a power of two"
+#endif
+
+#define DLOG_MASK       (ETHOSU_DLOG_WORDS - 1u)
+#define DLOG_MAX_RECORD (2u + ETHOSU_DLOG_MAX_ARG_WORDS)
+
+/* -------------------------------------------------------------------------- */
+/* Ring                                                                       */
+/* -------------------------------------------------------------------------- */
+
+/* head and tail count words and run freely. A writer reserves [head, head + n)
+ * with a compare-and-swap, fills in the arguments and stores the header word
+ * last; the reader stops at a header that is still zero, i.e. a record that is
+ * reserved but not complete, and zeroes what it consumes. */
+static uint32_t dlog_ring[ETHOSU_DLOG_WORDS];
+static uint32_t dlog_head;
+static uint32_t dlog_tail;
+static uint32_t dlog_drops;
+
+/* -------------------------------------------------------------------------- */
+/* Argument capture                                                           */
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    uint32_t n; /* words used, header and format included */
+    uint32_t flags;
+    uint32_t w[DLOG_MAX_RECORD];
+} dlog_record_t;
+
+static int dlog_push(dlog_record_t *r, uint64_t v, uint32_t words)
+{
+    if (r->n + words > DLOG_MAX_RECORD) {
+        r->flags |= ETHOSU_DLOG_F_TRUNCATED;
+        return -1;
+    }
+    r->w[r->n++] = (uint32_t)v;
+    if (words > 1) {
+        r->w[r->n++] = (uint32_t)(v >> 32);
+    }
+    return 0;
+}
+
+static int dlog_push_int(dlog_record_t *r, va_list *ap, size_t size)
+{
+    if (size > sizeof(uint32_t)) {
+        return dlog_push(r, va_arg(*ap, uint64_t), 2);
+    }
+    return dlog_push(r, va_arg(*ap, uint32_t), 1);
+}
+
+/* Store the arguments fmt consumes. The walk must match arg_words() in
+ * dlog.py: the host decides from the same conversions how many words each
+ * argument took. */
+static void dlog_capture(dlog_record_t *r, const char *fmt, va_list *ap)
+{
+    const char *p = fmt;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        size_t size = sizeof(int);
+        int is_long_double = 0;
+        double d;
+        uint64_t bits;
+
+        p++;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        while (*p && strchr("-+ #0", *p)) {
+            p++;
+        }
+        if (*p == '*') {
+            p++;
+            if (dlog_push_int(r, ap, sizeof(int))) {
+                return;
+            }
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                p++;
+                if (dlog_push_int(r, ap, sizeof(int))) {
+                    return;
+                }
+            }
+            while (*p >= '0' && *p <= '9') {
+                p++;
+            }
+        }
+
+        switch (*p) {
+        case 'h':
+            p += (p[1] == 'h') ? 2 : 1;
+            break;
+        case 'l':
+            if (p[1] == 'l') {
+                size = sizeof(long long);
+                p += 2;
+            } else {
+                size = sizeof(long);
+                p++;
+            }
+            break;
+        case 'j':
+            size = sizeof(intmax_t);
+            p++;
+            break;
+        case 'z':
+            size = sizeof(size_t);
+            p++;
+            break;
+        case 't':
+            size = sizeof(ptrdiff_t);
+            p++;
+            break;
+        case 'L':
+            is_long_double = 1;
+            p++;
+            break;
+        default:
+            break;
+        }
+
+        switch (*p) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (dlog_push_int(r, ap, size)) {
+                return;
+            }
+            break;
+        case 's':
+        case 'p':
+        case 'n':
+            if (dlog_push(r, (uintptr_t)va_arg(*ap, void *), sizeof(void *) / sizeof(uint32_t))) {
+                return;
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            /* always stored as a double */
+            d = is_long_double ? (double)va_arg(*ap, long double) : va_arg(*ap, double);
+            memcpy(&bits, &d, sizeof(bits));
+            if (dlog_push(r, bits, 2)) {
+                return;
+            }
+            break;
+        default:
+            /* unknown conversion, the rest cannot be located */
+            r->flags |= ETHOSU_DLOG_F_TRUNCATED;
+            return;
+        }
+        p++;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* Writer / reader                                                            */
+/* -------------------------------------------------------------------------- */
+
+void ethosu_dlog_write(const char *fmt, ...)
+{
+    dlog_record_t r;
+    va_list ap;
+    uint32_t head;
+    uint32_t tail;
+
+    r.n     = 2;
+    r.flags = 0;
+    r.w[1]  = (uint32_t)(uintptr_t)fmt;
+    va_start(ap, fmt);
+    dlog_capture(&r, fmt, &ap);
+    va_end(ap);
+
+    head = __atomic_load_n(&dlog_head, __ATOMIC_RELAXED);
+    do {
+        tail = __atomic_load_n(&dlog_tail, __ATOMIC_ACQUIRE);
+        if (head - tail + r.n > ETHOSU_DLOG_WORDS) {
+            __atomic_fetch_add(&dlog_drops, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&dlog_head, &head, head + r.n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    for (uint32_t i = 1; i < r.n; i++) {
+        dlog_ring[(head + i) & DLOG_MASK] = r.w[i];
+    }
+    __atomic_store_n(&dlog_ring[head & DLOG_MASK], r.flags | r.n, __ATOMIC_RELEASE);
+}
+
+/* One reader at a time: the dump, or a drain task */
+uint32_t ethosu_dlog_read(uint32_t *dst, uint32_t max_words)
+{
+    uint32_t tail = dlog_tail;
+    uint32_t copied = 0;
+
+    while (tail != __atomic_load_n(&dlog_head, __ATOMIC_RELAXED)) {
+        uint32_t hdr = __atomic_load_n(&dlog_ring[tail & DLOG_MASK], __ATOMIC_ACQUIRE);
+        uint32_t n   = hdr & 0xffu;
+
+        if (n == 0 || copied + n > max_words) {
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            dst[copied + i]                   = dlog_ring[(tail + i) & DLOG_MASK];
+            dlog_ring[(tail + i) & DLOG_MASK] = 0;
+        }
+        copied += n;
+        tail += n;
+        __atomic_store_n(&dlog_tail, tail, __ATOMIC_RELEASE);
+    }
+    return copied;
+}
+
+uint32_t ethosu_dlog_dropped(void)
+{
+    return __atomic_load_n(&dlog_drops, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+/* UART dump                                                                  */
+/* -------------------------------------------------------------------------- */
+
+#define DLOG_DUMP_LINE_WORDS 8
+
+void ethosu_dlog_dump(void)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint32_t words[DLOG_DUMP_LINE_WORDS + DLOG_MAX_RECORD];
+    char line[8 * DLOG_DUMP_LINE_WORDS + 1];
+    uint32_t pending = 0;
+    uint32_t total   = 0;
+    uint32_t n;
+
+    LOG("DLOG BEGIN dropped=%" PRIu32 "\r\n", ethosu_dlog_dropped());
+    do {
+        n = ethosu_dlog_read(words + pending, DLOG_MAX_RECORD);
+        pending += n;
+        total += n;
+        /* full lines, or whatever is left once the ring is empty */
+        while (pending >= DLOG_DUMP_LINE_WORDS || (n == 0 && pending > 0)) {
+            uint32_t chunk = pending < DLOG_DUMP_LINE_WORDS ? pending : DLOG_DUMP_LINE_WORDS;
+            for (uint32_t i = 0; i < 4 * chunk; i++) {
+                uint8_t b       = (uint8_t)(words[i / 4] >> (8 * (i % 4)));
+                line[2 * i]     = hex[b >> 4];
+                line[2 * i + 1] = hex[b & 0xf];
+            }
+            line[8 * chunk] = '\0';
+            LOG("DLOG:%s\r\n", line);
+            pending -= chunk;
+            memmove(words, words + chunk, pending * sizeof(words[0]));
+        }
+    } while (n > 0);
+    LOG("DLOG END words=%" PRIu32 "\r\n", total);
+}
+
+#endif /* ETHOSU_LOG_DEFERRED */
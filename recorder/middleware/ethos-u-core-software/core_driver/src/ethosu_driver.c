@@ -25,6 +25,7 @@
  #include "ethosu_device.h"
  #include "ethosu_log.h"
  #include "ethosu_shared.h"
+ #include "ethosu_trace.h"
  #include "pmu_ethosu.h"
  
  #ifdef ETHOSU55
@@ -300,10 +301,127 @@
      return NULL;
  }
  
- static void ethosu_reset_job(struct ethosu_driver *drv)
+ static void ethosu_reset_job(struct ethosu_job *job)
  {
      LOG_INFO("ethosu_reset_job called."); // [Called]
-     memset(&drv->job, 0, sizeof(struct ethosu_job));
+     memset(job, 0, sizeof(struct ethosu_job));
+ }
+ 
+ static void ethosu_reset_jobs(struct ethosu_driver *drv)
+ {
+     memset(drv->jobs, 0, sizeof(drv->jobs));
+     drv->job_head  = 0;
+     drv->job_count = 0;
+     drv->npu_busy  = false;
+ }
+ 
+ /*
+  * Job queue
+  *
+  * drv->jobs is a ring of ETHOSU_JOB_QUEUE_DEPTH jobs, oldest at job_head.
+  * ethosu_invoke_async() prepares a job in the caller's context and queues it
+  * PENDING; the NPU starts it as soon as the job before it completes, from
+  * the interrupt handler, so the caller can copy the next input and clean the
+  * caches while the NPU runs. ethosu_wait() retires jobs in order. The task
+  * and the interrupt handler share the ring; the task masks interrupts while
+  * it changes job_head/job_count or starts a job.
+  */
+ static inline uint32_t ethosu_lock_irq(void)
+ {
+     uint32_t primask = __get_PRIMASK();
+     __disable_irq();
+     return primask;
+ }
+ 
+ static inline void ethosu_unlock_irq(uint32_t primask)
+ {
+     __set_PRIMASK(primask);
+ }
+ 
+ static struct ethosu_job *ethosu_job_at(struct ethosu_driver *drv, int i)
+ {
+     return &drv->jobs[(drv->job_head + i) % ETHOSU_JOB_QUEUE_DEPTH];
+ }
+ 
+ /*
+  * Cache maintenance
+  *
+  * With base_addr_flags, only the regions the CPU writes or reads are cleaned
+  * and invalidated per job. ETHOSU_REGION_CONST regions, and the command
+  * stream, are cleaned the first time a job uses them and remembered in
+  * const_regions; later jobs skip any range that lies inside one of them.
+  */
+ static struct
+ {
+     uintptr_t addr;
+     size_t size;
+ } const_regions[ETHOSU_CONST_REGIONS];
+ static int const_region_count;
+ 
+ static void ethosu_clean_const(const void *p, size_t bytes)
+ {
+     uintptr_t addr = (uintptr_t)p;
+     bool cleaned   = false;
+ 
+     ethosu_mutex_lock(ethosu_mutex);
+     for (int i = 0; i < const_region_count && !cleaned; i++)
+     {
+         cleaned = addr >= const_regions[i].addr &&
+                   addr + bytes <= const_regions[i].addr + const_regions[i].size;
+     }
+     if (!cleaned)
+     {
+         ethosu_flush_dcache((uint32_t *)addr, bytes);
+         if (const_region_count < ETHOSU_CONST_REGIONS)
+         {
+             const_regions[const_region_count].addr = addr;
+             const_regions[const_region_count].size = bytes;
+             const_region_count++;
+         }
+     }
+     ethosu_mutex_unlock(ethosu_mutex);
+ }
+ 
+ void ethosu_forget_const_regions(void)
+ {
+     ethosu_mutex_lock(ethosu_mutex);
+     const_region_count = 0;
+     ethosu_mutex_unlock(ethosu_mutex);
+ }
+ 
+ static void ethosu_start_job(struct ethosu_driver *drv, struct ethosu_job *job)
+ {
+     job->state    = ETHOSU_JOB_RUNNING;
+     drv->npu_busy = true;
+ 
+     ethosu_inference_begin(drv, job->user_arg);
+ 
+     ethosu_trace_mark(ETHOSU_TRACE_MARK_PHASE, ETHOSU_TRACE_PHASE_RUN);
+     ethosu_dev_run_command_stream(drv->dev,
+                                   job->cmd_stream,
+                                   job->cms_bytes,
+                                   job->base_addr,
+                                   job->base_addr_size,
+                                   job->num_base_addr);
+ }
+ 
+ // Start the oldest pending job unless the NPU is busy or waits for a reset.
+ // Interrupts masked, or called from the interrupt handler.
+ static void ethosu_start_next_job(struct ethosu_driver *drv)
+ {
+     if (drv->npu_busy || drv->status_error)
+     {
+         return;
+     }
+     for (int i = 0; i < drv->job_count; i++)
+     {
+         struct ethosu_job *job = ethosu_job_at(drv, i);
+         if (job->state == ETHOSU_JOB_PENDING)
+         {
+             ethosu_start_job(drv, job);
+             return;
+         }
+     }
  }
  
  static int handle_optimizer_config(struct ethosu_driver *drv, struct opt_cfg_s *opt_cfg_p)
@@ -318,7 +436,7 @@
      return 0;
  }
  
- static int handle_command_stream(struct ethosu_driver *drv, const uint8_t *cmd_stream, const int cms_length)
+ static int handle_command_stream(struct ethosu_job *job, const uint8_t *cmd_stream, const int cms_length)
  {
      LOG_INFO("handle_command_stream called.");
      uint32_t cms_bytes = cms_length * BYTES_IN_32_BITS;
@@ -332,22 +450,47 @@
          return -1;
      }
  
+     if (job->cmd_stream != NULL)
+     {
+         LOG_ERR("More than one command stream in the custom operator payload");
+         return -1;
+     }
+ 
      // Verify 16 byte alignment for base address
-     for (int i = 0; i < drv->job.num_base_addr; i++)
+     for (int i = 0; i < job->num_base_addr; i++)
      {
-         if (0 != (drv->job.base_addr[i] & MASK_16_BYTE_ALIGN))
+         if (0 != (job->base_addr[i] & MASK_16_BYTE_ALIGN))
          {
-             LOG_ERR("Base addr %d: 0x%llx not aligned to 16 bytes", i, drv->job.base_addr[i]);
+             LOG_ERR("Base addr %d: 0x%llx not aligned to 16 bytes", i, job->base_addr[i]);
              return -1;
          }
      }
  
-     if (drv->job.base_addr_size != NULL)
+     // Cleaned now, while the NPU may still be running the previous job
+     if (job->base_addr_size != NULL && job->base_addr_flags != NULL)
+     {
+         ethosu_clean_const(cmd_stream, cms_bytes);
+         for (int i = 0; i < job->num_base_addr; i++)
+         {
+             uint8_t flags = job->base_addr_flags[i];
+ 
+             // An OFM is cleaned too, so no dirty line is evicted over the NPU's output
+             if (flags & (ETHOSU_REGION_CPU_WRITE | ETHOSU_REGION_CPU_READ))
+             {
+                 ethosu_flush_dcache((uint32_t *)(uintptr_t)job->base_addr[i], job->base_addr_size[i]);
+             }
+             else if (flags & ETHOSU_REGION_CONST)
+             {
+                 ethosu_clean_const((const void *)(uintptr_t)job->base_addr[i], job->base_addr_size[i]);
+             }
+         }
+     }
+     else if (job->base_addr_size != NULL)
      {
          ethosu_flush_dcache((uint32_t *)cmd_stream_ptr, cms_bytes);
-         for (int i = 0; i < drv->job.num_base_addr; i++)
+         for (int i = 0; i < job->num_base_addr; i++)
          {
-             ethosu_flush_dcache((uint32_t *)(uintptr_t)drv->job.base_addr[i], drv->job.base_addr_size[i]);
+             ethosu_flush_dcache((uint32_t *)(uintptr_t)job->base_addr[i], job->base_addr_size[i]);
          }
      }
      else
@@ -355,17 +498,8 @@
          ethosu_flush_dcache(NULL, 0);
      }
  
-     if (!ethosu_request_power(drv))
-     {
-         LOG_ERR("Failed to request power");
-         return -1;
-     }
- 
-     drv->job.state = ETHOSU_JOB_RUNNING;
- 
-     ethosu_inference_begin(drv, drv->job.user_arg);
- 
-     ethosu_dev_run_command_stream(drv->dev, cmd_stream, cms_bytes, drv->job.base_addr, drv->job.num_base_addr);
+     job->cmd_stream = cmd_stream;
+     job->cms_bytes  = cms_bytes;
      return 0;
  }
  
@@ -378,15 +512,61 @@
      LOG_INFO("Got interrupt from Ethos-U");
      LOG_INFO("Test Case 8: Got interrupt from Ethos-U");
  
-     drv = registered_drivers;
-     drv->job.state = ETHOSU_JOB_DONE;
+     struct ethosu_job *job = NULL;
+     for (int i = 0; i < drv->job_count; i++)
+     {
+         if (ethosu_job_at(drv, i)->state == ETHOSU_JOB_RUNNING)
+         {
+             job = ethosu_job_at(drv, i);
+             break;
+         }
+     }
+ 
+     ethosu_trace_mark(ETHOSU_TRACE_MARK_PHASE, ETHOSU_TRACE_PHASE_IRQ);
      if (!ethosu_dev_handle_interrupt(drv->dev))
      {
          drv->status_error = true;
+         if (job != NULL)
+         {
+             job->status_error = true;
+         }
      }
+     if (job != NULL)
+     {
+         job->state = ETHOSU_JOB_DONE;
+     }
+     drv->npu_busy = false;
+     ethosu_trace_mark(ETHOSU_TRACE_MARK_PHASE, ETHOSU_TRACE_PHASE_IDLE);
+ 
+ #if ETHOSU_RECORD_LEVEL == ETHOSU_RECORD_OFF
+     // Kick the next command stream straight away, it was prepared while this one ran
+     ethosu_start_next_job(drv);
+ #endif
+     // While recording, the hooks behind the kick (log lines, snapshot copies)
+     // must not run here: ethosu_wait() starts the next job instead
      ethosu_semaphore_give(drv->semaphore);
  }
  
+ void ethosu_irq_dispatch(void)
+ {
+     bool handled = false;
+ 
+     for (struct ethosu_driver *drv = registered_drivers; drv != NULL; drv = drv->next)
+     {
+         if (drv->npu_busy)
+         {
+             ethosu_irq_handler(drv);
+             handled = true;
+         }
+     }
+ 
+     // Nothing running: still acknowledge the interrupt
+     if (!handled && registered_drivers != NULL)
+     {
+         ethosu_irq_handler(registered_drivers);
+     }
+ }
+ 
  /******************************************************************************
   * Functions API
   ******************************************************************************/
@@ -415,6 +595,10 @@
      drv->fast_memory_size = fast_memory_size;
      drv->power_request_counter = 0;
  
+     // Register offsets in the trace are relative to the NPU base address
+     ethosu_trace_reset((uintptr_t)base_address);
+     ethosu_trace_mark(ETHOSU_TRACE_MARK_PHASE, ETHOSU_TRACE_PHASE_INIT);
+ 
      drv->dev = ethosu_dev_init(base_address, secure_enable, privilege_enable);
      if (drv->dev == NULL)
      {
@@ -425,7 +609,7 @@
      drv->semaphore = ethosu_semaphore_create();
      drv->status_error = false;
  
-     ethosu_reset_job(drv);
+     ethosu_reset_jobs(drv);
      ethosu_register_driver(drv);
  
      return 0;
@@ -506,60 +690,83 @@
  int ethosu_wait(struct ethosu_driver *drv, bool block)
  {
      LOG_INFO("ethosu_wait called."); // [Called]
+     struct ethosu_job *job;
+     uint32_t primask;
      int ret = 0;
  
-     switch (drv->job.state)
+     if (drv->job_count == 0)
      {
-         case ETHOSU_JOB_IDLE:
-             LOG_ERR("Inference job not running...");
-             ret = -2;
-             break;
-         case ETHOSU_JOB_RUNNING:
-             if (!block)
-             {
-                 ret = 1;
-                 break;
-             }
-             // fall through
-         case ETHOSU_JOB_DONE:
-             ethosu_semaphore_take(drv->semaphore);
-             ethosu_inference_end(drv, drv->job.user_arg);
-             ethosu_release_power(drv);
-             if (drv->status_error)
-             {
-                 LOG_ERR("NPU error(s) occured during inference.");
-                 ethosu_dev_print_err_status(drv->dev);
-                 (void)ethosu_soft_reset(drv);
-                 drv->status_error = false;
-                 ret = -1;
-             }
-             if (ret == 0)
+         LOG_ERR("Inference job not running...");
+         return -2;
+     }
+ 
+     // The oldest job; the interrupt handler gives the semaphore once per
+     // completed job, so recheck the state after every take
+     job = ethosu_job_at(drv, 0);
+     while (job->state != ETHOSU_JOB_DONE)
+     {
+         if (!block)
+         {
+             return 1;
+         }
+         ethosu_semaphore_take(drv->semaphore);
+     }
+ 
+ #if ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+     // The interrupt handler left the next job to task context
+     primask = ethosu_lock_irq();
+     ethosu_start_next_job(drv);
+     ethosu_unlock_irq(primask);
+ #endif
+ 
+     ethosu_inference_end(drv, job->user_arg);
+     ethosu_release_power(drv);
+     if (job->status_error)
+     {
+         LOG_ERR("NPU error(s) occured during inference.");
+         ethosu_dev_print_err_status(drv->dev);
+         (void)ethosu_soft_reset(drv);
+         ret = -1;
+     }
+     if (ret == 0)
+     {
+         if (job->base_addr_size != NULL)
+         {
+             for (int i = 0; i < job->num_base_addr; i++)
              {
-                 if (drv->job.base_addr_size != NULL)
-                 {
-                     for (int i = 0; i < drv->job.num_base_addr; i++)
-                     {
-                         ethosu_invalidate_dcache((uint32_t *)(uintptr_t)drv->job.base_addr[i], drv->job.base_addr_size[i]);
-                     }
-                 }
-                 else
+                 if (job->base_addr_flags == NULL || (job->base_addr_flags[i] & ETHOSU_REGION_CPU_READ))
                  {
-                     ethosu_invalidate_dcache(NULL, 0);
+                     ethosu_invalidate_dcache((uint32_t *)(uintptr_t)job->base_addr[i], job->base_addr_size[i]);
                  }
-                 LOG_INFO("Test Case 18: read at end of command stream");
-                 LOG_INFO("Inference finished successfully...");
              }
-             ethosu_reset_job(drv);
-             break;
-         default:
-             LOG_ERR("Unexpected job state");
-             ethosu_reset_job(drv);
-             ret = -1;
-             break;
+         }
+         else
+         {
+             ethosu_invalidate_dcache(NULL, 0);
+         }
+         LOG_INFO("Test Case 18: read at end of command stream");
+         LOG_INFO("Inference finished successfully...");
      }
+ 
+     primask = ethosu_lock_irq();
+     if (job->status_error)
+     {
+         // The NPU has been reset, the jobs queued behind this one can run
+         drv->status_error = false;
+     }
+     ethosu_reset_job(job);
+     drv->job_head = (drv->job_head + 1) % ETHOSU_JOB_QUEUE_DEPTH;
+     drv->job_count--;
+     ethosu_start_next_job(drv);
+     ethosu_unlock_irq(primask);
      return ret;
  }
  
+ int ethosu_job_count(struct ethosu_driver *drv)
+ {
+     return drv->job_count;
+ }
+ 
  int ethosu_invoke_async(struct ethosu_driver *drv,
                          const void *custom_data_ptr,
                          const int custom_data_size,
@@ -569,7 +776,23 @@
                          void *user_arg)
  {
      LOG_INFO("ethosu_invoke_async called.");
+     return ethosu_invoke_regions_async(
+         drv, custom_data_ptr, custom_data_size, base_addr, base_addr_size, NULL, num_base_addr, user_arg);
+ }
+ 
+ int ethosu_invoke_regions_async(struct ethosu_driver *drv,
+                                 const void *custom_data_ptr,
+                                 const int custom_data_size,
+                                 const uint64_t *base_addr,
+                                 const size_t *base_addr_size,
+                                 const uint8_t *base_addr_flags,
+                                 const int num_base_addr,
+                                 void *user_arg)
+ {
+     LOG_INFO("ethosu_invoke_regions_async called.");
      const struct cop_data_s *data_ptr = custom_data_ptr;
+     struct ethosu_job *job;
+     uint32_t primask;
      const struct cop_data_s *data_end = (const struct cop_data_s *)((ptrdiff_t)custom_data_ptr + custom_data_size);
  
      LOG_INFO("custom_data_ptr: 0x%x, custom_data_size %d", custom_data_ptr, custom_data_size);
@@ -577,19 +800,23 @@
          LOG_INFO("base_addr[%d]: %x", i, (uint32_t)base_addr[i]);
      }
  
-     if (drv->job.state != ETHOSU_JOB_IDLE)
+     if (drv->job_count >= ETHOSU_JOB_QUEUE_DEPTH)
      {
-         LOG_ERR("Inference already running, or waiting to be cleared...");
+         LOG_ERR("Job queue full (%d jobs), waiting to be cleared...", ETHOSU_JOB_QUEUE_DEPTH);
          return -1;
      }
  
-     drv->job.state            = ETHOSU_JOB_IDLE;
-     drv->job.custom_data_ptr  = custom_data_ptr;
-     drv->job.custom_data_size = custom_data_size;
-     drv->job.base_addr        = base_addr;
-     drv->job.base_addr_size   = base_addr_size;
-     drv->job.num_base_addr    = num_base_addr;
-     drv->job.user_arg         = user_arg;
+     // The free slot after the last queued job; the interrupt handler does not
+     // look at it until job_count covers it
+     job = ethosu_job_at(drv, drv->job_count);
+     ethosu_reset_job(job);
+     job->custom_data_ptr  = custom_data_ptr;
+     job->custom_data_size = custom_data_size;
+     job->base_addr        = base_addr;
+     job->base_addr_size   = base_addr_size;
+     job->base_addr_flags  = base_addr_flags;
+     job->num_base_addr    = num_base_addr;
+     job->user_arg         = user_arg;
  
      if (data_ptr->word != ETHOSU_FOURCC)
      {
@@ -621,8 +848,6 @@
          LOG_INFO("Updated base_addr[%d]: %x", i, (uint32_t)base_addr[i]);
      }
  
-     drv->status_error = false;
- 
      while (data_ptr < data_end)
      {
          switch (data_ptr->driver_action_command)
@@ -643,7 +868,7 @@
                  LOG_INFO("COMMAND_STREAM");
                  void *command_stream = (uint8_t *)(data_ptr) + sizeof(struct cop_data_s);
                  int cms_length = (data_ptr->reserved << 16) | data_ptr->length;
-                 if (handle_command_stream(drv, command_stream, cms_length) < 0)
+                 if (handle_command_stream(job, command_stream, cms_length) < 0)
                  {
                      goto err;
                  }
@@ -663,10 +888,30 @@
              }
          }
      }
+ 
+     if (job->cmd_stream == NULL)
+     {
+         LOG_ERR("No command stream in the custom operator payload");
+         goto err;
+     }
+ 
+     // Held until ethosu_wait() retires the job, so the NPU stays powered
+     // between queued jobs
+     if (!ethosu_request_power(drv))
+     {
+         LOG_ERR("Failed to request power");
+         goto err;
+     }
+ 
+     job->state = ETHOSU_JOB_PENDING;
+     primask    = ethosu_lock_irq();
+     drv->job_count++;
+     ethosu_start_next_job(drv);
+     ethosu_unlock_irq(primask);
      return 0;
  err:
      LOG_ERR("Failed to invoke inference.");
-     ethosu_reset_job(drv);
+     ethosu_reset_job(job);
      return -1;
  }
  
@@ -686,6 +931,24 @@
      return ethosu_wait(drv, true);
  }
  
+ int ethosu_invoke_regions(struct ethosu_driver *drv,
+                           const void *custom_data_ptr,
+                           const int custom_data_size,
+                           const uint64_t *base_addr,
+                           const size_t *base_addr_size,
+                           const uint8_t *base_addr_flags,
+                           const int num_base_addr,
+                           void *user_arg)
+ {
+     LOG_INFO("ethosu_invoke_regions called.");
+     if (ethosu_invoke_regions_async(drv, custom_data_ptr, custom_data_size, base_addr, base_addr_size,
+                                     base_addr_flags, num_base_addr, user_arg) < 0)
+     {
+         return -1;
+     }
+     return ethosu_wait(drv, true);
+ }
+ 
  struct ethosu_driver *ethosu_reserve_driver(void)
  {
      LOG_INFO("ethosu_reserve_driver called.");
@@ -712,16 +975,19 @@
      ethosu_mutex_lock(ethosu_mutex);
      if (drv != NULL && drv->reserved)
      {
-         if (drv->job.state == ETHOSU_JOB_RUNNING || drv->job.state == ETHOSU_JOB_DONE)
+         // Retire the jobs that have completed, drop the rest
+         while (drv->job_count > 0 && ethosu_wait(drv, false) != 1)
          {
-             if (ethosu_wait(drv, false) == 1)
-             {
-                 drv->power_request_counter = 0;
-                 ethosu_soft_reset(drv);
-                 ethosu_reset_job(drv);
-                 drv->status_error = false;
-                 ethosu_semaphore_give(drv->semaphore);
-             }
+         }
+         if (drv->job_count > 0)
+         {
+             uint32_t primask = ethosu_lock_irq();
+             ethosu_reset_jobs(drv);
+             drv->status_error = false;
+             ethosu_unlock_irq(primask);
+             drv->power_request_counter = 0;
+             ethosu_soft_reset(drv);
+             ethosu_semaphore_give(drv->semaphore);
          }
          drv->reserved = false;
          LOG_INFO("NPU driver handle %p released", drv);
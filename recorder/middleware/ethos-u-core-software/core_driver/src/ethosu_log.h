@@ -38,11 +38,22 @@
 #define ETHOSU_LOG_INFO 2
 #define ETHOSU_LOG_DEBUG 3
 
-#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_DEBUG
-
 // Define default log severity
 #ifndef ETHOSU_LOG_SEVERITY
-#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_WARN
+#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_DEBUG
+#endif
+
+// Deferred logging: warnings, info and debug go to a RAM ring instead of
+// the UART, see ethosu_dlog.h. Errors and LOG() are always printed.
+#ifndef ETHOSU_LOG_DEFERRED
+#define ETHOSU_LOG_DEFERRED 0
+#endif
+
+#if ETHOSU_LOG_DEFERRED
+#include "ethosu_dlog.h"
+#define LOG_DEFERRABLE(f, ...) ETHOSU_DLOG(f, ##__VA_ARGS__)
+#else
+#define LOG_DEFERRABLE(f, ...) PRINTF(f, ##__VA_ARGS__)
 #endif
 
 // Log formatting
@@ -56,19 +67,19 @@
 #endif
 
 #if ETHOSU_LOG_SEVERITY >= ETHOSU_LOG_WARN
-#define LOG_WARN(f, ...) PRINTF("W: " f "\r\n", ##__VA_ARGS__)
+#define LOG_WARN(f, ...) LOG_DEFERRABLE("W: " f "\r\n", ##__VA_ARGS__)
 #else
 #define LOG_WARN(f, ...)
 #endif
 
 #if ETHOSU_LOG_SEVERITY >= ETHOSU_LOG_INFO
-#define LOG_INFO(f, ...) PRINTF("I: " f "\r\n", ##__VA_ARGS__)
+#define LOG_INFO(f, ...) LOG_DEFERRABLE("I: " f "\r\n", ##__VA_ARGS__)
 #else
 #define LOG_INFO(f, ...)
 #endif
 
 #if ETHOSU_LOG_SEVERITY >= ETHOSU_LOG_DEBUG
-#define LOG_DEBUG(f, ...) PRINTF("D: %s(): " f "\r\n", __FUNCTION__, ##__VA_ARGS__)
+#define LOG_DEBUG(f, ...) LOG_DEFERRABLE("D: %s(): " f "\r\n", __FUNCTION__, ##__VA_ARGS__)
 #else
 #define LOG_DEBUG(f, ...)
 #endif
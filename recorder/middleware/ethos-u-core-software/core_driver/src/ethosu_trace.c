@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "ethosu_trace.h"
+#include "ethosu_log.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF
+
+/* -------------------------------------------------------------------------- */
+/* Trace storage                                                              */
+/* -------------------------------------------------------------------------- */
+
+/* Worst case record: tag + 5 byte delta + 5 byte value */
+#define TRACE_MAX_RECORD_SIZE 11
+
+static ethosu_trace_header_t trace_hdr = {
+    .magic   = ETHOSU_TRACE_MAGIC,
+    .version = ETHOSU_TRACE_VERSION,
+};
+
+#if ETHOSU_TRACE_STREAM
+/* Record ring: two chunk buffers. The recorder fills the active one while the
+ * other is being drained to Linux; a full chunk is handed over with
+ * ethosu_trace_chunk_ready(). Records are only dropped if the drain falls a
+ * whole chunk behind. */
+static uint8_t trace_chunks[2][ETHOSU_TRACE_CHUNK_BYTES];
+static uint32_t trace_chunk_len[2];
+static uint32_t trace_chunk_offset[2]; /* stream offset of each chunk */
+static volatile uint8_t trace_chunk_full[2];
+static uint32_t trace_active;
+static uint32_t trace_drain;
+#else
+static uint8_t trace_records[ETHOSU_TRACE_RECORD_BYTES];
+#endif
+
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+/* Snapshot arena: a bump allocator indexed by content hash, so a region that
+ * was already captured (same weights, same model header, an earlier run) is
+ * referenced again instead of copied again. */
+typedef struct {
+    uint32_t hash;
+    uint32_t offset;
+    uint32_t size;
+} trace_blob_t;
+
+static uint8_t trace_blobs[ETHOSU_TRACE_BLOB_BYTES];
+static trace_blob_t trace_blob_index[ETHOSU_TRACE_BLOB_SLOTS];
+static uint32_t trace_blob_count;
+static uint32_t trace_snap_bytes; /* bytes referenced by SNAP records */
+#endif
+
+static int32_t trace_last_word; /* word offset of the previous READ/WRITE */
+static uint32_t trace_next_order = 1;
+
+/* -------------------------------------------------------------------------- */
+/* Encoding helpers                                                           */
+/* -------------------------------------------------------------------------- */
+
+static inline uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+/* FNV-1a, only used to find candidates; a hit is confirmed with memcmp */
+static uint32_t blob_hash(const uint8_t *p, uint32_t n)
+{
+    uint32_t h = 2166136261u;
+    while (n--) {
+        h = (h ^ *p++) * 16777619u;
+    }
+    return h;
+}
+
+/* Arena offset of a blob with this content, stored first if it is new.
+ * Returns -1 when the arena or its index is full. */
+static int32_t trace_blob_intern(const void *data, uint32_t size)
+{
+    uint32_t hash = blob_hash(data, size);
+
+    for (uint32_t i = 0; i < trace_blob_count; i++) {
+        const trace_blob_t *b = &trace_blob_index[i];
+        if (b->hash == hash && b->size == size && memcmp(&trace_blobs[b->offset], data, size) == 0) {
+            return (int32_t)b->offset;
+        }
+    }
+
+    if (trace_blob_count >= ETHOSU_TRACE_BLOB_SLOTS || size > sizeof(trace_blobs) - trace_hdr.blob_bytes) {
+        return -1;
+    }
+
+    trace_blob_t *b = &trace_blob_index[trace_blob_count++];
+    b->hash         = hash;
+    b->offset       = trace_hdr.blob_bytes;
+    b->size         = size;
+
+    memcpy(&trace_blobs[b->offset], data, size);
+    trace_hdr.blob_bytes += size;
+    return (int32_t)b->offset;
+}
+#endif
+
+#if ETHOSU_TRACE_STREAM
+/* Hand the active chunk to the drain side and switch to the other one.
+ * Fails if the other chunk has not been drained yet. */
+static int trace_chunk_seal(void)
+{
+    uint32_t len = trace_chunk_len[trace_active];
+
+    if (len == 0) {
+        return 0;
+    }
+    if (trace_chunk_full[trace_active ^ 1]) {
+        return -1;
+    }
+
+    trace_chunk_offset[trace_active] = trace_hdr.record_bytes - len;
+    trace_chunk_full[trace_active]   = 1;
+    trace_active ^= 1;
+    trace_chunk_len[trace_active] = 0;
+
+    ethosu_trace_chunk_ready();
+    return 0;
+}
+#endif
+
+/* Reserve room for one record, flag the trace as truncated if there is none */
+static uint8_t *trace_reserve(void)
+{
+#if ETHOSU_TRACE_STREAM
+    if (trace_chunk_len[trace_active] + 2 * TRACE_MAX_RECORD_SIZE > ETHOSU_TRACE_CHUNK_BYTES &&
+        trace_chunk_seal() != 0) {
+        trace_hdr.flags |= ETHOSU_TRACE_HDR_TRUNCATED;
+        return NULL;
+    }
+    return &trace_chunks[trace_active][trace_chunk_len[trace_active]];
+#else
+    if (trace_hdr.record_bytes + 2 * TRACE_MAX_RECORD_SIZE > sizeof(trace_records)) {
+        trace_hdr.flags |= ETHOSU_TRACE_HDR_TRUNCATED;
+        return NULL;
+    }
+    return &trace_records[trace_hdr.record_bytes];
+#endif
+}
+
+/* Account for the bytes written at the pointer returned by trace_reserve();
+ * records is 0 for a MARK, which is not counted in record_count */
+static void trace_commit(const uint8_t *end, uint32_t records)
+{
+#if ETHOSU_TRACE_STREAM
+    uint32_t len = (uint32_t)(end - trace_chunks[trace_active]);
+    trace_hdr.record_bytes += len - trace_chunk_len[trace_active];
+    trace_chunk_len[trace_active] = len;
+#else
+    trace_hdr.record_bytes = (uint32_t)(end - trace_records);
+#endif
+    trace_hdr.record_count += records;
+}
+
+static uint8_t *trace_sync_order(uint8_t *p, uint32_t op_order)
+{
+    if (op_order != trace_next_order) {
+        *p++ = ETHOSU_TRACE_TAG_MARK;
+        p    = put_varint(p, ETHOSU_TRACE_MARK_ORDER);
+        p    = put_varint(p, op_order);
+    }
+    trace_next_order = op_order + 1;
+    return p;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Public API                                                                 */
+/* -------------------------------------------------------------------------- */
+
+void ethosu_trace_reset(uintptr_t reg_base)
+{
+    trace_hdr.flags        = 0;
+    trace_hdr.reg_base     = (uint32_t)reg_base;
+    trace_hdr.record_count = 0;
+    trace_hdr.record_bytes = 0;
+    trace_last_word        = 0;
+    trace_next_order       = 1;
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+    trace_snap_bytes = 0;
+#endif
+#if ETHOSU_TRACE_STREAM
+    trace_chunk_len[0]  = 0;
+    trace_chunk_len[1]  = 0;
+    trace_chunk_full[0] = 0;
+    trace_chunk_full[1] = 0;
+    trace_active        = 0;
+    trace_drain         = 0;
+#endif
+}
+
+void ethosu_trace_reg(uint32_t is_write, uintptr_t reg_addr, uint32_t value, uint32_t op_order)
+{
+    uint8_t *p = trace_reserve();
+    if (p == NULL) {
+        return;
+    }
+
+    p = trace_sync_order(p, op_order);
+
+    int32_t word = (int32_t)((uint32_t)reg_addr - trace_hdr.reg_base) >> 2;
+    uint8_t tag  = is_write ? ETHOSU_TRACE_TAG_WRITE : ETHOSU_TRACE_TAG_READ;
+    if (value == 0) {
+        tag |= ETHOSU_TRACE_F_ZERO;
+    }
+
+    *p++ = tag;
+    p    = put_varint(p, zigzag(word - trace_last_word));
+    if (value != 0) {
+        p = put_varint(p, value);
+    }
+
+    trace_last_word = word;
+    trace_commit(p, 1);
+}
+
+void ethosu_trace_mark(uint32_t kind, uint32_t arg)
+{
+    uint8_t *p = trace_reserve();
+    if (p == NULL) {
+        return;
+    }
+
+    *p++ = ETHOSU_TRACE_TAG_MARK;
+    p    = put_varint(p, kind);
+    p    = put_varint(p, arg);
+    trace_commit(p, 0);
+}
+
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+void ethosu_trace_snapshot(uintptr_t addr, const void *data, uint32_t size, uint32_t op_order)
+{
+    uint8_t *p = trace_reserve();
+    if (p == NULL) {
+        return;
+    }
+
+    int32_t offset = trace_blob_intern(data, size);
+    if (offset < 0) {
+        trace_hdr.flags |= ETHOSU_TRACE_HDR_TRUNCATED;
+        return;
+    }
+
+    p    = trace_sync_order(p, op_order);
+    *p++ = ETHOSU_TRACE_TAG_SNAP;
+    p    = put_varint(p, (uint32_t)addr);
+    p    = put_varint(p, size);
+    p    = put_varint(p, (uint32_t)offset);
+
+    trace_snap_bytes += size;
+    trace_commit(p, 1);
+}
+#endif
+
+const ethosu_trace_header_t *ethosu_trace_header(void)
+{
+    return &trace_hdr;
+}
+
+#if ETHOSU_TRACE_STREAM
+void __attribute__((weak)) ethosu_trace_chunk_ready(void) {}
+
+const uint8_t *ethosu_trace_chunk_peek(uint32_t *len, uint32_t *offset)
+{
+    if (!trace_chunk_full[trace_drain]) {
+        return NULL;
+    }
+    *len    = trace_chunk_len[trace_drain];
+    *offset = trace_chunk_offset[trace_drain];
+    return trace_chunks[trace_drain];
+}
+
+void ethosu_trace_chunk_release(void)
+{
+    trace_chunk_full[trace_drain] = 0;
+    trace_drain ^= 1;
+}
+
+int ethosu_trace_seal(void)
+{
+    return trace_chunk_seal();
+}
+#else
+const uint8_t *ethosu_trace_records(void)
+{
+    return trace_records;
+}
+#endif
+
+const uint8_t *ethosu_trace_blobs(void)
+{
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+    return trace_blobs;
+#else
+    return NULL;
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* UART dump                                                                  */
+/* -------------------------------------------------------------------------- */
+
+#if !ETHOSU_TRACE_STREAM
+#define TRACE_DUMP_LINE_BYTES 32
+
+static void trace_dump_bytes(const uint8_t *p, uint32_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[2 * TRACE_DUMP_LINE_BYTES + 1];
+
+    while (n > 0) {
+        uint32_t chunk = n < TRACE_DUMP_LINE_BYTES ? n : TRACE_DUMP_LINE_BYTES;
+        for (uint32_t i = 0; i < chunk; i++) {
+            line[2 * i]     = hex[p[i] >> 4];
+            line[2 * i + 1] = hex[p[i] & 0xf];
+        }
+        line[2 * chunk] = '\0';
+        LOG("TRACE:%s\r\n", line);
+        p += chunk;
+        n -= chunk;
+    }
+}
+#endif
+
+void ethosu_trace_dump(void)
+{
+#if ETHOSU_TRACE_STREAM
+    LOG_INFO("Register trace streamed: %" PRIu32 " records, %" PRIu32 " bytes%s",
+             trace_hdr.record_count,
+             trace_hdr.record_bytes,
+             (trace_hdr.flags & ETHOSU_TRACE_HDR_TRUNCATED) ? " (records dropped)" : "");
+#else
+    if (trace_hdr.flags & ETHOSU_TRACE_HDR_TRUNCATED) {
+        LOG_WARN("Register trace truncated, raise ETHOSU_TRACE_RECORD_BYTES/ETHOSU_TRACE_BLOB_BYTES");
+    }
+
+#if ETHOSU_RECORD_LEVEL >= ETHOSU_RECORD_FULL
+    LOG_INFO("Snapshots: %" PRIu32 " bytes referenced, %" PRIu32 " bytes stored in %" PRIu32 " unique blobs",
+             trace_snap_bytes,
+             trace_hdr.blob_bytes,
+             trace_blob_count);
+#endif
+
+    LOG("TRACE BEGIN records=%" PRIu32 " record_bytes=%" PRIu32 " blob_bytes=%" PRIu32 "\r\n",
+        trace_hdr.record_count,
+        trace_hdr.record_bytes,
+        trace_hdr.blob_bytes);
+    trace_dump_bytes((const uint8_t *)&trace_hdr, sizeof(trace_hdr));
+    trace_dump_bytes(trace_records, trace_hdr.record_bytes);
+    trace_dump_bytes(ethosu_trace_blobs(), trace_hdr.blob_bytes);
+    LOG("TRACE END\r\n");
+#endif
+}
+
+#endif /* ETHOSU_RECORD_LEVEL > ETHOSU_RECORD_OFF */
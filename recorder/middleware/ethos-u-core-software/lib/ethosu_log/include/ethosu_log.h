@@ -38,11 +38,9 @@
 #define ETHOSU_LOG_INFO  2
 #define ETHOSU_LOG_DEBUG 3
 
-#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_DEBUG
-
 // Define default log severity
 #ifndef ETHOSU_LOG_SEVERITY
-#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_WARN
+#define ETHOSU_LOG_SEVERITY ETHOSU_LOG_DEBUG
 #endif
 
 // Log formatting
@@ -26,6 +26,8 @@
 #include <stdint.h>
 #include <vector>
 
+// One PMU sample of an ETHOSU_CORE_INFERENCE_OP job, 48 bytes, little endian.
+// Counters past the configured events read ETHOSU_PMU_NO_EVENT.
 typedef struct {
     uint64_t cycleCount;
     uint32_t qread;
@@ -44,6 +44,10 @@ void EthosUMonitor::monitorSample(ethosu_driver *drv, EthosuQreadEvent *event) {
         event->pmu[i].eventConfig = ethosuEventIds[i];
         event->pmu[i].eventCount = ETHOSU_PMU_Get_EVCNTR(drv, i);
     }
+    for (size_t i = numEvents; i < ETHOSU_PMU_NCOUNTERS; i++) {
+        event->pmu[i].eventConfig = ETHOSU_PMU_NO_EVENT;
+        event->pmu[i].eventCount = 0;
+    }
 
     event->cycleCount = ETHOSU_PMU_Get_CCNTR(drv);
     event->qread = ETHOSU_PMU_Get_QREAD(drv);
@@ -5,8 +5,10 @@ message("${CMAKE_CURRENT_LIST_FILE} component is included.")
 
 target_sources(${MCUX_SDK_PROJECT_NAME} PRIVATE
   ${CMAKE_CURRENT_LIST_DIR}/core_driver/src/ethosu_device_u55_u65.c
+  ${CMAKE_CURRENT_LIST_DIR}/core_driver/src/ethosu_dlog.c
   ${CMAKE_CURRENT_LIST_DIR}/core_driver/src/ethosu_driver.c
   ${CMAKE_CURRENT_LIST_DIR}/core_driver/src/ethosu_pmu.c
+  ${CMAKE_CURRENT_LIST_DIR}/core_driver/src/ethosu_trace.c
 )
 
 target_include_directories(${MCUX_SDK_PROJECT_NAME} PUBLIC
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Linux side of the streaming recorder (ethosu_apps_rpmsg built with
+ * -DETHOSU_TRACE_STREAM=ON).
+ *
+ * The M33 announces its trace endpoint as "rpmsg-raw", which rpmsg_char
+ * exposes as /dev/rpmsgN. This tool sends a HELLO chunk so the target learns
+ * our address, then reassembles record and snapshot chunks. The target sends
+ * an END chunk after every inference; each one rewrites the output file with
+ * the whole trace so far (header + records + blobs), which rrtrace.py splits
+ * into inferences using the phase marks.
+ *
+ *   trace_collect [-d /dev/rpmsg0] [-o trace.bin] [-n inferences]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ethosu_trace.h"
+
+#define MSG_MAX_BYTES 512
+
+struct section {
+    uint8_t *data;
+    uint32_t size;  /* allocated bytes      */
+    uint32_t valid; /* bytes received so far */
+};
+
+static int section_put(struct section *s, uint32_t offset, const uint8_t *src, uint32_t len)
+{
+    if (offset + len > s->size) {
+        uint32_t size = s->size ? s->size : 4096;
+        uint8_t *data;
+
+        while (size < offset + len)
+            size *= 2;
+        data = realloc(s->data, size);
+        if (!data)
+            return -1;
+        s->data = data;
+        s->size = size;
+    }
+
+    if (offset > s->valid)
+        fprintf(stderr, "gap in section: %u bytes missing at %u\n", offset - s->valid, s->valid);
+
+    memcpy(s->data + offset, src, len);
+    if (offset + len > s->valid)
+        s->valid = offset + len;
+    return 0;
+}
+
+static int write_trace(const char *path, unsigned int n, const ethosu_trace_header_t *hdr,
+                       const struct section *rec, const struct section *blob)
+{
+    FILE *f;
+
+    if (hdr->record_bytes > rec->valid || hdr->blob_bytes > blob->valid) {
+        fprintf(stderr, "trace %u incomplete: records %u/%u, blobs %u/%u\n",
+                n, rec->valid, hdr->record_bytes, blob->valid, hdr->blob_bytes);
+        return -1;
+    }
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    fwrite(hdr, sizeof(*hdr), 1, f);
+    fwrite(rec->data, 1, hdr->record_bytes, f);
+    fwrite(blob->data, 1, hdr->blob_bytes, f);
+    fclose(f);
+
+    printf("%s: inference %u, %u records, %u record bytes, %u blob bytes%s\n", path, n, hdr->record_count,
+           hdr->record_bytes, hdr->blob_bytes,
+           (hdr->flags & ETHOSU_TRACE_HDR_TRUNCATED) ? " (truncated)" : "");
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-d device] [-o output] [-n inferences]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev    = "/dev/rpmsg0";
+    const char *output = "trace.bin";
+    unsigned int count = 0; /* 0: until interrupted */
+    unsigned int n     = 0;
+    uint32_t seq       = 0;
+    struct section rec  = {0};
+    struct section blob = {0};
+    ethosu_trace_chunk_t hello = {
+        .magic = ETHOSU_TRACE_MAGIC,
+        .type  = ETHOSU_TRACE_CHUNK_HELLO,
+    };
+    uint8_t msg[MSG_MAX_BYTES];
+    int opt;
+    int fd;
+
+    while ((opt = getopt(argc, argv, "d:o:n:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            dev = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'n':
+            count = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(dev, O_RDWR);
+    if (fd < 0) {
+        perror(dev);
+        return 1;
+    }
+
+    if (write(fd, &hello, sizeof(hello)) != sizeof(hello)) {
+        perror("hello");
+        return 1;
+    }
+    printf("Connected to %s, waiting for traces\n", dev);
+
+    while (count == 0 || n < count) {
+        const ethosu_trace_chunk_t *chunk = (const ethosu_trace_chunk_t *)msg;
+        const uint8_t *payload            = msg + sizeof(*chunk);
+        ssize_t len;
+
+        /* rpmsg_char returns exactly one message per read */
+        len = read(fd, msg, sizeof(msg));
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            break;
+        }
+
+        if ((size_t)len < sizeof(*chunk) || chunk->magic != ETHOSU_TRACE_MAGIC ||
+            sizeof(*chunk) + chunk->length != (size_t)len) {
+            fprintf(stderr, "dropping malformed message (%zd bytes)\n", len);
+            continue;
+        }
+        if (chunk->seq != seq)
+            fprintf(stderr, "lost %u messages before seq %u\n", chunk->seq - seq, chunk->seq);
+        seq = chunk->seq + 1;
+
+        switch (chunk->type) {
+        case ETHOSU_TRACE_CHUNK_RECORDS:
+            if (section_put(&rec, chunk->offset, payload, chunk->length))
+                goto oom;
+            break;
+        case ETHOSU_TRACE_CHUNK_BLOBS:
+            /* Only arena bytes the target has not sent before */
+            if (section_put(&blob, chunk->offset, payload, chunk->length))
+                goto oom;
+            break;
+        case ETHOSU_TRACE_CHUNK_END:
+            if (chunk->length != sizeof(ethosu_trace_header_t)) {
+                fprintf(stderr, "bad END chunk length %u\n", chunk->length);
+                break;
+            }
+            (void)write_trace(output, n++, (const ethosu_trace_header_t *)payload, &rec, &blob);
+            break;
+        default:
+            fprintf(stderr, "unknown chunk type %u\n", chunk->type);
+            break;
+        }
+    }
+
+    close(fd);
+    free(rec.data);
+    free(blob.data);
+    return 0;
+
+oom:
+    fprintf(stderr, "out of memory\n");
+    close(fd);
+    return 1;
+}
@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 RRNPU. All rights reserved.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Expand the core driver's deferred log.
+
+With -DETHOSU_LOG_DEFERRED=1 the driver's LOG_WARN/LOG_INFO/LOG_DEBUG calls
+store only the address of their format string and the raw arguments
+(core_driver/src/ethosu_dlog.c). ethosu_dlog_dump() prints those records
+between "DLOG BEGIN" / "DLOG END" as "DLOG:<hex>" lines. This tool reads the
+format strings from the ethosu_dlog section of the firmware ELF, and %s
+arguments from its loaded sections, and prints the log as the driver would
+have:
+
+  dlog.py ethosu_apps.elf record_conv2d.txt        UART log
+  dlog.py ethosu_apps.elf dlog.bin                 words from ethosu_dlog_read()
+  dlog.py ethosu_apps.elf -l                       list the format strings
+
+The ELF must be the image that produced the log.
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+SECTION = "ethosu_dlog"
+
+F_TRUNCATED = 0x100
+LEN_MASK = 0xff
+
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+# printf conversion, as walked by dlog_capture() in ethosu_dlog.c
+CONVERSION = re.compile(r"%(?P<flags>[-+ #0]*)(?P<width>\*|\d+)?(?:\.(?P<prec>\*|\d*))?"
+                        r"(?P<len>hh|h|ll|l|j|z|t|L)?(?P<conv>.)", re.S)
+
+
+class DlogError(Exception):
+    pass
+
+
+# --------------------------------------------------------------------------
+# ELF
+# --------------------------------------------------------------------------
+
+
+class Elf:
+    """Little-endian ELF32/ELF64 sections, enough to read strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        d = self.data
+        if d[:4] != b"\x7fELF":
+            raise DlogError("%s is not an ELF file" % path)
+        if d[5] != 1:
+            raise DlogError("%s is not little endian" % path)
+        self.is64 = d[4] == 2
+        if self.is64:
+            shoff, = struct.unpack_from("<Q", d, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", d, 0x3a)
+            fmt = "<IIQQQQ"
+        else:
+            shoff, = struct.unpack_from("<I", d, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", d, 0x2e)
+            fmt = "<IIIIII"
+
+        raw = []
+        for i in range(shnum):
+            raw.append(struct.unpack_from(fmt, d, shoff + i * shentsize))
+        names = raw[shstrndx][4]
+
+        # (name, addr, file offset, size) of every section loaded on the target
+        self.sections = {}
+        self.loaded = []
+        for name, stype, flags, addr, offset, size in raw:
+            end = d.index(b"\0", names + name)
+            sname = d[names + name:end].decode("ascii", errors="replace")
+            self.sections[sname] = (addr, offset, size)
+            if flags & SHF_ALLOC and stype != SHT_NOBITS and size:
+                self.loaded.append((addr, offset, size))
+
+        # argument sizes in bytes, ILP32 or LP64
+        self.long_size = 8 if self.is64 else 4
+        self.ptr_size = self.long_size
+
+    def cstr(self, addr):
+        """NUL-terminated string at a target address, None if not in the image."""
+        for base, offset, size in self.loaded:
+            if base <= addr < base + size:
+                start = offset + addr - base
+                end = self.data.find(b"\0", start, offset + size)
+                if end < 0:
+                    end = offset + size
+                return self.data[start:end].decode("utf-8", errors="replace")
+        return None
+
+    def formats(self):
+        """{address: format} for every string in the ethosu_dlog section."""
+        if SECTION not in self.sections:
+            raise DlogError("no %s section, was the image built with ETHOSU_LOG_DEFERRED=1?" % SECTION)
+        addr, offset, size = self.sections[SECTION]
+        fmts = {}
+        pos = 0
+        while pos < size:
+            end = self.data.find(b"\0", offset + pos, offset + size)
+            if end < 0:
+                end = offset + size
+            if end > offset + pos:
+                fmts[addr + pos] = self.data[offset + pos:end].decode("utf-8", errors="replace")
+            pos = end - offset + 1
+        return fmts
+
+
+# --------------------------------------------------------------------------
+# Log records
+# --------------------------------------------------------------------------
+
+
+def extract(text):
+    """Collect the hex payload of every DLOG BEGIN / DLOG END block, in order."""
+    payload = []
+    dropped = 0
+    inside = False
+    found = False
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith("DLOG BEGIN"):
+            inside = found = True
+            m = re.search(r"dropped=(\d+)", line)
+            if m:
+                dropped = int(m.group(1))
+        elif line.startswith("DLOG END"):
+            inside = False
+        elif inside and line.startswith("DLOG:"):
+            payload.append(line[len("DLOG:"):])
+    if not found:
+        raise DlogError("no DLOG BEGIN/DLOG END block found")
+    return bytes.fromhex("".join(payload)), dropped
+
+
+def load(path):
+    """Words of the log and the drop count, from a UART log or raw words."""
+    with open(path, "rb") as f:
+        raw = f.read()
+    dropped = 0
+    if b"DLOG BEGIN" in raw:
+        raw, dropped = extract(raw.decode("utf-8", errors="replace"))
+    if len(raw) % 4:
+        raise DlogError("log is not a whole number of words")
+    return list(struct.unpack("<%dI" % (len(raw) // 4), raw)), dropped
+
+
+def records(words):
+    """Yield (flags, format address, argument words) per record."""
+    pos = 0
+    while pos < len(words):
+        n = words[pos] & LEN_MASK
+        if n < 2 or pos + n > len(words):
+            raise DlogError("bad record header 0x%08x at word %d" % (words[pos], pos))
+        yield words[pos] & ~LEN_MASK, words[pos + 1], words[pos + 2:pos + n]
+        pos += n
+
+
+# --------------------------------------------------------------------------
+# printf
+# --------------------------------------------------------------------------
+
+
+def arg_bytes(elf, length, conv):
+    """Bytes dlog_capture() stored for one conversion, None if it takes no argument."""
+    if conv in "diouxXc":
+        return {"ll": 8, "j": 8, "l": elf.long_size, "z": elf.ptr_size, "t": elf.ptr_size}.get(length, 4)
+    if conv in "spn":
+        return elf.ptr_size
+    if conv in "fFeEgGaA":
+        return 8
+    return None
+
+
+class Args:
+    def __init__(self, words):
+        self.words = words
+        self.pos = 0
+
+    def take(self, size):
+        n = max(1, size // 4)
+        if self.pos + n > len(self.words):
+            return None
+        v = 0
+        for i in range(n):
+            v |= self.words[self.pos + i] << (32 * i)
+        self.pos += n
+        return v
+
+
+def _signed(v, bits):
+    v &= (1 << bits) - 1
+    return v - (1 << bits) if v >> (bits - 1) else v
+
+
+def expand(elf, fmt, words):
+    """Format fmt like printf with the argument words of one record."""
+    args = Args(words)
+    out = []
+    pos = 0
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group("conv")
+        if conv == "%":
+            out.append("%")
+            continue
+        size = arg_bytes(elf, m.group("len"), conv)
+        if size is None:
+            out.append(fmt[m.start():])
+            pos = len(fmt)
+            break
+
+        width = m.group("width")
+        prec = m.group("prec")
+        if width == "*":
+            w = args.take(4)
+            width = None if w is None else str(_signed(w, 32))
+        if prec == "*":
+            p = args.take(4)
+            prec = None if p is None else str(max(0, _signed(p, 32)))
+        v = args.take(size)
+        if v is None:
+            out.append("?")
+            continue
+
+        spec = "%" + m.group("flags") + (width or "") + ("." + prec if prec is not None else "")
+        bits = 8 * size
+        length = m.group("len")
+        if length == "hh":
+            bits = 8
+        elif length == "h":
+            bits = 16
+        if conv in "di":
+            out.append((spec + "d") % _signed(v, bits))
+        elif conv == "u":
+            out.append((spec + "d") % (v & ((1 << bits) - 1)))
+        elif conv in "oxX":
+            out.append((spec + conv) % (v & ((1 << bits) - 1)))
+        elif conv == "c":
+            out.append((spec + "c") % (v & 0xff))
+        elif conv == "s":
+            s = elf.cstr(v)
+            out.append((spec + "s") % (s if s is not None else "<0x%x>" % v))
+        elif conv == "p":
+            out.append((spec + "s") % ("0x%x" % v))
+        elif conv == "n":
+            pass
+        else:
+            d, = struct.unpack("<d", struct.pack("<Q", v))
+            if conv in "aA":
+                s = d.hex()
+                out.append((spec + "s") % (s.upper() if conv == "A" else s))
+            else:
+                out.append((spec + conv) % d)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def render(elf, words):
+    fmts = elf.formats()
+    lines = []
+    for flags, addr, argw in records(words):
+        fmt = fmts.get(addr)
+        if fmt is None:
+            text = "<unknown format 0x%08x, wrong ELF?>" % addr
+        else:
+            text = expand(elf, fmt, argw).rstrip("\r\n")
+        if flags & F_TRUNCATED:
+            text += " [arguments truncated]"
+        lines.append(text)
+    return lines
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware image that produced the log")
+    parser.add_argument("log", nargs="?", help="UART log or raw words from ethosu_dlog_read()")
+    parser.add_argument("-l", "--list", action="store_true", help="list the format strings in the image")
+    parser.add_argument("-o", "--output", help="write the expanded log here (default: stdout)")
+    args = parser.parse_args(argv)
+
+    try:
+        elf = Elf(args.elf)
+        if args.list:
+            lines = ["0x%08x %s" % (a, f.rstrip("\r\n")) for a, f in sorted(elf.formats().items())]
+        elif args.log:
+            words, dropped = load(args.log)
+            lines = render(elf, words)
+            if dropped:
+                print("dlog: %d records dropped on the target, raise ETHOSU_DLOG_WORDS" % dropped,
+                      file=sys.stderr)
+        else:
+            parser.error("a log is required unless --list is given")
+    except (DlogError, OSError, struct.error) as e:
+        print("dlog: %s" % e, file=sys.stderr)
+        return 1
+
+    text = "\n".join(lines) + ("\n" if lines else "")
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,461 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 RRNPU. All rights reserved.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Decode and cost Ethos-U65 command streams.
+
+The opcodes and the field layout of every command are read from the core
+driver's ethosu65_interface.h (cmd0_opcode/cmd1_opcode and the npu_*_t
+bitfield structs behind its isa::disassemble()), so the decoder follows the
+header instead of keeping a second copy of the ISA.
+
+On top of the decoder, analyze() tracks the NPU_SET_* state and turns every
+NPU_OP_* into an Op with its IFM/IFM2/OFM/weight/scale accesses (region,
+offset, bytes), an estimate of the MACs and of the bytes it moves, and
+whether it is compute or bandwidth bound. missing_snapshots() checks the
+accesses against the memory a trace snapshotted.
+
+  npucmd.py cmd.bin                              raw command stream
+  npucmd.py replay_templates.h -a op_24_data     byte array from a header
+
+rrtrace.py analyze runs the same analysis on every inference of a trace and
+also reports the regions the recorder did not snapshot.
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+DEFAULT_INTERFACE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..",
+                                 "middleware", "ethos-u-core-software", "core_driver", "src",
+                                 "ethosu65_interface.h")
+
+CMD1_CTRL = 1 << 14
+OPCODE_MASK = 0x3FF
+
+# Machine balance of the estimate: MACs per cycle (CONFIG.macs_per_cc is the
+# log2) and bytes the AXI ports move per cycle
+MACS_PER_CC = 256
+BYTES_PER_CC = 16
+
+OP_NAMES = ("NPU_OP_CONV", "NPU_OP_DEPTHWISE", "NPU_OP_POOL", "NPU_OP_ELEMENTWISE",
+            "NPU_OP_DMA_START")
+
+# activation_format
+NHWC = 0
+NHCWB16 = 1
+
+
+class CmdStreamError(Exception):
+    pass
+
+
+# --------------------------------------------------------------------------
+# Decoder
+# --------------------------------------------------------------------------
+
+
+class Command:
+    """One decoded command: word offset, name and its non-reserved fields."""
+
+    def __init__(self, offset, name, fields, words):
+        self.offset = offset
+        self.name = name
+        self.fields = fields
+        self.words = words
+
+    def value(self, field=None):
+        """The named field, or the only field of a single-field command."""
+        if field is None:
+            if len(self.fields) != 1:
+                raise CmdStreamError("%s has %d fields" % (self.name, len(self.fields)))
+            return next(iter(self.fields.values()))
+        return self.fields[field]
+
+    def __str__(self):
+        words = " ".join("%08x" % w for w in self.words)
+        fields = " ".join("%s=%d" % kv for kv in self.fields.items())
+        return "%5d  %-17s %-25s %s" % (self.offset, words, self.name, fields)
+
+
+def _enum(text, name):
+    m = re.search(r"enum class %s : \w+\s*\{(.*?)\};" % name, text, re.S)
+    if not m:
+        raise CmdStreamError("enum %s not found in the interface header" % name)
+    return {int(v, 0): k for k, v in re.findall(r"(\w+)\s*=\s*(\w+)", m.group(1))}
+
+
+def _structs(text):
+    """Bitfields of every npu_*_t command struct, in declaration order."""
+    layouts = {}
+    for m in re.finditer(r"struct (npu_\w+_t)\s*\{\s*#ifdef __cplusplus\s*private:\s*#endif(.*?)"
+                         r"#ifdef __cplusplus", text, re.S):
+        layouts[m.group(1)] = [(f, int(w)) for f, w in
+                               re.findall(r"uint32_t\s+(\w+)\s*:\s*(\d+);", m.group(2))]
+    return layouts
+
+
+class Isa:
+    """Command names and field layouts of ethosu65_interface.h."""
+
+    def __init__(self, path=None):
+        path = path or DEFAULT_INTERFACE
+        try:
+            with open(path) as f:
+                text = f.read()
+        except OSError as e:
+            raise CmdStreamError("cannot read the interface header: %s" % e)
+        self.cmd0 = _enum(text, "cmd0_opcode")
+        self.cmd1 = _enum(text, "cmd1_opcode")
+        self.layouts = _structs(text)
+
+    def decode(self, words):
+        """Decode a command stream (list of 32-bit words) into Commands."""
+        out = []
+        pc = 0
+        while pc < len(words):
+            w = words[pc]
+            cmd1 = bool(w & CMD1_CTRL)
+            table = self.cmd1 if cmd1 else self.cmd0
+            name = table.get(w & OPCODE_MASK, "UNKNOWN_%s_0x%03x" % ("CMD1" if cmd1 else "CMD0",
+                                                                     w & OPCODE_MASK))
+            n = 2 if cmd1 else 1
+            if pc + n > len(words):
+                raise CmdStreamError("%s at word %d runs past the end of the stream" % (name, pc))
+            raw = words[pc] | (words[pc + 1] << 32 if cmd1 else 0)
+            fields = {}
+            shift = 0
+            for field, width in self.layouts.get(name.lower() + "_t", []):
+                if field not in ("opcode", "control") and not field.startswith("reserved"):
+                    fields[field] = (raw >> shift) & ((1 << width) - 1)
+                shift += width
+            if "addr_lo" in fields:
+                fields["addr"] = fields.pop("addr_lo") | fields.pop("addr_hi", 0) << 32
+            out.append(Command(pc, name, fields, words[pc:pc + n]))
+            pc += n
+            if name == "NPU_OP_STOP":
+                break
+        return out
+
+
+# --------------------------------------------------------------------------
+# Analysis
+# --------------------------------------------------------------------------
+
+
+class Access:
+    """Bytes an operation reads or writes behind BASEP[region].
+
+    size is the span from offset the access touches, traffic the bytes it
+    actually moves; they differ for a strided feature map.
+    """
+
+    def __init__(self, role, region, offset, size, write=False, traffic=None):
+        self.role = role
+        self.region = region
+        self.offset = offset
+        self.size = size
+        self.write = write
+        self.traffic = size if traffic is None else traffic
+
+    def __str__(self):
+        s = "%-6s %s r%d+0x%x %d bytes" % (self.role, "wr" if self.write else "rd",
+                                            self.region, self.offset, self.size)
+        if self.traffic != self.size:
+            s += " (%d moved)" % self.traffic
+        return s
+
+
+class Op:
+    """One NPU_OP_* with the state it was issued with."""
+
+    def __init__(self, index, cmd, desc, macs, accesses):
+        self.index = index
+        self.offset = cmd.offset
+        self.name = cmd.name[len("NPU_OP_"):]
+        self.desc = desc
+        self.macs = macs
+        self.accesses = accesses
+
+    @property
+    def bytes_read(self):
+        return sum(a.traffic for a in self.accesses if not a.write)
+
+    @property
+    def bytes_written(self):
+        return sum(a.traffic for a in self.accesses if a.write)
+
+    def cycles(self, macs_per_cc=MACS_PER_CC, bytes_per_cc=BYTES_PER_CC):
+        """(compute, memory) cycle estimates."""
+        return (-(-self.macs // macs_per_cc),
+                -(-(self.bytes_read + self.bytes_written) // bytes_per_cc))
+
+    def bound(self, macs_per_cc=MACS_PER_CC, bytes_per_cc=BYTES_PER_CC):
+        compute, memory = self.cycles(macs_per_cc, bytes_per_cc)
+        return "memory" if memory > compute else "compute"
+
+
+class _State:
+    """NPU_SET_* values seen so far, by command name without NPU_SET_."""
+
+    def __init__(self):
+        self.cmds = {}
+
+    def set(self, cmd):
+        self.cmds[cmd.name[len("NPU_SET_"):]] = cmd
+
+    def get(self, name, field=None, default=0):
+        cmd = self.cmds.get(name)
+        return cmd.value(field) if cmd else default
+
+    def element_size(self, prefix):
+        prec = self.cmds.get(prefix + "_PRECISION")
+        return 1 << prec.fields["activation_precision"] if prec else 1
+
+    def feature_map(self, prefix, w, h, d):
+        """Bytes spanned by a w x h x d IFM/IFM2/OFM at prefix."""
+        prec = self.cmds.get(prefix + "_PRECISION")
+        esize = self.element_size(prefix)
+        fmt = prec.fields["activation_format"] if prec else NHWC
+        sx = self.get(prefix + "_STRIDE_X")
+        sy = self.get(prefix + "_STRIDE_Y")
+        sc = self.get(prefix + "_STRIDE_C")
+        if fmt == NHCWB16:
+            sx = sx or 16 * esize
+            sc = sc or sx * w
+            sy = sy or sc * -(-d // 16)
+            return (h - 1) * sy + (w - 1) * sx + (-(-d // 16) - 1) * sc + 16 * esize
+        sx = sx or d * esize
+        sy = sy or sx * w
+        return (h - 1) * sy + (w - 1) * sx + d * esize
+
+    def access(self, role, prefix, w, h, d, write=False):
+        return Access(role, self.get(prefix + "_REGION"), self.get(prefix + "_BASE0"),
+                      self.feature_map(prefix, w, h, d), write,
+                      w * h * d * self.element_size(prefix))
+
+
+def _ofm_shape(st):
+    return (st.get("OFM_WIDTH_M1") + 1, st.get("OFM_HEIGHT_M1") + 1, st.get("OFM_DEPTH_M1") + 1)
+
+
+def _ifm_shape(st, prefix="IFM"):
+    # Tile 0 only: the common single-tile case
+    depth = st.get("IFM_DEPTH_M1") + 1
+    return (st.get(prefix + "_WIDTH0_M1") + 1, st.get(prefix + "_HEIGHT0_M1") + 1, depth)
+
+
+def _kernel(st):
+    stride = st.cmds.get("KERNEL_STRIDE")
+    sx = sy = 1
+    if stride:
+        sx = (stride.fields["stride_x_msb"] << 1 | stride.fields["stride_x_lsb"]) + 1
+        sy = (stride.fields["stride_y_msb"] << 1 | stride.fields["stride_y_lsb"]) + 1
+    return st.get("KERNEL_WIDTH_M1") + 1, st.get("KERNEL_HEIGHT_M1") + 1, sx, sy
+
+
+def _weights(st):
+    out = []
+    for name, region in (("WEIGHT", "WEIGHT_REGION"), ("WEIGHT1", "WEIGHT_REGION"),
+                         ("SCALE", "SCALE_REGION"), ("SCALE1", "SCALE_REGION")):
+        length = st.get(name + "_LENGTH")
+        if length:
+            out.append(Access("weight" if name.startswith("WEIGHT") else "scale",
+                              st.get(region), st.get(name + "_BASE"), length))
+    return out
+
+
+def _op(index, cmd, st):
+    kind = cmd.name
+    accesses = []
+    ow, oh, od = _ofm_shape(st)
+    ofm = ow * oh * od
+
+    if kind == "NPU_OP_DMA_START":
+        src = st.cmds.get("DMA0_SRC_REGION")
+        dst = st.cmds.get("DMA0_DST_REGION")
+        length = st.get("DMA0_LEN")
+        if src and not src.fields["region_mode"]:
+            accesses.append(Access("dma", src.fields["region"], st.get("DMA0_SRC"), length))
+        if dst and not dst.fields["region_mode"]:
+            accesses.append(Access("dma", dst.fields["region"], st.get("DMA0_DST"), length, True))
+        return Op(index, cmd, "%d bytes" % length, 0, accesses)
+
+    iw, ih, idp = _ifm_shape(st)
+    kw, kh, sx, sy = _kernel(st)
+    accesses.append(st.access("ifm", "IFM", iw, ih, idp))
+
+    if kind == "NPU_OP_CONV":
+        macs = ofm * kw * kh * idp
+    elif kind in ("NPU_OP_DEPTHWISE", "NPU_OP_POOL"):
+        macs = ofm * kw * kh
+    else:
+        macs = ofm
+        bc = st.cmds.get("IFM2_BROADCAST")
+        if not (bc and bc.fields["broadcast_constant"]):
+            w, h, d = _ifm_shape(st, "IFM2")
+            if bc:
+                w = 1 if bc.fields["broadcast_w"] else w
+                h = 1 if bc.fields["broadcast_h"] else h
+                d = 1 if bc.fields["broadcast_c"] else d
+            accesses.append(st.access("ifm2", "IFM2", w, h, d))
+
+    if kind in ("NPU_OP_CONV", "NPU_OP_DEPTHWISE"):
+        accesses.extend(_weights(st))
+    accesses.append(st.access("ofm", "OFM", ow, oh, od, True))
+    desc = "%dx%dx%d -> %dx%dx%d" % (iw, ih, idp, ow, oh, od)
+    if kind in ("NPU_OP_CONV", "NPU_OP_DEPTHWISE", "NPU_OP_POOL"):
+        desc += " k%dx%d s%dx%d" % (kw, kh, sx, sy)
+    return Op(index, cmd, desc, macs, accesses)
+
+
+def analyze(commands):
+    """Turn decoded commands into Ops."""
+    st = _State()
+    ops = []
+    for cmd in commands:
+        if cmd.name.startswith("NPU_SET_"):
+            st.set(cmd)
+        elif cmd.name in OP_NAMES:
+            ops.append(_op(len(ops), cmd, st))
+    return ops
+
+
+def regions(ops):
+    """Per region, the (start, end) offsets the ops touch, merged."""
+    spans = {}
+    for op in ops:
+        for a in op.accesses:
+            spans.setdefault(a.region, []).append((a.offset, a.offset + a.size))
+    return {r: _merge(s) for r, s in spans.items()}
+
+
+def _merge(spans):
+    out = []
+    for s, e in sorted(spans):
+        if out and s <= out[-1][1]:
+            out[-1] = (out[-1][0], max(out[-1][1], e))
+        else:
+            out.append((s, e))
+    return out
+
+
+def missing_snapshots(ops, basep, snapshots):
+    """Reads the snapshots do not cover.
+
+    basep maps a region to its base address, snapshots is a list of
+    (address, size) in the same address space. Returns (op, access, reason)
+    for every read whose bytes were not all snapshotted; writes only need
+    the memory to exist and are not checked.
+    """
+    covered = _merge([(a, a + n) for a, n in snapshots])
+    out = []
+    for op in ops:
+        for a in op.accesses:
+            if a.write or not a.size:
+                continue
+            if a.region not in basep:
+                out.append((op, a, "BASEP[%d] never set" % a.region))
+                continue
+            start = basep[a.region] + a.offset
+            end = start + a.size
+            hole = end - start
+            for s, e in covered:
+                if s < end and e > start:
+                    hole -= min(e, end) - max(s, start)
+            if hole > 0:
+                out.append((op, a, "0x%08x-0x%08x: %d bytes not snapshotted" % (start, end, hole)))
+    return out
+
+
+# --------------------------------------------------------------------------
+# Report
+# --------------------------------------------------------------------------
+
+
+def render(ops, macs_per_cc=MACS_PER_CC, bytes_per_cc=BYTES_PER_CC, verbose=False):
+    out = []
+    w = out.append
+    w("  op  word  %-11s %-30s %10s %9s %9s %7s  %s" % (
+        "kind", "shape", "MACs", "read", "written", "MAC/B", "bound"))
+    total_macs = total_bytes = total_cycles = 0
+    for op in ops:
+        moved = op.bytes_read + op.bytes_written
+        intensity = op.macs / moved if moved else 0.0
+        w("%4d %5d  %-11s %-30s %10d %9d %9d %7.1f  %s" % (
+            op.index, op.offset, op.name, op.desc, op.macs, op.bytes_read, op.bytes_written,
+            intensity, op.bound(macs_per_cc, bytes_per_cc)))
+        if verbose:
+            for a in op.accesses:
+                w("                %s" % a)
+        total_macs += op.macs
+        total_bytes += moved
+        total_cycles += max(op.cycles(macs_per_cc, bytes_per_cc))
+    w("%d ops, %d MACs, %d bytes moved, ~%d cycles at %d MACs and %d bytes per cycle" % (
+        len(ops), total_macs, total_bytes, total_cycles, macs_per_cc, bytes_per_cc))
+    for region, spans in sorted(regions(ops).items()):
+        w("region %d: %s" % (region, ", ".join("+0x%x-0x%x" % s for s in spans)))
+    return "\n".join(out) + "\n"
+
+
+# --------------------------------------------------------------------------
+# Command line
+# --------------------------------------------------------------------------
+
+
+def words_from_bytes(data):
+    data = bytes(data) + b"\0" * (-len(data) % 4)
+    return list(struct.unpack("<%dI" % (len(data) // 4), data))
+
+
+def c_array(text, name):
+    """Bytes of "name[...] = {...}" in a generated replay_templates_*.h."""
+    m = re.search(r"\b%s\s*\[[^]]*\]\s*=\s*\{([^}]*)\}" % re.escape(name), text)
+    if not m:
+        found = re.findall(r"\b(op_\d+_data)\s*\[", text)
+        raise CmdStreamError("no array %s (found: %s)" % (name, ", ".join(found) or "none"))
+    return bytes(int(v, 0) for v in m.group(1).replace(",", " ").split())
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="raw command stream, or a C header with -a")
+    parser.add_argument("-a", "--array", help="byte array in the header holding the stream")
+    parser.add_argument("-i", "--interface", help="ethosu65_interface.h (default: %s)" %
+                        os.path.relpath(DEFAULT_INTERFACE))
+    parser.add_argument("-d", "--disassemble", action="store_true", help="list every command")
+    parser.add_argument("-v", "--verbose", action="store_true", help="list every access")
+    parser.add_argument("--macs-per-cc", type=int, default=MACS_PER_CC,
+                        help="MACs per cycle for the estimate (default %(default)d)")
+    parser.add_argument("--bytes-per-cc", type=int, default=BYTES_PER_CC,
+                        help="bytes per cycle for the estimate (default %(default)d)")
+    args = parser.parse_args(argv)
+
+    try:
+        isa = Isa(args.interface)
+        if args.array:
+            with open(args.input) as f:
+                data = c_array(f.read(), args.array)
+        else:
+            with open(args.input, "rb") as f:
+                data = f.read()
+        cmds = isa.decode(words_from_bytes(data))
+        if args.disassemble:
+            for cmd in cmds:
+                print(cmd)
+        sys.stdout.write(render(analyze(cmds), args.macs_per_cc, args.bytes_per_cc,
+                                args.verbose))
+    except (CmdStreamError, OSError) as e:
+        print("npucmd: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
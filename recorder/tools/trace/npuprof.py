@@ -0,0 +1,321 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 RRNPU. All rights reserved.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Attribute Ethos-U PMU counts to the operations of a command stream.
+
+While an ETHOSU_CORE_INFERENCE_OP job runs, InferenceProcess::runEthosuOp()
+polls the NPU and keeps an EthosuQreadEvent (ethosu_monitor.hpp) every time
+QREAD or STATUS moves: the cycle counter, QREAD, STATUS and the four event
+counters. Those samples come back as the job's output buffer. This tool
+decodes the command stream with npucmd.py and charges the cycles and events
+between two samples to the operation the NPU had reached: the last NPU_OP_*
+that QREAD has passed. The command reader runs slightly ahead of execution,
+so an operation's tail can be charged to the next one; short operations the
+CPU did not see between two polls get nothing.
+
+  npuprof.py samples.bin cmd.bin                  raw command stream
+  npuprof.py samples.bin replay_templates.h -a op_24_data
+  npuprof.py samples.bin --trace record_conv2d.txt [-n 1]
+                                                  stream of a recorded inference
+  ... --csv ops.csv --chrome ops.json             per-op table, Chrome/Perfetto trace
+
+Count ETHOSU_PMU_NPU_ACTIVE and ETHOSU_PMU_MAC_ACTIVE with an AXI event such
+as ETHOSU_PMU_AXI0_RD_DATA_BEAT_RECEIVED, and enable the cycle counter (or
+count ETHOSU_PMU_CYCLE). An operation with a low MAC_ACTIVE share of its
+cycles and busy AXI ports is memory bound.
+"""
+
+import argparse
+import bisect
+import csv
+import json
+import os
+import re
+import struct
+import sys
+
+import npucmd
+import rrtrace
+
+DEFAULT_PMU_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..",
+                                  "middleware", "ethos-u-core-software", "core_driver", "include",
+                                  "pmu_ethosu.h")
+
+NCOUNTERS = 4  # ETHOSU_PMU_NCOUNTERS
+NO_EVENT = 0  # ETHOSU_PMU_NO_EVENT, an unused counter
+NPU_MHZ = 1000  # ML clock root, see ethosu_resume()
+
+# "before" the first operation and "after" the last one
+SETUP = -1
+
+
+class ProfError(Exception):
+    pass
+
+
+# --------------------------------------------------------------------------
+# Samples
+# --------------------------------------------------------------------------
+
+
+def event_names(path=None):
+    """{value: name} of enum ethosu_pmu_event_type in pmu_ethosu.h."""
+    path = path or DEFAULT_PMU_HEADER
+    try:
+        with open(path) as f:
+            text = f.read()
+    except OSError as e:
+        raise ProfError("cannot read the PMU header: %s" % e)
+    m = re.search(r"enum ethosu_pmu_event_type\s*\{(.*?)\};", text, re.S)
+    if not m:
+        raise ProfError("enum ethosu_pmu_event_type not found in %s" % path)
+    body = re.sub(r"//[^\n]*", "", m.group(1))
+    names = {}
+    value = 0
+    for item in body.split(","):
+        item = item.strip()
+        if not item:
+            continue
+        name, _, init = item.partition("=")
+        if init.strip():
+            value = int(init.strip(), 0)
+        names[value] = name.strip()[len("ETHOSU_PMU_"):]
+        value += 1
+    return names
+
+
+class Sample:
+    def __init__(self, cycles, qread, status, pmu):
+        self.cycles = cycles
+        self.qread = qread
+        self.status = status
+        self.pmu = pmu  # [(event, count)] per counter
+
+
+def load_samples(path, ncounters=NCOUNTERS):
+    """EthosuQreadEvent[] as written by the target, little endian."""
+    rec = struct.Struct("<QII" + "II" * ncounters)
+    with open(path, "rb") as f:
+        raw = f.read()
+    if not raw or len(raw) % rec.size:
+        raise ProfError("%s: %d bytes is not a whole number of %d-byte samples" %
+                        (path, len(raw), rec.size))
+    out = []
+    for fields in rec.iter_unpack(raw):
+        pmu = list(zip(fields[3::2], fields[4::2]))
+        out.append(Sample(fields[0], fields[1], fields[2], pmu))
+    return out
+
+
+def _counters(samples):
+    """(counter, event) of the counters in use, from the first sample."""
+    return [(k, ev) for k, (ev, _) in enumerate(samples[0].pmu) if ev != NO_EVENT]
+
+
+def _cycles(samples, counters, cycle_event):
+    """Cycle stamp of every sample: the cycle counter, else a counter of cycle_event."""
+    if any(s.cycles for s in samples):
+        return [s.cycles - samples[0].cycles for s in samples]
+    for k, ev in counters:
+        if ev != cycle_event:
+            continue
+        t = [0]
+        for a, b in zip(samples, samples[1:]):
+            t.append(t[-1] + ((b.pmu[k][1] - a.pmu[k][1]) & 0xFFFFFFFF))
+        return t
+    raise ProfError("no cycle count in the samples: enable the PMU cycle counter or count "
+                    "ETHOSU_PMU_CYCLE")
+
+
+# --------------------------------------------------------------------------
+# Attribution
+# --------------------------------------------------------------------------
+
+
+class OpProfile:
+    def __init__(self, op, ncounters):
+        self.op = op  # npucmd.Op, None for SETUP
+        self.cycles = 0
+        self.counts = [0] * ncounters
+        self.samples = 0
+
+
+def profile(ops, samples, cycle_event):
+    """Per-op profiles and the timeline as (op index, start, end) cycle ranges."""
+    if len(samples) < 2:
+        raise ProfError("need at least two samples, got %d" % len(samples))
+    counters = _counters(samples)
+    stamps = _cycles(samples, counters, cycle_event)
+    starts = [4 * op.offset for op in ops]  # QREAD is a byte offset into the stream
+
+    profs = {SETUP: OpProfile(None, len(counters))}
+    for op in ops:
+        profs[op.index] = OpProfile(op, len(counters))
+
+    timeline = []
+    for i in range(1, len(samples)):
+        a, b = samples[i - 1], samples[i]
+        # the last operation the reader has passed at the start of the interval
+        n = bisect.bisect_left(starts, a.qread) - 1
+        idx = ops[n].index if n >= 0 else SETUP
+        p = profs[idx]
+        p.cycles += stamps[i] - stamps[i - 1]
+        p.samples += 1
+        for j, (k, _) in enumerate(counters):
+            p.counts[j] += (b.pmu[k][1] - a.pmu[k][1]) & 0xFFFFFFFF
+        if timeline and timeline[-1][0] == idx:
+            timeline[-1][2] = stamps[i]
+        else:
+            timeline.append([idx, stamps[i - 1], stamps[i]])
+    return profs, counters, stamps, timeline
+
+
+# --------------------------------------------------------------------------
+# Output
+# --------------------------------------------------------------------------
+
+
+def _label(p):
+    return "setup" if p.op is None else "%d %s" % (p.op.index, p.op.name)
+
+
+def render(profs, counters, names, total, macs_per_cc):
+    out = []
+    w = out.append
+    cols = [names.get(ev, "EVENT_%d" % ev) for _, ev in counters]
+    w("  op  word  %-11s %-30s %10s %6s %s %8s  %s" % (
+        "kind", "shape", "cycles", "share", " ".join("%14s" % c[:14] for c in cols),
+        "MAC/cc", "estimate"))
+    for idx in sorted(profs):
+        p = profs[idx]
+        if p.op is None and not p.cycles:
+            continue
+        share = 100.0 * p.cycles / total if total else 0.0
+        counts = " ".join("%14d" % c for c in p.counts)
+        if p.op is None:
+            w("   -     -  %-11s %-30s %10d %5.1f%% %s" % ("setup", "", p.cycles, share, counts))
+            continue
+        achieved = "%8.1f" % (p.op.macs / p.cycles) if p.cycles else "%8s" % "-"
+        w("%4d %5d  %-11s %-30s %10d %5.1f%% %s %s  %s" % (
+            p.op.index, p.op.offset, p.op.name, p.op.desc, p.cycles, share, counts, achieved,
+            p.op.bound(macs_per_cc)))
+    w("%d cycles over %d operations" % (total, len(profs) - 1))
+    if "MAC_ACTIVE" in cols and "NPU_ACTIVE" in cols:
+        mac, act = cols.index("MAC_ACTIVE"), cols.index("NPU_ACTIVE")
+        for idx in sorted(profs):
+            p = profs[idx]
+            if p.op is not None and p.counts[act] and p.counts[mac] < p.counts[act] // 4:
+                w("op %d %s: MACs active %d of %d NPU cycles, likely memory bound" % (
+                    p.op.index, p.op.name, p.counts[mac], p.counts[act]))
+    return "\n".join(out) + "\n"
+
+
+def write_csv(path, profs, counters, names):
+    cols = [names.get(ev, "EVENT_%d" % ev) for _, ev in counters]
+    with open(path, "w", newline="") as f:
+        wr = csv.writer(f)
+        wr.writerow(["op", "word", "kind", "shape", "cycles"] + cols +
+                    ["macs", "bytes_read", "bytes_written", "estimate"])
+        for idx in sorted(profs):
+            p = profs[idx]
+            if p.op is None:
+                wr.writerow(["setup", "", "", "", p.cycles] + p.counts + ["", "", "", ""])
+            else:
+                wr.writerow([p.op.index, p.op.offset, p.op.name, p.op.desc, p.cycles] + p.counts +
+                            [p.op.macs, p.op.bytes_read, p.op.bytes_written, p.op.bound()])
+
+
+def write_chrome(path, profs, counters, names, samples, stamps, timeline, npu_mhz):
+    """Chrome trace event JSON, which Perfetto and chrome://tracing open."""
+    us = lambda cycles: cycles / float(npu_mhz)
+    events = [{"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "Ethos-U"}},
+              {"name": "thread_name", "ph": "M", "pid": 0, "tid": 0, "args": {"name": "ops"}}]
+    for idx, start, end in timeline:
+        p = profs[idx]
+        args = {"cycles": end - start}
+        if p.op is not None:
+            args.update(word=p.op.offset, shape=p.op.desc, macs=p.op.macs,
+                        bytes_read=p.op.bytes_read, bytes_written=p.op.bytes_written)
+        events.append({"name": _label(p), "cat": "npu", "ph": "X", "pid": 0, "tid": 0,
+                       "ts": us(start), "dur": us(end - start), "args": args})
+    cols = [names.get(ev, "EVENT_%d" % ev) for _, ev in counters]
+    # counters as events per cycle over each sample interval
+    for i in range(1, len(samples)):
+        dt = stamps[i] - stamps[i - 1]
+        if not dt:
+            continue
+        a, b = samples[i - 1], samples[i]
+        for (k, _), col in zip(counters, cols):
+            events.append({"name": col, "ph": "C", "pid": 0, "ts": us(stamps[i - 1]),
+                           "args": {"per_cycle": ((b.pmu[k][1] - a.pmu[k][1]) & 0xFFFFFFFF) / dt}})
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, f)
+
+
+# --------------------------------------------------------------------------
+# Command line
+# --------------------------------------------------------------------------
+
+
+def _stream(args):
+    if args.trace:
+        trace = rrtrace.load(args.trace)
+        infs = rrtrace.inferences(trace)
+        if not 0 <= args.inference < len(infs):
+            raise ProfError("trace has %d inferences" % len(infs))
+        words, _, _ = rrtrace.command_stream(trace, infs[args.inference])
+        return words
+    if not args.stream:
+        raise ProfError("give a command stream or --trace")
+    if args.array:
+        with open(args.stream) as f:
+            return npucmd.words_from_bytes(npucmd.c_array(f.read(), args.array))
+    with open(args.stream, "rb") as f:
+        return npucmd.words_from_bytes(f.read())
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("samples", help="EthosuQreadEvent[] from the job's output buffer")
+    parser.add_argument("stream", nargs="?", help="raw command stream, or a C header with -a")
+    parser.add_argument("-a", "--array", help="byte array in the header holding the stream")
+    parser.add_argument("--trace", help="take the stream from a recorder trace instead")
+    parser.add_argument("-n", "--inference", type=int, default=0,
+                        help="inference of the trace (default %(default)d)")
+    parser.add_argument("-i", "--interface", help="ethosu65_interface.h with the command definitions")
+    parser.add_argument("--pmu-header", help="pmu_ethosu.h with the event names")
+    parser.add_argument("--csv", help="write the per-op table as CSV")
+    parser.add_argument("--chrome", help="write a Chrome/Perfetto trace (JSON)")
+    parser.add_argument("--npu-mhz", type=float, default=NPU_MHZ,
+                        help="NPU clock for the trace timestamps (default %(default)d)")
+    parser.add_argument("--macs-per-cc", type=int, default=npucmd.MACS_PER_CC,
+                        help="MACs per cycle for the estimate (default %(default)d)")
+    args = parser.parse_args(argv)
+
+    try:
+        names = event_names(args.pmu_header)
+        cycle_event = next(v for v, n in names.items() if n == "CYCLE")
+        samples = load_samples(args.samples)
+        ops = npucmd.analyze(npucmd.Isa(args.interface).decode(_stream(args)))
+        if not ops:
+            raise ProfError("the command stream has no NPU operations")
+        profs, counters, stamps, timeline = profile(ops, samples, cycle_event)
+        sys.stdout.write(render(profs, counters, names, stamps[-1], args.macs_per_cc))
+        if args.csv:
+            write_csv(args.csv, profs, counters, names)
+        if args.chrome:
+            write_chrome(args.chrome, profs, counters, names, samples, stamps, timeline,
+                         args.npu_mhz)
+    except (ProfError, npucmd.CmdStreamError, rrtrace.TraceError, OSError) as e:
+        print("npuprof: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,1118 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2025 RRNPU. All rights reserved.
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+
+"""Decode the recorder's compact binary register trace.
+
+The recorder (core_driver/src/ethosu_trace.c) prints the trace between
+"TRACE BEGIN" / "TRACE END" as "TRACE:<hex>" lines.  This tool accepts either
+such a UART log or the raw binary trace and can
+
+  * list the decoded records               rrtrace.py dump record_conv2d.txt
+  * list the inferences and their phases   rrtrace.py phases record_conv2d.txt
+  * prune accesses the replay does not need rrtrace.py optimize record_conv2d.txt \\
+                                               -o replay_templates_conv2d.h
+  * regenerate a replay_templates_*.h file rrtrace.py templates record_conv2d.txt \\
+                                               -o replay_templates_conv2d.h
+  * compile a replay_vm program            rrtrace.py program record_conv2d.txt \\
+                                               -o conv2d.rpvm -c replay_program.h
+    (--base moves the model's memory segment, e.g. to pack several models
+    into OCRAM; the PTA can also relocate the program when it loads it)
+  * decode and cost the command streams    rrtrace.py analyze record_conv2d.txt
+    and flag reads the snapshots miss      (see npucmd.py)
+"""
+
+import bisect
+
+import argparse
+import struct
+import sys
+
+import npucmd
+
+TRACE_MAGIC = 0x52544E52
+TRACE_VERSIONS = (1, 2)  # 2: SNAP records carry a blob offset
+HEADER = struct.Struct("<IHHIIII")
+
+TAG_READ = 0x0
+TAG_WRITE = 0x1
+TAG_SNAP = 0x2
+TAG_MARK = 0x3
+TAG_MASK = 0x3
+F_ZERO = 0x4
+
+MARK_ORDER = 0
+MARK_PHASE = 1
+
+PHASE_INIT = 0
+PHASE_RUN = 1
+PHASE_IRQ = 2
+PHASE_IDLE = 3
+PHASE_NAMES = {PHASE_INIT: "INIT", PHASE_RUN: "RUN", PHASE_IRQ: "IRQ", PHASE_IDLE: "IDLE"}
+
+HDR_TRUNCATED = 0x1
+
+# Ethos-U register offsets used to find the replay phases
+REG_ID = 0x000
+REG_STATUS = 0x004
+REG_CMD = 0x008
+REG_RESET = 0x00C
+REG_QBASE = 0x010
+REG_QBASE_HI = 0x014
+REG_QREAD = 0x018
+REG_QSIZE = 0x020
+REG_PROT = 0x024
+REG_CONFIG = 0x028
+REG_BASEP = 0x080  # BASEP[n] at 0x080 + 8 * n, high word at + 4
+BASEP_COUNT = 8
+REG_WINDOW = 0x1000
+
+
+class TraceError(Exception):
+    pass
+
+
+class Record:
+    """One decoded trace record (READ, WRITE or SNAP)."""
+
+    def __init__(self, order, kind, address, value=0, data=None, blob=None):
+        self.order = order
+        self.kind = kind
+        self.address = address
+        self.value = value
+        self.data = data
+        self.blob = blob  # (offset, size) in the blob section
+
+    @property
+    def is_write(self):
+        return self.kind == TAG_WRITE
+
+    @property
+    def is_snapshot(self):
+        return self.kind == TAG_SNAP
+
+    def offset(self, reg_base):
+        return self.address - reg_base
+
+    def __str__(self):
+        if self.is_snapshot:
+            return "%4d SNAP  0x%08x %d bytes" % (self.order, self.address, len(self.data))
+        op = "WRITE" if self.is_write else "READ "
+        return "%4d %s 0x%08x 0x%08x" % (self.order, op, self.address, self.value)
+
+
+class Trace:
+    def __init__(self, reg_base, flags, records, markers=None):
+        self.reg_base = reg_base
+        self.flags = flags
+        self.records = records
+        self.markers = markers or []  # (order of the next record, kind, arg)
+
+    @property
+    def truncated(self):
+        return bool(self.flags & HDR_TRUNCATED)
+
+
+def _varint(buf, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(buf):
+            raise TraceError("varint runs past end of record section")
+        b = buf[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def _unzigzag(v):
+    return (v >> 1) ^ -(v & 1)
+
+
+def decode(raw):
+    """Decode a raw binary trace (header + records + blobs)."""
+    if len(raw) < HEADER.size:
+        raise TraceError("trace shorter than its header")
+    magic, version, flags, reg_base, count, rec_bytes, blob_bytes = HEADER.unpack_from(raw)
+    if magic != TRACE_MAGIC:
+        raise TraceError("bad trace magic 0x%08x" % magic)
+    if version not in TRACE_VERSIONS:
+        raise TraceError("unsupported trace version %d" % version)
+
+    rec = raw[HEADER.size:HEADER.size + rec_bytes]
+    blobs = raw[HEADER.size + rec_bytes:HEADER.size + rec_bytes + blob_bytes]
+    if len(rec) != rec_bytes or len(blobs) != blob_bytes:
+        raise TraceError("trace is shorter than its header claims")
+
+    records = []
+    markers = []
+    pending = []  # marks waiting for the order of the record they precede
+    pos = 0
+    order = 1
+    word = 0
+    blob_pos = 0
+    while pos < len(rec):
+        tag = rec[pos]
+        pos += 1
+        kind = tag & TAG_MASK
+        if kind == TAG_MARK:
+            mark, pos = _varint(rec, pos)
+            arg, pos = _varint(rec, pos)
+            if mark == MARK_ORDER:
+                order = arg
+            else:
+                pending.append((mark, arg))
+            continue
+        markers.extend((order, mark, arg) for mark, arg in pending)
+        pending = []
+        if kind == TAG_SNAP:
+            addr, pos = _varint(rec, pos)
+            size, pos = _varint(rec, pos)
+            if version >= 2:
+                offset, pos = _varint(rec, pos)
+            else:
+                offset = blob_pos
+                blob_pos += size
+            data = bytes(blobs[offset:offset + size])
+            if len(data) != size:
+                raise TraceError("snapshot %d runs past end of blob section" % order)
+            records.append(Record(order, kind, addr, data=data, blob=(offset, size)))
+        else:
+            delta, pos = _varint(rec, pos)
+            word += _unzigzag(delta)
+            value = 0
+            if not tag & F_ZERO:
+                value, pos = _varint(rec, pos)
+            addr = (reg_base + word * 4) & 0xFFFFFFFF
+            records.append(Record(order, kind, addr, value))
+        order += 1
+
+    markers.extend((order, mark, arg) for mark, arg in pending)
+
+    if len(records) != count:
+        raise TraceError("decoded %d records, header says %d" % (len(records), count))
+    return Trace(reg_base, flags, records, markers)
+
+
+def extract(text):
+    """Collect the hex payload between TRACE BEGIN / TRACE END in a UART log."""
+    payload = []
+    inside = False
+    for line in text.splitlines():
+        line = line.strip()
+        if line.startswith("TRACE BEGIN"):
+            payload = []
+            inside = True
+        elif line.startswith("TRACE END"):
+            inside = False
+        elif inside and line.startswith("TRACE:"):
+            payload.append(line[len("TRACE:"):])
+    if not payload:
+        raise TraceError("no TRACE BEGIN/TRACE END block found")
+    return bytes.fromhex("".join(payload))
+
+
+def load(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if len(raw) >= 4 and struct.unpack_from("<I", raw)[0] == TRACE_MAGIC:
+        return decode(raw)
+    return decode(extract(raw.decode("utf-8", errors="replace")))
+
+
+# --------------------------------------------------------------------------
+# replay_templates_*.h generation
+# --------------------------------------------------------------------------
+
+
+class Inference:
+    """Record orders (1 based op_order) of one inference's replay phases.
+
+    setup and run are inclusive ranges, irq_end is exclusive like the
+    INTERRUPT_HANDLING_END loop in the replayer. setup is the init phase for
+    the first inference (cold) and the job setup after the previous IRQ for
+    the following ones (warm).
+    """
+
+    def __init__(self, setup_start, run_start, irq_start, irq_end, wait, cold):
+        self.setup_start = setup_start
+        self.setup_end = run_start - 1
+        self.run_start = run_start
+        self.run_end = irq_start - 1
+        self.irq_start = irq_start
+        self.irq_end = irq_end
+        self.wait = wait
+        self.cold = cold
+
+
+def _reset_wait(recs, base, start, end):
+    """The STATUS read that polls for the last soft reset in [start, end)."""
+    resets = [r.order for r in recs
+              if start <= r.order < end and r.is_write and r.offset(base) == REG_RESET]
+    if not resets:
+        return None
+    return next((r.order for r in recs
+                 if resets[-1] < r.order < end and not r.is_write and
+                 r.offset(base) == REG_STATUS), None)
+
+
+def _irq_end(recs, base, start, end):
+    # QREAD and the result snapshot after it are not replayed
+    return next((r.order for r in recs
+                 if start <= r.order < end and
+                 (r.is_snapshot or (not r.is_write and r.offset(base) == REG_QREAD))), end)
+
+
+def _marked_inferences(trace, phases):
+    recs = trace.records
+    base = trace.reg_base
+    last = recs[-1].order + 1
+    result = []
+    setup_start = recs[0].order
+    cold = False
+
+    for i, (order, phase) in enumerate(phases):
+        if phase == PHASE_INIT:
+            cold = True
+        if phase != PHASE_RUN:
+            continue
+        later = phases[i + 1:]
+        irq = next((o for o, p in later if p == PHASE_IRQ), None)
+        if irq is None:
+            break  # trace ends inside this inference
+        idle = next((o for o, p in later if o >= irq and p == PHASE_IDLE), last)
+        result.append(Inference(setup_start, order, irq, _irq_end(recs, base, irq, idle),
+                                _reset_wait(recs, base, setup_start, order), cold))
+        setup_start = idle
+        cold = False
+
+    if not result:
+        raise TraceError("no complete RUN/IRQ phase pair in the trace")
+    return result
+
+
+def _heuristic_inference(trace):
+    """Phases of a trace recorded before the driver emitted phase marks."""
+    recs = trace.records
+    base = trace.reg_base
+
+    # FULL traces snapshot the command stream first; VALUES traces keep
+    # the snapshot site as a plain READ outside the register window.
+    run_start = next((r.order for r in recs
+                      if r.is_snapshot or not 0 <= r.offset(base) < REG_WINDOW), None)
+    if run_start is None:
+        raise TraceError("no command stream snapshot, cannot find the run phase")
+
+    run_end = next((r.order for r in recs
+                    if r.order > run_start and r.is_write and
+                    r.offset(base) == REG_CMD and r.value & 0x1), None)
+    if run_end is None:
+        raise TraceError("no CMD.transition_to_running_state write found")
+
+    irq_end = _irq_end(recs, base, run_end + 1, recs[-1].order + 1)
+    if irq_end > recs[-1].order:
+        raise TraceError("no QREAD read or result snapshot after the run phase")
+
+    return Inference(recs[0].order, run_start, run_end + 1, irq_end,
+                     _reset_wait(recs, base, recs[0].order, run_start), True)
+
+
+def inferences(trace):
+    """Split a trace into inferences, by phase marks when it has them."""
+    if not trace.records:
+        raise TraceError("trace has no records")
+    phases = [(order, arg) for order, kind, arg in trace.markers if kind == MARK_PHASE]
+    if phases:
+        return _marked_inferences(trace, phases)
+    return [_heuristic_inference(trace)]
+
+
+def _c_bytes(data, per_line=16):
+    rows = []
+    for i in range(0, len(data), per_line):
+        rows.append("    " + ", ".join("0x%02x" % b for b in data[i:i + per_line]))
+    return ",\n".join(rows)
+
+
+def render_templates(trace):
+    infs = inferences(trace)
+    orders = [r.order for r in trace.records]
+
+    def index(order):
+        """register_access_records[] index of the first record at or after order."""
+        return bisect.bisect_left(orders, order)
+
+    ph = infs[0]
+    out = []
+    w = out.append
+
+    w("#ifndef REPLAY_TEMPLATES_H")
+    w("#define REPLAY_TEMPLATES_H")
+    w("#include <stdint.h>")
+    w("#include <stdbool.h>")
+    w("#define MAX_REG_OP_RECORDS 1024")
+    w("typedef enum {")
+    w("    REG_OP_READ,")
+    w("    REG_OP_WRITE")
+    w("} reg_op_type_t;")
+    w("typedef struct {")
+    w("    reg_op_type_t op_type;")
+    w("    volatile void *reg_address;")
+    w("    uint32_t reg_value;")
+    w("    uint32_t op_order;")
+    w("} reg_op_record_t;")
+    w("#define INIT_VERIFICATION_START %d-1" % (index(ph.setup_start) + 1))
+    w("#define INIT_VERIFICATION_END %d-1" % index(ph.run_start))
+    w("#define RUN_STREAM_COMMAND_START %d-1" % (index(ph.run_start) + 1))
+    w("#define RUN_STREAM_COMMAND_END %d-1" % index(ph.irq_start))
+    w("#define INTERRUPT_HANDLING_START %d-1" % (index(ph.irq_start) + 1))
+    w("#define INTERRUPT_HANDLING_END  %d-1" % (index(ph.irq_end) + 1))
+    if ph.wait is not None:
+        w("#define WAIT %d-1" % (index(ph.wait) + 1))
+    w("//record register access")
+    w("static reg_op_record_t register_access_records[] = {")
+    notes = {}
+    for n, inf in enumerate(infs):
+        if inf.cold:
+            notes.setdefault(inf.setup_start, "//init & verification")
+        elif inf.setup_start <= inf.setup_end:
+            notes.setdefault(inf.setup_start, "// inference %d setup" % n)
+        notes.setdefault(inf.run_start, "//run command stream" if n == 0 else
+                         "//run command stream, inference %d" % n)
+        notes.setdefault(inf.run_end, "// last operation of run command stream")
+        notes.setdefault(inf.irq_start, "// interrupt handling")
+    for r in trace.records:
+        op = "REG_OP_WRITE" if r.is_write else "REG_OP_READ"
+        line = "    {%s, (volatile void *)0x%08x, 0x%08x, %d}," % (op, r.address, r.value, r.order)
+        w(line + notes.get(r.order, ""))
+    w("};")
+    w("//record data")
+    first = {}
+    snaps = []
+    for i, r in enumerate(trace.records):
+        if not r.is_snapshot:
+            continue
+        snaps.append((i, r))
+        if r.blob in first:
+            # same content as an earlier snapshot, share its array
+            w("#define op_%d_data op_%d_data" % (r.order, first[r.blob]))
+            continue
+        first[r.blob] = r.order
+        w("unsigned char op_%d_data[%d] = {" % (r.order, len(r.data)))
+        w(_c_bytes(r.data))
+        w("};")
+    # Phase table: register_access_records[] indices, same range rules as
+    # the defines above, one row per recorded inference
+    w("#define REPLAY_INFERENCE_COUNT %d" % len(infs))
+    w("#define REPLAY_NO_WAIT UINT32_MAX")
+    w("typedef struct {")
+    w("    uint32_t setup_start; // init (cold) or job setup (warm), inclusive")
+    w("    uint32_t setup_end;")
+    w("    uint32_t run_start;   // inclusive")
+    w("    uint32_t run_end;")
+    w("    uint32_t irq_start;   // irq_end is exclusive")
+    w("    uint32_t irq_end;")
+    w("    uint32_t wait;        // reset poll in setup, or REPLAY_NO_WAIT")
+    w("    bool cold;            // setup contains ethosu_init")
+    w("} replay_phase_t;")
+    w("static const replay_phase_t replay_phases[REPLAY_INFERENCE_COUNT] = {")
+    for inf in infs:
+        wait = "%d" % index(inf.wait) if inf.wait is not None else "REPLAY_NO_WAIT"
+        w("    {%d, %d, %d, %d, %d, %d, %s, %s}," % (
+            index(inf.setup_start), index(inf.run_start) - 1, index(inf.run_start),
+            index(inf.irq_start) - 1, index(inf.irq_start), index(inf.irq_end), wait,
+            "true" if inf.cold else "false"))
+    w("};")
+    # Memory the NPU reads, restored before the record at index is replayed
+    w("typedef struct {")
+    w("    uint32_t index;")
+    w("    volatile void *dst;")
+    w("    const unsigned char *data;")
+    w("    uint32_t size;")
+    w("} replay_snapshot_t;")
+    w("#define REPLAY_SNAPSHOT_COUNT %d" % len(snaps))
+    if snaps:
+        w("static const replay_snapshot_t replay_snapshots[REPLAY_SNAPSHOT_COUNT] = {")
+        for i, r in snaps:
+            w("    {%d, (volatile void *)0x%08x, op_%d_data, sizeof(op_%d_data)}," % (
+                i, r.address, r.order, r.order))
+        w("};")
+    for ret, fn in (("void", "replay_inference"), ("int", "replay_handle_interrupt"),
+                    ("void", "replay_initialization_verification")):
+        w("#ifdef __cplusplus")
+        w('extern "C" {')
+        w("#endif")
+        w("%s %s(void);" % (ret, fn))
+        w("#ifdef __cplusplus")
+        w("}")
+        w("#endif")
+    w("#ifdef __cplusplus")
+    w('extern "C" {')
+    w("#endif")
+    w("int replay_warm_inference(uint32_t n);")
+    w("#ifdef __cplusplus")
+    w("}")
+    w("#endif")
+    w("#endif  // REPLAY_TEMPLATES_H")
+    return "\n".join(out) + "\n"
+
+
+# --------------------------------------------------------------------------
+# Trace optimizer
+# --------------------------------------------------------------------------
+
+READ_POLL = "poll"      # waits for the NPU, must be replayed as a poll
+READ_VERIFY = "verify"  # checks a fixed device property, replayed once
+READ_DROP = "drop"      # value is never used by the replay
+
+# Read-only identification registers, the same value on every read
+VERIFY_REGS = (REG_ID, REG_PROT, REG_CONFIG)
+
+
+def _is_reg(r, base):
+    return not r.is_snapshot and 0 <= r.offset(base) < REG_WINDOW
+
+
+def _is_kick(r, base):
+    # CMD.transition_to_running_state: the NPU consumes the queue/region setup
+    return r.is_write and r.offset(base) == REG_CMD and r.value & 0x1
+
+
+class Optimized:
+    """Result of optimize(): the records to replay and why the rest went."""
+
+    def __init__(self, trace, infs, records, dropped, reads):
+        self.trace = trace
+        self.inferences = infs
+        self.records = records
+        self.dropped = dropped  # order -> reason
+        self.reads = reads      # order -> READ_* of every register read
+
+    def as_trace(self):
+        return Trace(self.trace.reg_base, self.trace.flags, self.records, self.trace.markers)
+
+
+def _dead_writes(recs, base):
+    """Writes whose value the NPU never sees.
+
+    Walking backwards, a register write is dead if the same register is
+    written again, or the NPU is soft reset, before the next kick. A RESET is
+    dead if another one follows before the next kick. CMD writes always stay,
+    they act on the NPU immediately.
+    """
+    dead = {}
+    overwritten = set()
+    reset_later = False
+    for r in reversed(recs):
+        if not _is_reg(r, base) or not r.is_write:
+            continue
+        off = r.offset(base)
+        if off == REG_CMD:
+            if _is_kick(r, base):
+                overwritten.clear()
+                reset_later = False
+        elif off == REG_RESET:
+            if reset_later:
+                dead[r.order] = "RESET repeated before the NPU is started"
+            reset_later = True
+        elif reset_later:
+            dead[r.order] = "cleared by a later RESET"
+        elif off in overwritten:
+            dead[r.order] = "overwritten before the NPU is started"
+        else:
+            overwritten.add(off)
+    return dead
+
+
+def _duplicate_writes(recs, base, dropped):
+    """Writes of the value a register already holds since the last RESET.
+
+    QBASE and QSIZE are kept: writing them also clears STATUS.cmd_end_reached.
+    """
+    dup = {}
+    value = {}
+    for r in recs:
+        if r.order in dropped or not _is_reg(r, base) or not r.is_write:
+            continue
+        off = r.offset(base)
+        if off == REG_RESET:
+            value.clear()
+        elif off not in (REG_CMD, REG_QBASE, REG_QBASE_HI, REG_QSIZE):
+            if value.get(off) == r.value:
+                dup[r.order] = "register already holds 0x%08x" % r.value
+            value[off] = r.value
+    return dup
+
+
+def _classify_reads(recs, base, infs, dropped):
+    irq_first = set()
+    for inf in infs:
+        first = next((r.order for r in recs
+                      if inf.irq_start <= r.order < inf.irq_end and r.order not in dropped and
+                      _is_reg(r, base) and not r.is_write), None)
+        if first is not None:
+            irq_first.add(first)
+
+    reads = {}
+    after_reset = False
+    for r in recs:
+        if r.order in dropped or not _is_reg(r, base):
+            continue
+        off = r.offset(base)
+        if r.is_write:
+            after_reset = off == REG_RESET
+            continue
+        if (off == REG_STATUS and after_reset) or r.order in irq_first:
+            reads[r.order] = READ_POLL
+        elif off in VERIFY_REGS:
+            reads[r.order] = READ_VERIFY
+        else:
+            reads[r.order] = READ_DROP
+        after_reset = False
+    return reads
+
+
+def optimize(trace):
+    """Drop dead and duplicate writes and every read the replay does not need."""
+    recs = trace.records
+    base = trace.reg_base
+    infs = inferences(trace)
+
+    dropped = _dead_writes(recs, base)
+    dropped.update(_duplicate_writes(recs, base, dropped))
+    reads = _classify_reads(recs, base, infs, dropped)
+
+    verified = set()
+    for r in recs:
+        cls = reads.get(r.order)
+        if cls == READ_DROP:
+            dropped[r.order] = "value not used by the replay"
+        elif cls == READ_VERIFY:
+            key = (r.offset(base), r.value)
+            if key in verified:
+                dropped[r.order] = "already verified"
+            verified.add(key)
+
+    kept = [r for r in recs if r.order not in dropped]
+    return Optimized(trace, infs, kept, dropped, reads)
+
+
+def _phase_ranges(inf):
+    return (("setup", inf.setup_start, inf.setup_end + 1),
+            ("run", inf.run_start, inf.run_end + 1),
+            ("irq", inf.irq_start, inf.irq_end))
+
+
+def _path_cost(recs, base, start, end, reads):
+    """(reads, polls, writes, snapshot bytes) replayed in [start, end)."""
+    nr = np = nw = nb = 0
+    for r in recs:
+        if not start <= r.order < end:
+            continue
+        if r.is_snapshot:
+            nb += len(r.data)
+        elif r.is_write:
+            nw += 1
+        elif reads.get(r.order) == READ_POLL:
+            np += 1
+        else:
+            nr += 1
+    return nr, np, nw, nb
+
+
+def render_report(opt, read_ns=None, write_ns=None):
+    base = opt.trace.reg_base
+    out = []
+    w = out.append
+    w("%-22s %15s %15s %15s" % ("", "reads", "polls", "writes"))
+    total = [[0, 0, 0], [0, 0, 0]]
+    for n, inf in enumerate(opt.inferences):
+        for name, start, end in _phase_ranges(inf):
+            before = _path_cost(opt.trace.records, base, start, end, opt.reads)
+            after = _path_cost(opt.records, base, start, end, opt.reads)
+            for i in range(3):
+                total[0][i] += before[i]
+                total[1][i] += after[i]
+            w("%-22s %15s %15s %15s" % (
+                "inference %d %s" % (n, name),
+                *("%d -> %d" % (before[i], after[i]) for i in range(3))))
+    w("%-22s %15s %15s %15s" % ("total", *("%d -> %d" % (total[0][i], total[1][i]) for i in range(3))))
+    w("MMIO accesses on the replay path: %d -> %d" % (sum(total[0]), sum(total[1])))
+    if read_ns is not None and write_ns is not None:
+        # polls are counted as a single read, their wait is the NPU's own time
+        est = [(t[0] + t[1]) * read_ns + t[2] * write_ns for t in total]
+        w("estimated register time: %.1f us -> %.1f us" % (est[0] / 1000.0, est[1] / 1000.0))
+    return "\n".join(out) + "\n"
+
+
+# --------------------------------------------------------------------------
+# Replay programs (replayer/middleware/replay_vm)
+# --------------------------------------------------------------------------
+
+VM_MAGIC = 0x4D565052
+VM_VERSION = 3
+VM_HEADER = struct.Struct("<IHHIIIIIII")
+VM_INFERENCE = struct.Struct("<IIII")
+VM_RELOC = struct.Struct("<II")
+
+OP_END = 0
+OP_WRITE = 1
+OP_POLL_MASK = 2
+OP_CHECK = 3
+OP_COPY_BLOB = 4
+OP_WAIT_IRQ = 5
+OP_FENCE = 6
+OP_NAMES = ("END", "WRITE", "POLL_MASK", "CHECK", "COPY_BLOB", "WAIT_IRQ", "FENCE")
+OP_ARGS = (0, 1, 4, 2, 3, 0, 0)
+
+# POLL_MASK backoff: failed reads that spin, then ones that wait for an event
+# before the poll yields (REPLAY_VM_BACKOFF)
+POLL_SPIN = 64
+POLL_WAITS = 1000
+POLL_BACKOFF = POLL_SPIN | POLL_WAITS << 16
+RESET_TIMEOUT_US = 10000
+IRQ_TIMEOUT_US = 1000000
+
+# Relocation symbols (REPLAY_SYM_*): what a relocated operand points at
+SYM_SNAPSHOT = 0
+SYM_QBASE = 1
+SYM_BASEP = 2  # + n
+
+
+def sym_name(sym):
+    if sym == SYM_SNAPSHOT:
+        return "snapshot"
+    if sym == SYM_QBASE:
+        return "qbase"
+    return "basep%d" % (sym - SYM_BASEP)
+
+
+# STATUS bits
+STATUS_IRQ_RAISED = 1 << 1
+STATUS_RESET = 1 << 3
+STATUS_CMD_END = 1 << 5
+STATUS_ERRORS = (1 << 2) | (1 << 4) | (1 << 7) | (1 << 8)  # bus, parse, wd, ecc
+
+
+class Program:
+    """A replay program: code words, blob section and per-inference offsets."""
+
+    def __init__(self, reg_base):
+        self.reg_base = reg_base
+        self.code = []
+        self.blobs = bytearray()
+        self.inferences = []  # (setup, run, irq, end) code offsets
+        self.relocs = []  # (code word, symbol), in code order
+        self.mem_base = 0
+        self.mem_size = 0
+        self._blob_index = {}
+
+    def emit(self, op, reg=0, *args, sym=None):
+        """Append an instruction; sym marks its first operand as an address
+        inside the memory segment."""
+        if sym is not None:
+            self.relocs.append((len(self.code) + 1, sym))
+        self.code.append(op | reg << 8)
+        self.code.extend(args)
+
+    def layout(self, qsize=0, min_size=0):
+        """Set the segment to cover every relocated address: snapshot
+        destinations, the command stream (QBASE + qsize) and the BASEP
+        regions, at least min_size bytes from a 16-byte aligned base."""
+        if not self.relocs:
+            return
+        start = []
+        end = []
+        for word, sym in self.relocs:
+            addr = self.code[word]
+            start.append(addr)
+            if sym == SYM_SNAPSHOT:
+                end.append(addr + self.code[word + 2])
+            elif sym == SYM_QBASE:
+                end.append(addr + qsize)
+            else:
+                end.append(addr)
+        self.mem_base = min(start) & ~15
+        self.mem_size = max(max(end) - self.mem_base, min_size)
+        self.mem_size = (self.mem_size + 15) & ~15
+
+    def relocate(self, base):
+        """Move the segment to base, like replay_vm_relocate()."""
+        if base & 15:
+            raise TraceError("segment base 0x%08x is not 16-byte aligned" % base)
+        delta = base - self.mem_base
+        for word, _ in self.relocs:
+            self.code[word] = (self.code[word] + delta) & 0xFFFFFFFF
+        self.mem_base = base
+
+    def blob(self, data):
+        data = bytes(data)
+        if data not in self._blob_index:
+            self._blob_index[data] = len(self.blobs)
+            self.blobs += data
+        return self._blob_index[data]
+
+    def image(self):
+        out = bytearray(VM_HEADER.pack(VM_MAGIC, VM_VERSION, 0, self.reg_base,
+                                       len(self.inferences), len(self.code), len(self.blobs),
+                                       self.mem_base, self.mem_size, len(self.relocs)))
+        for entry in self.inferences:
+            out += VM_INFERENCE.pack(*entry)
+        for entry in self.relocs:
+            out += VM_RELOC.pack(*entry)
+        out += struct.pack("<%dI" % len(self.code), *self.code)
+        out += self.blobs
+        return bytes(out)
+
+    def disassemble(self):
+        relocs = dict(self.relocs)
+        starts = {}
+        for n, entry in enumerate(self.inferences):
+            for name, pc in zip(("setup", "run", "irq"), entry):
+                starts.setdefault(pc, []).append("inference %d %s" % (n, name))
+        pc = 0
+        while pc < len(self.code):
+            for label in starts.get(pc, []):
+                yield "---- %s" % label
+            op = self.code[pc] & 0xFF
+            args = self.code[pc + 1:pc + 1 + OP_ARGS[op]]
+            if op == OP_POLL_MASK:
+                text = "0x%03x 0x%08x 0x%08x %dus spin %d wait %d" % (
+                    self.code[pc] >> 8, args[0], args[1], args[2], args[3] & 0xFFFF, args[3] >> 16)
+            elif op in (OP_WRITE, OP_CHECK):
+                text = "0x%03x " % (self.code[pc] >> 8) + " ".join("0x%08x" % a for a in args)
+            elif op == OP_COPY_BLOB:
+                text = "0x%08x blob+%d %d bytes" % tuple(args)
+            else:
+                text = ""
+            if pc + 1 in relocs:
+                text += "  @%s" % sym_name(relocs[pc + 1])
+            yield "%5d %-9s %s" % (pc, OP_NAMES[op], text)
+            pc += 1 + OP_ARGS[op]
+
+
+def _reloc_sym(off, value):
+    """Relocation symbol of a register write, or None if it is no address."""
+    if value == 0:
+        return None  # unused region
+    if off == REG_QBASE:
+        return SYM_QBASE
+    n, rem = divmod(off - REG_BASEP, 8)
+    if 0 <= n < BASEP_COUNT and rem == 0:
+        return SYM_BASEP + n
+    return None
+
+
+def build_program(trace, verify=True, irq_timeout_us=IRQ_TIMEOUT_US, mem_size=0, mem_base=None):
+    """Compile a trace into a replay program.
+
+    Writes and reads follow the optimizer. The first IRQ read becomes
+    WAIT_IRQ plus a poll on STATUS.irq_raised, the STATUS read after a soft
+    reset polls STATUS.reset_status, the completion STATUS read checks the
+    error bits and cmd_end_reached, and the remaining verify-once reads
+    become CHECKs unless verify is False. A FENCE precedes every kick.
+    Polls only look at the bits they wait for and give up after their
+    timeout, so a hung NPU fails the replay instead of hanging it.
+
+    QBASE, BASEP and snapshot addresses are relocations into one memory
+    segment of at least mem_size bytes, moved to mem_base if given.
+    """
+    opt = optimize(trace)
+    base = trace.reg_base
+    prog = Program(base)
+    recs = trace.records
+
+    def emit_range(start, end, irq):
+        checked = False
+        for r in recs:
+            if not start <= r.order < end:
+                continue
+            if r.is_snapshot:
+                prog.emit(OP_COPY_BLOB, 0, r.address, prog.blob(r.data), len(r.data),
+                          sym=SYM_SNAPSHOT)
+                continue
+            if not _is_reg(r, base):
+                raise TraceError("record %d at 0x%08x has no snapshot data, record with "
+                                 "ETHOSU_RECORD_LEVEL=ETHOSU_RECORD_FULL" % (r.order, r.address))
+            off = r.offset(base)
+            if r.is_write:
+                if r.order in opt.dropped:
+                    continue
+                if _is_kick(r, base):
+                    prog.emit(OP_FENCE)
+                prog.emit(OP_WRITE, off, r.value, sym=_reloc_sym(off, r.value))
+            elif irq and off == REG_STATUS and r.value & STATUS_CMD_END and not checked:
+                mask = STATUS_ERRORS | STATUS_CMD_END
+                prog.emit(OP_CHECK, off, mask, r.value & mask)
+                checked = True
+            elif opt.reads.get(r.order) == READ_POLL and not irq:
+                prog.emit(OP_POLL_MASK, off, STATUS_RESET, 0, RESET_TIMEOUT_US, POLL_BACKOFF)
+            elif verify and r.order not in opt.dropped and opt.reads.get(r.order) == READ_VERIFY:
+                prog.emit(OP_CHECK, off, 0xFFFFFFFF, r.value)
+
+    for inf in opt.inferences:
+        setup = len(prog.code)
+        emit_range(inf.setup_start, inf.run_start, False)
+        run = len(prog.code)
+        emit_range(inf.run_start, inf.irq_start, False)
+        irq = len(prog.code)
+        prog.emit(OP_WAIT_IRQ)
+        prog.emit(OP_POLL_MASK, REG_STATUS, STATUS_IRQ_RAISED, STATUS_IRQ_RAISED,
+                  irq_timeout_us, POLL_BACKOFF)
+        emit_range(inf.irq_start, inf.irq_end, True)
+        prog.inferences.append((setup, run, irq, len(prog.code)))
+
+    qsize = max([r.value for r in recs if r.is_write and _is_reg(r, base)
+                 and r.offset(base) == REG_QSIZE] or [0])
+    prog.layout(qsize, mem_size)
+    if mem_base is not None:
+        prog.relocate(mem_base)
+    return prog
+
+
+def command_stream(trace, inf):
+    """Command stream words of an inference, the BASEP values it runs with
+    and the snapshots (address, size) it can rely on, in NPU addresses.
+
+    The recorder snapshots the stream right before it writes QBASE; the
+    driver's BASEP_OFFSET is the difference between QBASE and that
+    snapshot's address and applies to every snapshot.
+    """
+    base = trace.reg_base
+    recs = [r for r in trace.records if r.order < inf.irq_start]
+    qbase = qsize = snap = None
+    basep = {}
+    for r in recs:
+        if r.is_snapshot:
+            if r.order >= inf.run_start and qbase is None:
+                snap = r
+            continue
+        if not r.is_write or not _is_reg(r, base):
+            continue
+        off = r.offset(base)
+        n, rem = divmod(off - REG_BASEP, 8)
+        if off == REG_QBASE and r.order >= inf.run_start:
+            qbase = r.value
+        elif off == REG_QSIZE:
+            qsize = r.value
+        elif 0 <= n < BASEP_COUNT and rem == 0:
+            basep[n] = r.value
+    if qbase is None:
+        raise TraceError("no QBASE write in the run phase at record %d" % inf.run_start)
+    if snap is None:
+        raise TraceError("command stream at 0x%08x was not snapshotted, record with "
+                         "ETHOSU_RECORD_LEVEL=ETHOSU_RECORD_FULL" % qbase)
+    delta = qbase - snap.address
+    data = snap.data[:qsize] if qsize else snap.data
+    snapshots = [(r.address + delta, len(r.data)) for r in recs if r.is_snapshot]
+    return npucmd.words_from_bytes(data), basep, snapshots
+
+
+def _c_words(data, per_line=8):
+    data = bytes(data) + b"\0" * (-len(data) % 4)
+    words = struct.unpack("<%dI" % (len(data) // 4), data)
+    rows = []
+    for i in range(0, len(words), per_line):
+        rows.append("    " + ", ".join("0x%08x" % w for w in words[i:i + per_line]))
+    return ",\n".join(rows)
+
+
+def render_program_header(prog, source):
+    image = prog.image()
+    out = []
+    w = out.append
+    w("/* Generated by rrtrace.py program from %s, do not edit */" % source)
+    w("#ifndef REPLAY_PROGRAM_H")
+    w("#define REPLAY_PROGRAM_H")
+    w("")
+    w("#include <stdint.h>")
+    w("")
+    w("/* %d inferences, %d code words, %d blob bytes */" % (
+        len(prog.inferences), len(prog.code), len(prog.blobs)))
+    w("#define REPLAY_PROGRAM_SIZE %d" % len(image))
+    w("")
+    w("/* uint32_t keeps the image word aligned for replay_vm_load() */")
+    w("static const uint32_t replay_program[] = {")
+    w(_c_words(image))
+    w("};")
+    w("")
+    w("#endif /* REPLAY_PROGRAM_H */")
+    return "\n".join(out) + "\n"
+
+
+# --------------------------------------------------------------------------
+# Command line
+# --------------------------------------------------------------------------
+
+
+def cmd_dump(args):
+    trace = load(args.trace)
+    print("reg_base=0x%08x records=%d%s" % (trace.reg_base, len(trace.records),
+                                            " (truncated)" if trace.truncated else ""))
+    marks = {}
+    for order, kind, arg in trace.markers:
+        if kind == MARK_PHASE:
+            marks.setdefault(order, []).append(PHASE_NAMES.get(arg, "PHASE %d" % arg))
+    for r in trace.records:
+        for name in marks.pop(r.order, []):
+            print("---- %s" % name)
+        print(r)
+    for names in marks.values():
+        for name in names:
+            print("---- %s" % name)
+
+
+def cmd_phases(args):
+    trace = load(args.trace)
+    for n, inf in enumerate(inferences(trace)):
+        wait = " wait=%d" % inf.wait if inf.wait is not None else ""
+        print("inference %d (%s): setup %d-%d run %d-%d irq %d-%d%s" % (
+            n, "cold" if inf.cold else "warm", inf.setup_start, inf.setup_end,
+            inf.run_start, inf.run_end, inf.irq_start, inf.irq_end - 1, wait))
+
+
+def cmd_templates(args):
+    trace = load(args.trace)
+    if trace.truncated:
+        print("warning: trace was truncated on the target", file=sys.stderr)
+    text = render_templates(trace)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+def cmd_optimize(args):
+    trace = load(args.trace)
+    opt = optimize(trace)
+    if args.verbose:
+        for r in trace.records:
+            if r.order in opt.dropped:
+                print("%-6s %s  (%s)" % ("drop", r, opt.dropped[r.order]))
+            elif opt.reads.get(r.order) in (READ_POLL, READ_VERIFY):
+                print("%-6s %s" % (opt.reads[r.order], r))
+    sys.stdout.write(render_report(opt, args.read_ns, args.write_ns))
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(render_templates(opt.as_trace()))
+
+
+def cmd_program(args):
+    trace = load(args.trace)
+    if trace.truncated:
+        print("warning: trace was truncated on the target", file=sys.stderr)
+    prog = build_program(trace, verify=not args.no_verify, irq_timeout_us=args.irq_timeout_us,
+                         mem_size=args.mem_size, mem_base=args.base)
+    if args.verbose:
+        for line in prog.disassemble():
+            print(line)
+    image = prog.image()
+    print("%d inferences, %d code words, %d blob bytes, %d byte image" % (
+        len(prog.inferences), len(prog.code), len(prog.blobs), len(image)))
+    if prog.relocs:
+        print("segment 0x%08x-0x%08x, %d relocations" % (
+            prog.mem_base, prog.mem_base + prog.mem_size, len(prog.relocs)))
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(image)
+    if args.header:
+        with open(args.header, "w") as f:
+            f.write(render_program_header(prog, args.trace))
+
+
+def cmd_analyze(args):
+    trace = load(args.trace)
+    isa = npucmd.Isa(args.interface)
+    macs_per_cc = args.macs_per_cc
+    if macs_per_cc is None:
+        config = next((r.value for r in trace.records if not r.is_write and
+                       not r.is_snapshot and r.offset(trace.reg_base) == REG_CONFIG), None)
+        macs_per_cc = 1 << (config & 0xF) if config is not None else npucmd.MACS_PER_CC
+    holes = 0
+    for n, inf in enumerate(inferences(trace)):
+        words, basep, snapshots = command_stream(trace, inf)
+        cmds = isa.decode(words)
+        print("---- inference %d: %d command words, %s" % (
+            n, len(words), " ".join("BASEP%d=0x%08x" % kv for kv in sorted(basep.items()))))
+        if args.disassemble:
+            for cmd in cmds:
+                print(cmd)
+        ops = npucmd.analyze(cmds)
+        sys.stdout.write(npucmd.render(ops, macs_per_cc, args.bytes_per_cc, args.verbose))
+        for op, access, reason in npucmd.missing_snapshots(ops, basep, snapshots):
+            print("warning: op %d %s %s: %s" % (op.index, op.name, access, reason))
+            holes += 1
+    if holes:
+        print("%d reads not covered by the snapshots, the replay would use stale memory" % holes)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("dump", help="list decoded records")
+    p.add_argument("trace", help="UART log or raw binary trace")
+    p.set_defaults(func=cmd_dump)
+
+    p = sub.add_parser("phases", help="list inferences and their phase ranges")
+    p.add_argument("trace", help="UART log or raw binary trace")
+    p.set_defaults(func=cmd_phases)
+
+    p = sub.add_parser("templates", help="generate replay_templates_*.h")
+    p.add_argument("trace", help="UART log or raw binary trace")
+    p.add_argument("-o", "--output", help="output header (default: stdout)")
+    p.set_defaults(func=cmd_templates)
+
+    p = sub.add_parser("optimize", help="prune redundant accesses and report the replay path")
+    p.add_argument("trace", help="UART log or raw binary trace")
+    p.add_argument("-o", "--output", help="write the pruned replay_templates_*.h")
+    p.add_argument("-v", "--verbose", action="store_true", help="list every dropped or polled access")
+    p.add_argument("--read-ns", type=float, help="cost of one register read, for the time estimate")
+    p.add_argument("--write-ns", type=float, help="cost of one register write, for the time estimate")
+    p.set_defaults(func=cmd_optimize)
+
+    p = sub.add_parser("program", help="compile the trace into a replay_vm program")
+    p.add_argument("trace", help="UART log or raw binary trace (ETHOSU_RECORD_FULL)")
+    p.add_argument("-o", "--output", help="write the binary program image")
+    p.add_argument("-c", "--header", help="write the image as a C array (replay_program.h)")
+    p.add_argument("-v", "--verbose", action="store_true", help="disassemble the program")
+    p.add_argument("--no-verify", action="store_true",
+                   help="do not check ID/CONFIG/PROT, e.g. when replaying from another world")
+    p.add_argument("--irq-timeout-us", type=int, default=IRQ_TIMEOUT_US,
+                   help="give up waiting for the NPU interrupt after this long (default %(default)d)")
+    p.add_argument("--base", type=lambda v: int(v, 0),
+                   help="move the model's memory segment to this 16-byte aligned address")
+    p.add_argument("--mem-size", type=lambda v: int(v, 0), default=0,
+                   help="reserve at least this many bytes for the segment, e.g. to cover the "
+                        "tensor arena beyond the recorded addresses")
+    p.set_defaults(func=cmd_program)
+
+    p = sub.add_parser("analyze", help="decode and cost the command streams, check the snapshots")
+    p.add_argument("trace", help="UART log or raw binary trace (ETHOSU_RECORD_FULL)")
+    p.add_argument("-d", "--disassemble", action="store_true", help="list every command")
+    p.add_argument("-v", "--verbose", action="store_true", help="list every access")
+    p.add_argument("-i", "--interface", help="ethosu65_interface.h with the command definitions")
+    p.add_argument("--macs-per-cc", type=int,
+                   help="MACs per cycle for the estimate (default: from CONFIG in the trace)")
+    p.add_argument("--bytes-per-cc", type=int, default=npucmd.BYTES_PER_CC,
+                   help="bytes per cycle for the estimate (default %(default)d)")
+    p.set_defaults(func=cmd_analyze)
+
+    args = parser.parse_args(argv)
+    try:
+        args.func(args)
+    except (TraceError, npucmd.CmdStreamError, OSError) as e:
+        print("rrtrace: %s" % e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * M33 端的完成环（done_ring）平台接口。环在 OCRAM 的 DONE_RING_PA，
+ * 由 A55（OP-TEE core/drivers/replay_done.c）复位和消费；M33 按物理地址
+ * 直接访问 OCRAM，只需要屏障。DONE_RING_MU 时每推一个槽触发 MU2 MUA 的
+ * 通用中断 0，A55 在 MUB 上收到中断后唤醒等待的线程。
+ */
+
+#include <stdint.h>
+
+#include "fsl_common.h"
+#include "fsl_debug_console.h"
+#include "fsl_device_registers.h"
+#ifdef DONE_RING_MU
+#include "fsl_mu.h"
+#endif
+
+#include "done_ring.h"
+#include "done_ring_port.h"
+
+/* 环满时每次等待的时间和总的等待上限 */
+#define DONE_REPORT_WAIT_US    10
+#define DONE_REPORT_TIMEOUT_US 1000000
+
+/* 槽写完再写 head */
+static void done_fence(void *ctx)
+{
+    (void)ctx;
+    __DSB();
+}
+
+#ifdef DONE_RING_MU
+static void done_notify(void *ctx)
+{
+    (void)ctx;
+    /* 上一次的门铃 A55 还没处理时 GIR0 仍然置位，合并成一次就够了 */
+    (void)MU_TriggerInterrupts(MU2_MUA, kMU_GenInt0InterruptTrigger);
+}
+#endif
+
+static const done_ring_ops_t done_ops = {
+    .fence = done_fence,
+#ifdef DONE_RING_MU
+    .notify = done_notify,
+#endif
+    /* .sync_in/.sync_out 为空：M33 访问 OCRAM 不经过 D-Cache */
+};
+
+static const done_ring_ep_t done_ep = {
+    .ring = (done_ring_t *)DONE_RING_PA,
+    .ops  = &done_ops,
+    .ctx  = NULL,
+};
+
+int replay_done_report(uint32_t seq, int32_t status, uint32_t out_pa, uint32_t out_size)
+{
+    const done_ring_slot_t slot = {
+        .seq        = seq,
+        .status     = status,
+        .out_offset = out_size ? out_pa - DONE_RING_OUT_BASE : 0,
+        .out_size   = out_size,
+    };
+    uint32_t waited = 0;
+    int ret;
+
+#ifdef DONE_RING_MU
+    static bool mu_ready;
+
+    if (!mu_ready) {
+        MU_Init(MU2_MUA);
+        mu_ready = true;
+    }
+#endif
+
+    while ((ret = done_ring_push(&done_ep, &slot)) == DONE_RING_EFULL && waited < DONE_REPORT_TIMEOUT_US) {
+        SDK_DelayAtLeastUs(DONE_REPORT_WAIT_US, SystemCoreClock);
+        waited += DONE_REPORT_WAIT_US;
+    }
+    if (ret != DONE_RING_OK) {
+        PRINTF("Completion %u not reported: %d\r\n", (unsigned int)seq, ret);
+    }
+    return ret;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef DONE_RING_PORT_H
+#define DONE_RING_PORT_H
+
+#include <stdint.h>
+
+#include "done_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 向 A55 报告第 seq 次推理完成：往 OCRAM 的完成环推一个槽，
+ * DONE_RING_MU 时再触发 MU2 的通用中断 0。out_size 为 0 表示 A55 按
+ * 默认地址读输出。返回 DONE_RING_*；A55 没有复位完成环（没有消费者）
+ * 时返回 DONE_RING_EBADRING，环满时等 A55 取走，超时返回 DONE_RING_EFULL。
+ */
+int replay_done_report(uint32_t seq, int32_t status, uint32_t out_pa, uint32_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DONE_RING_PORT_H */
@@ -11,7 +11,11 @@
 
 #include "ethosu_driver.h"
 #include "ethosu_core_interface.h"
+#include "done_ring_port.h"
+#include "replay_vm_port.h"
+#ifndef REPLAY_VM
 #include "replay_templates_conv2d.h"
+#endif
  
 #include "inference_process.hpp"
 // #include "add_model.hpp"
@@ -36,6 +40,9 @@ extern "C" {
 #endif
 
 void dump_reg_op_records(void);
+#ifdef REPLAY_VM
+int replay_program_run(void);
+#endif
 
 #ifdef __cplusplus
 }
@@ -68,7 +75,6 @@ volatile uint32_t msTicks = 0;
 // Example of a simple FreeRTOS task
 
 #define APP_TASK_STACK_SIZE (10*1024)
-#define FLAG_PA 0x20490000
 
 static TaskHandle_t app_task_handle = NULL;
 
@@ -138,16 +144,27 @@ int main(void)
        //     time_end-time_start);
 */
        
+     /* 各阶段耗时统计，跑完在串口打印 */
+     replay_phase_reset();
+#ifdef REPLAY_VM
+     /* replay_program.h: rrtrace.py program 生成，所有推理由 replay_vm 执行 */
+     replay_program_run();
+#else
     replay_initialization_verification();
      PRINTF("Initialization!\r\n");
      replay_inference();
-     replay_handle_interrupt();
+     /* 每次推理完成都推一条完成记录，A55 不用等整批跑完；失败的那次带上错误码 */
+     int replay_ret = replay_handle_interrupt();
+     replay_done_report(0, replay_ret, 0, 0);
+#ifdef REPLAY_INFERENCE_COUNT
+     for (uint32_t n = 1; n < REPLAY_INFERENCE_COUNT && replay_ret == 0; n++) {
+         replay_ret = replay_warm_inference(n);
+         replay_done_report(n, replay_ret, 0, 0);
+     }
+#endif
+#endif
+     replay_phase_report();
      PRINTF("DONE!\r\n");
-    {
-        volatile uint8_t *flag = (volatile uint8_t *)FLAG_PA;
-        *flag = 1;                
-        __DSB();                  
-    }
 
     return 0;
 }
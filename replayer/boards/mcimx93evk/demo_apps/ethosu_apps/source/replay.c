@@ -2,7 +2,7 @@
 #include <stdio.h>
 #include "ethosu_log.h"
 
-void replay_handle_interrupt(void)
+int replay_handle_interrupt(void)
 {
     for (int i = INTERRUPT_HANDLING_START; i < INTERRUPT_HANDLING_END; ++i) {
         reg_op_record_t *rec = &register_access_records[i];
@@ -33,7 +33,7 @@ void replay_handle_interrupt(void)
                      addr, v, rec->op_order);
         }
     }
-
+    return 0;
 }
 
 
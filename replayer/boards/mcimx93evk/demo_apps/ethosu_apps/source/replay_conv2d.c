@@ -1,6 +1,9 @@
 #include "replay_templates_conv2d.h"
 #include <stdio.h>
 #include "ethosu_log.h"
+#include "replay_vm_port.h"
+
+#define REPLAY_NPU_BASE 0x4A900000UL
 void print_memory(const void *addr, size_t len) {
     const uint8_t *p = (const uint8_t *)addr;      // 将地址转换为字节指针
     for (size_t i = 0; i < len; i++) {
@@ -14,42 +17,57 @@ void print_memory(const void *addr, size_t len) {
     }
 }
 
-void replay_handle_interrupt(void)
+/**
+ *  IRQ 阶段：先等 STATUS.irq_raised（带超时），再重放写操作。
+ *  STATUS 的读只比较错误位和 cmd_end_reached，其余位（irq_history 等）每次运行都可能不同；
+ *  CMD、QREAD 等其他读不影响重放，直接跳过。
+ */
+static int replay_irq_records(int start, int end)
 {
-    for (int i = INTERRUPT_HANDLING_START; i < INTERRUPT_HANDLING_END; ++i) {
+    volatile uint32_t *status = (volatile uint32_t *)(REPLAY_NPU_BASE + REPLAY_NPU_STATUS);
+    uint32_t t0 = replay_phase_begin();
+
+    if (replay_poll(status, REPLAY_STATUS_IRQ_RAISED, REPLAY_STATUS_IRQ_RAISED, REPLAY_IRQ_TIMEOUT_US) !=
+        REPLAY_VM_OK) {
+        LOG_ERR("NPU did not complete within %u us, STATUS=0x%08x\n", REPLAY_IRQ_TIMEOUT_US, *status);
+        return -1;
+    }
+    replay_phase_end(REPLAY_PHASE_NPU, t0);
+
+    t0 = replay_phase_begin();
+
+    for (int i = start; i < end; ++i) {
         reg_op_record_t *rec = &register_access_records[i];
         volatile uint32_t *addr = (volatile uint32_t *)rec->reg_address;
 
         if (rec->op_type == REG_OP_WRITE) {
             *addr = rec->reg_value;
-            LOG_INFO("IRQ WRITE: Addr=%p, Val=0x%08x, Order=%u\n",
-                     addr, rec->reg_value, rec->op_order);
-        } else {
-            uint32_t v;
-            /* 对 45 号读操作特殊处理：任何非 0 都视为“中断到来” */
-            uint32_t expected = rec->reg_value;
-            if (rec->op_order == 45) {
-                expected = 1;
+        } else if (addr == status) {
+            uint32_t v = *addr;
+            if ((v & REPLAY_STATUS_CHECK) != (rec->reg_value & REPLAY_STATUS_CHECK)) {
+                LOG_ERR("IRQ STATUS mismatch: Got=0x%08x, Expect=0x%08x, Order=%u\n",
+                        v, rec->reg_value, rec->op_order);
+                return -1;
             }
+        }
+    }
+    replay_phase_end(REPLAY_PHASE_IRQ_ACK, t0);
+    return 0;
+}
 
-            /* —— 轮询直到读到和期望一致 —— */
-            do {
-                v = *addr;
-                if (v != expected) {
-                    LOG_INFO("IRQ POLL: Addr=%p, Got=0x%08x, Expect=0x%08x, Order=%u\n",
-                             addr, v, expected, rec->op_order);
-                }
-            } while (v != expected);
+int replay_handle_interrupt(void)
+{
+    int ret = replay_irq_records(INTERRUPT_HANDLING_START, INTERRUPT_HANDLING_END);
 
-            LOG_INFO("IRQ READ OK: Addr=%p, Val=0x%08x, Order=%u\n",
-                     addr, v, rec->op_order);
-        }
+    if (ret != 0) {
+        return ret;
     }
 
     /* —— 重放完 48 条之后，把结果数据 dump 出来 —— */
     PRINTF("INFERENCE RESULT :\r\n");
     const uintptr_t target_addr = 0x20484000UL;
     print_memory((const void *)target_addr, 1024);
+    return 0;
 }
 
 
@@ -58,6 +76,8 @@ void replay_handle_interrupt(void)
  */
 uint32_t register_access(reg_op_record_t *record) {
     uint32_t result = 0;
+    uint32_t t0 = replay_phase_begin();
+    bool copied = true;
 
     /* —— 根据 op_order 预写数据 —— */
     switch (record->op_order) {
@@ -80,8 +100,12 @@ uint32_t register_access(reg_op_record_t *record) {
             memcpy((void *)0x20484000, op_40_data, sizeof(op_40_data));
             break;
         default:
+            copied = false;
             break;
     }
+    if (copied) {
+        replay_phase_end(REPLAY_PHASE_COPY_IN, t0);
+    }
 
     if (record->op_type == REG_OP_WRITE) {
         *(volatile uint32_t *)record->reg_address = record->reg_value;
@@ -107,30 +131,66 @@ uint32_t register_access(reg_op_record_t *record) {
 
 //replay templates of initialization & verification
 void replay_initialization_verification(void) {
+    uint32_t t0 = replay_phase_begin();
+
     for (int i = INIT_VERIFICATION_START; i <= INIT_VERIFICATION_END; ++i) {
             if (i != WAIT) {
                 // 非轮询情形，直接调用 register_access
                 register_access(&register_access_records[i]);
             }
             else {
-                // WAIT 情形的处理
-                int j;
-                for (j = 0; j < 100000 && register_access(&register_access_records[i]); j++) {
-                    // 空循环等待
-                }
-                if (register_access(&register_access_records[i]) != 0) {
+                // WAIT 情形：等 STATUS.reset_status 清零（软复位完成）
+                volatile uint32_t *status = (volatile uint32_t *)register_access_records[i].reg_address;
+                if (replay_poll(status, REPLAY_STATUS_RESET, 0, REPLAY_RESET_TIMEOUT_US) != REPLAY_VM_OK) {
                     LOG_ERR("failed to initialize Ethos\n");
                 }
             }
         
     }
+    replay_phase_end(REPLAY_PHASE_INIT, t0);
 }
 
 
 void replay_inference(void){
+    uint32_t t0 = replay_phase_begin();
+
     for (int i = RUN_STREAM_COMMAND_START; i <= RUN_STREAM_COMMAND_END; ++i) {
             register_access(&register_access_records[i]);
     }
+    replay_phase_end(REPLAY_PHASE_KICK, t0);
     PRINTF("HANDLING INTERRUPTS CONV2D OK!");
 }
 
+#ifdef REPLAY_INFERENCE_COUNT
+/**
+ *  重放多推理 trace 中的第 n 个推理（n > 0）：NPU 已由第 0 个推理初始化，
+ *  只恢复快照并重放 RUN 和 IRQ 两个阶段，不再执行 init。
+ *  返回 IRQ 阶段的结果（超时或 STATUS 不符为 -1），调用方原样报给 A55
+ */
+int replay_warm_inference(uint32_t n)
+{
+    const replay_phase_t *ph = &replay_phases[n];
+    uint32_t t0 = replay_phase_begin();
+#if REPLAY_SNAPSHOT_COUNT > 0
+    uint32_t s = 0;
+
+    while (s < REPLAY_SNAPSHOT_COUNT && replay_snapshots[s].index < ph->run_start) {
+        s++;
+    }
+#endif
+
+    for (uint32_t i = ph->run_start; i <= ph->run_end; ++i) {
+#if REPLAY_SNAPSHOT_COUNT > 0
+        for (; s < REPLAY_SNAPSHOT_COUNT && replay_snapshots[s].index == i; s++) {
+            uint32_t tc = replay_phase_begin();
+
+            memcpy((void *)replay_snapshots[s].dst, replay_snapshots[s].data, replay_snapshots[s].size);
+            replay_phase_end(REPLAY_PHASE_COPY_IN, tc);
+        }
+#endif
+        register_access(&register_access_records[i]);
+    }
+    replay_phase_end(REPLAY_PHASE_KICK, t0);
+    return replay_irq_records(ph->irq_start, ph->irq_end);
+}
+#endif
@@ -14,7 +14,7 @@ void print_memory(const void *addr, size_t len) {
     }
 }
 
-void replay_handle_interrupt(void)
+int replay_handle_interrupt(void)
 {
     for (int i = INTERRUPT_HANDLING_START; i < INTERRUPT_HANDLING_END; ++i) {
         reg_op_record_t *rec = &register_access_records[i];
@@ -50,6 +50,7 @@ void replay_handle_interrupt(void)
     LOG_INFO("INFERENCE RESULT (128 bytes):");
     LOG_INFO("print_result:");
     LOG_INFO("\n");
+    return 0;
 }
 
 
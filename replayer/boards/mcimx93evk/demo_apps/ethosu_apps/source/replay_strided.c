@@ -14,7 +14,7 @@ void print_memory(const void *addr, size_t len) {
     }
 }
 
-void replay_handle_interrupt(void)
+int replay_handle_interrupt(void)
 {
     for (int i = INTERRUPT_HANDLING_START; i < INTERRUPT_HANDLING_END; ++i) {
         reg_op_record_t *rec = &register_access_records[i];
@@ -52,6 +52,7 @@ void replay_handle_interrupt(void)
     const uintptr_t target_addr = 0x20484000UL;
     //print_memory((const void *)target_addr, 1472);
     LOG_INFO("\n");
+    return 0;
 }
 
 
@@ -194,7 +194,7 @@ void replay_inference(void);
 extern "C" {
 #endif
 
-void replay_handle_interrupt(void);
+int replay_handle_interrupt(void);
 
 #ifdef __cplusplus
 }
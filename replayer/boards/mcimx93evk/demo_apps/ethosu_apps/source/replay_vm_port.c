@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/*
+ * M33 端的 replay_vm 平台接口：
+ *  - replay_poll() 给模板重放（replay_conv2d.c 等）做带掩码、超时和退避的轮询；
+ *  - REPLAY_VM 时 replay_program_run() 执行 replay_program.h，它由
+ *      rrtrace.py program record.txt -c replay_program.h
+ *    生成，解释器 replay_vm.c 与 OP-TEE 的 core/drivers/replay.c 共用，
+ *    每次推理完成后通过完成环（done_ring_port.c）报告给 A55；
+ *  - replay_phase_*() 按阶段统计重放耗时（replay_hist.c，也和 OP-TEE 共用）。
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "fsl_common.h"
+#include "fsl_debug_console.h"
+#include "fsl_device_registers.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "replay_hist.h"
+#include "replay_vm.h"
+#include "replay_vm_port.h"
+#include "done_ring_port.h"
+#ifdef REPLAY_VM
+#include "replay_program.h"
+#endif
+
+#define REPLAY_NPU_REG_BASE 0x4A900000UL
+#define REPLAY_NPU_REG_SIZE 0x00001000UL  /* 4 KB */
+#define REPLAY_OCRAM_BASE   0x20480000UL
+#define REPLAY_OCRAM_SIZE   (640 * 1024UL) /* 640 KB */
+
+/* wait_event 每次的等待时间 */
+#define REPLAY_WAIT_US 2
+
+static replay_hist_t replay_phase_hist[REPLAY_PHASE_COUNT];
+
+static const char *const replay_phase_names[REPLAY_PHASE_COUNT] = {
+    [REPLAY_PHASE_INIT]     = "init",
+    [REPLAY_PHASE_KICK]     = "kick",
+    [REPLAY_PHASE_NPU]      = "npu",
+    [REPLAY_PHASE_IRQ_ACK]  = "irq_ack",
+    [REPLAY_PHASE_COPY_IN]  = "copy_in",
+    [REPLAY_PHASE_COPY_OUT] = "copy_out",
+};
+
+void replay_phase_reset(void)
+{
+    MSDK_EnableCpuCycleCounter();
+    for (int i = 0; i < REPLAY_PHASE_COUNT; i++) {
+        replay_hist_reset(&replay_phase_hist[i]);
+    }
+}
+
+void replay_phase_end(enum replay_phase_id ph, uint32_t t0)
+{
+    /* CYCCNT 回绕时无符号减法仍然正确 */
+    replay_hist_add(&replay_phase_hist[ph], MSDK_GetCpuCycleCount() - t0);
+}
+
+void replay_phase_report(void)
+{
+    replay_hist_summary_t s;
+
+    PRINTF("phase        count     min_ns     avg_ns     max_ns     p99_ns\r\n");
+    for (int i = 0; i < REPLAY_PHASE_COUNT; i++) {
+        replay_hist_summarize(&replay_phase_hist[i], SystemCoreClock, &s);
+        if (s.count) {
+            PRINTF("%-9s %8u %10u %10u %10u %10u\r\n", replay_phase_names[i], (unsigned int)s.count,
+                   (unsigned int)s.min_ns, (unsigned int)s.avg_ns, (unsigned int)s.max_ns, (unsigned int)s.p99_ns);
+        }
+    }
+}
+
+/* M33 直接按物理地址访问 OCRAM，只需检查范围 */
+static int replay_copy(void *ctx, uint32_t pa, const void *src, uint32_t len)
+{
+    uint32_t t0 = replay_phase_begin();
+
+    (void)ctx;
+    if (pa < REPLAY_OCRAM_BASE || len > REPLAY_OCRAM_SIZE || pa - REPLAY_OCRAM_BASE > REPLAY_OCRAM_SIZE - len) {
+        return -1;
+    }
+    memcpy((void *)(uintptr_t)pa, src, len);
+    replay_phase_end(REPLAY_PHASE_COPY_IN, t0);
+    return 0;
+}
+
+/* 启动 NPU 前，保证拷贝都已写出 */
+static void replay_fence(void *ctx)
+{
+    (void)ctx;
+    __DSB();
+}
+
+/* 超时用 DWT 周期计数器计时 */
+static uint32_t replay_now(void *ctx)
+{
+    (void)ctx;
+    return MSDK_GetCpuCycleCount();
+}
+
+/*
+ * 这里不用 WFE：NPU 中断在 M33 上没有打开，调度器启动前也没有 SysTick，
+ * 挂死的 NPU 会让 WFE 永远睡下去。短延时同样不再占满总线。
+ */
+static void replay_wait_event(void *ctx)
+{
+    (void)ctx;
+    SDK_DelayAtLeastUs(REPLAY_WAIT_US, SystemCoreClock);
+}
+
+/* 调度器运行时让出 CPU，否则继续短延时 */
+static void replay_yield(void *ctx)
+{
+    (void)ctx;
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) {
+        taskYIELD();
+    } else {
+        SDK_DelayAtLeastUs(REPLAY_WAIT_US, SystemCoreClock);
+    }
+}
+
+static const replay_vm_ops_t replay_ops = {
+    .copy       = replay_copy,
+    .fence      = replay_fence,
+    .now        = replay_now,
+    .wait_event = replay_wait_event,
+    .yield      = replay_yield,
+    /* .wait_irq 为空：完成靠程序里的 STATUS.irq_raised 轮询 */
+};
+
+static void replay_vm_init(replay_vm_t *vm)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->regs         = (volatile uint32_t *)REPLAY_NPU_REG_BASE;
+    vm->reg_size     = REPLAY_NPU_REG_SIZE;
+    vm->ticks_per_us = SystemCoreClock / 1000000U;
+    vm->ops          = &replay_ops;
+    MSDK_EnableCpuCycleCounter();
+}
+
+int replay_poll(volatile uint32_t *reg, uint32_t mask, uint32_t expect, uint32_t timeout_us)
+{
+    replay_vm_t vm;
+
+    replay_vm_init(&vm);
+    return replay_vm_poll(&vm, reg, mask, expect, timeout_us, REPLAY_POLL_BACKOFF);
+}
+
+#ifdef REPLAY_VM
+int replay_program_run(void)
+{
+    replay_vm_t vm;
+    int ret;
+
+    replay_vm_init(&vm);
+    if (replay_vm_load(&vm, replay_program, REPLAY_PROGRAM_SIZE) != REPLAY_VM_OK) {
+        PRINTF("Invalid replay program\r\n");
+        return REPLAY_VM_EBADPROG;
+    }
+
+    /* 每次推理完成都向 A55 报告一次，失败的那次带上错误码 */
+    for (uint32_t n = 0; n < vm.hdr->inference_count; n++) {
+        ret = replay_vm_run_inference(&vm, n);
+        replay_done_report(n, ret, 0, 0);
+        if (ret != REPLAY_VM_OK) {
+            PRINTF("Replay program failed: %d at pc %u\r\n", ret, (unsigned int)vm.fault_pc);
+            return ret;
+        }
+    }
+    return REPLAY_VM_OK;
+}
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef REPLAY_VM_PORT_H
+#define REPLAY_VM_PORT_H
+
+#include <stdint.h>
+
+#include "fsl_common.h"
+#include "replay_vm.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 等到 (*reg & mask) == expect：先空转，再短延时，最后让出 CPU。
+ * 返回 REPLAY_VM_OK，或超过 timeout_us 时返回 REPLAY_VM_ETIMEOUT。
+ */
+int replay_poll(volatile uint32_t *reg, uint32_t mask, uint32_t expect, uint32_t timeout_us);
+
+/*
+ * 重放各阶段的耗时统计，阶段和 OP-TEE 的 enum replay_phase 一致：NPU 复位
+ * 和验证、启动命令流的寄存器写、等 NPU 完成、中断应答、拷进 OCRAM、
+ * 拷出 OCRAM。用 DWT 周期计数，只在 main() 里重放，不加锁。
+ */
+enum replay_phase_id
+{
+    REPLAY_PHASE_INIT,
+    REPLAY_PHASE_KICK,
+    REPLAY_PHASE_NPU,
+    REPLAY_PHASE_IRQ_ACK,
+    REPLAY_PHASE_COPY_IN,
+    REPLAY_PHASE_COPY_OUT,
+    REPLAY_PHASE_COUNT
+};
+
+/* 清空统计并打开 DWT 周期计数器，重放前调用一次 */
+void replay_phase_reset(void);
+
+/* 阶段开始时的周期数，交给 replay_phase_end() */
+static inline uint32_t replay_phase_begin(void)
+{
+    return MSDK_GetCpuCycleCount();
+}
+
+/* 记录从 t0 到现在的耗时 */
+void replay_phase_end(enum replay_phase_id ph, uint32_t t0);
+
+/* 打印每个阶段的次数、最小、平均、最大和 p99，单位 ns */
+void replay_phase_report(void);
+
+#ifdef REPLAY_VM
+/* 执行 replay_program.h 中的全部推理，返回 REPLAY_VM_* */
+int replay_program_run(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_VM_PORT_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "done_ring.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+static void ring_sync_in(const done_ring_ep_t *ep, const volatile void *p, uint32_t len)
+{
+    if (ep->ops && ep->ops->sync_in)
+        ep->ops->sync_in(ep->ctx, p, len);
+}
+
+static void ring_sync_out(const done_ring_ep_t *ep, const volatile void *p, uint32_t len)
+{
+    if (ep->ops && ep->ops->sync_out)
+        ep->ops->sync_out(ep->ctx, p, len);
+}
+
+static void ring_fence(const done_ring_ep_t *ep)
+{
+    if (ep->ops && ep->ops->fence)
+        ep->ops->fence(ep->ctx);
+    else
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void done_ring_reset(const done_ring_ep_t *ep)
+{
+    volatile uint32_t *w = (volatile uint32_t *)ep->ring;
+
+    for (size_t i = 0; i < sizeof(done_ring_t) / sizeof(uint32_t); i++)
+        w[i] = 0;
+    ep->ring->slots = DONE_RING_SLOTS;
+    ring_fence(ep);
+    /* magic last: a producer that sees it also sees empty indices */
+    ep->ring->magic = DONE_RING_MAGIC;
+    ring_sync_out(ep, ep->ring, sizeof(done_ring_t));
+    ring_fence(ep);
+}
+
+int done_ring_push(const done_ring_ep_t *ep, const done_ring_slot_t *slot)
+{
+    done_ring_t *r = ep->ring;
+    volatile done_ring_slot_t *s;
+    uint32_t head;
+    uint32_t tail;
+
+    ring_sync_in(ep, r, 3 * DONE_RING_LINE);
+    if (r->magic != DONE_RING_MAGIC || r->slots != DONE_RING_SLOTS)
+        return DONE_RING_EBADRING;
+
+    head = r->head;
+    tail = r->tail;
+    if (head - tail >= DONE_RING_SLOTS)
+        return DONE_RING_EFULL;
+
+    s = &r->slot[head % DONE_RING_SLOTS];
+    s->seq = slot->seq;
+    s->status = slot->status;
+    s->out_offset = slot->out_offset;
+    s->out_size = slot->out_size;
+    ring_sync_out(ep, s, sizeof(*s));
+
+    /* the slot must be visible before the index that covers it */
+    ring_fence(ep);
+    r->head = head + 1;
+    ring_sync_out(ep, &r->head, sizeof(r->head));
+    ring_fence(ep);
+
+    if (ep->ops && ep->ops->notify)
+        ep->ops->notify(ep->ctx);
+    return DONE_RING_OK;
+}
+
+int done_ring_pop(const done_ring_ep_t *ep, done_ring_slot_t *slot)
+{
+    done_ring_t *r = ep->ring;
+    volatile done_ring_slot_t *s;
+    uint32_t head;
+    uint32_t tail;
+
+    ring_sync_in(ep, &r->head, sizeof(r->head));
+    head = r->head;
+    tail = r->tail;
+    if (head == tail)
+        return DONE_RING_EEMPTY;
+    if (head - tail > DONE_RING_SLOTS)
+        return DONE_RING_EBADRING; /* ring overwritten behind our back */
+
+    /* read the index before the slot it covers */
+    ring_fence(ep);
+    s = &r->slot[tail % DONE_RING_SLOTS];
+    ring_sync_in(ep, s, sizeof(*s));
+    slot->seq = s->seq;
+    slot->status = s->status;
+    slot->out_offset = s->out_offset;
+    slot->out_size = s->out_size;
+
+    /* the slot may be reused as soon as the producer sees the new tail */
+    ring_fence(ep);
+    r->tail = tail + 1;
+    ring_sync_out(ep, &r->tail, sizeof(r->tail));
+    return DONE_RING_OK;
+}
+
+uint32_t done_ring_pending(const done_ring_ep_t *ep)
+{
+    ring_sync_in(ep, &ep->ring->head, sizeof(ep->ring->head));
+    return ep->ring->head - ep->ring->tail;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Completion ring between the M33 replayer (producer) and the A55
+ * (consumer, OP-TEE core/drivers/replay_done.c).
+ *
+ * The ring lives in OCRAM at a fixed physical address both sides agree on
+ * (DONE_RING_PA). It replaces the single completion byte the M33 used to
+ * set: every finished inference is reported as one slot carrying its
+ * sequence number, status and where its output is, so several inferences
+ * can complete before the A55 looks, and nothing is lost if it is late.
+ *
+ * Single producer, single consumer. Each index is written by one side
+ * only and sits on its own cache line, and slots are written by the
+ * producer only, so a side with a data cache (the A55) never holds a
+ * dirty copy of a line the other side writes. Cache maintenance, memory
+ * ordering and the doorbell are supplied by the platform through
+ * done_ring_ops_t; the same code runs on the M33, in OP-TEE and on Linux
+ * (done_ring_loopback.c).
+ */
+
+#ifndef DONE_RING_H
+#define DONE_RING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Physical address of the ring: the last 4 KB of the M33's OCRAM (m_ocram) */
+#define DONE_RING_PA    0x204DF000u
+#define DONE_RING_SIZE  0x1000u
+
+#define DONE_RING_MAGIC 0x474e5244u /* "DRNG" */
+#define DONE_RING_LINE  64u         /* largest cache line of either side */
+#define DONE_RING_SLOTS 16u         /* power of two */
+
+/* Return codes */
+#define DONE_RING_OK      0
+#define DONE_RING_EEMPTY  (-1) /* pop: nothing completed yet */
+#define DONE_RING_EFULL   (-2) /* push: the consumer is DONE_RING_SLOTS behind */
+#define DONE_RING_EBADRING (-3) /* the consumer never reset the ring */
+
+/* One completed inference */
+typedef struct {
+    uint32_t seq;        /* producer's sequence number, counts from 0 after reset */
+    int32_t status;      /* 0 on success, negative error from the replayer */
+    uint32_t out_offset; /* output location, offset from DONE_RING_OUT_BASE */
+    uint32_t out_size;   /* output bytes, 0 if the job has no output */
+} done_ring_slot_t;
+
+/* out_offset is relative to the start of OCRAM */
+#define DONE_RING_OUT_BASE 0x20480000u
+
+typedef struct {
+    /* Written by the consumer at reset only */
+    uint32_t magic;
+    uint32_t slots;
+    uint8_t pad0[DONE_RING_LINE - 2 * sizeof(uint32_t)];
+    /* Producer line: number of slots ever pushed */
+    volatile uint32_t head;
+    uint8_t pad1[DONE_RING_LINE - sizeof(uint32_t)];
+    /* Consumer line: number of slots ever popped */
+    volatile uint32_t tail;
+    uint8_t pad2[DONE_RING_LINE - sizeof(uint32_t)];
+    /* Written by the producer only */
+    done_ring_slot_t slot[DONE_RING_SLOTS];
+} done_ring_t;
+
+/*
+ * Platform hooks. Any hook may be NULL: sync_in/sync_out for memory that
+ * is coherent with the other side, fence for a compiler-only barrier plus
+ * __atomic_thread_fence(), notify when the consumer polls.
+ */
+typedef struct {
+    /* Drop stale cached copies of [p, p + len) before reading (invalidate) */
+    void (*sync_in)(void *ctx, const volatile void *p, uint32_t len);
+    /* Write back this side's writes to [p, p + len) (clean) */
+    void (*sync_out)(void *ctx, const volatile void *p, uint32_t len);
+    /* Order the slot writes before the index write seen by the other side */
+    void (*fence)(void *ctx);
+    /* Producer: ring the consumer's doorbell after a push */
+    void (*notify)(void *ctx);
+} done_ring_ops_t;
+
+/* One side's view of the ring */
+typedef struct {
+    done_ring_t *ring;          /* mapped by the caller, DONE_RING_LINE aligned */
+    const done_ring_ops_t *ops;
+    void *ctx;                  /* passed to every hook */
+} done_ring_ep_t;
+
+/*
+ * Consumer: empty the ring and mark it valid. Call before starting the
+ * producer; slots pushed before the reset are discarded.
+ */
+void done_ring_reset(const done_ring_ep_t *ep);
+
+/*
+ * Producer: publish one completion and ring the doorbell. Returns
+ * DONE_RING_OK, DONE_RING_EFULL, or DONE_RING_EBADRING if the ring was
+ * never reset (no consumer).
+ */
+int done_ring_push(const done_ring_ep_t *ep, const done_ring_slot_t *slot);
+
+/* Consumer: take the oldest completion. Returns DONE_RING_OK or DONE_RING_EEMPTY */
+int done_ring_pop(const done_ring_ep_t *ep, done_ring_slot_t *slot);
+
+/* Consumer: completions waiting to be popped */
+uint32_t done_ring_pending(const done_ring_ep_t *ep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DONE_RING_H */
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Linux stand-in for the M33 -> A55 completion path: a producer thread
+ * plays the M33 replayer, the main thread plays OP-TEE's replay_done.c.
+ * The doorbell is a latched bit like the MU general purpose interrupt:
+ * notifies that arrive while the consumer is awake are merged, and one
+ * that arrives before the consumer sleeps is not lost.
+ *
+ *   cc -O2 -Wall -pthread done_ring.c done_ring_loopback.c -o done_ring_loopback
+ *   ./done_ring_loopback [-n jobs] [-c consumer_delay_us] [-p]
+ *
+ * -c slows the consumer down so the producer runs into a full ring,
+ * -p polls instead of sleeping on the doorbell. Exits non-zero if a
+ * completion is lost, duplicated or reordered.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "done_ring.h"
+
+struct doorbell {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int pending;
+    unsigned long rings;
+};
+
+static struct doorbell bell = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static done_ring_t ring __attribute__((aligned(DONE_RING_LINE)));
+
+static void loop_notify(void *ctx)
+{
+    struct doorbell *b = ctx;
+
+    pthread_mutex_lock(&b->lock);
+    b->pending = 1;
+    b->rings++;
+    pthread_cond_signal(&b->cond);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/* Consumer side of the doorbell: sleep until the latched bit is set, then clear it */
+static void loop_wait(struct doorbell *b)
+{
+    pthread_mutex_lock(&b->lock);
+    while (!b->pending)
+        pthread_cond_wait(&b->cond, &b->lock);
+    b->pending = 0;
+    pthread_mutex_unlock(&b->lock);
+}
+
+/* Shared memory in one process is coherent: only ordering and the doorbell */
+static const done_ring_ops_t producer_ops = {
+    .notify = loop_notify,
+};
+static const done_ring_ops_t consumer_ops = { 0 };
+
+struct producer_args {
+    uint32_t jobs;
+    unsigned long full;
+};
+
+static void *producer(void *arg)
+{
+    struct producer_args *pa = arg;
+    const done_ring_ep_t ep = { &ring, &producer_ops, &bell };
+
+    for (uint32_t seq = 0; seq < pa->jobs; seq++) {
+        const done_ring_slot_t s = {
+            .seq = seq,
+            .status = (seq % 7 == 6) ? -1 : 0,
+            .out_offset = 0x4000 + (seq % DONE_RING_SLOTS) * 0x100,
+            .out_size = 0x100,
+        };
+        int rc;
+
+        while ((rc = done_ring_push(&ep, &s)) == DONE_RING_EFULL) {
+            pa->full++;
+            sched_yield();
+        }
+        if (rc != DONE_RING_OK) {
+            fprintf(stderr, "push %u: %d\n", seq, rc);
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const done_ring_ep_t ep = { &ring, &consumer_ops, NULL };
+    struct producer_args pa = { .jobs = 100000 };
+    unsigned int delay_us = 0;
+    unsigned long sleeps = 0;
+    unsigned long failed = 0;
+    int poll = 0;
+    pthread_t th;
+    uint32_t next = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:p")) != -1) {
+        switch (opt) {
+        case 'n':
+            pa.jobs = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            delay_us = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            poll = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n jobs] [-c consumer_delay_us] [-p]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* The consumer resets the ring before starting the producer, like ocram_load.pta */
+    done_ring_reset(&ep);
+    if (pthread_create(&th, NULL, producer, &pa)) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    while (next < pa.jobs) {
+        done_ring_slot_t s;
+        int rc = done_ring_pop(&ep, &s);
+
+        if (rc == DONE_RING_EEMPTY) {
+            if (poll) {
+                sched_yield();
+            } else {
+                loop_wait(&bell);
+                sleeps++;
+            }
+            continue;
+        }
+        if (rc != DONE_RING_OK) {
+            fprintf(stderr, "pop: %d\n", rc);
+            return 1;
+        }
+        if (s.seq != next || s.out_size != 0x100) {
+            fprintf(stderr, "expected seq %u, got seq %u size %u\n", next, s.seq, s.out_size);
+            return 1;
+        }
+        if (s.status)
+            failed++;
+        next++;
+        if (delay_us)
+            usleep(delay_us);
+    }
+    pthread_join(th, NULL);
+
+    if (done_ring_pending(&ep)) {
+        fprintf(stderr, "%u completions left over\n", done_ring_pending(&ep));
+        return 1;
+    }
+    printf("%u completions in order (%lu with error status), %lu doorbells, %lu sleeps, "
+           "producer saw a full ring %lu times\n",
+           next, failed, bell.rings, sleeps, pa.full);
+    return 0;
+}
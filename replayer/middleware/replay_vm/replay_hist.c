@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "replay_hist.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Index of the highest set bit, v != 0 */
+static inline uint32_t hist_log2(uint32_t v)
+{
+    return 31u - (uint32_t)__builtin_clz(v);
+}
+
+static uint32_t hist_index(uint32_t ticks)
+{
+    uint32_t e;
+
+    if (ticks < REPLAY_HIST_EXACT) {
+        return ticks;
+    }
+    e = hist_log2(ticks); /* 4..31 */
+    return REPLAY_HIST_EXACT + (e - 4u) * REPLAY_HIST_SUB + ((ticks >> (e - 3u)) & (REPLAY_HIST_SUB - 1u));
+}
+
+/* Largest value that falls in bucket i */
+static uint32_t hist_upper(uint32_t i)
+{
+    uint32_t e;
+    uint32_t sub;
+
+    if (i < REPLAY_HIST_EXACT) {
+        return i;
+    }
+    e   = (i - REPLAY_HIST_EXACT) / REPLAY_HIST_SUB + 4u;
+    sub = (i - REPLAY_HIST_EXACT) % REPLAY_HIST_SUB;
+    /* bucket covers [(8 + sub) << (e - 3), (9 + sub) << (e - 3)) */
+    return (uint32_t)((((uint64_t)REPLAY_HIST_SUB + sub + 1u) << (e - 3u)) - 1u);
+}
+
+void replay_hist_reset(replay_hist_t *h)
+{
+    uint8_t *p = (uint8_t *)h;
+
+    for (size_t i = 0; i < sizeof(*h); i++) {
+        p[i] = 0;
+    }
+}
+
+void replay_hist_add(replay_hist_t *h, uint32_t ticks)
+{
+    if (h->count == UINT32_MAX) {
+        return;
+    }
+    if (!h->count || ticks < h->min) {
+        h->min = ticks;
+    }
+    if (ticks > h->max) {
+        h->max = ticks;
+    }
+    h->count++;
+    h->sum += ticks;
+    h->bucket[hist_index(ticks)]++;
+}
+
+uint32_t replay_hist_percentile(const replay_hist_t *h, uint32_t permille)
+{
+    /* rank of the sample wanted, rounded up, at least 1 */
+    uint64_t rank = ((uint64_t)h->count * permille + 999u) / 1000u;
+    uint64_t seen = 0;
+    uint32_t v;
+
+    if (!h->count) {
+        return 0;
+    }
+    if (!rank) {
+        rank = 1;
+    }
+    for (uint32_t i = 0; i < REPLAY_HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            v = hist_upper(i);
+            return v < h->min ? h->min : (v > h->max ? h->max : v);
+        }
+    }
+    return h->max;
+}
+
+static uint32_t hist_ns(uint64_t ticks, uint32_t freq_hz)
+{
+    uint64_t ns;
+
+    if (!freq_hz) {
+        return 0;
+    }
+    /* ticks < 2^32 here, so ticks * 10^9 fits in 64 bits */
+    ns = ticks * 1000000000u / freq_hz;
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+void replay_hist_summarize(const replay_hist_t *h, uint32_t freq_hz, replay_hist_summary_t *s)
+{
+    s->count  = h->count;
+    s->min_ns = hist_ns(h->min, freq_hz);
+    s->avg_ns = h->count ? hist_ns(h->sum / h->count, freq_hz) : 0;
+    s->max_ns = hist_ns(h->max, freq_hz);
+    s->p99_ns = hist_ns(replay_hist_percentile(h, 990), freq_hz);
+}
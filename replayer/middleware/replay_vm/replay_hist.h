@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef REPLAY_HIST_H
+#define REPLAY_HIST_H
+
+/*******************************************************************************
+ *  Replay latency histogram
+ *  ------------------------
+ *  Fixed-size log-linear histogram of counter ticks, cheap enough to update on
+ *  every replay phase: values below 16 ticks get a bucket each, above that
+ *  every power of two is split into 8 buckets, so a percentile read back from
+ *  it is within 12.5% of the true value. Ticks come from whatever counter the
+ *  platform has (CNTVCT on the A55, DWT CYCCNT on the M33); the frequency is
+ *  only needed to summarize. Shared by the M33 replayer and OP-TEE
+ *  core/drivers/replay.c like replay_vm.c. Not thread safe: callers lock.
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPLAY_HIST_EXACT   16u /* ticks below this get one bucket each */
+#define REPLAY_HIST_SUB     8u  /* buckets per power of two above it    */
+#define REPLAY_HIST_BUCKETS (REPLAY_HIST_EXACT + (32u - 4u) * REPLAY_HIST_SUB)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t bucket[REPLAY_HIST_BUCKETS];
+} replay_hist_t;
+
+/* Summary in nanoseconds, saturated at UINT32_MAX (about 4.3 s) */
+typedef struct {
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t avg_ns;
+    uint32_t max_ns;
+    uint32_t p99_ns;
+} replay_hist_summary_t;
+
+void replay_hist_reset(replay_hist_t *h);
+
+/* Record one sample of ticks */
+void replay_hist_add(replay_hist_t *h, uint32_t ticks);
+
+/*
+ * Smallest bucket bound with at least permille/1000 of the samples at or
+ * below it, clamped to [min, max]. 0 if the histogram is empty.
+ */
+uint32_t replay_hist_percentile(const replay_hist_t *h, uint32_t permille);
+
+/* count, min, avg, max and p99 of h, converted with a counter of freq_hz */
+void replay_hist_summarize(const replay_hist_t *h, uint32_t freq_hz, replay_hist_summary_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_HIST_H */
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "replay_vm.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Operand words following the instruction word, per opcode */
+static const uint8_t replay_op_args[REPLAY_OP_COUNT] = {
+    [REPLAY_OP_END]       = 0,
+    [REPLAY_OP_WRITE]     = 1,
+    [REPLAY_OP_POLL_MASK] = 4,
+    [REPLAY_OP_CHECK]     = 2,
+    [REPLAY_OP_COPY_BLOB] = 3,
+    [REPLAY_OP_WAIT_IRQ]  = 0,
+    [REPLAY_OP_FENCE]     = 0,
+};
+
+static inline uint32_t replay_op(uint32_t insn)
+{
+    return insn & 0xffu;
+}
+
+/* Register index (word offset) of a register instruction */
+static inline uint32_t replay_reg(uint32_t insn)
+{
+    return insn >> 10;
+}
+
+static int replay_fault(replay_vm_t *vm, uint32_t pc, int err)
+{
+    vm->fault_pc = pc;
+    return err;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Loader                                                                     */
+/* -------------------------------------------------------------------------- */
+
+/* A relocation of the instruction at pc: its first operand, written to the
+ * register (or, for a snapshot, copied to the range) the symbol names, and
+ * inside the segment. */
+static int replay_vm_check_reloc(const replay_vm_t *vm, const replay_vm_reloc_t *rel, uint32_t pc)
+{
+    const replay_vm_header_t *hdr = vm->hdr;
+    uint32_t insn                 = vm->code[pc];
+    uint32_t addr                 = vm->code[pc + 1];
+    uint32_t len                  = 0;
+
+    if (rel->sym == REPLAY_SYM_SNAPSHOT) {
+        if (replay_op(insn) != REPLAY_OP_COPY_BLOB) {
+            return REPLAY_VM_EBADPROG;
+        }
+        len = vm->code[pc + 3];
+    } else if (rel->sym == REPLAY_SYM_QBASE) {
+        if (insn != (REPLAY_OP_WRITE | 0x010u << 8)) {
+            return REPLAY_VM_EBADPROG;
+        }
+    } else if (rel->sym < REPLAY_SYM_COUNT) {
+        if (insn != (REPLAY_OP_WRITE | (0x080u + 8 * (rel->sym - REPLAY_SYM_BASEP(0))) << 8)) {
+            return REPLAY_VM_EBADPROG;
+        }
+    } else {
+        return REPLAY_VM_EBADPROG;
+    }
+
+    if (addr < hdr->mem_base || addr - hdr->mem_base > hdr->mem_size ||
+        len > hdr->mem_size - (addr - hdr->mem_base)) {
+        return REPLAY_VM_EBADPROG;
+    }
+    return REPLAY_VM_OK;
+}
+
+/* Every instruction decodes, stays inside the code and touches only mapped
+ * registers and existing blob bytes; every inference offset is an
+ * instruction boundary; every relocation is the first operand of a matching
+ * instruction. */
+static int replay_vm_validate(const replay_vm_t *vm)
+{
+    const replay_vm_header_t *hdr = vm->hdr;
+    const uint32_t *tab           = (const uint32_t *)vm->inferences;
+    uint32_t ntab                 = hdr->inference_count * 4;
+    uint32_t t                    = 0;
+    uint32_t r                    = 0;
+    uint32_t pc                   = 0;
+
+    if ((hdr->mem_base & 15u) != 0 || hdr->mem_size > UINT32_MAX - hdr->mem_base) {
+        return REPLAY_VM_EBADPROG;
+    }
+
+    while (pc < hdr->code_words) {
+        uint32_t insn = vm->code[pc];
+        uint32_t op   = replay_op(insn);
+
+        for (; t < ntab && tab[t] == pc; t++) {
+        }
+        if (t < ntab && tab[t] < pc) {
+            return REPLAY_VM_EBADPROG; /* points into an instruction, or backwards */
+        }
+
+        if (op >= REPLAY_OP_COUNT || replay_op_args[op] >= hdr->code_words - pc) {
+            return REPLAY_VM_EBADPROG;
+        }
+
+        switch (op) {
+        case REPLAY_OP_WRITE:
+        case REPLAY_OP_POLL_MASK:
+        case REPLAY_OP_CHECK:
+            if ((insn & 0x300u) != 0 || (insn >> 8) >= vm->reg_size) {
+                return REPLAY_VM_EBADPROG;
+            }
+            break;
+        case REPLAY_OP_COPY_BLOB:
+            if (vm->ops->copy == NULL || vm->code[pc + 2] > hdr->blob_bytes ||
+                vm->code[pc + 3] > hdr->blob_bytes - vm->code[pc + 2]) {
+                return REPLAY_VM_EBADPROG;
+            }
+            break;
+        default:
+            break;
+        }
+
+        if (r < hdr->reloc_count && vm->relocs[r].word == pc + 1) {
+            if (replay_vm_check_reloc(vm, &vm->relocs[r], pc) != REPLAY_VM_OK) {
+                return REPLAY_VM_EBADPROG;
+            }
+            r++;
+        }
+
+        pc += 1 + replay_op_args[op];
+
+        if (r < hdr->reloc_count && vm->relocs[r].word < pc) {
+            return REPLAY_VM_EBADPROG; /* not a first operand, or out of order */
+        }
+    }
+
+    for (; t < ntab; t++) {
+        if (tab[t] != hdr->code_words) {
+            return REPLAY_VM_EBADPROG;
+        }
+    }
+    return r == hdr->reloc_count ? REPLAY_VM_OK : REPLAY_VM_EBADPROG;
+}
+
+int replay_vm_load(replay_vm_t *vm, const void *image, size_t size)
+{
+    const replay_vm_header_t *hdr = image;
+    size_t need                   = sizeof(*hdr);
+
+    vm->hdr = NULL;
+
+    if (vm->ops == NULL || ((uintptr_t)image & 3u) != 0 || size < need || hdr->magic != REPLAY_VM_MAGIC ||
+        hdr->version != REPLAY_VM_VERSION) {
+        return REPLAY_VM_EBADPROG;
+    }
+
+    /* Section sizes are checked one at a time so the sum cannot wrap */
+    if (hdr->inference_count > (size - need) / sizeof(replay_vm_inference_t)) {
+        return REPLAY_VM_EBADPROG;
+    }
+    need += (size_t)hdr->inference_count * sizeof(replay_vm_inference_t);
+    if (hdr->reloc_count > (size - need) / sizeof(replay_vm_reloc_t)) {
+        return REPLAY_VM_EBADPROG;
+    }
+    need += (size_t)hdr->reloc_count * sizeof(replay_vm_reloc_t);
+    if (hdr->code_words > (size - need) / sizeof(uint32_t)) {
+        return REPLAY_VM_EBADPROG;
+    }
+    need += (size_t)hdr->code_words * sizeof(uint32_t);
+    if (hdr->blob_bytes > size - need) {
+        return REPLAY_VM_EBADPROG;
+    }
+
+    vm->hdr        = hdr;
+    vm->inferences = (const replay_vm_inference_t *)(hdr + 1);
+    vm->relocs     = (const replay_vm_reloc_t *)(vm->inferences + hdr->inference_count);
+    vm->code       = (const uint32_t *)(vm->relocs + hdr->reloc_count);
+    vm->blobs      = (const uint8_t *)(vm->code + hdr->code_words);
+
+    if (replay_vm_validate(vm) != REPLAY_VM_OK) {
+        vm->hdr = NULL;
+        return REPLAY_VM_EBADPROG;
+    }
+    return REPLAY_VM_OK;
+}
+
+int replay_vm_relocate(replay_vm_t *vm, void *image, uint32_t base)
+{
+    replay_vm_header_t *hdr = image;
+    replay_vm_reloc_t *rel;
+    uint32_t *code;
+    uint32_t delta;
+
+    if (vm->hdr == NULL || image != (const void *)vm->hdr || (base & 15u) != 0 ||
+        hdr->mem_size > UINT32_MAX - base) {
+        return REPLAY_VM_EBADPROG;
+    }
+
+    /* Same layout as replay_vm_load(), through the writable pointer */
+    rel   = (replay_vm_reloc_t *)((replay_vm_inference_t *)(hdr + 1) + hdr->inference_count);
+    code  = (uint32_t *)(rel + hdr->reloc_count);
+    delta = base - hdr->mem_base;
+
+    for (uint32_t r = 0; r < hdr->reloc_count; r++) {
+        code[rel[r].word] += delta;
+    }
+    hdr->mem_base = base;
+    return REPLAY_VM_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Polling                                                                    */
+/* -------------------------------------------------------------------------- */
+
+int replay_vm_poll(const replay_vm_t *vm, volatile uint32_t *reg, uint32_t mask, uint32_t expect,
+                   uint32_t timeout_us, uint32_t backoff)
+{
+    const replay_vm_ops_t *ops = vm->ops;
+    uint32_t spin              = backoff & 0xffffu;
+    uint32_t waits             = spin + (backoff >> 16);
+    uint64_t limit             = timeout_us;
+    uint32_t start             = 0;
+
+    if (ops->now != NULL) {
+        limit *= vm->ticks_per_us;
+    }
+
+    for (uint32_t n = 0; (*reg & mask) != expect; n++) {
+        uint64_t elapsed;
+
+        if (n < spin) {
+            continue;
+        }
+        if (ops->now == NULL) {
+            elapsed = n - spin;
+        } else if (n == spin) {
+            start   = ops->now(vm->ctx);
+            elapsed = 0;
+        } else {
+            elapsed = (uint32_t)(ops->now(vm->ctx) - start);
+        }
+        if (elapsed >= limit) {
+            return REPLAY_VM_ETIMEOUT;
+        }
+
+        if (n >= waits && ops->yield != NULL) {
+            ops->yield(vm->ctx);
+        } else if (ops->wait_event != NULL) {
+            ops->wait_event(vm->ctx);
+        }
+    }
+    return REPLAY_VM_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Interpreter                                                                */
+/* -------------------------------------------------------------------------- */
+
+int replay_vm_exec(replay_vm_t *vm, uint32_t pc, uint32_t end)
+{
+    const uint32_t *code       = vm->code;
+    volatile uint32_t *regs    = vm->regs;
+    const replay_vm_ops_t *ops = vm->ops;
+    int err;
+
+    if (vm->hdr == NULL || end > vm->hdr->code_words) {
+        return replay_fault(vm, pc, REPLAY_VM_EBADPROG);
+    }
+
+    while (pc < end) {
+        uint32_t insn = code[pc];
+
+        switch (replay_op(insn)) {
+        case REPLAY_OP_WRITE:
+            regs[replay_reg(insn)] = code[pc + 1];
+            pc += 2;
+            break;
+
+        case REPLAY_OP_POLL_MASK:
+            if (replay_vm_poll(vm, &regs[replay_reg(insn)], code[pc + 1], code[pc + 2], code[pc + 3],
+                               code[pc + 4]) != REPLAY_VM_OK) {
+                return replay_fault(vm, pc, REPLAY_VM_ETIMEOUT);
+            }
+            pc += 5;
+            break;
+
+        case REPLAY_OP_CHECK:
+            if ((regs[replay_reg(insn)] & code[pc + 1]) != code[pc + 2]) {
+                return replay_fault(vm, pc, REPLAY_VM_EVERIFY);
+            }
+            pc += 3;
+            break;
+
+        case REPLAY_OP_COPY_BLOB:
+            if (ops->copy(vm->ctx, code[pc + 1], vm->blobs + code[pc + 2], code[pc + 3]) != 0) {
+                return replay_fault(vm, pc, REPLAY_VM_EFAULT);
+            }
+            pc += 4;
+            break;
+
+        case REPLAY_OP_WAIT_IRQ:
+            if (ops->wait_irq != NULL && (err = ops->wait_irq(vm->ctx)) != 0) {
+                return replay_fault(vm, pc, err < 0 ? err : REPLAY_VM_ETIMEOUT);
+            }
+            pc += 1;
+            break;
+
+        case REPLAY_OP_FENCE:
+            if (ops->fence != NULL) {
+                ops->fence(vm->ctx);
+            }
+            pc += 1;
+            break;
+
+        default: /* REPLAY_OP_END, the loader rejects anything else */
+            return REPLAY_VM_OK;
+        }
+    }
+    return REPLAY_VM_OK;
+}
+
+int replay_vm_run_inference(replay_vm_t *vm, uint32_t n)
+{
+    if (vm->hdr == NULL || n >= vm->hdr->inference_count) {
+        return REPLAY_VM_EBADPROG;
+    }
+    return replay_vm_exec(vm, vm->inferences[n].setup, vm->inferences[n].end);
+}
+
+int replay_vm_run(replay_vm_t *vm)
+{
+    int err = REPLAY_VM_OK;
+
+    for (uint32_t n = 0; vm->hdr != NULL && n < vm->hdr->inference_count && err == REPLAY_VM_OK; n++) {
+        err = replay_vm_run_inference(vm, n);
+    }
+    return vm->hdr == NULL ? REPLAY_VM_EBADPROG : err;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef REPLAY_VM_H
+#define REPLAY_VM_H
+
+/*******************************************************************************
+ *  Portable replay program interpreter
+ *  -----------------------------------
+ *  Each replay used to be hand-written C: a register_access_records[] table
+ *  plus a switch on op_order that memcpy'd the model data before the right
+ *  record, duplicated per model (replay_conv2d.c, replay_pad.c, ...) and again
+ *  in the OP-TEE driver.  A replay is now a program generated from the trace
+ *  by "rrtrace.py program" and run by this interpreter, which only needs
+ *  <stdint.h>/<string.h> and is built unchanged by the M33 replayer and by
+ *  OP-TEE core/drivers/replay.c.
+ *
+ *  Program image (little endian, 4-byte aligned):
+ *
+ *    header    : replay_vm_header_t
+ *    inferences: replay_vm_inference_t[inference_count], code offsets
+ *    relocs    : replay_vm_reloc_t[reloc_count], operands that hold addresses
+ *    code      : uint32_t[code_words]
+ *    blobs     : blob_bytes of snapshot data referenced by COPY_BLOB
+ *
+ *  Instructions: word 0 is opcode (bits[7:0]) | register byte offset
+ *  (bits[31:8]), followed by a fixed number of operand words:
+ *
+ *    END                          stop
+ *    WRITE     reg, value         regs[reg] = value
+ *    POLL_MASK reg, mask, expect, wait until (regs[reg] & mask) == expect,
+ *              timeout_us, backoff  see replay_vm_poll()
+ *    CHECK     reg, mask, expect  fail if (regs[reg] & mask) != expect
+ *    COPY_BLOB dst, blob, len     copy blob bytes to physical address dst
+ *    WAIT_IRQ                     block until the NPU interrupt (platform)
+ *    FENCE                        make copies visible to the NPU (platform)
+ *
+ *  replay_vm_load() validates the whole image once, so replay_vm_exec() runs
+ *  without bounds checks or logging.
+ *
+ *  Relocations: everything the program puts in memory (the command stream
+ *  behind QBASE, the regions behind BASEP[n], the snapshot destinations)
+ *  lies in one segment [mem_base, mem_base + mem_size). The relocation table
+ *  lists the operands that point into it, so replay_vm_relocate() can move
+ *  the segment, e.g. to pack several models into OCRAM side by side. Ethos-U
+ *  command streams only address memory through QBASE and BASEP, so the
+ *  segment contents need no patching.
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REPLAY_VM_MAGIC   0x4d565052u /* "RPVM" */
+#define REPLAY_VM_VERSION 3 /* 2: POLL_MASK timeout and backoff, 3: relocations */
+
+enum replay_vm_opcode {
+    REPLAY_OP_END,
+    REPLAY_OP_WRITE,
+    REPLAY_OP_POLL_MASK,
+    REPLAY_OP_CHECK,
+    REPLAY_OP_COPY_BLOB,
+    REPLAY_OP_WAIT_IRQ,
+    REPLAY_OP_FENCE,
+    REPLAY_OP_COUNT
+};
+
+/* Return values, replay_vm::fault_pc holds the failing instruction */
+#define REPLAY_VM_OK       0
+#define REPLAY_VM_EBADPROG (-1) /* malformed image, from replay_vm_load     */
+#define REPLAY_VM_ETIMEOUT (-2) /* POLL_MASK timed out, the NPU is hung    */
+#define REPLAY_VM_EVERIFY  (-3) /* CHECK read an unexpected value           */
+#define REPLAY_VM_EFAULT   (-4) /* COPY_BLOB destination rejected by copy() */
+
+/* POLL_MASK backoff word: failed reads that spin, then failed reads that
+ * call ops->wait_event before the poll falls back to ops->yield */
+#define REPLAY_VM_BACKOFF(spin, waits) ((uint32_t)(spin) | ((uint32_t)(waits) << 16))
+
+/* Ethos-U STATUS and the defaults "rrtrace.py program" emits, also used by
+ * the template replays that poll through replay_vm_poll() */
+#define REPLAY_NPU_STATUS          0x004u
+#define REPLAY_STATUS_IRQ_RAISED   (1u << 1)
+#define REPLAY_STATUS_RESET        (1u << 3)
+#define REPLAY_STATUS_CMD_END      (1u << 5)
+#define REPLAY_STATUS_ERRORS       0x194u /* bus, cmd_parse, wd and ecc faults */
+#define REPLAY_STATUS_CHECK        (REPLAY_STATUS_ERRORS | REPLAY_STATUS_CMD_END)
+#define REPLAY_RESET_TIMEOUT_US    10000u
+#define REPLAY_IRQ_TIMEOUT_US      1000000u
+#define REPLAY_POLL_BACKOFF        REPLAY_VM_BACKOFF(64, 1000)
+
+typedef struct {
+    uint32_t magic;           /* REPLAY_VM_MAGIC                            */
+    uint16_t version;         /* REPLAY_VM_VERSION                          */
+    uint16_t flags;           /* reserved, 0                                */
+    uint32_t reg_base;        /* NPU window the trace was recorded against  */
+    uint32_t inference_count; /* entries in the inference table             */
+    uint32_t code_words;      /* size of the code section                   */
+    uint32_t blob_bytes;      /* size of the blob section                   */
+    uint32_t mem_base;        /* where the segment is, 16-byte aligned      */
+    uint32_t mem_size;        /* bytes of the segment, 0 if not relocatable */
+    uint32_t reloc_count;     /* entries in the relocation table            */
+} replay_vm_header_t;
+
+/* Code offsets (in words) of one inference. setup covers the NPU init for the
+ * first inference and the job setup after the previous IRQ for later ones;
+ * [setup, end) replays the whole inference. */
+typedef struct {
+    uint32_t setup;
+    uint32_t run;
+    uint32_t irq;
+    uint32_t end;
+} replay_vm_inference_t;
+
+/* Relocation symbols: what a relocated operand points at */
+#define REPLAY_SYM_SNAPSHOT 0u                       /* COPY_BLOB destination */
+#define REPLAY_SYM_QBASE    1u                       /* WRITE to QBASE        */
+#define REPLAY_SYM_BASEP(n) (2u + (uint32_t)(n))     /* WRITE to BASEP[n]     */
+#define REPLAY_SYM_COUNT    REPLAY_SYM_BASEP(8)
+
+/* Code word (absolute index) holding an address inside the segment, sorted
+ * by word */
+typedef struct {
+    uint32_t word;
+    uint32_t sym;
+} replay_vm_reloc_t;
+
+/* Platform hooks, ctx is replay_vm::ctx */
+typedef struct {
+    /* Copy len bytes to physical address pa, including any cache maintenance
+     * the NPU needs to see them. Returns 0, or nonzero if the destination is
+     * outside the memory the platform lets the program write. */
+    int (*copy)(void *ctx, uint32_t pa, const void *src, uint32_t len);
+    /* Block until the NPU interrupt fired. NULL: the following POLL_MASK on
+     * STATUS.irq_raised does the waiting. */
+    int (*wait_irq)(void *ctx);
+    /* Barrier before the NPU is started. NULL: nothing to do. */
+    void (*fence)(void *ctx);
+    /* Free-running tick counter for poll timeouts, replay_vm::ticks_per_us
+     * ticks per microsecond, may wrap. NULL: each failed read counts as 1 us. */
+    uint32_t (*now)(void *ctx);
+    /* Second backoff stage: a low-power wait that returns after a few
+     * microseconds even if nothing happens (WFE with a periodic event
+     * source, or a short delay). NULL: keep spinning. */
+    void (*wait_event)(void *ctx);
+    /* Last backoff stage: let other work run. NULL: wait_event. */
+    void (*yield)(void *ctx);
+} replay_vm_ops_t;
+
+typedef struct {
+    /* Filled in by the caller */
+    volatile uint32_t *regs; /* mapped NPU register window   */
+    uint32_t reg_size;       /* bytes mapped at regs         */
+    uint32_t ticks_per_us;   /* rate of ops->now             */
+    const replay_vm_ops_t *ops;
+    void *ctx;
+
+    /* Set by replay_vm_load() */
+    const replay_vm_header_t *hdr;
+    const replay_vm_inference_t *inferences;
+    const replay_vm_reloc_t *relocs;
+    const uint32_t *code;
+    const uint8_t *blobs;
+
+    /* Set when replay_vm_exec() fails */
+    uint32_t fault_pc;
+} replay_vm_t;
+
+/*
+ * Validate a program image and attach it to vm, whose regs, reg_size and ops
+ * must already be set. The image must stay in place (and unmodified) while it
+ * is executed. Returns REPLAY_VM_OK or REPLAY_VM_EBADPROG.
+ */
+int replay_vm_load(replay_vm_t *vm, const void *image, size_t size);
+
+/*
+ * Move the segment of the loaded program to base (16-byte aligned): patch
+ * every relocated operand and the header in place. image is the writable
+ * image passed to replay_vm_load(); the caller checks that the new segment
+ * is memory the program may use. Returns REPLAY_VM_OK or REPLAY_VM_EBADPROG.
+ */
+int replay_vm_relocate(replay_vm_t *vm, void *image, uint32_t base);
+
+/*
+ * Execute the loaded program from code offset pc up to end, or up to an END
+ * instruction. pc and end must come from the inference table. Returns REPLAY_VM_OK or a negative REPLAY_VM_E* value.
+ */
+int replay_vm_exec(replay_vm_t *vm, uint32_t pc, uint32_t end);
+
+/*
+ * Wait until (*reg & mask) == expect. The first (backoff & 0xffff) failed
+ * reads spin, the next (backoff >> 16) call ops->wait_event, later ones
+ * ops->yield. Returns REPLAY_VM_ETIMEOUT once timeout_us have passed; only
+ * needs vm->ops (and ticks_per_us), so the template replay uses it too.
+ */
+int replay_vm_poll(const replay_vm_t *vm, volatile uint32_t *reg, uint32_t mask, uint32_t expect,
+                   uint32_t timeout_us, uint32_t backoff);
+
+/* Replay inference n of the program (setup, run and IRQ) */
+int replay_vm_run_inference(replay_vm_t *vm, uint32_t n);
+
+/* Replay every inference of the program in order */
+int replay_vm_run(replay_vm_t *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_VM_H */
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2025 RRNPU. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/*
+ * Linux test of the replay_vm loader. OP-TEE runs replay_vm_load() on
+ * images the normal world hands to REPLAY_CMD_RUN_PROGRAM and CACHE_LOAD,
+ * so every malformed image must come back as REPLAY_VM_EBADPROG before a
+ * single instruction runs. The test builds one valid program (register
+ * writes with relocations, a snapshot copy, a poll and a check), runs and
+ * relocates it against a fake register window, then breaks it one field at
+ * a time.
+ *
+ *   cc -std=c99 -O2 -Wall -Wextra -Wpedantic replay_vm.c replay_vm_test.c -o replay_vm_test
+ *   ./replay_vm_test
+ *
+ * Exits non-zero if a broken image loads or the valid one does not run.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "replay_vm.h"
+
+#define MEM_BASE  0x20480000u
+#define MEM_SIZE  0x1000u
+#define REG_SIZE  0x1000u
+#define CODE_WORDS 18
+#define BLOB_BYTES 16
+
+#define INSN(op, reg) ((uint32_t)(op) | (uint32_t)(reg) << 8)
+
+struct prog {
+    replay_vm_header_t hdr;
+    replay_vm_inference_t inf[1];
+    replay_vm_reloc_t rel[3];
+    uint32_t code[CODE_WORDS];
+    uint8_t blobs[BLOB_BYTES];
+};
+
+/* Code words of the valid program, for the mutations below */
+enum {
+    PC_QBASE = 0,  /* WRITE QBASE, addr           (reloc QBASE)    */
+    PC_BASEP = 2,  /* WRITE BASEP[0], addr        (reloc BASEP(0)) */
+    PC_COPY = 4,   /* COPY_BLOB dst, off, len     (reloc SNAPSHOT) */
+    PC_FENCE = 8,
+    PC_POLL = 9,   /* POLL_MASK STATUS, irq_raised */
+    PC_CHECK = 14, /* CHECK STATUS, irq_raised     */
+    PC_END = 17,
+};
+
+static uint32_t regs[REG_SIZE / 4];
+
+struct copy_log {
+    uint32_t pa;
+    uint32_t len;
+    uint8_t data[BLOB_BYTES];
+    int count;
+};
+
+static int fake_copy(void *ctx, uint32_t pa, const void *src, uint32_t len)
+{
+    struct copy_log *log = ctx;
+
+    log->pa = pa;
+    log->len = len;
+    memcpy(log->data, src, len < sizeof(log->data) ? len : sizeof(log->data));
+    log->count++;
+    return 0;
+}
+
+static const replay_vm_ops_t ops = { .copy = fake_copy };
+static const replay_vm_ops_t ops_no_copy = { 0 };
+
+static void build(struct prog *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->hdr.magic = REPLAY_VM_MAGIC;
+    p->hdr.version = REPLAY_VM_VERSION;
+    p->hdr.reg_base = 0x4a900000u;
+    p->hdr.inference_count = 1;
+    p->hdr.code_words = CODE_WORDS;
+    p->hdr.blob_bytes = BLOB_BYTES;
+    p->hdr.mem_base = MEM_BASE;
+    p->hdr.mem_size = MEM_SIZE;
+    p->hdr.reloc_count = 3;
+
+    p->inf[0] = (replay_vm_inference_t){ PC_QBASE, PC_FENCE, PC_POLL, CODE_WORDS };
+
+    p->rel[0] = (replay_vm_reloc_t){ PC_QBASE + 1, REPLAY_SYM_QBASE };
+    p->rel[1] = (replay_vm_reloc_t){ PC_BASEP + 1, REPLAY_SYM_BASEP(0) };
+    p->rel[2] = (replay_vm_reloc_t){ PC_COPY + 1, REPLAY_SYM_SNAPSHOT };
+
+    p->code[PC_QBASE] = INSN(REPLAY_OP_WRITE, 0x010);
+    p->code[PC_QBASE + 1] = MEM_BASE + 0x100;
+    p->code[PC_BASEP] = INSN(REPLAY_OP_WRITE, 0x080);
+    p->code[PC_BASEP + 1] = MEM_BASE + 0x200;
+    p->code[PC_COPY] = INSN(REPLAY_OP_COPY_BLOB, 0);
+    p->code[PC_COPY + 1] = MEM_BASE + 0x40;
+    p->code[PC_COPY + 2] = 0;
+    p->code[PC_COPY + 3] = BLOB_BYTES;
+    p->code[PC_FENCE] = INSN(REPLAY_OP_FENCE, 0);
+    p->code[PC_POLL] = INSN(REPLAY_OP_POLL_MASK, REPLAY_NPU_STATUS);
+    p->code[PC_POLL + 1] = REPLAY_STATUS_IRQ_RAISED;
+    p->code[PC_POLL + 2] = REPLAY_STATUS_IRQ_RAISED;
+    p->code[PC_POLL + 3] = 10;
+    p->code[PC_POLL + 4] = 0;
+    p->code[PC_CHECK] = INSN(REPLAY_OP_CHECK, REPLAY_NPU_STATUS);
+    p->code[PC_CHECK + 1] = REPLAY_STATUS_IRQ_RAISED;
+    p->code[PC_CHECK + 2] = REPLAY_STATUS_IRQ_RAISED;
+    p->code[PC_END] = INSN(REPLAY_OP_END, 0);
+
+    for (int i = 0; i < BLOB_BYTES; i++)
+        p->blobs[i] = (uint8_t)(0xa0 + i);
+}
+
+static void vm_setup(replay_vm_t *vm, const replay_vm_ops_t *o, struct copy_log *log)
+{
+    memset(vm, 0, sizeof(*vm));
+    vm->regs = regs;
+    vm->reg_size = REG_SIZE;
+    vm->ticks_per_us = 1;
+    vm->ops = o;
+    vm->ctx = log;
+}
+
+static int load(const struct prog *p, size_t size, const replay_vm_ops_t *o)
+{
+    replay_vm_t vm;
+    struct copy_log log = { 0 };
+
+    vm_setup(&vm, o, &log);
+    return replay_vm_load(&vm, p, size);
+}
+
+/* Malformed images, one broken field each */
+struct bad_case {
+    const char *name;
+    void (*mutate)(struct prog *p);
+};
+
+#define BAD(fn, body) static void fn(struct prog *p) { body; }
+
+BAD(bad_magic, p->hdr.magic ^= 1)
+BAD(bad_version, p->hdr.version = REPLAY_VM_VERSION - 1)
+BAD(inference_count_huge, p->hdr.inference_count = 0x10000000u)
+BAD(reloc_count_huge, p->hdr.reloc_count = 0x20000000u)
+BAD(code_words_huge, p->hdr.code_words = 0x40000000u)
+BAD(blob_bytes_past_end, p->hdr.blob_bytes = BLOB_BYTES + 1)
+BAD(opcode_count, p->code[PC_FENCE] = INSN(REPLAY_OP_COUNT, 0))
+BAD(opcode_ff, p->code[PC_FENCE] = INSN(0xff, 0))
+BAD(operands_past_code, { p->code[PC_END] = INSN(REPLAY_OP_WRITE, 0x010); })
+BAD(poll_past_code, { p->hdr.code_words = PC_POLL + 3; p->inf[0].end = PC_POLL + 3; })
+BAD(reg_misaligned_2, p->code[PC_CHECK] = INSN(REPLAY_OP_CHECK, REPLAY_NPU_STATUS + 2))
+BAD(reg_misaligned_1, p->code[PC_POLL] = INSN(REPLAY_OP_POLL_MASK, REPLAY_NPU_STATUS + 1))
+BAD(reg_at_window_end, p->code[PC_CHECK] = INSN(REPLAY_OP_CHECK, REG_SIZE))
+BAD(reg_past_window, p->code[PC_POLL] = INSN(REPLAY_OP_POLL_MASK, 0xfffffc))
+BAD(blob_offset_past_end, p->code[PC_COPY + 2] = BLOB_BYTES + 4)
+BAD(blob_range_past_end, { p->code[PC_COPY + 2] = 4; p->code[PC_COPY + 3] = BLOB_BYTES; })
+BAD(blob_range_wraps, { p->code[PC_COPY + 2] = 4; p->code[PC_COPY + 3] = 0xfffffffcu; })
+BAD(inference_mid_insn, p->inf[0].run = PC_COPY + 1)
+BAD(inference_past_code, p->inf[0].end = CODE_WORDS + 1)
+BAD(inference_backwards, { p->inf[0].setup = PC_POLL; p->inf[0].run = PC_FENCE; })
+BAD(mem_base_misaligned, p->hdr.mem_base = MEM_BASE + 4)
+BAD(mem_size_wraps, p->hdr.mem_size = 0xffffffffu - MEM_BASE + 1)
+BAD(reloc_below_segment, p->code[PC_QBASE + 1] = MEM_BASE - 4)
+BAD(reloc_above_segment, p->code[PC_BASEP + 1] = MEM_BASE + MEM_SIZE + 4)
+BAD(reloc_copy_past_segment, p->code[PC_COPY + 1] = MEM_BASE + MEM_SIZE - BLOB_BYTES / 2)
+BAD(reloc_wrong_register, p->rel[0].sym = REPLAY_SYM_BASEP(1))
+BAD(reloc_snapshot_on_write, p->rel[0].sym = REPLAY_SYM_SNAPSHOT)
+BAD(reloc_qbase_on_copy, p->rel[2].sym = REPLAY_SYM_QBASE)
+BAD(reloc_sym_unknown, p->rel[1].sym = REPLAY_SYM_COUNT)
+BAD(reloc_not_first_operand, p->rel[2].word = PC_COPY + 2)
+BAD(reloc_on_insn_word, p->rel[1].word = PC_BASEP)
+BAD(reloc_out_of_order, { p->rel[0].word = PC_BASEP + 1; p->rel[0].sym = REPLAY_SYM_BASEP(0);
+                          p->rel[1].word = PC_QBASE + 1; p->rel[1].sym = REPLAY_SYM_QBASE; })
+BAD(reloc_past_code, p->rel[2].word = CODE_WORDS + 1)
+
+static const struct bad_case bad_cases[] = {
+#define CASE(fn) { #fn, fn }
+    CASE(bad_magic),
+    CASE(bad_version),
+    CASE(inference_count_huge),
+    CASE(reloc_count_huge),
+    CASE(code_words_huge),
+    CASE(blob_bytes_past_end),
+    CASE(opcode_count),
+    CASE(opcode_ff),
+    CASE(operands_past_code),
+    CASE(poll_past_code),
+    CASE(reg_misaligned_2),
+    CASE(reg_misaligned_1),
+    CASE(reg_at_window_end),
+    CASE(reg_past_window),
+    CASE(blob_offset_past_end),
+    CASE(blob_range_past_end),
+    CASE(blob_range_wraps),
+    CASE(inference_mid_insn),
+    CASE(inference_past_code),
+    CASE(inference_backwards),
+    CASE(mem_base_misaligned),
+    CASE(mem_size_wraps),
+    CASE(reloc_below_segment),
+    CASE(reloc_above_segment),
+    CASE(reloc_copy_past_segment),
+    CASE(reloc_wrong_register),
+    CASE(reloc_snapshot_on_write),
+    CASE(reloc_qbase_on_copy),
+    CASE(reloc_sym_unknown),
+    CASE(reloc_not_first_operand),
+    CASE(reloc_on_insn_word),
+    CASE(reloc_out_of_order),
+    CASE(reloc_past_code),
+#undef CASE
+};
+
+static int failures;
+
+static void expect(int cond, const char *what)
+{
+    if (!cond) {
+        fprintf(stderr, "FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+/* The valid program loads, runs, relocates and runs again at the new base */
+static void test_valid(void)
+{
+    static struct prog p;
+    replay_vm_t vm;
+    struct copy_log log = { 0 };
+
+    build(&p);
+    vm_setup(&vm, &ops, &log);
+    regs[REPLAY_NPU_STATUS / 4] = REPLAY_STATUS_IRQ_RAISED;
+
+    expect(replay_vm_load(&vm, &p, sizeof(p)) == REPLAY_VM_OK, "valid program loads");
+    expect(replay_vm_run_inference(&vm, 0) == REPLAY_VM_OK, "valid program runs");
+    expect(regs[0x010 / 4] == MEM_BASE + 0x100, "QBASE written");
+    expect(regs[0x080 / 4] == MEM_BASE + 0x200, "BASEP[0] written");
+    expect(log.count == 1 && log.pa == MEM_BASE + 0x40 && log.len == BLOB_BYTES &&
+               memcmp(log.data, p.blobs, BLOB_BYTES) == 0,
+           "snapshot copied");
+    expect(replay_vm_run_inference(&vm, 1) == REPLAY_VM_EBADPROG, "inference past the table");
+
+    expect(replay_vm_relocate(&vm, &p, MEM_BASE + 0x8) == REPLAY_VM_EBADPROG, "misaligned relocation base");
+    expect(replay_vm_relocate(&vm, &p, 0xfffff000u) == REPLAY_VM_EBADPROG, "segment wraps after relocation");
+    expect(replay_vm_relocate(&vm, &p, MEM_BASE + 0x10000) == REPLAY_VM_OK, "relocation");
+    expect(replay_vm_load(&vm, &p, sizeof(p)) == REPLAY_VM_OK, "relocated program loads");
+    expect(replay_vm_run_inference(&vm, 0) == REPLAY_VM_OK, "relocated program runs");
+    expect(regs[0x010 / 4] == MEM_BASE + 0x10100 && regs[0x080 / 4] == MEM_BASE + 0x10200 &&
+               log.pa == MEM_BASE + 0x10040,
+           "relocated addresses");
+
+    /* A check that does not match and a poll that times out are run-time
+     * errors of a valid program, not load errors */
+    regs[REPLAY_NPU_STATUS / 4] = 0;
+    expect(replay_vm_exec(&vm, PC_CHECK, CODE_WORDS) == REPLAY_VM_EVERIFY && vm.fault_pc == PC_CHECK,
+           "CHECK mismatch");
+    expect(replay_vm_exec(&vm, PC_POLL, CODE_WORDS) == REPLAY_VM_ETIMEOUT && vm.fault_pc == PC_POLL,
+           "POLL_MASK timeout");
+    expect(replay_vm_exec(&vm, 0, CODE_WORDS + 1) == REPLAY_VM_EBADPROG, "exec past the code");
+}
+
+/* Every image shorter than the whole program is rejected */
+static void test_truncated(void)
+{
+    static struct prog p;
+
+    build(&p);
+    for (size_t size = 0; size < sizeof(p); size++) {
+        if (load(&p, size, &ops) != REPLAY_VM_EBADPROG) {
+            fprintf(stderr, "FAIL: image truncated to %zu of %zu bytes loads\n", size, sizeof(p));
+            failures++;
+        }
+    }
+}
+
+static void test_misc(void)
+{
+    static uint32_t buf[sizeof(struct prog) / 4 + 1];
+    struct prog *p = (struct prog *)buf;
+    replay_vm_t vm;
+
+    build(p);
+    expect(load(p, sizeof(*p), &ops_no_copy) == REPLAY_VM_EBADPROG, "COPY_BLOB without ops->copy");
+
+    /* A failed load leaves nothing runnable behind */
+    vm_setup(&vm, &ops, NULL);
+    p->hdr.magic = 0;
+    expect(replay_vm_load(&vm, p, sizeof(*p)) == REPLAY_VM_EBADPROG && vm.hdr == NULL, "failed load detaches");
+    expect(replay_vm_run(&vm) == REPLAY_VM_EBADPROG, "run after a failed load");
+
+    /* The image must be 4-byte aligned */
+    build(p);
+    memmove((uint8_t *)buf + 2, buf, sizeof(*p));
+    expect(load((const struct prog *)((uint8_t *)buf + 2), sizeof(*p), &ops) == REPLAY_VM_EBADPROG,
+           "misaligned image");
+
+    vm_setup(&vm, NULL, NULL);
+    build(p);
+    expect(replay_vm_load(&vm, p, sizeof(*p)) == REPLAY_VM_EBADPROG, "no ops");
+}
+
+int main(void)
+{
+    static struct prog p;
+
+    test_valid();
+    test_truncated();
+    test_misc();
+
+    for (size_t i = 0; i < sizeof(bad_cases) / sizeof(bad_cases[0]); i++) {
+        build(&p);
+        bad_cases[i].mutate(&p);
+        if (load(&p, sizeof(p), &ops) != REPLAY_VM_EBADPROG) {
+            fprintf(stderr, "FAIL: %s loads\n", bad_cases[i].name);
+            failures++;
+        }
+    }
+
+    if (failures) {
+        fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    printf("valid program ok, %zu truncations and %zu malformed images rejected\n", sizeof(p),
+           sizeof(bad_cases) / sizeof(bad_cases[0]));
+    return 0;
+}